@@ -0,0 +1,211 @@
+/**
+ * magnetic dynamics -- benchmark for the grid file reader
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "../gridfile.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <random>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <cmath>
+
+using t_real = GridFile::t_real;
+using t_size = GridFile::t_size;
+using t_clock = std::chrono::steady_clock;
+
+
+
+/**
+ * write a synthetic grid file with a few cosine-shaped branches
+ */
+static void write_test_grid(const std::string& filename, t_size num_pts, t_size num_branches)
+{
+	std::ofstream ofstr{filename, std::ios_base::binary};
+	if(!ofstr)
+		throw std::runtime_error("Cannot write grid file \"" + filename + "\".");
+
+	const t_real pi = 3.14159265358979323846;
+	const t_real start = -1., end = 1.;
+	const t_real step = (end - start) / t_real(num_pts);
+
+	std::uint64_t idxblock = 0;
+	ofstr.write(reinterpret_cast<const char*>(&idxblock), sizeof(idxblock));
+	for(int i=0; i<3; ++i)
+	{
+		ofstr.write(reinterpret_cast<const char*>(&start), sizeof(start));
+		ofstr.write(reinterpret_cast<const char*>(&end), sizeof(end));
+		ofstr.write(reinterpret_cast<const char*>(&step), sizeof(step));
+	}
+	ofstr << "Takin/Magdyn Grid File Version 2 (doi: https://doi.org/10.5281/zenodo.4117437).";
+
+	std::vector<std::uint64_t> index;
+	index.reserve(num_pts*num_pts*num_pts);
+
+	for(t_size h_idx=0; h_idx<num_pts; ++h_idx)
+	for(t_size k_idx=0; k_idx<num_pts; ++k_idx)
+	for(t_size l_idx=0; l_idx<num_pts; ++l_idx)
+	{
+		t_real h = start + step*t_real(h_idx);
+		t_real k = start + step*t_real(k_idx);
+		t_real l = start + step*t_real(l_idx);
+
+		index.push_back(ofstr.tellp());
+		std::uint32_t _num_branches = std::uint32_t(num_branches);
+		ofstr.write(reinterpret_cast<const char*>(&_num_branches), sizeof(_num_branches));
+
+		for(t_size branch=0; branch<num_branches; ++branch)
+		{
+			t_real E = t_real(branch + 1) * (3. - std::cos(pi*h) - std::cos(pi*k) - std::cos(pi*l));
+			t_real S = 1. / (E + 1.);
+			ofstr.write(reinterpret_cast<const char*>(&E), sizeof(E));
+			ofstr.write(reinterpret_cast<const char*>(&S), sizeof(S));
+		}
+	}
+
+	idxblock = ofstr.tellp();
+	ofstr.write(reinterpret_cast<const char*>(index.data()), index.size()*sizeof(std::uint64_t));
+	ofstr.seekp(0, std::ios_base::beg);
+	ofstr.write(reinterpret_cast<const char*>(&idxblock), sizeof(idxblock));
+}
+
+
+
+/**
+ * print the number of lookups per second
+ */
+static void print_rate(const char* name, t_size num_lookups,
+	const t_clock::time_point& start, t_real checksum)
+{
+	t_real secs = std::chrono::duration<t_real>(t_clock::now() - start).count();
+
+	std::cout << name << ": " << num_lookups << " lookups in " << secs << " s, "
+		<< t_real(num_lookups) / secs << " lookups/s"
+		<< " (checksum: " << checksum << ")" << std::endl;
+}
+
+
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		std::string filename;
+		t_size num_lookups = 1000000;
+		bool remove_file = false;
+
+		if(argc > 1)
+			filename = argv[1];
+		if(argc > 2)
+			num_lookups = std::stoul(argv[2]);
+
+		// without a given file, use a synthetic one
+		if(filename == "" || filename == "-")
+		{
+			filename = (std::filesystem::temp_directory_path() / "magdyn_gridbench.bin").string();
+			std::cout << "Writing test grid to \"" << filename << "\"..." << std::endl;
+			write_test_grid(filename, 64, 4);
+			remove_file = true;
+		}
+
+		auto start_open = t_clock::now();
+		GridFile grid{filename};
+		std::cout << "Opened and validated grid of "
+			<< grid.GetNumPoints(0) << " x " << grid.GetNumPoints(1) << " x " << grid.GetNumPoints(2)
+			<< " points in " << std::chrono::duration<t_real>(t_clock::now() - start_open).count()
+			<< " s." << std::endl;
+
+		// random Q points inside the grid
+		std::mt19937 rng{1234};
+		std::vector<t_real> Qs(num_lookups * 3);
+		for(int i=0; i<3; ++i)
+		{
+			t_real Q_min = grid.GetStart(i);
+			t_real Q_max = grid.GetStart(i) + grid.GetStep(i)*t_real(grid.GetNumPoints(i) - 1);
+			std::uniform_real_distribution<t_real> dist{std::min(Q_min, Q_max), std::max(Q_min, Q_max)};
+
+			for(t_size Q_idx=0; Q_idx<num_lookups; ++Q_idx)
+				Qs[Q_idx*3 + i] = dist(rng);
+		}
+
+		// single nearest-point lookups
+		{
+			t_real checksum = 0.;
+			auto start = t_clock::now();
+			for(t_size Q_idx=0; Q_idx<num_lookups; ++Q_idx)
+			{
+				auto branches = grid.GetBranches(Qs[Q_idx*3], Qs[Q_idx*3 + 1], Qs[Q_idx*3 + 2]);
+				if(branches.size())
+					checksum += branches[0].E;
+			}
+			print_rate("nearest", num_lookups, start, checksum);
+		}
+
+		// batch lookups
+		{
+			t_real checksum = 0.;
+			std::vector<GridFile::t_branches> results(num_lookups);
+			auto start = t_clock::now();
+			grid.GetBranches(Qs.data(), num_lookups, results.data());
+			for(const auto& branches : results)
+			{
+				if(branches.size())
+					checksum += branches[0].E;
+			}
+			print_rate("batch", num_lookups, start, checksum);
+		}
+
+		// interpolated lookups
+		{
+			t_real checksum = 0.;
+			std::vector<GridFile::Branch> branches;
+			auto start = t_clock::now();
+			for(t_size Q_idx=0; Q_idx<num_lookups; ++Q_idx)
+			{
+				if(grid.Interpolate(Qs[Q_idx*3], Qs[Q_idx*3 + 1], Qs[Q_idx*3 + 2], branches)
+					&& branches.size())
+					checksum += branches[0].E;
+			}
+			print_rate("interpolated", num_lookups, start, checksum);
+		}
+
+		if(remove_file)
+			std::filesystem::remove(filename);
+	}
+	catch(const std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
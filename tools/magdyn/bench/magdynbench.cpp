@@ -0,0 +1,415 @@
+/**
+ * magnetic dynamics -- benchmark of the magnon calculation
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "../calc.h"
+#include "../gridfile.h"
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+namespace pt = boost::property_tree;
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <random>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cmath>
+
+#ifndef MAGDYN_TEST_DIR
+	#define MAGDYN_TEST_DIR "test"
+#endif
+
+using t_clock = std::chrono::steady_clock;
+
+
+
+/**
+ * a magnetic structure to benchmark
+ */
+struct BenchModel
+{
+	std::string name{};
+	t_magdyn dyn{};
+	MagDynConfig cfg{};
+};
+
+
+
+/**
+ * benchmark settings
+ */
+struct BenchSettings
+{
+	std::vector<unsigned int> num_threads{};
+	t_size repetitions{ 3 };
+
+	t_size num_Q_energies{ 256 };     // single-threaded GetEnergies calls
+	t_size num_Q_dispersion{ 256 };   // points of the dispersion
+	t_size num_grid_points{ 8 };      // grid points per direction for the export
+
+	std::string tmp_dir{};
+};
+
+
+
+/**
+ * load a model from a magdyn file
+ */
+static std::unique_ptr<BenchModel> load_model(const std::string& name, const std::string& filename)
+{
+	auto model = std::make_unique<BenchModel>();
+	model->name = name;
+	load_magdyn(filename, model->dyn, model->cfg);
+	return model;
+}
+
+
+
+/**
+ * create a synthetic chain with num_sites sites per unit cell
+ * from the single-site ferromagnetic chain
+ */
+static std::unique_ptr<BenchModel> make_chain_model(const pt::ptree& base_chain,
+	t_size num_sites, bool dmi, bool field, bool incommensurate, const std::string& tmp_dir)
+{
+	pt::ptree node = base_chain;
+	pt::ptree& magdyn = node.get_child("magdyn");
+
+	magdyn.put<bool>("config.use_DMI", dmi);
+	magdyn.put<bool>("config.use_field", field);
+
+	// variables
+	pt::ptree vars;
+	for(const auto& [var_name, var_value] : { std::make_pair("J", "(-1,0)"), std::make_pair("D", "(0.1,0)") })
+	{
+		pt::ptree var;
+		var.put("name", var_name);
+		var.put("value", var_value);
+		vars.add_child("variable", var);
+	}
+	magdyn.put_child("variables", vars);
+
+	// sites along the chain, spiralling around z in the incommensurate case
+	pt::ptree sites;
+	for(t_size site_idx=0; site_idx<num_sites; ++site_idx)
+	{
+		pt::ptree site;
+		site.put("name", "site_" + std::to_string(site_idx));
+		site.put<t_real>("position_x", t_real(site_idx) / t_real(num_sites));
+		site.put<t_real>("position_y", 0.);
+		site.put<t_real>("position_z", 0.);
+		site.put<t_real>("spin_x", incommensurate ? 1. : 0.);
+		site.put<t_real>("spin_y", 0.);
+		site.put<t_real>("spin_z", incommensurate ? 0. : 1.);
+		site.put<t_real>("spin_magnitude", 1.);
+		sites.add_child("site", site);
+	}
+	magdyn.put_child("atom_sites", sites);
+
+	// nearest-neighbour couplings, the last one connects to the next unit cell
+	pt::ptree terms;
+	for(t_size site_idx=0; site_idx<num_sites; ++site_idx)
+	{
+		pt::ptree term;
+		term.put("name", "J_" + std::to_string(site_idx));
+		term.put<t_size>("atom_1_index", site_idx);
+		term.put<t_size>("atom_2_index", (site_idx + 1) % num_sites);
+		term.put<t_real>("distance_x", site_idx + 1 == num_sites ? 1. : 0.);
+		term.put<t_real>("distance_y", 0.);
+		term.put<t_real>("distance_z", 0.);
+		term.put("interaction", "J");
+		term.put("dmi_x", "0");
+		term.put("dmi_y", "0");
+		term.put("dmi_z", dmi ? "D" : "0");
+		terms.add_child("term", term);
+	}
+	magdyn.put_child("exchange_terms", terms);
+
+	magdyn.put<t_real>("field.direction_h", 0.);
+	magdyn.put<t_real>("field.direction_k", 0.);
+	magdyn.put<t_real>("field.direction_l", 1.);
+	magdyn.put<t_real>("field.magnitude", field ? 0.5 : 0.);
+	magdyn.put<bool>("field.align_spins", false);
+
+	magdyn.put<t_real>("ordering.h", incommensurate ? 0.1 : 0.);
+	magdyn.put<t_real>("ordering.k", 0.);
+	magdyn.put<t_real>("ordering.l", 0.);
+	magdyn.put<t_real>("rotation_axis.h", 0.);
+	magdyn.put<t_real>("rotation_axis.k", 0.);
+	magdyn.put<t_real>("rotation_axis.l", 1.);
+
+	std::string name = "chain_" + std::to_string(num_sites);
+	if(dmi)
+		name += "_dmi";
+	if(field)
+		name += "_field";
+	if(incommensurate)
+		name += "_incommensurate";
+
+	// load the structure the same way as a file from the gui
+	const std::string filename = (std::filesystem::path(tmp_dir) / ("magdynbench_" + name + ".magdyn")).string();
+	pt::write_xml(filename, node, std::locale(),
+		pt::xml_writer_make_settings('\t', 1, std::string{"utf-8"}));
+
+	std::unique_ptr<BenchModel> model;
+	try
+	{
+		model = load_model(name, filename);
+	}
+	catch(...)
+	{
+		std::filesystem::remove(filename);
+		throw;
+	}
+
+	std::filesystem::remove(filename);
+	return model;
+}
+
+
+
+/**
+ * sum of the finite energies as a check that the results do not change
+ */
+static t_real get_checksum(const std::vector<SofQE>& results)
+{
+	t_real checksum = 0.;
+	for(const SofQE& result : results)
+	{
+		for(t_real E : result.E)
+		{
+			if(std::isfinite(E))
+				checksum += E;
+		}
+	}
+	return checksum;
+}
+
+
+
+/**
+ * print a result line:
+ * model, sites, benchmark, threads, points, seconds, points/s, checksum
+ */
+static void print_result(const BenchModel& model, const char* bench,
+	unsigned int num_threads, t_size num_points, t_real secs, t_real checksum)
+{
+	std::cout << model.name << ","
+		<< model.dyn.GetAtomSites().size() << ","
+		<< bench << ","
+		<< num_threads << ","
+		<< num_points << ","
+		<< secs << ","
+		<< t_real(num_points) / secs << ","
+		<< checksum << std::endl;
+}
+
+
+
+/**
+ * time func, keeping the fastest of the repetitions
+ */
+template<class t_func>
+static t_real time_best(t_size repetitions, t_func&& func)
+{
+	t_real best = -1.;
+	for(t_size rep=0; rep<std::max<t_size>(repetitions, 1); ++rep)
+	{
+		auto start = t_clock::now();
+		func();
+		t_real secs = std::chrono::duration<t_real>(t_clock::now() - start).count();
+
+		if(best < 0. || secs < best)
+			best = secs;
+	}
+	return best;
+}
+
+
+
+/**
+ * run all benchmarks for a model
+ */
+static void run_benchmarks(BenchModel& model, const BenchSettings& settings, CalcThreadPool& pool)
+{
+	std::cerr << "Benchmarking " << model.name << "..." << std::endl;
+
+	// single GetEnergies calls at random Q points
+	{
+		std::mt19937 rng{1234};
+		std::uniform_real_distribution<t_real> dist{-1., 1.};
+
+		std::vector<t_vec_real> Qs;
+		Qs.reserve(settings.num_Q_energies);
+		for(t_size Q_idx=0; Q_idx<settings.num_Q_energies; ++Q_idx)
+			Qs.emplace_back(tl2::create<t_vec_real>({ dist(rng), dist(rng), dist(rng) }));
+
+		t_real checksum = 0.;
+		t_real secs = time_best(settings.repetitions, [&model, &Qs, &checksum]()
+		{
+			checksum = 0.;
+			for(const t_vec_real& Q : Qs)
+			{
+				for(const auto& E_and_S : model.dyn.GetEnergies(Q, !model.cfg.use_weights))
+				{
+					if(std::isfinite(E_and_S.E))
+						checksum += E_and_S.E;
+				}
+			}
+		});
+
+		print_result(model, "energies", 1, Qs.size(), secs, checksum);
+	}
+
+	for(unsigned int num_threads : settings.num_threads)
+	{
+		pool.Start(num_threads);
+
+		// dispersion along the model's Q range
+		{
+			MagDynConfig cfg = model.cfg;
+			cfg.num_Q_points = settings.num_Q_dispersion;
+			cfg.adaptive_Q = false;
+
+			std::vector<SofQE> results;
+			t_real secs = time_best(settings.repetitions, [&model, &cfg, &results, &pool]()
+			{
+				calc_dispersion(model.dyn, cfg, results, pool);
+			});
+
+			print_result(model, "dispersion", num_threads, results.size(), secs, get_checksum(results));
+		}
+
+		// small grid export
+		{
+			MagDynConfig cfg = model.cfg;
+			for(int i=0; i<3; ++i)
+			{
+				cfg.export_start[i] = -1.;
+				cfg.export_end[i] = 1.;
+				cfg.export_num_points[i] = settings.num_grid_points;
+			}
+			cfg.export_use_symmetry = false;
+			cfg.export_checkpoints = false;
+			cfg.export_shard = 0;
+			cfg.export_num_shards = 1;
+
+			const std::string filename = (std::filesystem::path(settings.tmp_dir) / "magdynbench_grid.bin").string();
+			t_real secs = time_best(settings.repetitions, [&model, &cfg, &filename, &pool]()
+			{
+				export_sqe(model.dyn, cfg, filename, EXPORT_GRID, pool);
+			});
+
+			// sum of the energies in the written grid
+			t_real checksum = 0.;
+			{
+				GridFile grid{filename};
+				for(t_size h_idx=0; h_idx<grid.GetNumPoints(0); ++h_idx)
+				for(t_size k_idx=0; k_idx<grid.GetNumPoints(1); ++k_idx)
+				for(t_size l_idx=0; l_idx<grid.GetNumPoints(2); ++l_idx)
+				{
+					for(const GridFile::Branch& branch : grid.GetBranches(h_idx, k_idx, l_idx))
+					{
+						if(std::isfinite(branch.E))
+							checksum += branch.E;
+					}
+				}
+			}
+			std::filesystem::remove(filename);
+
+			const t_size num_points = settings.num_grid_points * settings.num_grid_points * settings.num_grid_points;
+			print_result(model, "export", num_threads, num_points, secs, checksum);
+		}
+	}
+}
+
+
+
+/**
+ * usage: takin_magdyn_bench [test model directory] [maximum threads] [repetitions]
+ */
+int main(int argc, char** argv)
+{
+	try
+	{
+		std::string test_dir = MAGDYN_TEST_DIR;
+		unsigned int max_threads = CalcThreadPool::GetDefaultNumThreads();
+
+		BenchSettings settings;
+		settings.tmp_dir = std::filesystem::temp_directory_path().string();
+
+		if(argc > 1 && std::string{argv[1]} != "-")
+			test_dir = argv[1];
+		if(argc > 2 && std::string{argv[2]} != "-")
+			max_threads = std::max<unsigned int>(std::stoul(argv[2]), 1);
+		if(argc > 3 && std::string{argv[3]} != "-")
+			settings.repetitions = std::stoul(argv[3]);
+
+		// powers of two up to the maximum number of threads
+		for(unsigned int num_threads = 1; num_threads < max_threads; num_threads *= 2)
+			settings.num_threads.push_back(num_threads);
+		settings.num_threads.push_back(max_threads);
+
+		// models from the test directory
+		std::vector<std::unique_ptr<BenchModel>> models;
+		for(const char* name : { "ferromagnetic_chain", "antiferromagnetic_chain", "antiferromagnetic_chain_2" })
+		{
+			const std::string filename = (std::filesystem::path(test_dir) / (std::string{name} + ".xml")).string();
+			models.emplace_back(load_model(name, filename));
+		}
+
+		// scaled synthetic models based on the ferromagnetic chain
+		pt::ptree base_chain;
+		pt::read_xml((std::filesystem::path(test_dir) / "ferromagnetic_chain.xml").string(), base_chain);
+
+		for(t_size num_sites : { 4, 16, 64 })
+			models.emplace_back(make_chain_model(base_chain, num_sites, false, false, false, settings.tmp_dir));
+		models.emplace_back(make_chain_model(base_chain, 16, true, false, false, settings.tmp_dir));
+		models.emplace_back(make_chain_model(base_chain, 16, false, true, false, settings.tmp_dir));
+		models.emplace_back(make_chain_model(base_chain, 16, true, true, false, settings.tmp_dir));
+		for(t_size num_sites : { 4, 16 })
+			models.emplace_back(make_chain_model(base_chain, num_sites, false, false, true, settings.tmp_dir));
+
+		CalcThreadPool pool{max_threads};
+
+		std::cout << "# model,sites,benchmark,threads,points,seconds,points_per_second,checksum" << std::endl;
+		std::cout.precision(g_prec);
+		for(auto& model : models)
+			run_benchmarks(*model, settings, pool);
+	}
+	catch(const std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
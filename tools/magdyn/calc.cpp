@@ -0,0 +1,2715 @@
+/**
+ * magnetic dynamics -- calculations without gui
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+namespace pt = boost::property_tree;
+
+#include "calc.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
+#include <limits>
+#include <random>
+
+#include "tlibs2/libs/log.h"
+#include "../structfact/loadcif.h"
+#include "gridfile.h"
+#include "profiler.h"
+#include "phases.h"
+
+#ifdef USE_HDF5
+	#include "tlibs2/libs/h5file.h"
+	#include "h5writer.h"
+#endif
+
+using namespace tl2_ops;
+
+
+// for debugging: write individual data chunks in hdf5 file
+//#define WRITE_HDF5_CHUNKS
+
+// maximum number of consecutive path points calculated in one work item with cached phases
+#define DISPERSION_MAX_POINTS_PER_ITEM 32
+
+// minimum number of work items per thread for the dispersion with cached phases
+#define DISPERSION_ITEMS_PER_THREAD 4
+
+// number of random Q points at which the incommensurate cached phases are verified
+#define INCOMMENSURATE_PHASES_CHECKS 8
+
+// number of generic Q points at which the symmetry operations are verified
+#define EXPORT_SYMMETRY_CHECKS 24
+
+// number of (h, k) columns whose representative results are cached in a symmetry-reduced export
+#define EXPORT_SYMMETRY_CACHE_COLUMNS 256
+
+
+
+/**
+ * load a magnetic structure configuration and the calculation settings
+ */
+void load_magdyn(const std::string& filename, t_magdyn& dyn, MagDynConfig& cfg)
+{
+	// properties tree
+	pt::ptree node;
+
+	// load from file
+	std::ifstream ifstr{filename};
+	if(!ifstr)
+		throw std::runtime_error("Cannot open file \"" + filename + "\".");
+	pt::read_xml(ifstr, node);
+
+	// check signature
+	if(auto optInfo = node.get_optional<std::string>("magdyn.meta.info");
+		!optInfo || !(*optInfo==std::string{"magdyn_tool"}))
+	{
+		throw std::runtime_error("Unrecognised file format.");
+	}
+
+	const auto &magdyn = node.get_child("magdyn");
+
+	// settings
+	const char* hkl[] = { "h", "k", "l" };
+	for(int i=0; i<3; ++i)
+	{
+		std::string comp{hkl[i]};
+
+		if(auto optVal = magdyn.get_optional<t_real>("config." + comp + "_start"))
+			cfg.Q_start[i] = *optVal;
+		if(auto optVal = magdyn.get_optional<t_real>("config." + comp + "_end"))
+			cfg.Q_end[i] = *optVal;
+		if(auto optVal = magdyn.get_optional<t_real>("config.export_start_" + comp))
+			cfg.export_start[i] = *optVal;
+		if(auto optVal = magdyn.get_optional<t_real>("config.export_end_" + comp))
+			cfg.export_end[i] = *optVal;
+		if(auto optVal = magdyn.get_optional<t_size>(
+			"config.export_num_points_" + std::to_string(i+1)))
+			cfg.export_num_points[i] = *optVal;
+	}
+
+	if(auto optVal = magdyn.get_optional<int>("config.export_compression"))
+		cfg.export_compression = *optVal;
+	if(auto optVal = magdyn.get_optional<bool>("config.export_use_symmetry"))
+		cfg.export_use_symmetry = *optVal;
+	if(auto optVal = magdyn.get_optional<bool>("config.export_time_reversal"))
+		cfg.export_time_reversal = *optVal;
+	if(auto optVal = magdyn.get_optional<bool>("config.export_checkpoints"))
+		cfg.export_checkpoints = *optVal;
+	if(auto optVal = magdyn.get_optional<t_real>("config.export_checkpoint_interval"))
+		cfg.export_checkpoint_interval = *optVal;
+
+	// space group, in the same order as in the gui's list
+	if(auto optVal = magdyn.get_optional<int>("config.spacegroup_index"))
+	{
+		auto spacegroups = get_sgs<t_mat_real>();
+		if(*optVal >= 0 && std::size_t(*optVal) < spacegroups.size())
+			cfg.sg_ops = std::get<2>(spacegroups[*optVal]);
+	}
+
+	if(auto optVal = magdyn.get_optional<t_real>("config.powder_Q_min"))
+		cfg.powder_Q_range[0] = *optVal;
+	if(auto optVal = magdyn.get_optional<t_real>("config.powder_Q_max"))
+		cfg.powder_Q_range[1] = *optVal;
+	if(auto optVal = magdyn.get_optional<t_real>("config.powder_E_min"))
+		cfg.powder_E_range[0] = *optVal;
+	if(auto optVal = magdyn.get_optional<t_real>("config.powder_E_max"))
+		cfg.powder_E_range[1] = *optVal;
+	if(auto optVal = magdyn.get_optional<t_size>("config.powder_num_Q"))
+		cfg.powder_num_Q = *optVal;
+	if(auto optVal = magdyn.get_optional<t_size>("config.powder_num_E"))
+		cfg.powder_num_E = *optVal;
+	if(auto optVal = magdyn.get_optional<t_size>("config.powder_num_dirs"))
+		cfg.powder_num_dirs = *optVal;
+	if(auto optVal = magdyn.get_optional<t_real>("config.powder_E_sigma"))
+		cfg.powder_E_sigma = *optVal;
+
+	if(auto optVal = magdyn.get_optional<int>("config.slice_mode"))
+		cfg.slice_mode = *optVal;
+	for(int i=0; i<3; ++i)
+	{
+		std::string comp{hkl[i]};
+
+		if(auto optVal = magdyn.get_optional<t_real>("config.slice_origin_" + comp))
+			cfg.slice_origin[i] = *optVal;
+		if(auto optVal = magdyn.get_optional<t_real>("config.slice_dir1_" + comp))
+			cfg.slice_dir1[i] = *optVal;
+		if(auto optVal = magdyn.get_optional<t_real>("config.slice_dir2_" + comp))
+			cfg.slice_dir2[i] = *optVal;
+	}
+	for(int i=0; i<2; ++i)
+	{
+		const std::string idx = std::to_string(i+1);
+		t_real* range = i == 0 ? cfg.slice_range1 : cfg.slice_range2;
+
+		if(auto optVal = magdyn.get_optional<t_real>("config.slice_min_" + idx))
+			range[0] = *optVal;
+		if(auto optVal = magdyn.get_optional<t_real>("config.slice_max_" + idx))
+			range[1] = *optVal;
+		if(auto optVal = magdyn.get_optional<t_size>("config.slice_num_points_" + idx))
+			cfg.slice_num_points[i] = *optVal;
+		if(auto optVal = magdyn.get_optional<t_real>("config.slice_Q_width_" + idx))
+			cfg.slice_Q_width[i] = *optVal;
+	}
+	if(auto optVal = magdyn.get_optional<t_real>("config.slice_E_min"))
+		cfg.slice_E_range[0] = *optVal;
+	if(auto optVal = magdyn.get_optional<t_real>("config.slice_E_max"))
+		cfg.slice_E_range[1] = *optVal;
+	if(auto optVal = magdyn.get_optional<t_size>("config.slice_num_E"))
+		cfg.slice_num_E = *optVal;
+	if(auto optVal = magdyn.get_optional<int>("config.slice_kernel"))
+		cfg.slice_kernel = *optVal;
+	if(auto optVal = magdyn.get_optional<t_real>("config.slice_E_width"))
+		cfg.slice_E_width = *optVal;
+
+	for(int i=0; i<3; ++i)
+	{
+		if(auto optVal = magdyn.get_optional<t_size>("config.dos_mesh_" + std::to_string(i+1)))
+			cfg.dos_mesh[i] = *optVal;
+	}
+	if(auto optVal = magdyn.get_optional<bool>("config.dos_reduce_inversion"))
+		cfg.dos_reduce_inversion = *optVal;
+	if(auto optVal = magdyn.get_optional<int>("config.dos_method"))
+		cfg.dos_method = *optVal;
+	if(auto optVal = magdyn.get_optional<t_real>("config.dos_E_min"))
+		cfg.dos_E_range[0] = *optVal;
+	if(auto optVal = magdyn.get_optional<t_real>("config.dos_E_max"))
+		cfg.dos_E_range[1] = *optVal;
+	if(auto optVal = magdyn.get_optional<t_size>("config.dos_num_E"))
+		cfg.dos_num_E = *optVal;
+	if(auto optVal = magdyn.get_optional<t_real>("config.dos_E_width"))
+		cfg.dos_E_width = *optVal;
+	if(auto optVal = magdyn.get_optional<t_real>("config.dos_T_min"))
+		cfg.dos_T_range[0] = *optVal;
+	if(auto optVal = magdyn.get_optional<t_real>("config.dos_T_max"))
+		cfg.dos_T_range[1] = *optVal;
+	if(auto optVal = magdyn.get_optional<t_size>("config.dos_num_T"))
+		cfg.dos_num_T = *optVal;
+
+	const char* lattice[] = { "a", "b", "c" };
+	const char* angles[] = { "alpha", "beta", "gamma" };
+	for(int i=0; i<3; ++i)
+	{
+		if(auto optVal = magdyn.get_optional<t_real>(std::string("config.xtal_") + lattice[i]))
+			cfg.xtal_lattice[i] = *optVal;
+		if(auto optVal = magdyn.get_optional<t_real>(std::string("config.xtal_") + angles[i]))
+			cfg.xtal_angles[i] = *optVal;
+	}
+
+	if(auto optVal = magdyn.get_optional<t_size>("config.num_Q_points"))
+		cfg.num_Q_points = *optVal;
+	if(auto optVal = magdyn.get_optional<bool>("config.adaptive_Q"))
+		cfg.adaptive_Q = *optVal;
+	if(auto optVal = magdyn.get_optional<t_real>("config.adaptive_E_tol"))
+		cfg.adaptive_E_tol = *optVal;
+	if(auto optVal = magdyn.get_optional<t_real>("config.fit_rel_step"))
+		cfg.fit_rel_step = *optVal;
+	if(auto optVal = magdyn.get_optional<bool>("config.use_DMI"))
+		cfg.use_dmi = *optVal;
+	if(auto optVal = magdyn.get_optional<bool>("config.use_field"))
+		cfg.use_field = *optVal;
+	if(auto optVal = magdyn.get_optional<bool>("config.use_temperature"))
+		cfg.use_temperature = *optVal;
+	if(auto optVal = magdyn.get_optional<bool>("config.use_weights"))
+		cfg.use_weights = *optVal;
+	if(auto optVal = magdyn.get_optional<bool>("config.use_projector"))
+		cfg.use_projector = *optVal;
+	if(auto optVal = magdyn.get_optional<bool>("config.unite_degeneracies"))
+		cfg.unite_degeneracies = *optVal;
+	if(auto optVal = magdyn.get_optional<bool>("config.ignore_annihilation"))
+		cfg.ignore_annihilation = *optVal;
+	if(auto optVal = magdyn.get_optional<bool>("config.force_incommensurate"))
+		cfg.force_incommensurate = *optVal;
+	if(auto optVal = magdyn.get_optional<bool>("config.cache_phases"))
+		cfg.cache_phases = *optVal;
+
+	// saved coordinates as multi-segment path
+	cfg.Q_path.clear();
+	if(auto coords = magdyn.get_child_optional("saved_coordinates"); coords)
+	{
+		for(const auto &coord : *coords)
+		{
+			DispersionSegment segment;
+			for(int i=0; i<3; ++i)
+			{
+				std::string comp{hkl[i]};
+
+				segment.Q_start[i] = coord.second.get<t_real>(comp + "_i", 0.);
+				segment.Q_end[i] = coord.second.get<t_real>(comp + "_f", 0.);
+			}
+
+			cfg.Q_path.emplace_back(std::move(segment));
+		}
+	}
+
+	// magnon calculator configuration
+	dyn.SetEpsilon(g_eps);
+	dyn.SetPrecision(g_prec);
+	if(!dyn.Load(magdyn))
+		throw std::runtime_error("Invalid magnetic structure configuration.");
+
+	apply_magdyn_config(dyn, cfg);
+}
+
+
+
+/**
+ * apply the calculation settings to the magnon calculator
+ * (does the same as the gui's SyncSitesAndTerms for a freshly loaded file)
+ */
+void apply_magdyn_config(t_magdyn& dyn, const MagDynConfig& cfg)
+{
+	dyn.SetUniteDegenerateEnergies(cfg.unite_degeneracies);
+	dyn.SetForceIncommensurate(cfg.force_incommensurate);
+
+	if(!cfg.use_field)
+		dyn.ClearExternalField();
+	if(!cfg.use_temperature)
+		dyn.SetTemperature(-1.);
+
+	if(!cfg.use_dmi)
+	{
+		// re-insert the exchange terms without their dmi vectors
+		std::vector<t_magdyn::ExchangeTerm> terms = dyn.GetExchangeTerms();
+		dyn.ClearExchangeTerms();
+
+		for(t_magdyn::ExchangeTerm& term : terms)
+		{
+			for(int i=0; i<3; ++i)
+				term.dmi[i] = "0";
+			dyn.AddExchangeTerm(std::move(term));
+		}
+	}
+
+	dyn.CalcAtomSites();
+	dyn.CalcExchangeTerms();
+}
+
+
+
+/**
+ * calculate the energies and correlations at Q,
+ * with profiling enabled the calculation stages are timed individually,
+ * with a line, the hamiltonians are assembled from its cached phase factors,
+ * all branches follow the calculator's own settings, like in GetEnergies
+ */
+static std::vector<t_magdyn::EnergyAndWeight> get_energies(const t_magdyn& dyn,
+	const t_vec_real& Q, bool only_energies,
+	HamiltonianLine* line = nullptr, t_size line_idx = 0)
+{
+	if(!is_profiling() && !line)
+		return dyn.GetEnergies(Q, only_energies);
+
+	const bool incommensurate = dyn.IsIncommensurate();
+	if(incommensurate && !(line && line->GetPhases().IsIncommensurate()))
+	{
+		// the incommensurate case combines the stages for Q and Q +- O
+		ProfileTimer timer{PROFILE_INCOMMENSURATE};
+		return dyn.GetEnergies(Q, only_energies);
+	}
+
+	// the same stages as in GetEnergies
+	std::vector<t_magdyn::EnergyAndWeight> energies_and_correlations;
+
+	if(incommensurate)
+	{
+		const HamiltonianPhases& phases = line->GetPhases();
+		const t_vec_real& O = phases.GetOrdering();
+		const t_vec_real Qs[3] = { Q, Q + O, Q - O };
+
+		t_mat H[3];
+		{
+			ProfileTimer timer{PROFILE_HAMILTONIAN};
+			line->GetHamiltonians(line_idx, H);
+		}
+
+		ProfileTimer timer{PROFILE_EIGENSYSTEM};
+		for(int i=0; i<3; ++i)
+		{
+			auto Es_and_Ss = dyn.GetEnergiesFromHamiltonian(H[i], Qs[i], only_energies);
+
+			// rotate the correlation functions back into the crystal frame
+			if(!only_energies)
+			{
+				for(t_magdyn::EnergyAndWeight& E_and_S : Es_and_Ss)
+					E_and_S.S = E_and_S.S * phases.GetIncommensurateRotation(i);
+			}
+
+			energies_and_correlations.insert(energies_and_correlations.end(),
+				std::make_move_iterator(Es_and_Ss.begin()),
+				std::make_move_iterator(Es_and_Ss.end()));
+		}
+	}
+	else
+	{
+		t_mat H;
+		{
+			ProfileTimer timer{PROFILE_HAMILTONIAN};
+			H = line ? line->GetHamiltonian(line_idx) : dyn.GetHamiltonian(Q);
+		}
+
+		ProfileTimer timer{PROFILE_EIGENSYSTEM};
+		energies_and_correlations = dyn.GetEnergiesFromHamiltonian(H, Q, only_energies);
+	}
+
+	if(!only_energies)
+	{
+		ProfileTimer timer{PROFILE_CORRELATIONS};
+		dyn.GetIntensities(Q, energies_and_correlations);
+	}
+
+	if(dyn.GetUniteDegenerateEnergies())
+	{
+		ProfileTimer timer{PROFILE_UNITE};
+		energies_and_correlations = dyn.UniteEnergies(energies_and_correlations);
+	}
+
+	return energies_and_correlations;
+}
+
+
+
+/**
+ * compare the incommensurate energies and weights calculated from
+ * the cached phase factors with the ones from GetEnergies
+ */
+static bool check_incommensurate_phases(const t_magdyn& dyn,
+	const MagDynConfig& cfg, const HamiltonianPhases& phases)
+{
+	const bool only_energies = !cfg.use_weights;
+
+	// reproducible random Q points
+	std::mt19937 rng{ 0x696e636du };
+	std::uniform_real_distribution<t_real> dist_Q{ -2., 2. };
+	std::vector<t_vec_real> Qs_check;
+	for(t_size idx=0; idx<INCOMMENSURATE_PHASES_CHECKS; ++idx)
+		Qs_check.emplace_back(tl2::create<t_vec_real>({ dist_Q(rng), dist_Q(rng), dist_Q(rng) }));
+
+	auto differs = [](t_real val1, t_real val2) -> bool
+	{
+		const t_real eps = g_eps * std::max({ std::abs(val1), std::abs(val2), t_real(1) });
+		return std::abs(val1 - val2) > eps;
+	};
+
+	for(const t_vec_real& Q : Qs_check)
+	{
+		HamiltonianLine line{phases, Q, tl2::zero<t_vec_real>(3)};
+		const auto Es_and_Ss = get_energies(dyn, Q, only_energies, &line, 0);
+		const auto Es_and_Ss_full = dyn.GetEnergies(Q, only_energies);
+
+		if(Es_and_Ss.size() != Es_and_Ss_full.size())
+			return false;
+
+		for(std::size_t i=0; i<Es_and_Ss.size(); ++i)
+		{
+			if(differs(Es_and_Ss[i].E, Es_and_Ss_full[i].E))
+				return false;
+
+			if(!only_energies && (differs(Es_and_Ss[i].weight, Es_and_Ss_full[i].weight) ||
+				differs(Es_and_Ss[i].weight_full, Es_and_Ss_full[i].weight_full)))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+
+
+/**
+ * hash of the magnetic model to identify its revision, e.g. for checkpoints and cached phases,
+ * uses fnv-1a on the saved model to be stable across runs and builds
+ */
+static std::string get_model_hash(const t_magdyn& dyn)
+{
+	pt::ptree node;
+	if(!dyn.Save(node))
+		throw std::runtime_error("Could not serialise the magnetic model.");
+
+	std::ostringstream ostr;
+	pt::write_xml(ostr, node);
+	const std::string model = ostr.str();
+
+	std::uint64_t hash = 0xcbf29ce484222325ull;
+	for(char c : model)
+	{
+		hash ^= std::uint64_t(static_cast<unsigned char>(c));
+		hash *= 0x100000001b3ull;
+	}
+
+	std::ostringstream ostrHash;
+	ostrHash << std::hex << std::setw(16) << std::setfill('0') << hash;
+	return ostrHash.str();
+}
+
+
+
+// phase factors of the most recently used model revision, nullptr if they are not valid for it
+static std::mutex g_mtx_phases{};
+static std::string g_phases_model{};
+static std::shared_ptr<const HamiltonianPhases> g_phases{};
+
+
+
+/**
+ * set up the cached phase factors of the hamiltonian if they pay off
+ * for the given number of Q points, otherwise returns nullptr,
+ * they are only sampled again if the model has changed
+ */
+static std::shared_ptr<const HamiltonianPhases> get_hamiltonian_phases(const t_magdyn& dyn,
+	const MagDynConfig& cfg, t_size num_points, CalcThreadPool& pool,
+	const t_calc_progress& progress = nullptr)
+{
+	if(!cfg.cache_phases)
+		return nullptr;
+
+	std::string model = get_model_hash(dyn);
+	if(dyn.IsIncommensurate())
+		model += cfg.use_weights ? ":incomm:weights" : ":incomm";
+
+	{
+		std::lock_guard lock{g_mtx_phases};
+		if(model == g_phases_model)
+			return g_phases;
+	}
+
+	auto phases = std::make_shared<HamiltonianPhases>();
+	if(!phases->Init(dyn) || phases->GetNumSamples()*2 > num_points)
+		return nullptr;
+
+	// the sampling only reports the stop requests, not its own progress
+	bool stopped = false;
+	auto sampling_progress = [&progress, &stopped, num_points](t_size, t_size) -> bool
+	{
+		stopped = progress && !progress(0, num_points);
+		return !stopped;
+	};
+
+	auto cache_phases = [&model](std::shared_ptr<const HamiltonianPhases> phases)
+		-> std::shared_ptr<const HamiltonianPhases>
+	{
+		std::lock_guard lock{g_mtx_phases};
+		g_phases_model = std::move(model);
+		g_phases = phases;
+		return phases;
+	};
+
+	if(!phases->Calculate(dyn, pool, sampling_progress))
+	{
+		if(stopped)
+			return nullptr;
+
+		std::cerr << "Warning: The sampled phase factors do not reproduce the hamiltonian"
+			<< " of the model, they are not used." << std::endl;
+		return cache_phases(nullptr);
+	}
+
+	if(dyn.IsIncommensurate())
+	{
+		// the rotations at Q +- O follow the calculator's phase sign convention
+		phases->SetIncommensurate(dyn.GetOrderingWavevector(), dyn.GetRotationAxis(), dyn.GetPhaseSign());
+
+		if(!check_incommensurate_phases(dyn, cfg, *phases))
+		{
+			std::cerr << "Warning: The cached phase factors do not reproduce the incommensurate"
+				<< " energies and weights of the model, they are not used." << std::endl;
+			return cache_phases(nullptr);
+		}
+	}
+
+	return cache_phases(phases);
+}
+
+
+
+/**
+ * number of consecutive path points calculated in one work item with cached phases,
+ * small enough to give every thread several items
+ */
+static t_size get_dispersion_block_size(t_size num_points, const CalcThreadPool& pool)
+{
+	const t_size num_threads = std::max<t_size>(pool.GetNumThreads(), 1);
+	const t_size block_size = num_points / (num_threads * DISPERSION_ITEMS_PER_THREAD);
+
+	return std::clamp<t_size>(block_size, 1, DISPERSION_MAX_POINTS_PER_ITEM);
+}
+
+
+
+/**
+ * calculate the energies and weights at a Q position of the dispersion,
+ * optionally Q is the point line_idx of a line with cached phase factors
+ */
+SofQE calc_dispersion_point(const t_magdyn& dyn,
+	const MagDynConfig& cfg, const t_vec_real& Q, t_real E0,
+	HamiltonianLine* line, t_size line_idx)
+{
+	ProfileTimer timer{PROFILE_Q_POINT};
+
+	SofQE result;
+	result.h = Q[0];
+	result.k = Q[1];
+	result.l = Q[2];
+
+	auto energies_and_correlations = get_energies(dyn, Q,
+		!cfg.use_weights, line, line_idx);
+	result.E.reserve(energies_and_correlations.size());
+	result.S.reserve(energies_and_correlations.size());
+
+	for(const auto& E_and_S : energies_and_correlations)
+	{
+		t_real E = E_and_S.E - E0;
+		if(std::isnan(E) || std::isinf(E))
+			continue;
+		if(cfg.ignore_annihilation && E < t_real(0))
+			continue;
+
+		t_real weight = 0.;
+		t_real weight_channel[3] = { 0., 0., 0. };
+
+		// weights
+		if(cfg.use_weights)
+		{
+			weight = cfg.use_projector ? E_and_S.weight : E_and_S.weight_full;
+			if(std::isnan(weight) || std::isinf(weight))
+				continue;
+
+			for(int channel=0; channel<3; ++channel)
+			{
+				weight_channel[channel] = cfg.use_projector
+					? E_and_S.weight_channel[channel]
+					: E_and_S.weight_channel_full[channel];
+			}
+		}
+
+		result.E.push_back(E);
+		result.S.push_back(weight);
+		for(int channel=0; channel<3; ++channel)
+			result.S_channel[channel].push_back(weight_channel[channel]);
+	}
+
+	// sort the branches by energy
+	std::vector<std::size_t> perm(result.E.size());
+	std::iota(perm.begin(), perm.end(), 0);
+	std::stable_sort(perm.begin(), perm.end(), [&result](std::size_t idx1, std::size_t idx2) -> bool
+	{
+		return result.E[idx1] < result.E[idx2];
+	});
+
+	auto reorder = [&perm](std::vector<t_real>& vec)
+	{
+		std::vector<t_real> vec_sorted;
+		vec_sorted.reserve(vec.size());
+		for(std::size_t idx : perm)
+			vec_sorted.push_back(vec[idx]);
+		vec = std::move(vec_sorted);
+	};
+
+	reorder(result.E);
+	reorder(result.S);
+	for(int channel=0; channel<3; ++channel)
+		reorder(result.S_channel[channel]);
+
+	return result;
+}
+
+
+
+/**
+ * add a weight at energy E to the histogram bins, which are centred at E_min + i*dE,
+ * the weight is distributed according to the resolution kernel integrated over
+ * the bins, or added to the nearest bin if the kernel width is zero
+ */
+void add_energy_kernel(t_real* bins, t_size num_E, t_real E_min, t_real dE,
+	t_real E, t_real weight, int kernel, t_real width)
+{
+	if(width <= t_real(0))
+	{
+		const t_real bin = std::round((E - E_min) / dE);
+		if(bin >= t_real(0) && bin < t_real(num_E))
+			bins[t_size(bin)] += weight;
+		return;
+	}
+
+	// cumulative distribution of the kernel
+	auto cdf = [kernel, width, E](t_real x) -> t_real
+	{
+		if(kernel == KERNEL_LORENTZIAN)
+			return std::atan((x - E) / width) / tl2::pi<t_real>;
+		return t_real(0.5) * std::erf((x - E) / (std::sqrt(t_real(2)) * width));
+	};
+
+	// only consider the bins where the kernel is significant
+	const t_real cutoff = width * (kernel == KERNEL_LORENTZIAN ? t_real(50) : t_real(5));
+	const t_real bin_lo = std::max<t_real>(std::floor((E - cutoff - E_min) / dE), 0.);
+	const t_real bin_hi = std::min<t_real>(std::ceil((E + cutoff - E_min) / dE),
+		t_real(num_E) - t_real(1));
+
+	for(t_real bin=bin_lo; bin<=bin_hi; bin+=t_real(1))
+	{
+		const t_real bin_E = E_min + bin * dE;
+		bins[t_size(bin)] += weight * (cdf(bin_E + t_real(0.5)*dE) - cdf(bin_E - t_real(0.5)*dE));
+	}
+}
+
+
+
+/**
+ * position on the dispersion path, frac = 0..1
+ */
+static t_vec_real get_dispersion_Q(const MagDynConfig& cfg, t_real frac)
+{
+	return tl2::create<t_vec_real>(
+	{
+		std::lerp(cfg.Q_start[0], cfg.Q_end[0], frac),
+		std::lerp(cfg.Q_start[1], cfg.Q_end[1], frac),
+		std::lerp(cfg.Q_start[2], cfg.Q_end[2], frac),
+	});
+}
+
+
+
+/**
+ * how much the interval between two neighbouring dispersion points needs refinement,
+ * values above 1 exceed the tolerance
+ */
+static t_real dispersion_refinement(const SofQE& result1, const SofQE& result2,
+	const MagDynConfig& cfg)
+{
+	// branches appear or vanish, e.g. at degeneracies
+	if(result1.E.size() != result2.E.size())
+		return t_real(1) + g_eps;
+
+	t_real refinement = 0.;
+	for(std::size_t branch=0; branch<result1.E.size(); ++branch)
+	{
+		// energy change
+		t_real dE = std::abs(result1.E[branch] - result2.E[branch]);
+		refinement = std::max(refinement, dE / cfg.adaptive_E_tol);
+
+		// the branches are sorted by energy, so a crossing of branches
+		// shows up as a jump in the weights of the sorted branches
+		if(cfg.use_weights)
+		{
+			t_real S1 = std::abs(result1.S[branch]);
+			t_real S2 = std::abs(result2.S[branch]);
+			t_real S_max = std::max(S1, S2);
+
+			if(S_max > g_eps && std::abs(S1 - S2) > t_real(0.5)*S_max)
+				refinement = std::max(refinement, t_real(1) + g_eps);
+		}
+	}
+
+	return refinement;
+}
+
+
+
+/**
+ * calculate the dispersion branches with adaptive sampling of the Q path:
+ * starting from a coarse uniform grid, the intervals between neighbouring
+ * points are bisected where the branches change by more than the tolerance,
+ * until the tolerance or the maximum number of points is reached
+ */
+static bool calc_dispersion_adaptive(const t_magdyn& dyn, const MagDynConfig& cfg,
+	std::vector<SofQE>& results, CalcThreadPool& pool, t_real E0,
+	const t_calc_progress& progress, const t_calc_result& on_result)
+{
+	const t_size max_pts = cfg.num_Q_points;
+
+	// don't bisect intervals shorter than this fraction of the path
+	const t_real min_interval = t_real(1e-6);
+
+	// calculated points, ordered by their position on the path
+	std::vector<std::pair<t_real, SofQE>> points;
+	points.reserve(max_pts);
+	t_size num_done = 0;
+
+	// calculate a batch of new points in parallel, fracs have to be sorted
+	auto calc_points = [&](const std::vector<t_real>& fracs) -> bool
+	{
+		std::vector<SofQE> new_results(fracs.size());
+		const t_size offs = num_done;
+
+		t_calc_progress batch_progress = nullptr;
+		if(progress)
+		{
+			batch_progress = [&progress, offs, max_pts](t_size done, t_size /*total*/) -> bool
+			{
+				return progress(offs + done, max_pts);
+			};
+		}
+
+		bool ok = pool.ParallelFor(fracs.size(),
+			[&dyn, &cfg, &fracs, &new_results, &on_result, offs, E0](t_size i)
+		{
+			new_results[i] = calc_dispersion_point(dyn, cfg, get_dispersion_Q(cfg, fracs[i]), E0);
+			if(on_result)
+				on_result(offs + i, new_results[i]);
+		}, batch_progress);
+
+		// only keep complete batches
+		if(!ok)
+			return false;
+
+		num_done += fracs.size();
+
+		const std::size_t old_size = points.size();
+		for(std::size_t i=0; i<fracs.size(); ++i)
+			points.emplace_back(fracs[i], std::move(new_results[i]));
+
+		std::inplace_merge(points.begin(), points.begin() + old_size, points.end(),
+			[](const auto& pt1, const auto& pt2) -> bool
+		{
+			return pt1.first < pt2.first;
+		});
+
+		return true;
+	};
+
+	// coarse uniform grid
+	const t_size num_start = std::min(max_pts, std::max(cfg.adaptive_start_points, t_size(2)));
+	std::vector<t_real> fracs(num_start);
+	for(t_size i=0; i<num_start; ++i)
+		fracs[i] = num_start > 1 ? t_real(i)/t_real(num_start-1) : 0.;
+
+	bool ok = calc_points(fracs);
+
+	// bisection
+	while(ok && num_done < max_pts)
+	{
+		// intervals exceeding the tolerance, with the amount of needed refinement
+		std::vector<std::pair<t_real, t_real>> intervals;
+		for(std::size_t i=0; i+1<points.size(); ++i)
+		{
+			const auto& [frac1, result1] = points[i];
+			const auto& [frac2, result2] = points[i+1];
+
+			if(frac2 - frac1 < min_interval)
+				continue;
+
+			t_real refinement = dispersion_refinement(result1, result2, cfg);
+			if(refinement > t_real(1))
+				intervals.emplace_back(refinement, (frac1 + frac2) / t_real(2));
+		}
+
+		if(intervals.size() == 0)
+			break;
+
+		// if the remaining points don't suffice, refine the worst intervals first
+		const t_size num_new = std::min<t_size>(intervals.size(), max_pts - num_done);
+		if(num_new < intervals.size())
+		{
+			std::nth_element(intervals.begin(), intervals.begin() + num_new, intervals.end(),
+				[](const auto& interval1, const auto& interval2) -> bool
+			{
+				return interval1.first > interval2.first;
+			});
+			intervals.resize(num_new);
+		}
+
+		fracs.clear();
+		for(const auto& interval : intervals)
+			fracs.push_back(interval.second);
+		std::sort(fracs.begin(), fracs.end());
+
+		ok = calc_points(fracs);
+	}
+
+	results.clear();
+	results.reserve(points.size());
+	for(auto& point : points)
+		results.emplace_back(std::move(point.second));
+
+	return ok;
+}
+
+
+
+/**
+ * calculate the dispersion branches along the Q path given in the settings,
+ * the results are ordered by their position along the path
+ * (in adaptive mode, the indices passed to on_result are in calculation order)
+ */
+bool calc_dispersion(const t_magdyn& dyn, const MagDynConfig& cfg,
+	std::vector<SofQE>& results, CalcThreadPool& pool,
+	const t_calc_progress& progress, const t_calc_result& on_result)
+{
+	const t_size num_pts = cfg.num_Q_points;
+	results.clear();
+	results.resize(num_pts);
+
+	if(!num_pts || dyn.GetAtomSites().size()==0 || dyn.GetExchangeTerms().size()==0)
+		return true;
+
+	const bool use_goldstone = false;
+	t_real E0 = use_goldstone ? dyn.GetGoldstoneEnergy() : 0.;
+
+	if(cfg.adaptive_Q && cfg.adaptive_E_tol > t_real(0))
+		return calc_dispersion_adaptive(dyn, cfg, results, pool, E0, progress, on_result);
+
+	auto calc_point = [&dyn, &cfg, &results, &on_result, num_pts, E0](t_size i, HamiltonianLine* line)
+	{
+		const t_real frac = num_pts > 1 ? t_real(i)/t_real(num_pts-1) : 0.;
+		const t_vec_real Q = get_dispersion_Q(cfg, frac);
+
+		// each task only writes into its own result slot
+		results[i] = calc_dispersion_point(dyn, cfg, Q, E0, line, i);
+		if(on_result)
+			on_result(i, results[i]);
+	};
+
+	std::shared_ptr<const HamiltonianPhases> phases = get_hamiltonian_phases(dyn, cfg, num_pts, pool, progress);
+	if(!phases)
+	{
+		return pool.ParallelFor(num_pts, [&calc_point](t_size i)
+		{
+			calc_point(i, nullptr);
+		}, progress);
+	}
+
+	// blocks of consecutive points along the path share their phase factors
+	const t_vec_real Q_start = get_dispersion_Q(cfg, 0.);
+	const t_vec_real Q_step = (get_dispersion_Q(cfg, 1.) - Q_start) / t_real(num_pts - 1);
+	const t_size block_size = get_dispersion_block_size(num_pts, pool);
+	const t_size num_items = (num_pts + block_size - 1) / block_size;
+	std::atomic<t_size> num_done = 0;
+
+	return pool.ParallelFor(num_items, [&calc_point, &phases, &Q_start, &Q_step, &num_done, num_pts, block_size](t_size item)
+	{
+		HamiltonianLine line{*phases, Q_start, Q_step};
+		const t_size begin = item * block_size;
+		const t_size end = std::min<t_size>(begin + block_size, num_pts);
+
+		for(t_size i=begin; i<end; ++i)
+			calc_point(i, &line);
+
+		num_done += end - begin;
+	}, [&progress, &num_done, num_pts](t_size, t_size) -> bool
+	{
+		return !progress || progress(num_done, num_pts);
+	});
+}
+
+
+
+/**
+ * save the dispersion branches to a text file
+ */
+bool save_dispersion(const std::string& filename, const std::vector<SofQE>& results)
+{
+	std::ofstream ofstr{filename};
+	if(!ofstr)
+		return false;
+
+	ofstr.precision(g_prec);
+
+	const int field_len = g_prec * 2.5;
+	ofstr
+		<< std::setw(field_len) << std::left << "# h" << " "
+		<< std::setw(field_len) << std::left << "k" << " "
+		<< std::setw(field_len) << std::left << "l" << " "
+		<< std::setw(field_len) << std::left << "E" << " "
+		<< std::setw(field_len) << std::left << "w" << " "
+		<< std::setw(field_len) << std::left << "w_SF1" << " "
+		<< std::setw(field_len) << std::left << "w_SF2" << " "
+		<< std::setw(field_len) << std::left << "w_NSF" << "\n";
+
+	for(const SofQE& result : results)
+	{
+		for(std::size_t branch=0; branch<result.E.size(); ++branch)
+		{
+			ofstr
+				<< std::setw(field_len) << std::left << result.h << " "
+				<< std::setw(field_len) << std::left << result.k << " "
+				<< std::setw(field_len) << std::left << result.l << " "
+				<< std::setw(field_len) << std::left << result.E[branch] << " "
+				<< std::setw(field_len) << std::left << result.S[branch] << " "
+				<< std::setw(field_len) << std::left << result.S_channel[0][branch] << " "
+				<< std::setw(field_len) << std::left << result.S_channel[1][branch] << " "
+				<< std::setw(field_len) << std::left << result.S_channel[2][branch] << "\n";
+		}
+	}
+
+	ofstr.flush();
+	return true;
+}
+
+
+
+/**
+ * lengths of the multi-segment path's segments in 1/A
+ */
+std::vector<t_real> get_dispersion_path_lengths(const MagDynConfig& cfg)
+{
+	const t_mat_real B = tl2::B_matrix<t_mat_real>(
+		cfg.xtal_lattice[0], cfg.xtal_lattice[1], cfg.xtal_lattice[2],
+		cfg.xtal_angles[0]/180.*tl2::pi<t_real>,
+		cfg.xtal_angles[1]/180.*tl2::pi<t_real>,
+		cfg.xtal_angles[2]/180.*tl2::pi<t_real>);
+
+	std::vector<t_real> lengths;
+	lengths.reserve(cfg.Q_path.size());
+
+	for(const DispersionSegment& segment : cfg.Q_path)
+	{
+		const t_vec_real dQ = tl2::create<t_vec_real>(
+		{
+			segment.Q_end[0] - segment.Q_start[0],
+			segment.Q_end[1] - segment.Q_start[1],
+			segment.Q_end[2] - segment.Q_start[2],
+		});
+
+		t_real len = tl2::norm<t_vec_real>(B * dQ);
+		if(!std::isfinite(len))
+			len = 0.;
+		lengths.push_back(len);
+	}
+
+	return lengths;
+}
+
+
+
+/**
+ * distribute the dispersion points among the path's segments
+ * according to their lengths, every segment gets at least its end points
+ */
+std::vector<t_size> get_dispersion_path_points(const MagDynConfig& cfg)
+{
+	const std::vector<t_real> lengths = get_dispersion_path_lengths(cfg);
+	const t_real total_len = std::accumulate(lengths.begin(), lengths.end(), t_real(0));
+
+	std::vector<t_size> num_pts;
+	num_pts.reserve(lengths.size());
+
+	for(t_real len : lengths)
+	{
+		t_size num = 2;
+		if(total_len > g_eps)
+			num = std::max(num, t_size(std::round(len / total_len * t_real(cfg.num_Q_points))));
+		else if(lengths.size())
+			num = std::max(num, cfg.num_Q_points / lengths.size());
+
+		num_pts.push_back(num);
+	}
+
+	return num_pts;
+}
+
+
+
+/**
+ * does the segment start where the previous one ends?
+ */
+static bool is_dispersion_path_contiguous(const MagDynConfig& cfg, std::size_t seg_idx)
+{
+	if(seg_idx == 0 || seg_idx >= cfg.Q_path.size())
+		return false;
+
+	const DispersionSegment& prev_segment = cfg.Q_path[seg_idx - 1];
+	const DispersionSegment& segment = cfg.Q_path[seg_idx];
+
+	for(int i=0; i<3; ++i)
+	{
+		if(!tl2::equals<t_real>(prev_segment.Q_end[i], segment.Q_start[i], g_eps))
+			return false;
+	}
+
+	return true;
+}
+
+
+
+/**
+ * total number of calculated points along the path,
+ * the shared vertex of contiguous segments is only counted once
+ */
+t_size get_dispersion_path_num_points(const MagDynConfig& cfg)
+{
+	const std::vector<t_size> num_pts = get_dispersion_path_points(cfg);
+
+	t_size num = 0;
+	for(t_size seg_idx=0; seg_idx<num_pts.size(); ++seg_idx)
+		num += num_pts[seg_idx] - (is_dispersion_path_contiguous(cfg, seg_idx) ? 1 : 0);
+
+	return num;
+}
+
+
+
+/**
+ * get a label for a path vertex
+ */
+static std::string get_dispersion_path_label(const t_real* Q)
+{
+	std::ostringstream ostr;
+	ostr.precision(4);
+	ostr << "(" << Q[0] << " " << Q[1] << " " << Q[2] << ")";
+	return ostr.str();
+}
+
+
+
+/**
+ * get the path positions and labels of the vertices between the segments,
+ * non-contiguous segments get a combined label
+ */
+std::vector<t_path_tick> get_dispersion_path_ticks(const MagDynConfig& cfg)
+{
+	const std::vector<t_real> lengths = get_dispersion_path_lengths(cfg);
+
+	std::vector<t_path_tick> ticks;
+	ticks.reserve(cfg.Q_path.size() + 1);
+
+	t_real pos = 0.;
+	for(std::size_t seg_idx=0; seg_idx<cfg.Q_path.size(); ++seg_idx)
+	{
+		const DispersionSegment& segment = cfg.Q_path[seg_idx];
+		std::string label = get_dispersion_path_label(segment.Q_start);
+
+		if(seg_idx > 0 && !is_dispersion_path_contiguous(cfg, seg_idx))
+			label = get_dispersion_path_label(cfg.Q_path[seg_idx - 1].Q_end) + "|" + label;
+
+		ticks.emplace_back(pos, label);
+		pos += lengths[seg_idx];
+	}
+
+	if(cfg.Q_path.size())
+		ticks.emplace_back(pos, get_dispersion_path_label(cfg.Q_path.back().Q_end));
+
+	return ticks;
+}
+
+
+
+/**
+ * calculate the dispersion branches along all segments of the multi-segment path,
+ * the points of all segments are distributed over the thread pool in one job,
+ * the results are ordered by their position along the path,
+ * a vertex shared by contiguous segments is only calculated for the first of them
+ */
+bool calc_dispersion_path(const t_magdyn& dyn, const MagDynConfig& cfg,
+	std::vector<SofQE>& results, CalcThreadPool& pool,
+	const t_calc_progress& progress, const t_calc_result& on_result)
+{
+	const std::vector<t_real> lengths = get_dispersion_path_lengths(cfg);
+	const std::vector<t_size> num_pts = get_dispersion_path_points(cfg);
+
+	// the segment and path position of each point
+	struct PathPoint
+	{
+		t_size segment{};
+		t_real frac{};
+		t_real pos{};
+	};
+
+	std::vector<PathPoint> points;
+	points.reserve(get_dispersion_path_num_points(cfg));
+
+	t_real seg_pos = 0.;
+	for(t_size seg_idx=0; seg_idx<num_pts.size(); ++seg_idx)
+	{
+		const t_size first = is_dispersion_path_contiguous(cfg, seg_idx) ? 1 : 0;
+		for(t_size i=first; i<num_pts[seg_idx]; ++i)
+		{
+			const t_real frac = num_pts[seg_idx] > 1 ? t_real(i)/t_real(num_pts[seg_idx]-1) : 0.;
+			points.emplace_back(PathPoint{ seg_idx, frac, seg_pos + frac*lengths[seg_idx] });
+		}
+
+		seg_pos += lengths[seg_idx];
+	}
+
+	results.clear();
+	results.resize(points.size());
+
+	const bool use_goldstone = false;
+	t_real E0 = use_goldstone ? dyn.GetGoldstoneEnergy() : 0.;
+
+	auto calc_point = [&dyn, &cfg, &results, &points, &on_result, E0](
+		t_size i, HamiltonianLine* line, t_size line_idx)
+	{
+		const PathPoint& point = points[i];
+		const DispersionSegment& segment = cfg.Q_path[point.segment];
+
+		const t_vec_real Q = tl2::create<t_vec_real>(
+		{
+			std::lerp(segment.Q_start[0], segment.Q_end[0], point.frac),
+			std::lerp(segment.Q_start[1], segment.Q_end[1], point.frac),
+			std::lerp(segment.Q_start[2], segment.Q_end[2], point.frac),
+		});
+
+		// each task only writes into its own result slot
+		results[i] = calc_dispersion_point(dyn, cfg, Q, E0, line, line_idx);
+		results[i].path_pos = point.pos;
+		results[i].segment = point.segment;
+
+		if(on_result)
+			on_result(i, results[i]);
+	};
+
+	std::shared_ptr<const HamiltonianPhases> phases = get_hamiltonian_phases(dyn, cfg, points.size(), pool, progress);
+	if(!phases)
+	{
+		return pool.ParallelFor(points.size(), [&calc_point](t_size i)
+		{
+			calc_point(i, nullptr, 0);
+		}, progress);
+	}
+
+	// blocks of consecutive points within a segment share their phase factors
+	struct PathItem
+	{
+		t_size segment{};
+		t_size seg_begin{};   // index the segment's start vertex would have, also if it is skipped
+		t_size begin{}, end{};
+	};
+
+	const t_size block_size = get_dispersion_block_size(points.size(), pool);
+
+	std::vector<PathItem> items;
+	t_size num_points = 0;
+	for(t_size seg_idx=0; seg_idx<num_pts.size(); ++seg_idx)
+	{
+		const t_size first = is_dispersion_path_contiguous(cfg, seg_idx) ? 1 : 0;
+		const t_size seg_begin = num_points - first;
+
+		for(t_size begin=first; begin<num_pts[seg_idx]; begin+=block_size)
+		{
+			const t_size end = std::min<t_size>(begin + block_size, num_pts[seg_idx]);
+			items.emplace_back(PathItem{ seg_idx, seg_begin, seg_begin + begin, seg_begin + end });
+		}
+
+		num_points = seg_begin + num_pts[seg_idx];
+	}
+
+	std::atomic<t_size> num_done = 0;
+
+	return pool.ParallelFor(items.size(), [&calc_point, &phases, &items, &cfg, &num_pts, &num_done](t_size item_idx)
+	{
+		const PathItem& item = items[item_idx];
+		const DispersionSegment& segment = cfg.Q_path[item.segment];
+		const t_size seg_pts = num_pts[item.segment];
+
+		const t_vec_real Q_start = tl2::create<t_vec_real>(
+			{ segment.Q_start[0], segment.Q_start[1], segment.Q_start[2] });
+		const t_vec_real Q_end = tl2::create<t_vec_real>(
+			{ segment.Q_end[0], segment.Q_end[1], segment.Q_end[2] });
+		const t_vec_real Q_step = seg_pts > 1
+			? (Q_end - Q_start) / t_real(seg_pts - 1)
+			: tl2::zero<t_vec_real>(3);
+
+		HamiltonianLine line{*phases, Q_start, Q_step};
+		for(t_size i=item.begin; i<item.end; ++i)
+			calc_point(i, &line, i - item.seg_begin);
+
+		num_done += item.end - item.begin;
+	}, [&progress, &num_done, &points](t_size, t_size) -> bool
+	{
+		return !progress || progress(num_done, points.size());
+	});
+}
+
+
+
+/**
+ * save the dispersion of a multi-segment path, the header lists the segments
+ */
+bool save_dispersion_path(const std::string& filename,
+	const MagDynConfig& cfg, const std::vector<SofQE>& results)
+{
+	std::ofstream ofstr{filename};
+	if(!ofstr)
+		return false;
+
+	ofstr.precision(g_prec);
+
+	// segment vertices
+	for(const auto& [pos, label] : get_dispersion_path_ticks(cfg))
+		ofstr << "# vertex: " << pos << " " << label << "\n";
+
+	const int field_len = g_prec * 2.5;
+	ofstr
+		<< std::setw(field_len) << std::left << "# path" << " "
+		<< std::setw(field_len) << std::left << "segment" << " "
+		<< std::setw(field_len) << std::left << "h" << " "
+		<< std::setw(field_len) << std::left << "k" << " "
+		<< std::setw(field_len) << std::left << "l" << " "
+		<< std::setw(field_len) << std::left << "E" << " "
+		<< std::setw(field_len) << std::left << "w" << " "
+		<< std::setw(field_len) << std::left << "w_SF1" << " "
+		<< std::setw(field_len) << std::left << "w_SF2" << " "
+		<< std::setw(field_len) << std::left << "w_NSF" << "\n";
+
+	for(const SofQE& result : results)
+	{
+		for(std::size_t branch=0; branch<result.E.size(); ++branch)
+		{
+			ofstr
+				<< std::setw(field_len) << std::left << result.path_pos << " "
+				<< std::setw(field_len) << std::left << result.segment << " "
+				<< std::setw(field_len) << std::left << result.h << " "
+				<< std::setw(field_len) << std::left << result.k << " "
+				<< std::setw(field_len) << std::left << result.l << " "
+				<< std::setw(field_len) << std::left << result.E[branch] << " "
+				<< std::setw(field_len) << std::left << result.S[branch] << " "
+				<< std::setw(field_len) << std::left << result.S_channel[0][branch] << " "
+				<< std::setw(field_len) << std::left << result.S_channel[1][branch] << " "
+				<< std::setw(field_len) << std::left << result.S_channel[2][branch] << "\n";
+		}
+	}
+
+	ofstr.flush();
+	return true;
+}
+
+
+
+/**
+ * calculate S(Q, E) at one grid point for the export,
+ * optionally the point line_idx of a line with cached phase factors
+ */
+static SofQE calc_export_point(const t_magdyn& dyn,
+	t_real h, t_real k, t_real l, bool use_weights, bool use_projector,
+	HamiltonianLine* line = nullptr, t_size line_idx = 0)
+{
+	ProfileTimer timer{PROFILE_Q_POINT};
+
+	auto energies_and_correlations = get_energies(dyn,
+		tl2::create<t_vec_real>({ h, k, l }), !use_weights, line, line_idx);
+
+	SofQE result;
+	result.h = h;
+	result.k = k;
+	result.l = l;
+	result.E.reserve(energies_and_correlations.size());
+	result.S.reserve(energies_and_correlations.size());
+
+	for(const auto& E_and_S : energies_and_correlations)
+	{
+		t_real E = E_and_S.E;
+		if(std::isnan(E) || std::isinf(E))
+			continue;
+
+		const t_mat& S = E_and_S.S;
+		t_real weight = E_and_S.weight;
+
+		if(!use_projector)
+			weight = tl2::trace<t_mat>(S).real();
+
+		if(std::isnan(weight) || std::isinf(weight))
+			weight = 0.;
+
+		result.E.push_back(E);
+		result.S.push_back(weight);
+	}
+
+	return result;
+}
+
+
+
+/**
+ * compare the energies and the weights of degenerate modes
+ */
+static bool equal_export_points(const SofQE& result1, const SofQE& result2, t_real eps)
+{
+	if(result1.E.size() != result2.E.size())
+		return false;
+
+	auto equals = [eps](t_real val1, t_real val2) -> bool
+	{
+		return std::abs(val1 - val2) <= eps * std::max<t_real>(1., std::abs(val1));
+	};
+
+	// weights can be distributed differently among degenerate modes
+	t_real S_sum1 = 0., S_sum2 = 0.;
+	for(std::size_t branch=0; branch<result1.E.size(); ++branch)
+	{
+		if(!equals(result1.E[branch], result2.E[branch]))
+			return false;
+
+		S_sum1 += result1.S[branch];
+		S_sum2 += result2.S[branch];
+
+		const bool last_degenerate = branch + 1 == result1.E.size() ||
+			!equals(result1.E[branch], result1.E[branch + 1]);
+		if(last_degenerate)
+		{
+			if(!equals(S_sum1, S_sum2))
+				return false;
+			S_sum1 = S_sum2 = 0.;
+		}
+	}
+
+	return true;
+}
+
+
+
+/**
+ * get the point operations of the space group, which leave S(Q, E) invariant,
+ * as matrices acting on Q in rlu, the identity is not included;
+ * the magnetic structure, the field and the interactions usually break some of
+ * the crystal's symmetries, so every operation is checked at some generic Q points;
+ * as this is a numerical test at a finite number of points, it cannot prove an
+ * operation, which is why the symmetry-reduced export has to be enabled explicitly
+ */
+std::vector<t_mat_real> get_Q_symmetries(const t_magdyn& dyn, const MagDynConfig& cfg)
+{
+	// the transposed rotational parts of the real-space operations act on Q
+	std::vector<t_mat_real> candidates;
+	auto add_candidate = [&candidates](const t_mat_real& op)
+	{
+		if(tl2::equals<t_mat_real>(op, tl2::unit<t_mat_real>(3), g_eps))
+			return;
+		for(const t_mat_real& candidate : candidates)
+		{
+			if(tl2::equals<t_mat_real>(op, candidate, g_eps))
+				return;
+		}
+		candidates.push_back(op);
+	};
+
+	for(const t_mat_real& sg_op : cfg.sg_ops)
+	{
+		t_mat_real op = tl2::submat<t_mat_real>(sg_op, 0,0, 3,3);
+		op = tl2::trans(op);
+
+		add_candidate(op);
+		if(cfg.export_time_reversal)
+			add_candidate(-op);
+	}
+
+	if(cfg.sg_ops.size() == 0 && cfg.export_time_reversal)
+		add_candidate(-tl2::unit<t_mat_real>(3));
+
+	// generic points in the export range, reproducibly chosen
+	std::mt19937 rng{0x5ea5};
+	std::uniform_real_distribution<t_real> frac{0., 1.};
+
+	std::vector<t_vec_real> Qs;
+	std::vector<SofQE> results;
+	for(int Q_idx=0; Q_idx<EXPORT_SYMMETRY_CHECKS; ++Q_idx)
+	{
+		t_vec_real Q = tl2::create<t_vec_real>({
+			std::lerp(cfg.export_start[0], cfg.export_end[0], frac(rng)),
+			std::lerp(cfg.export_start[1], cfg.export_end[1], frac(rng)),
+			std::lerp(cfg.export_start[2], cfg.export_end[2], frac(rng)) });
+
+		results.emplace_back(calc_export_point(dyn, Q[0], Q[1], Q[2],
+			cfg.use_weights, cfg.use_projector));
+		Qs.emplace_back(std::move(Q));
+	}
+
+	// an operation is only accepted if it reproduces all points to the calculation precision
+	std::vector<t_mat_real> ops;
+	for(const t_mat_real& op : candidates)
+	{
+		bool invariant = true;
+		for(std::size_t Q_idx=0; Q_idx<Qs.size() && invariant; ++Q_idx)
+		{
+			const t_vec_real Q = op * Qs[Q_idx];
+			invariant = equal_export_points(results[Q_idx],
+				calc_export_point(dyn, Q[0], Q[1], Q[2],
+					cfg.use_weights, cfg.use_projector),
+				g_eps);
+		}
+
+		if(invariant)
+			ops.push_back(op);
+	}
+
+	return ops;
+}
+
+
+
+/**
+ * maps grid points to the points of their symmetry orbits to take the results from,
+ * these are the lowest grid indices of the orbits within the grid,
+ * they are determined per point, so that no full-grid table is needed
+ */
+class ExportRepresentatives
+{
+public:
+	ExportRepresentatives(const MagDynConfig& cfg, std::vector<t_mat_real>&& ops)
+		: m_cfg{cfg}, m_ops{std::move(ops)}
+	{
+		for(int i=0; i<3; ++i)
+		{
+			m_num_pts[i] = cfg.export_num_points[i];
+			m_Qstep[i] = (cfg.export_end[i] - cfg.export_start[i]) / t_real(m_num_pts[i]);
+		}
+	}
+
+
+	/**
+	 * Q position of a grid point
+	 */
+	t_vec_real GetQ(t_size pt_idx) const
+	{
+		return tl2::create<t_vec_real>({
+			m_cfg.export_start[0] + m_Qstep[0]*t_real(pt_idx / (m_num_pts[1]*m_num_pts[2])),
+			m_cfg.export_start[1] + m_Qstep[1]*t_real((pt_idx / m_num_pts[2]) % m_num_pts[1]),
+			m_cfg.export_start[2] + m_Qstep[2]*t_real(pt_idx % m_num_pts[2]) });
+	}
+
+
+	/**
+	 * representative of a grid point, following chains of lower images
+	 * in case the operations are not closed
+	 */
+	t_size GetRepresentative(t_size pt_idx) const
+	{
+		while(true)
+		{
+			const t_size rep = GetLowestImage(pt_idx);
+			if(rep == pt_idx)
+				return rep;
+			pt_idx = rep;
+		}
+	}
+
+
+protected:
+	/**
+	 * grid index of Q, if it is on the grid
+	 */
+	std::optional<t_size> GetGridIndex(const t_vec_real& Q) const
+	{
+		t_size idx[3];
+		for(int i=0; i<3; ++i)
+		{
+			if(m_num_pts[i] == 1 || tl2::equals_0<t_real>(m_Qstep[i], g_eps))
+			{
+				if(!tl2::equals<t_real>(Q[i], m_cfg.export_start[i], g_eps))
+					return std::nullopt;
+				idx[i] = 0;
+				continue;
+			}
+
+			const t_real pos = (Q[i] - m_cfg.export_start[i]) / m_Qstep[i];
+			const t_real pos_rounded = std::round(pos);
+			if(!tl2::equals<t_real>(pos, pos_rounded, 1e-6) ||
+				pos_rounded < t_real(0) || pos_rounded >= t_real(m_num_pts[i]))
+				return std::nullopt;
+			idx[i] = t_size(pos_rounded);
+		}
+
+		return (idx[0]*m_num_pts[1] + idx[1])*m_num_pts[2] + idx[2];
+	}
+
+
+	/**
+	 * lowest grid index among the point and its images
+	 */
+	t_size GetLowestImage(t_size pt_idx) const
+	{
+		const t_vec_real Q = GetQ(pt_idx);
+
+		t_size rep = pt_idx;
+		for(const t_mat_real& op : m_ops)
+		{
+			if(auto image = GetGridIndex(op * Q); image && *image < rep)
+				rep = *image;
+		}
+
+		return rep;
+	}
+
+
+private:
+	const MagDynConfig& m_cfg;
+	std::vector<t_mat_real> m_ops{};
+	t_size m_num_pts[3]{};
+	t_real m_Qstep[3]{};
+};
+
+
+
+/**
+ * bounded cache of the results at representative grid points,
+ * the oldest entries are dropped first and have to be recalculated if needed again
+ */
+class ExportResultCache
+{
+public:
+	explicit ExportResultCache(t_size max_points) : m_max_points{std::max<t_size>(max_points, 1)}
+	{}
+
+
+	std::optional<SofQE> Get(t_size pt_idx) const
+	{
+		std::lock_guard lock{m_mtx};
+
+		auto iter = m_results.find(pt_idx);
+		if(iter == m_results.end())
+			return std::nullopt;
+		return iter->second;
+	}
+
+
+	void Insert(t_size pt_idx, const SofQE& result)
+	{
+		std::lock_guard lock{m_mtx};
+
+		if(!m_results.emplace(pt_idx, result).second)
+			return;
+		m_order.push_back(pt_idx);
+
+		while(m_order.size() > m_max_points)
+		{
+			m_results.erase(m_order.front());
+			m_order.pop_front();
+		}
+	}
+
+
+private:
+	t_size m_max_points{};
+	std::unordered_map<t_size, SofQE> m_results{};
+	std::deque<t_size> m_order{};   // insertion order
+	mutable std::mutex m_mtx{};
+};
+
+
+
+/**
+ * range [begin, end) of h indices covered by the configured export shard
+ */
+std::pair<t_size, t_size> get_export_shard_range(const MagDynConfig& cfg)
+{
+	const t_size num_pts_h = cfg.export_num_points[0];
+
+	if(cfg.export_num_shards == 0 || cfg.export_shard >= cfg.export_num_shards)
+		throw std::runtime_error("Invalid export shard index.");
+	if(cfg.export_num_shards > num_pts_h)
+		throw std::runtime_error("More export shards than grid points along h.");
+
+	return std::make_pair(
+		cfg.export_shard * num_pts_h / cfg.export_num_shards,
+		(cfg.export_shard + 1) * num_pts_h / cfg.export_num_shards);
+}
+
+
+
+/**
+ * write the header of a Takin grid file,
+ * the offset of the index block is filled in by write_export_grid_index
+ */
+static void write_export_grid_header(std::ostream& ostr,
+	const t_real* Qstart, const t_real* Qend, const t_real* Qstep)
+{
+	std::uint64_t dummy = 0;  // to be filled by index block index
+	ostr.write(reinterpret_cast<const char*>(&dummy), sizeof(dummy));
+
+	for(int i = 0; i<3; ++i)
+	{
+		ostr.write(reinterpret_cast<const char*>(&Qstart[i]), sizeof(Qstart[i]));
+		ostr.write(reinterpret_cast<const char*>(&Qend[i]), sizeof(Qend[i]));
+		ostr.write(reinterpret_cast<const char*>(&Qstep[i]), sizeof(Qstep[i]));
+	}
+
+	ostr << "Takin/Magdyn Grid File Version 2 (doi: https://doi.org/10.5281/zenodo.4117437).";
+}
+
+
+
+/**
+ * append the index block collected in the index file and record its position
+ */
+static void write_export_grid_index(std::ostream& ostr, std::FILE* idxfile)
+{
+	std::uint64_t idxblock = ostr.tellp();
+
+	// copy the hkl indices from the temporary file
+	std::rewind(idxfile);
+	std::vector<char> buf(1 << 16);
+	while(std::size_t len = std::fread(buf.data(), 1, buf.size(), idxfile))
+		ostr.write(buf.data(), len);
+
+	// write index into index block
+	ostr.seekp(0, std::ios_base::beg);
+	ostr.write(reinterpret_cast<const char*>(&idxblock), sizeof(idxblock));
+	ostr.flush();
+}
+
+
+
+#ifdef USE_HDF5
+/**
+ * write the meta data and the grid description of an hdf5 export
+ */
+static void write_export_h5_infos(H5::H5File& h5file,
+	const t_real* Qstart, const t_real* Qend, const t_real* Qstep,
+	const t_size* num_points)
+{
+	const char* user = std::getenv("USER");
+	if(!user) user = "";
+	tl2::set_h5_string<std::string>(h5file, "meta_infos/type", "takin_grid");
+	tl2::set_h5_string<std::string>(h5file, "meta_infos/description", "Takin/Magdyn grid format");
+	tl2::set_h5_string<std::string>(h5file, "meta_infos/user", user);
+	tl2::set_h5_string<std::string>(h5file, "meta_infos/date", tl2::epoch_to_str<t_real>(tl2::epoch<t_real>()));
+	tl2::set_h5_string<std::string>(h5file, "meta_infos/url", "https://code.ill.fr/scientific-software/takin");
+	tl2::set_h5_string<std::string>(h5file, "meta_infos/doi", "https://doi.org/10.5281/zenodo.4117437");
+	tl2::set_h5_string<std::string>(h5file, "meta_infos/doi_tlibs", "https://doi.org/10.5281/zenodo.5717779");
+
+	tl2::set_h5_string<std::string>(h5file, "infos/shape", "cuboid");
+	tl2::set_h5_vector(h5file, "infos/Q_start", std::vector<t_real>(Qstart, Qstart + 3));
+	tl2::set_h5_vector(h5file, "infos/Q_end", std::vector<t_real>(Qend, Qend + 3));
+	tl2::set_h5_vector(h5file, "infos/Q_steps", std::vector<t_real>(Qstep, Qstep + 3));
+	tl2::set_h5_vector(h5file, "infos/Q_dimensions", std::vector<std::size_t>(num_points, num_points + 3));
+
+	std::vector<std::string> labels{{"h", "k", "l", "E", "S_perp"}};
+	tl2::set_h5_string_vector(h5file, "infos/labels", labels);
+
+	std::vector<std::string> units{{"rlu", "rlu", "rlu", "meV", "a.u."}};
+	tl2::set_h5_string_vector(h5file, "infos/units", units);
+}
+#endif
+
+
+
+/**
+ * state of an interrupted export, the (h, k) columns
+ * before num_columns have been completely written
+ */
+struct ExportCheckpoint
+{
+	t_size num_columns{};
+	std::uint64_t data_size{};    // size of the grid or text file
+	std::uint64_t index_size{};   // size of the grid file's index file
+	t_size num_branches{};        // branches in the hdf5 file
+};
+
+
+
+/**
+ * files next to the export file, which are kept until the export is finished
+ */
+static std::string get_export_checkpoint_file(const std::string& filename)
+{
+	return filename + ".checkpoint";
+}
+
+static std::string get_export_index_file(const std::string& filename)
+{
+	return filename + ".index";
+}
+
+
+
+/**
+ * save the export checkpoint together with the grid and calculation settings
+ */
+static void save_export_checkpoint(const std::string& filename,
+	const MagDynConfig& cfg, int format, const std::string& model_hash,
+	const ExportCheckpoint& checkpoint)
+{
+	pt::ptree node;
+	node.put<int>("checkpoint.format", format);
+	node.put<std::string>("checkpoint.model_hash", model_hash);
+	node.put<bool>("checkpoint.use_symmetry", cfg.export_use_symmetry);
+	node.put<bool>("checkpoint.time_reversal", cfg.export_time_reversal);
+	node.put<bool>("checkpoint.use_weights", cfg.use_weights);
+	node.put<bool>("checkpoint.use_projector", cfg.use_projector);
+	node.put<bool>("checkpoint.unite_degeneracies", cfg.unite_degeneracies);
+	node.put<bool>("checkpoint.force_incommensurate", cfg.force_incommensurate);
+	for(int i=0; i<3; ++i)
+	{
+		const std::string comp{"hkl"[i]};
+		node.put<t_real>("checkpoint.start_" + comp, cfg.export_start[i]);
+		node.put<t_real>("checkpoint.end_" + comp, cfg.export_end[i]);
+		node.put<t_size>("checkpoint.num_points_" + std::to_string(i+1), cfg.export_num_points[i]);
+	}
+	node.put<t_size>("checkpoint.shard", cfg.export_shard);
+	node.put<t_size>("checkpoint.num_shards", cfg.export_num_shards);
+	node.put<t_size>("checkpoint.columns", checkpoint.num_columns);
+	node.put<std::uint64_t>("checkpoint.data_size", checkpoint.data_size);
+	node.put<std::uint64_t>("checkpoint.index_size", checkpoint.index_size);
+	node.put<t_size>("checkpoint.branches", checkpoint.num_branches);
+
+	// replace the previous checkpoint only once the new one is complete
+	const std::string ckptname = get_export_checkpoint_file(filename);
+	{
+		std::ofstream ofstr{ckptname + ".tmp"};
+		if(!ofstr)
+			throw std::runtime_error("Could not write checkpoint file \"" + ckptname + "\".");
+
+		pt::write_xml(ofstr, node,
+			pt::xml_writer_make_settings('\t', 1, std::string{"utf-8"}));
+	}
+	std::filesystem::rename(ckptname + ".tmp", ckptname);
+}
+
+
+
+/**
+ * load the export checkpoint and check if it belongs to the current model and settings
+ */
+static ExportCheckpoint load_export_checkpoint(const std::string& filename,
+	const MagDynConfig& cfg, int format, const std::string& model_hash)
+{
+	const std::string ckptname = get_export_checkpoint_file(filename);
+	std::ifstream ifstr{ckptname};
+	if(!ifstr)
+		throw std::runtime_error("No checkpoint \"" + ckptname + "\" found to resume from.");
+
+	pt::ptree node;
+	pt::read_xml(ifstr, node);
+
+	if(node.get<std::string>("checkpoint.model_hash", "") != model_hash)
+		throw std::runtime_error("The checkpoint belongs to an export of a different magnetic model.");
+
+	bool matches = node.get<int>("checkpoint.format", -1) == format;
+	matches = matches &&
+		node.get_optional<bool>("checkpoint.use_symmetry") == cfg.export_use_symmetry &&
+		node.get_optional<bool>("checkpoint.time_reversal") == cfg.export_time_reversal &&
+		node.get_optional<bool>("checkpoint.use_weights") == cfg.use_weights &&
+		node.get_optional<bool>("checkpoint.use_projector") == cfg.use_projector &&
+		node.get_optional<bool>("checkpoint.unite_degeneracies") == cfg.unite_degeneracies &&
+		node.get_optional<bool>("checkpoint.force_incommensurate") == cfg.force_incommensurate;
+	for(int i=0; i<3; ++i)
+	{
+		const std::string comp{"hkl"[i]};
+		matches = matches &&
+			tl2::equals<t_real>(node.get<t_real>("checkpoint.start_" + comp, 0.), cfg.export_start[i], g_eps) &&
+			tl2::equals<t_real>(node.get<t_real>("checkpoint.end_" + comp, 0.), cfg.export_end[i], g_eps) &&
+			node.get<t_size>("checkpoint.num_points_" + std::to_string(i+1), 0) == cfg.export_num_points[i];
+	}
+	matches = matches &&
+		node.get<t_size>("checkpoint.shard", 0) == cfg.export_shard &&
+		node.get<t_size>("checkpoint.num_shards", 1) == cfg.export_num_shards;
+	if(!matches)
+		throw std::runtime_error("The checkpoint belongs to an export with different settings.");
+
+	ExportCheckpoint checkpoint;
+	checkpoint.num_columns = node.get<t_size>("checkpoint.columns");
+	checkpoint.data_size = node.get<std::uint64_t>("checkpoint.data_size", 0);
+	checkpoint.index_size = node.get<std::uint64_t>("checkpoint.index_size", 0);
+	checkpoint.num_branches = node.get<t_size>("checkpoint.branches", 0);
+
+	const auto [h_begin, h_end] = get_export_shard_range(cfg);
+	if(checkpoint.num_columns > (h_end - h_begin) * cfg.export_num_points[1])
+		throw std::runtime_error("Invalid checkpoint.");
+
+	return checkpoint;
+}
+
+
+
+/**
+ * export S(Q, E) into a grid,
+ * with checkpoints an interrupted export can be resumed at the last recorded column,
+ * a shard only exports a range of h indices, see merge_export_shards
+ */
+bool export_sqe(const t_magdyn& _dyn, const MagDynConfig& cfg,
+	const std::string& filename, int format, CalcThreadPool& pool,
+	const t_calc_progress& progress, bool resume)
+{
+	// throws for an invalid shard before any file is touched
+	const std::pair<t_size, t_size> h_range = get_export_shard_range(cfg);
+
+	const std::string model_hash = get_model_hash(_dyn);
+
+	ExportCheckpoint checkpoint;
+	if(resume)
+		checkpoint = load_export_checkpoint(filename, cfg, format, model_hash);
+	const bool use_checkpoints = cfg.export_checkpoints || resume;
+
+#ifdef USE_HDF5
+	std::unique_ptr<H5::H5File> h5file;
+#endif
+	std::unique_ptr<std::ofstream> ofstr;
+	bool file_opened = false;
+
+	if(format == EXPORT_GRID || format == EXPORT_TEXT)
+	{
+		if(resume)
+		{
+			// discard everything written after the checkpoint
+			if(!std::filesystem::exists(filename) ||
+				std::filesystem::file_size(filename) < checkpoint.data_size)
+				throw std::runtime_error("File \"" + filename + "\" is smaller than its checkpoint.");
+			std::filesystem::resize_file(filename, checkpoint.data_size);
+
+			ofstr = std::make_unique<std::ofstream>(filename,
+				std::ios_base::in | std::ios_base::out);
+			ofstr->seekp(0, std::ios_base::end);
+		}
+		else
+		{
+			ofstr = std::make_unique<std::ofstream>(filename);
+		}
+
+		ofstr->precision(g_prec);
+		file_opened = ofstr->operator bool();
+	}
+
+#ifdef USE_HDF5
+	else if(format == EXPORT_HDF5)
+	{
+		if(resume)
+		{
+			h5file = std::make_unique<H5::H5File>(filename.c_str(), H5F_ACC_RDWR);
+		}
+		else
+		{
+			h5file = std::make_unique<H5::H5File>(filename.c_str(), H5F_ACC_TRUNC);
+			h5file->createGroup("meta_infos");
+			h5file->createGroup("infos");
+			h5file->createGroup("data");
+#ifdef WRITE_HDF5_CHUNKS
+			h5file->createGroup("chunks");
+#endif
+		}
+
+		file_opened = true;
+	}
+#endif
+
+	if(!file_opened)
+		throw std::runtime_error("File \"" + filename + "\" could not be opened.");
+
+	const t_vec_real Qstart = tl2::create<t_vec_real>({
+		cfg.export_start[0],
+		cfg.export_start[1],
+		cfg.export_start[2] });
+	const t_vec_real Qend = tl2::create<t_vec_real>({
+		cfg.export_end[0],
+		cfg.export_end[1],
+		cfg.export_end[2] });
+
+	const t_size num_pts_k = cfg.export_num_points[1];
+	const t_size num_pts_l = cfg.export_num_points[2];
+
+	t_magdyn dyn = _dyn;
+	dyn.SetUniteDegenerateEnergies(cfg.unite_degeneracies);
+	dyn.SetForceIncommensurate(cfg.force_incommensurate);
+	const bool use_weights = cfg.use_weights;
+	const bool use_projector = cfg.use_projector;
+
+	const t_vec_real dir = Qend - Qstart;
+	const t_real inc_h = dir[0] / t_real(cfg.export_num_points[0]);
+	const t_real inc_k = dir[1] / t_real(num_pts_k);
+	const t_real inc_l = dir[2] / t_real(num_pts_l);
+	const t_vec_real Qstep = tl2::create<t_vec_real>({inc_h, inc_k, inc_l});
+
+	// the file of a shard describes its part of the grid with the full grid's step
+	const t_size h_offs = h_range.first;
+	const t_size num_pts_h = h_range.second - h_range.first;
+	const std::size_t first_column = h_offs * num_pts_k;
+	t_vec_real file_start = Qstart, file_end = Qend;
+	file_start[0] = Qstart[0] + inc_h*t_real(h_range.first);
+	if(h_range.second < cfg.export_num_points[0])
+		file_end[0] = Qstart[0] + inc_h*t_real(h_range.second);
+	const t_size file_num_points[] = { num_pts_h, num_pts_k, num_pts_l };
+
+	using t_column = std::deque<SofQE>;
+
+	// the columns along l share their phase factors
+	std::shared_ptr<const HamiltonianPhases> phases;
+	if(!cfg.export_use_symmetry)
+		phases = get_hamiltonian_phases(dyn, cfg, num_pts_h*num_pts_k*num_pts_l, pool, progress);
+
+	// calculation of one (h, k) column along l
+	auto calc_column = [use_weights, use_projector, &dyn, &phases, inc_l, num_pts_l]
+		(t_real h_pos, t_real k_pos, t_real l_pos) -> t_column
+	{
+		t_column ret;
+
+		std::optional<HamiltonianLine> line;
+		if(phases)
+		{
+			line.emplace(*phases,
+				tl2::create<t_vec_real>({ h_pos, k_pos, l_pos }),
+				tl2::create<t_vec_real>({ 0., 0., inc_l }));
+		}
+
+		// iterate last Q dimension
+		for(std::size_t l_idx=0; l_idx<num_pts_l; ++l_idx)
+		{
+			t_real l = l_pos + inc_l*t_real(l_idx);
+			ret.emplace_back(calc_export_point(dyn, h_pos, k_pos, l,
+				use_weights, use_projector, line ? &*line : nullptr, l_idx));
+		}
+
+		return ret;
+	};
+
+	const std::size_t num_columns = num_pts_h * num_pts_k;
+	const std::size_t start_column = resume ? checkpoint.num_columns : 0;
+	const std::size_t num_todo = num_columns - start_column;
+	std::atomic<bool> stop_requested = false;
+
+	// with symmetry, the results of a column are taken from the representatives of its points,
+	// a representative has a lower grid index, so it is usually in the same or a recent column
+	// and still in the bounded cache, otherwise it is calculated again
+	std::optional<ExportRepresentatives> reps;
+	std::optional<ExportResultCache> rep_cache;
+	if(cfg.export_use_symmetry)
+	{
+		reps.emplace(cfg, get_Q_symmetries(dyn, cfg));
+		rep_cache.emplace(EXPORT_SYMMETRY_CACHE_COLUMNS * num_pts_l);
+	}
+
+	// results of one (h, k) column, either calculated or looked up
+	auto get_column = [&](std::size_t column_idx, t_real h_pos, t_real k_pos, t_real l_pos) -> t_column
+	{
+		if(!cfg.export_use_symmetry)
+			return calc_column(h_pos, k_pos, l_pos);
+
+		t_column ret;
+		for(std::size_t l_idx=0; l_idx<num_pts_l; ++l_idx)
+		{
+			const t_size pt_idx = (first_column + column_idx)*num_pts_l + l_idx;
+			const t_size rep_idx = reps->GetRepresentative(pt_idx);
+
+			std::optional<SofQE> result = rep_cache->Get(rep_idx);
+			if(!result)
+			{
+				const t_vec_real Q = reps->GetQ(rep_idx);
+				result = calc_export_point(dyn, Q[0], Q[1], Q[2], use_weights, use_projector);
+				rep_cache->Insert(rep_idx, *result);
+			}
+
+			result->h = h_pos;
+			result->k = k_pos;
+			result->l = l_pos + inc_l*t_real(l_idx);
+			ret.emplace_back(std::move(*result));
+		}
+
+		return ret;
+	};
+
+
+	// the grid file's index block is collected in a temporary file,
+	// which is kept next to the export file if it has to survive an interruption
+	std::unique_ptr<std::FILE, int(*)(std::FILE*)> idxfile{nullptr, std::fclose};
+	if(format == EXPORT_GRID && use_checkpoints)
+	{
+		const std::string idxname = get_export_index_file(filename);
+		if(resume)
+		{
+			if(!std::filesystem::exists(idxname) ||
+				std::filesystem::file_size(idxname) < checkpoint.index_size)
+				throw std::runtime_error("Index file \"" + idxname + "\" is smaller than its checkpoint.");
+			std::filesystem::resize_file(idxname, checkpoint.index_size);
+		}
+
+		idxfile.reset(std::fopen(idxname.c_str(), resume ? "r+b" : "w+b"));
+		if(!idxfile)
+			throw std::runtime_error("Could not open index file \"" + idxname + "\".");
+		std::fseek(idxfile.get(), 0, SEEK_END);
+	}
+	else if(format == EXPORT_GRID)
+	{
+		idxfile.reset(std::tmpfile());
+		if(!idxfile)
+			throw std::runtime_error("Could not create temporary index file.");
+	}
+
+	if(format == EXPORT_GRID && !resume)  // Takin grid format
+		write_export_grid_header(*ofstr, file_start.data(), file_end.data(), Qstep.data());
+
+#ifdef USE_HDF5
+	std::unique_ptr<SQEH5Writer> h5writer;
+	if(format == EXPORT_HDF5 && resume)
+	{
+		h5writer = std::make_unique<SQEH5Writer>(*h5file, "data",
+			num_pts_h, num_pts_k, num_pts_l,
+			start_column / num_pts_k, checkpoint.num_branches);
+	}
+	else if(format == EXPORT_HDF5)
+	{
+		h5writer = std::make_unique<SQEH5Writer>(*h5file, "data",
+			num_pts_h, num_pts_k, num_pts_l, cfg.export_compression);
+	}
+#endif
+
+	// flush the output and record the completed columns
+	auto write_checkpoint = [&](std::size_t columns_done)
+	{
+		ExportCheckpoint new_checkpoint;
+		new_checkpoint.num_columns = columns_done;
+
+		if(ofstr)
+		{
+			ofstr->flush();
+			new_checkpoint.data_size = ofstr->tellp();
+		}
+		if(idxfile)
+		{
+			std::fflush(idxfile.get());
+			new_checkpoint.index_size = std::ftell(idxfile.get());
+		}
+#ifdef USE_HDF5
+		// the flush writes the data and the metadata written so far, but without
+		// swmr mode, a crash while hdf5 updates its metadata may still corrupt the file
+		if(h5writer)
+		{
+			h5writer->Flush();
+			h5file->flush(H5F_SCOPE_GLOBAL);
+			new_checkpoint.num_branches = h5writer->GetNumBranches();
+		}
+#endif
+
+		save_export_checkpoint(filename, cfg, format, model_hash, new_checkpoint);
+	};
+
+	// hdf5 files can only be continued after complete (k, l) planes
+	auto can_checkpoint = [format, num_pts_k](std::size_t columns_done) -> bool
+	{
+		return format != EXPORT_HDF5 || columns_done % num_pts_k == 0;
+	};
+
+	const auto checkpoint_interval = std::chrono::duration<t_real>(cfg.export_checkpoint_interval);
+	auto last_checkpoint = std::chrono::steady_clock::now();
+	if(use_checkpoints)
+		write_checkpoint(start_column);
+
+	// write the results of one (h, k) column
+	auto write_column = [&](const t_column& results, [[maybe_unused]] std::size_t column_idx)
+	{
+		ProfileTimer timer{PROFILE_EXPORT_WRITE};
+
+		for(std::size_t result_idx=0; result_idx<results.size(); ++result_idx)
+		{
+			const SofQE& result = results[result_idx];
+			const std::size_t num_branches = result.E.size();
+			const auto& energies = result.E;
+			const auto& weights = result.S;
+
+			if(format == EXPORT_GRID)           // Takin grid format
+			{
+				std::uint64_t hklindex = ofstr->tellp();
+				if(std::fwrite(&hklindex, sizeof(hklindex), 1, idxfile.get()) != 1)
+					throw std::runtime_error("Could not write temporary index file.");
+
+				// write number of branches
+				std::uint32_t _num_branches = std::uint32_t(num_branches);
+				ofstr->write(reinterpret_cast<const char*>(&_num_branches), sizeof(_num_branches));
+			}
+			else if(format == EXPORT_TEXT)      // text format
+			{
+				(*ofstr) << "Q = " << result.h << " " << result.k << " " << result.l << ":\n";
+			}
+#ifdef USE_HDF5
+			else if(format == EXPORT_HDF5)  // hdf5 format
+			{
+#ifdef WRITE_HDF5_CHUNKS
+				const std::size_t h_idx = column_idx / num_pts_k;
+				const std::size_t k_idx = column_idx % num_pts_k;
+				const std::size_t l_idx = result_idx;
+
+				std::ostringstream chunk_name;
+				chunk_name << std::hex << h_idx << "_" << k_idx << "_" << l_idx;
+				H5::Group data_group = h5file->openGroup("chunks");
+				data_group.createGroup(chunk_name.str());
+
+				tl2::set_h5_scalar(*h5file, "chunks/" + chunk_name.str() + "/h", result.h);
+				tl2::set_h5_scalar(*h5file, "chunks/" + chunk_name.str() + "/k", result.k);
+				tl2::set_h5_scalar(*h5file, "chunks/" + chunk_name.str() + "/l", result.l);
+
+				tl2::set_h5_vector(*h5file, "chunks/" + chunk_name.str() + "/E", energies);
+				tl2::set_h5_vector(*h5file, "chunks/" + chunk_name.str() + "/S", weights);
+#endif
+
+				h5writer->WritePoint(energies, weights);
+			}
+#endif
+
+			// iterate energies and weights
+			for(std::size_t j=0; j<num_branches; ++j)
+			{
+				t_real energy = energies[j];
+				t_real weight = weights[j];
+
+				if(format == EXPORT_GRID)       // Takin grid format
+				{
+					// write energies and weights
+					ofstr->write(reinterpret_cast<const char*>(&energy), sizeof(energy));
+					ofstr->write(reinterpret_cast<const char*>(&weight), sizeof(weight));
+				}
+				else if(format == EXPORT_TEXT)  // text format
+				{
+					(*ofstr)
+						<< "\tE = " << energy
+						<< ", S = " << weight
+						<< std::endl;
+				}
+			}
+		}
+	};
+
+
+	// ring of result slots shared between the calculation and the writer threads
+	struct ResultSlot
+	{
+		t_column results{};
+		bool ready = false;
+	};
+
+	const std::size_t num_slots = std::max<std::size_t>(4 * pool.GetNumThreads(), 1);
+	std::vector<ResultSlot> slots(num_slots);
+
+	std::mutex slots_mtx;
+	std::condition_variable slot_ready, slot_free;
+	std::size_t columns_written = start_column;
+	std::exception_ptr writer_error{};
+
+	auto request_stop = [&slots_mtx, &slot_ready, &slot_free, &stop_requested]()
+	{
+		{
+			std::lock_guard lock{slots_mtx};
+			stop_requested = true;
+		}
+		slot_ready.notify_all();
+		slot_free.notify_all();
+	};
+
+	// writer thread, drains the slots in (h, k) order
+	std::thread writer_thread([&]()
+	{
+		try
+		{
+			for(std::size_t column_idx=start_column; column_idx<num_columns; ++column_idx)
+			{
+				ResultSlot& slot = slots[column_idx % num_slots];
+				t_column results;
+
+				{
+					std::unique_lock lock{slots_mtx};
+					slot_ready.wait(lock, [&slot, &stop_requested]()
+					{
+						return slot.ready || stop_requested;
+					});
+					if(!slot.ready)
+						break;
+
+					results = std::move(slot.results);
+					slot.results.clear();
+				}
+
+				write_column(results, column_idx);
+
+				{
+					// only release the slot after writing to bound the memory use
+					std::lock_guard lock{slots_mtx};
+					slot.ready = false;
+					++columns_written;
+				}
+				slot_free.notify_all();
+
+				if(use_checkpoints && can_checkpoint(column_idx + 1) &&
+					std::chrono::steady_clock::now() - last_checkpoint >= checkpoint_interval)
+				{
+					write_checkpoint(column_idx + 1);
+					last_checkpoint = std::chrono::steady_clock::now();
+				}
+			}
+		}
+		catch(...)
+		{
+			writer_error = std::current_exception();
+			request_stop();
+		}
+	});
+
+	// stop and join the writer on every exit path
+	struct WriterGuard
+	{
+		std::thread& thread;
+		const decltype(request_stop)& stop;
+
+		~WriterGuard()
+		{
+			if(thread.joinable())
+			{
+				stop();
+				thread.join();
+			}
+		}
+	} writer_guard{writer_thread, request_stop};
+
+	// calculate the missing (h, k) columns
+	bool kernel_failed = false;
+	try
+	{
+		pool.ParallelFor(num_todo, [&](t_size todo_idx)
+		{
+			const std::size_t column_idx = start_column + todo_idx;
+
+			// block until the column's slot is free
+			{
+				std::unique_lock lock{slots_mtx};
+				slot_free.wait(lock, [&]()
+				{
+					return column_idx < columns_written + num_slots || stop_requested;
+				});
+			}
+			if(stop_requested)
+				return;
+
+			const std::size_t h_idx = h_offs + column_idx / num_pts_k;
+			const std::size_t k_idx = column_idx % num_pts_k;
+
+			t_vec_real Q = Qstart;
+			Q[0] += inc_h*t_real(h_idx);
+			Q[1] += inc_k*t_real(k_idx);
+
+			t_column results = get_column(column_idx, Q[0], Q[1], Q[2]);
+
+			{
+				std::lock_guard lock{slots_mtx};
+				ResultSlot& slot = slots[column_idx % num_slots];
+				slot.results = std::move(results);
+				slot.ready = true;
+			}
+			slot_ready.notify_all();
+		}, [&](t_size done, t_size total) -> bool
+		{
+			if(stop_requested)
+				return false;
+			if(progress && !progress(done, total))
+			{
+				request_stop();
+				return false;
+			}
+			return true;
+		}, 1);
+	}
+	catch(const std::exception& ex)
+	{
+		// a failed calculation stops the export, the written columns are kept
+		std::cerr << "Error: Export calculation failed: " << ex.what() << std::endl;
+		kernel_failed = true;
+		request_stop();
+	}
+
+	// wait for the writer to finish
+	writer_thread.join();
+
+	if(writer_error)
+		std::rethrow_exception(writer_error);
+
+	// keep the partial files for resuming
+	if(stop_requested && use_checkpoints)
+	{
+		if(can_checkpoint(columns_written))
+			write_checkpoint(columns_written);
+		return false;
+	}
+
+	if(kernel_failed)
+		return false;
+
+	if(format == EXPORT_GRID)  // Takin grid format
+	{
+		write_export_grid_index(*ofstr, idxfile.get());
+	}
+#ifdef USE_HDF5
+	else if(format == EXPORT_HDF5)
+	{
+		write_export_h5_infos(*h5file, file_start.data(), file_end.data(),
+			Qstep.data(), file_num_points);
+
+		h5writer->Flush();
+		h5writer.reset();
+		h5file->close();
+	}
+#endif
+
+	// the export is complete, the checkpoint is not needed anymore
+	if(use_checkpoints && !stop_requested)
+	{
+		idxfile.reset();
+		std::filesystem::remove(get_export_index_file(filename));
+		std::filesystem::remove(get_export_checkpoint_file(filename));
+	}
+
+	if(!stop_requested && progress)
+		progress(num_todo, num_todo);
+	return !stop_requested;
+}
+
+
+
+/**
+ * part of a sharded grid export
+ */
+struct ExportShard
+{
+	std::string filename{};
+	t_size file_idx{};      // position in the given list of shard files
+	t_real start[3]{}, end[3]{}, step[3]{};
+	t_size num_points[3]{};
+};
+
+
+
+/**
+ * sort the shards along h and check that they are adjacent parts of the same grid
+ */
+static void sort_export_shards(std::vector<ExportShard>& shards)
+{
+	if(shards.size() == 0)
+		throw std::runtime_error("No shards to merge.");
+
+	const ExportShard& ref = shards[0];
+	if(!tl2::equals<t_real>(ref.step[0], 0., g_eps))
+	{
+		std::stable_sort(shards.begin(), shards.end(),
+			[&ref](const ExportShard& shard1, const ExportShard& shard2) -> bool
+		{
+			return (shard1.start[0] - ref.start[0]) / ref.step[0] <
+				(shard2.start[0] - ref.start[0]) / ref.step[0];
+		});
+	}
+
+	for(std::size_t shard_idx=0; shard_idx<shards.size(); ++shard_idx)
+	{
+		const ExportShard& shard = shards[shard_idx];
+
+		bool matches = tl2::equals<t_real>(shard.step[0], shards[0].step[0], g_eps);
+		for(int i=1; i<3; ++i)
+		{
+			matches = matches &&
+				tl2::equals<t_real>(shard.start[i], shards[0].start[i], g_eps) &&
+				tl2::equals<t_real>(shard.end[i], shards[0].end[i], g_eps) &&
+				tl2::equals<t_real>(shard.step[i], shards[0].step[i], g_eps) &&
+				shard.num_points[i] == shards[0].num_points[i];
+		}
+		if(!matches)
+			throw std::runtime_error("Shard \"" + shard.filename + "\" belongs to a different grid.");
+
+		if(shard_idx > 0 && !tl2::equals<t_real>(shard.start[0], shards[shard_idx - 1].end[0], g_eps))
+		{
+			throw std::runtime_error("Shard \"" + shard.filename +
+				"\" does not continue shard \"" + shards[shard_idx - 1].filename + "\".");
+		}
+	}
+}
+
+
+
+/**
+ * merge the shard files of a grid export into one grid file
+ */
+static bool merge_export_grid_shards(const std::vector<std::string>& shard_files,
+	const std::string& filename)
+{
+	std::vector<std::unique_ptr<GridFile>> grids;
+	std::vector<ExportShard> shards;
+
+	for(const std::string& shard_file : shard_files)
+	{
+		ExportShard shard;
+		shard.filename = shard_file;
+		shard.file_idx = grids.size();
+
+		std::unique_ptr<GridFile> grid = std::make_unique<GridFile>(shard_file);
+		for(int i=0; i<3; ++i)
+		{
+			shard.start[i] = grid->GetStart(i);
+			shard.end[i] = grid->GetEnd(i);
+			shard.step[i] = grid->GetStep(i);
+			shard.num_points[i] = grid->GetNumPoints(i);
+		}
+
+		shards.push_back(shard);
+		grids.emplace_back(std::move(grid));
+	}
+
+	sort_export_shards(shards);
+
+	std::ofstream ofstr(filename, std::ios_base::binary);
+	std::unique_ptr<std::FILE, int(*)(std::FILE*)> idxfile{std::tmpfile(), std::fclose};
+	if(!ofstr)
+		throw std::runtime_error("File \"" + filename + "\" could not be opened.");
+	if(!idxfile)
+		throw std::runtime_error("Could not create temporary index file.");
+
+	t_real start[3], end[3], step[3];
+	for(int i=0; i<3; ++i)
+	{
+		start[i] = shards.front().start[i];
+		end[i] = shards.back().end[i];
+		step[i] = shards.front().step[i];
+	}
+	write_export_grid_header(ofstr, start, end, step);
+
+	for(const ExportShard& shard : shards)
+	{
+		const GridFile& grid = *grids[shard.file_idx];
+
+		// copy the points in (h, k, l) order with their new offsets
+		for(t_size h_idx=0; h_idx<shard.num_points[0]; ++h_idx)
+		for(t_size k_idx=0; k_idx<shard.num_points[1]; ++k_idx)
+		for(t_size l_idx=0; l_idx<shard.num_points[2]; ++l_idx)
+		{
+			GridFile::t_branches branches = grid.GetBranches(h_idx, k_idx, l_idx);
+
+			std::uint64_t hklindex = ofstr.tellp();
+			if(std::fwrite(&hklindex, sizeof(hklindex), 1, idxfile.get()) != 1)
+				throw std::runtime_error("Could not write temporary index file.");
+
+			std::uint32_t num_branches = std::uint32_t(branches.size());
+			ofstr.write(reinterpret_cast<const char*>(&num_branches), sizeof(num_branches));
+			ofstr.write(reinterpret_cast<const char*>(branches.data()),
+				branches.size_bytes());
+		}
+	}
+
+	write_export_grid_index(ofstr, idxfile.get());
+	return ofstr.good();
+}
+
+
+
+#ifdef USE_HDF5
+/**
+ * hdf5 type corresponding to the real type
+ */
+static const H5::PredType& get_real_h5type()
+{
+	if constexpr(std::is_same_v<t_real, float>)
+		return H5::PredType::NATIVE_FLOAT;
+	else
+		return H5::PredType::NATIVE_DOUBLE;
+}
+
+
+
+/**
+ * read a vector of reals from an hdf5 file
+ */
+static std::vector<t_real> read_h5_real_vector(H5::H5File& h5file, const std::string& path)
+{
+	H5::DataSet dset = h5file.openDataSet(path);
+	std::vector<t_real> vec(dset.getSpace().getSimpleExtentNpoints());
+	dset.read(vec.data(), get_real_h5type());
+	return vec;
+}
+
+
+
+/**
+ * read a range of a one-dimensional hdf5 dataset of reals
+ */
+static void read_h5_real_range(H5::DataSet& dset, hsize_t offs, hsize_t num,
+	std::vector<t_real>& vec)
+{
+	vec.resize(num);
+	if(num == 0)
+		return;
+
+	H5::DataSpace mem_space(1, &num);
+	H5::DataSpace file_space = dset.getSpace();
+	if(offs + num > hsize_t(file_space.getSimpleExtentNpoints()))
+		throw std::runtime_error("HDF5 dataset is too small.");
+
+	file_space.selectHyperslab(H5S_SELECT_SET, &num, &offs);
+	dset.read(vec.data(), get_real_h5type(), mem_space, file_space);
+}
+
+
+
+/**
+ * merge the shard files of an hdf5 export into one hdf5 file
+ */
+static bool merge_export_h5_shards(const std::vector<std::string>& shard_files,
+	const std::string& filename, int compression)
+{
+	std::vector<ExportShard> shards;
+
+	for(const std::string& shard_file : shard_files)
+	{
+		ExportShard shard;
+		shard.filename = shard_file;
+
+		H5::H5File h5file(shard_file.c_str(), H5F_ACC_RDONLY);
+		std::vector<t_real> start = read_h5_real_vector(h5file, "infos/Q_start");
+		std::vector<t_real> end = read_h5_real_vector(h5file, "infos/Q_end");
+		std::vector<t_real> step = read_h5_real_vector(h5file, "infos/Q_steps");
+
+		H5::DataSpace point_space = h5file.openDataSet("data/indices").getSpace();
+		hsize_t point_dims[3]{};
+		if(start.size() != 3 || end.size() != 3 || step.size() != 3 ||
+			point_space.getSimpleExtentNdims() != 3)
+			throw std::runtime_error("Shard \"" + shard_file + "\" is not a valid HDF5 grid.");
+		point_space.getSimpleExtentDims(point_dims);
+
+		for(int i=0; i<3; ++i)
+		{
+			shard.start[i] = start[i];
+			shard.end[i] = end[i];
+			shard.step[i] = step[i];
+			shard.num_points[i] = point_dims[i];
+		}
+
+		shards.push_back(shard);
+	}
+
+	sort_export_shards(shards);
+
+	t_real start[3], end[3], step[3];
+	t_size num_points[3];
+	for(int i=0; i<3; ++i)
+	{
+		start[i] = shards.front().start[i];
+		end[i] = shards.back().end[i];
+		step[i] = shards.front().step[i];
+		num_points[i] = shards.front().num_points[i];
+	}
+	num_points[0] = 0;
+	for(const ExportShard& shard : shards)
+		num_points[0] += shard.num_points[0];
+
+	H5::H5File h5file(filename.c_str(), H5F_ACC_TRUNC);
+	h5file.createGroup("meta_infos");
+	h5file.createGroup("infos");
+	h5file.createGroup("data");
+
+	auto h5writer = std::make_unique<SQEH5Writer>(h5file, "data",
+		num_points[0], num_points[1], num_points[2], compression);
+
+	const t_size plane_size = num_points[1] * num_points[2];
+	std::vector<std::uint64_t> plane_indices(plane_size), plane_branches(plane_size);
+	std::vector<t_real> plane_energies, plane_weights;
+	std::vector<t_real> energies, weights;
+
+	for(const ExportShard& shard : shards)
+	{
+		H5::H5File shard_file(shard.filename.c_str(), H5F_ACC_RDONLY);
+		H5::DataSet indices = shard_file.openDataSet("data/indices");
+		H5::DataSet branches = shard_file.openDataSet("data/branches");
+		H5::DataSet shard_energies = shard_file.openDataSet("data/energies");
+		H5::DataSet shard_weights = shard_file.openDataSet("data/weights");
+
+		// copy the shard plane by plane
+		for(t_size h_idx=0; h_idx<shard.num_points[0]; ++h_idx)
+		{
+			hsize_t offs[] = { h_idx, 0, 0 };
+			hsize_t count[] = { 1, num_points[1], num_points[2] };
+			H5::DataSpace mem_space(3, count);
+
+			for(auto [dset, buf] : { std::make_pair(&indices, &plane_indices),
+				std::make_pair(&branches, &plane_branches) })
+			{
+				H5::DataSpace file_space = dset->getSpace();
+				file_space.selectHyperslab(H5S_SELECT_SET, count, offs);
+				dset->read(buf->data(), H5::PredType::NATIVE_UINT64, mem_space, file_space);
+			}
+
+			// branches of the plane
+			std::uint64_t plane_begin = std::numeric_limits<std::uint64_t>::max();
+			std::uint64_t plane_end = 0;
+			for(t_size pt_idx=0; pt_idx<plane_size; ++pt_idx)
+			{
+				plane_begin = std::min(plane_begin, plane_indices[pt_idx]);
+				plane_end = std::max(plane_end, plane_indices[pt_idx] + plane_branches[pt_idx]);
+			}
+			if(plane_end < plane_begin)
+				plane_begin = plane_end;
+
+			read_h5_real_range(shard_energies, plane_begin, plane_end - plane_begin, plane_energies);
+			read_h5_real_range(shard_weights, plane_begin, plane_end - plane_begin, plane_weights);
+
+			for(t_size pt_idx=0; pt_idx<plane_size; ++pt_idx)
+			{
+				const std::uint64_t first = plane_indices[pt_idx] - plane_begin;
+				const std::uint64_t num = plane_branches[pt_idx];
+
+				energies.assign(plane_energies.begin() + first, plane_energies.begin() + first + num);
+				weights.assign(plane_weights.begin() + first, plane_weights.begin() + first + num);
+				h5writer->WritePoint(energies, weights);
+			}
+		}
+	}
+
+	write_export_h5_infos(h5file, start, end, step, num_points);
+
+	h5writer->Flush();
+	h5writer.reset();
+	h5file.close();
+	return true;
+}
+#endif
+
+
+
+/**
+ * merge the shard files written by export_sqe with export_num_shards > 1
+ * into one file of the same format, the shards can be given in any order
+ */
+bool merge_export_shards(const std::vector<std::string>& shard_files,
+	const std::string& filename, int format, int compression)
+{
+	if(format == EXPORT_GRID)
+		return merge_export_grid_shards(shard_files, filename);
+
+#ifdef USE_HDF5
+	if(format == EXPORT_HDF5)
+	{
+		try
+		{
+			return merge_export_h5_shards(shard_files, filename, compression);
+		}
+		catch(const H5::Exception& ex)
+		{
+			throw std::runtime_error("HDF5 error: " + ex.getDetailMsg());
+		}
+	}
+#else
+	(void)compression;
+#endif
+
+	throw std::runtime_error("Only grid and HDF5 shards can be merged.");
+}
@@ -0,0 +1,265 @@
+/**
+ * magnetic dynamics -- calculations without gui
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __MAGDYN_CALC_H__
+#define __MAGDYN_CALC_H__
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <utility>
+
+#include "defs.h"
+#include "pool.h"
+#include "phases.h"
+
+
+
+/**
+ * export file types
+ */
+enum : int
+{
+	EXPORT_HDF5 = 0,
+	EXPORT_GRID = 1,
+	EXPORT_TEXT = 2,
+};
+
+
+
+/**
+ * energy resolution kernels
+ */
+enum : int
+{
+	KERNEL_GAUSSIAN = 0,    // width is the standard deviation
+	KERNEL_LORENTZIAN = 1,  // width is the half width at half maximum
+};
+
+
+
+/**
+ * slice geometries
+ */
+enum : int
+{
+	SLICE_PLANE = 0,  // Q plane spanned by two directions
+	SLICE_PATH = 1,   // dispersion path
+};
+
+
+
+/**
+ * density of states integration methods
+ */
+enum : int
+{
+	DOS_HISTOGRAM = 0,
+	DOS_TETRAHEDRON = 1,
+};
+
+
+
+/**
+ * one segment of a multi-segment dispersion path
+ */
+struct DispersionSegment
+{
+	t_real Q_start[3]{ 0., 0., 0. };
+	t_real Q_end[3]{ 0., 0., 0. };
+};
+
+
+
+/**
+ * calculation settings from the "config" section of a magdyn file
+ */
+struct MagDynConfig
+{
+	// dispersion path
+	t_real Q_start[3]{ -1., 0., 0. };
+	t_real Q_end[3]{ 1., 0., 0. };
+	t_size num_Q_points{ 512 };        // maximum number of points in adaptive mode
+
+	// multi-segment path, e.g. from the saved coordinates
+	std::vector<DispersionSegment> Q_path{};
+
+	// adaptive refinement of the dispersion path
+	bool adaptive_Q{ false };
+	t_real adaptive_E_tol{ 0.01 };      // maximum energy change between neighbouring points
+	t_size adaptive_start_points{ 33 }; // initial uniform points
+
+	// export grid
+	t_real export_start[3]{ -1., -1., -1. };
+	t_real export_end[3]{ 1., 1., 1. };
+	t_size export_num_points[3]{ 128, 128, 128 };
+	int export_compression{ 0 };  // deflate level for hdf5 export, 0: off
+	bool export_use_symmetry{ false };  // only calculate symmetry-inequivalent grid points
+	bool export_time_reversal{ true };  // also use Q -> -Q for the symmetry reduction
+	bool export_checkpoints{ false };   // periodically record the finished columns
+	t_real export_checkpoint_interval{ 300. };  // seconds between checkpoints
+	t_size export_shard{ 0 };           // index of the h range to export
+	t_size export_num_shards{ 1 };      // number of h ranges the grid is split into
+
+	// symmetry operations of the space group
+	std::vector<t_mat_real> sg_ops{};
+
+	// powder average
+	t_real powder_Q_range[2]{ 0.1, 3. };  // |Q| in 1/A
+	t_real powder_E_range[2]{ 0., 10. };  // E in meV
+	t_size powder_num_Q{ 200 };
+	t_size powder_num_E{ 400 };
+	t_size powder_num_dirs{ 512 };        // directions on the sphere per |Q|
+	t_real powder_E_sigma{ 0. };          // gaussian energy resolution, 0: off
+
+	// S(Q, E) slice
+	int slice_mode{ SLICE_PLANE };
+	t_real slice_origin[3]{ 0., 0., 0. };   // plane origin in rlu
+	t_real slice_dir1[3]{ 1., 0., 0. };     // in-plane directions in rlu
+	t_real slice_dir2[3]{ 0., 1., 0. };
+	t_real slice_range1[2]{ -1., 1. };      // coordinates along the directions
+	t_real slice_range2[2]{ -1., 1. };
+	t_size slice_num_points[2]{ 128, 128 }; // the path only uses the first one
+	t_real slice_E_range[2]{ 0., 10. };
+	t_size slice_num_E{ 256 };
+	int slice_kernel{ KERNEL_GAUSSIAN };
+	t_real slice_E_width{ 0.1 };            // energy resolution, 0: off
+	t_real slice_Q_width[2]{ 0., 0. };      // gaussian Q resolution along the axes, 0: off
+
+	// density of states and thermodynamics
+	t_size dos_mesh[3]{ 16, 16, 16 };       // monkhorst-pack mesh
+	bool dos_reduce_inversion{ false };     // only use one of k and -k
+	int dos_method{ DOS_HISTOGRAM };
+	t_real dos_E_range[2]{ 0., 0. };        // automatic if max <= min
+	t_size dos_num_E{ 256 };
+	t_real dos_E_width{ 0. };               // gaussian broadening of the histogram
+	t_real dos_T_range[2]{ 1., 300. };      // temperatures in K
+	t_size dos_num_T{ 300 };
+
+	// fitting of the variables
+	t_real fit_rel_step{ 6e-6 };            // relative step of the central-difference jacobian, ~cbrt(epsilon)
+
+	// crystal lattice
+	t_real xtal_lattice[3]{ 5., 5., 5. };   // a, b, c
+	t_real xtal_angles[3]{ 90., 90., 90. }; // alpha, beta, gamma in degrees
+
+	// options
+	bool use_dmi{ true };
+	bool use_field{ true };
+	bool use_temperature{ true };
+	bool use_weights{ true };
+	bool use_projector{ true };
+	bool unite_degeneracies{ true };
+	bool ignore_annihilation{ false };
+	bool force_incommensurate{ false };
+	bool cache_phases{ false }; // assemble the hamiltonian from cached phase factors along lines
+};
+
+
+
+/**
+ * energies and spectral weights at one Q point
+ */
+struct SofQE
+{
+	t_real h{}, k{}, l{};
+
+	// position along a multi-segment path in 1/A
+	t_real path_pos{};
+	t_size segment{};
+
+	std::vector<t_real> E{};
+	std::vector<t_real> S{};
+
+	// polarisation channels (only filled for the dispersion)
+	std::vector<t_real> S_channel[3]{};
+};
+
+
+
+/**
+ * progress callback, gets the number of finished and total work items
+ * and returns false to request a stop of the calculation
+ */
+using t_calc_progress = std::function<bool(t_size done, t_size total)>;
+
+
+/**
+ * callback for a finished result, gets the result's index,
+ * it is invoked from the calculation threads
+ */
+using t_calc_result = std::function<void(t_size idx, const SofQE& result)>;
+
+
+/**
+ * path position and label of a vertex of a multi-segment path
+ */
+using t_path_tick = std::pair<t_real, std::string>;
+
+
+
+// loading
+extern void load_magdyn(const std::string& filename,
+	t_magdyn& dyn, MagDynConfig& cfg);
+extern void apply_magdyn_config(t_magdyn& dyn, const MagDynConfig& cfg);
+
+// calculations
+extern SofQE calc_dispersion_point(const t_magdyn& dyn,
+	const MagDynConfig& cfg, const t_vec_real& Q, t_real E0 = 0.,
+	HamiltonianLine* line = nullptr, t_size line_idx = 0);
+extern bool calc_dispersion(const t_magdyn& dyn, const MagDynConfig& cfg,
+	std::vector<SofQE>& results, CalcThreadPool& pool,
+	const t_calc_progress& progress = nullptr,
+	const t_calc_result& on_result = nullptr);
+extern bool save_dispersion(const std::string& filename,
+	const std::vector<SofQE>& results);
+extern void add_energy_kernel(t_real* bins, t_size num_E, t_real E_min, t_real dE,
+	t_real E, t_real weight, int kernel = KERNEL_GAUSSIAN, t_real width = 0.);
+
+// multi-segment paths
+extern std::vector<t_real> get_dispersion_path_lengths(const MagDynConfig& cfg);
+extern std::vector<t_size> get_dispersion_path_points(const MagDynConfig& cfg);
+extern t_size get_dispersion_path_num_points(const MagDynConfig& cfg);
+extern std::vector<t_path_tick> get_dispersion_path_ticks(const MagDynConfig& cfg);
+extern bool calc_dispersion_path(const t_magdyn& dyn, const MagDynConfig& cfg,
+	std::vector<SofQE>& results, CalcThreadPool& pool,
+	const t_calc_progress& progress = nullptr,
+	const t_calc_result& on_result = nullptr);
+extern bool save_dispersion_path(const std::string& filename,
+	const MagDynConfig& cfg, const std::vector<SofQE>& results);
+extern bool export_sqe(const t_magdyn& dyn, const MagDynConfig& cfg,
+	const std::string& filename, int format, CalcThreadPool& pool,
+	const t_calc_progress& progress = nullptr, bool resume = false);
+extern std::vector<t_mat_real> get_Q_symmetries(const t_magdyn& dyn,
+	const MagDynConfig& cfg);
+extern std::pair<t_size, t_size> get_export_shard_range(const MagDynConfig& cfg);
+extern bool merge_export_shards(const std::vector<std::string>& shard_files,
+	const std::string& filename, int format, int compression = 0);
+
+
+#endif
@@ -33,6 +33,7 @@
 #include <vector>
 
 #include "tlibs2/libs/maths.h"
+#include "tlibs2/libs/magdyn.h"
 #include "tlibs2/libs/qt/gl.h"
 
 
@@ -53,6 +54,10 @@ using t_vec3_gl = tl2::t_vec3_gl;
 using t_vec_gl = tl2::t_vec_gl;
 using t_mat_gl = tl2::t_mat_gl;
 
+using t_magdyn = tl2_mag::MagDyn<
+	t_mat, t_vec, t_mat_real, t_vec_real,
+	t_cplx, t_real, t_size>;
+
 
 extern t_real g_eps;
 extern int g_prec;
@@ -0,0 +1,609 @@
+/**
+ * magnetic dynamics -- magnon density of states and thermodynamics
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "dos.h"
+
+#include <fstream>
+#include <iomanip>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+extern int g_prec;
+extern t_real g_eps;
+
+
+// mesh points or cubes that are handled in one work item
+#define DOS_ITEMS_PER_BLOCK 64
+
+// boltzmann constant in meV/K
+#define DOS_KB 0.08617333262
+
+
+
+/**
+ * E at the centre of the given bin
+ */
+t_real DosResults::GetE(t_size E_idx) const
+{
+	if(num_E <= 1)
+		return E_range[0];
+	return std::lerp(E_range[0], E_range[1], t_real(E_idx) / t_real(num_E - 1));
+}
+
+
+
+/**
+ * histograms that are handed out to the work items, so that concurrently
+ * running items never write into the same histogram, and that are merged at the end
+ */
+class DosHistograms
+{
+public:
+	DosHistograms(t_size size) : m_size{size}
+	{}
+
+	std::vector<t_real>* Acquire()
+	{
+		std::lock_guard<std::mutex> _lck{m_mtx};
+
+		if(m_available.size() == 0)
+		{
+			m_all.emplace_back(std::make_unique<std::vector<t_real>>(m_size, t_real(0)));
+			return m_all.rbegin()->get();
+		}
+
+		std::vector<t_real>* hist = *m_available.rbegin();
+		m_available.pop_back();
+		return hist;
+	}
+
+	void Release(std::vector<t_real>* hist)
+	{
+		std::lock_guard<std::mutex> _lck{m_mtx};
+		m_available.push_back(hist);
+	}
+
+	std::vector<t_real> Merge() const
+	{
+		std::vector<t_real> merged(m_size, t_real(0));
+		for(const auto& hist : m_all)
+		{
+			for(t_size idx=0; idx<m_size; ++idx)
+				merged[idx] += (*hist)[idx];
+		}
+		return merged;
+	}
+
+
+private:
+	t_size m_size{};
+	std::mutex m_mtx{};
+	std::vector<std::unique_ptr<std::vector<t_real>>> m_all{};
+	std::vector<std::vector<t_real>*> m_available{};
+};
+
+
+
+/**
+ * get the points of a monkhorst-pack mesh in rlu,
+ * optionally only keeping one of each pair k and -k
+ */
+void get_dos_mesh_points(const t_size* dims, bool reduce,
+	DosMesh& mesh, std::vector<t_vec_real>& Qs)
+{
+	for(int i=0; i<3; ++i)
+		mesh.dims[i] = std::max<t_size>(dims[i], 1);
+	mesh.reduced = reduce;
+
+	const t_size num_full = mesh.GetFullSize();
+	mesh.full_to_reduced.resize(num_full);
+	mesh.weights.clear();
+	Qs.clear();
+
+	auto get_coord = [](t_size idx, t_size num) -> t_real
+	{
+		return t_real(2*idx + 1) / t_real(2*num) - t_real(0.5);
+	};
+
+	for(t_size idx=0; idx<num_full; ++idx)
+	{
+		const t_size i = idx / (mesh.dims[1] * mesh.dims[2]);
+		const t_size j = (idx / mesh.dims[2]) % mesh.dims[1];
+		const t_size l = idx % mesh.dims[2];
+
+		// the mesh is symmetric, so -k is also a mesh point
+		const t_size partner = ((mesh.dims[0]-1-i)*mesh.dims[1] +
+			(mesh.dims[1]-1-j))*mesh.dims[2] + (mesh.dims[2]-1-l);
+
+		if(reduce && partner < idx)
+		{
+			const t_size reduced_idx = mesh.full_to_reduced[partner];
+			mesh.full_to_reduced[idx] = reduced_idx;
+			mesh.weights[reduced_idx] += t_real(1);
+			continue;
+		}
+
+		mesh.full_to_reduced[idx] = Qs.size();
+		mesh.weights.push_back(t_real(1));
+		Qs.emplace_back(tl2::create<t_vec_real>({
+			get_coord(i, mesh.dims[0]),
+			get_coord(j, mesh.dims[1]),
+			get_coord(l, mesh.dims[2]) }));
+	}
+
+	for(t_real& weight : mesh.weights)
+		weight /= t_real(num_full);
+}
+
+
+
+/**
+ * diagonalise the hamiltonian on the fine and the coarse k mesh
+ */
+bool calc_dos_meshes(const t_magdyn& _dyn, const MagDynConfig& _cfg,
+	DosMeshes& meshes, CalcThreadPool& pool,
+	const t_calc_progress& progress)
+{
+	if(_dyn.IsIncommensurate())
+		throw std::runtime_error("The density of states needs a commensurate magnetic structure.");
+
+	// all modes are needed individually, but no weights
+	MagDynConfig cfg = _cfg;
+	cfg.use_weights = false;
+	cfg.ignore_annihilation = false;
+
+	t_magdyn dyn = _dyn;
+	dyn.SetUniteDegenerateEnergies(false);
+
+	std::vector<t_vec_real> Qs_fine, Qs_coarse;
+	get_dos_mesh_points(cfg.dos_mesh, cfg.dos_reduce_inversion, meshes.fine, Qs_fine);
+
+	// the coarse mesh has half the density
+	t_size coarse_dims[3];
+	meshes.has_coarse = false;
+	for(int i=0; i<3; ++i)
+	{
+		coarse_dims[i] = std::max<t_size>(meshes.fine.dims[i] / 2, 1);
+		if(coarse_dims[i] != meshes.fine.dims[i])
+			meshes.has_coarse = true;
+	}
+
+	if(meshes.has_coarse)
+		get_dos_mesh_points(coarse_dims, cfg.dos_reduce_inversion, meshes.coarse, Qs_coarse);
+	else
+		meshes.coarse = DosMesh{};
+
+	for(DosMesh* mesh : { &meshes.fine, &meshes.coarse })
+	{
+		mesh->num_sites = dyn.GetAtomSites().size();
+		mesh->energies.clear();
+		mesh->energies.resize(mesh->weights.size());
+	}
+
+	const t_size num_fine = Qs_fine.size();
+	return pool.ParallelFor(num_fine + Qs_coarse.size(),
+		[&dyn, &cfg, &meshes, &Qs_fine, &Qs_coarse, num_fine](t_size idx)
+	{
+		const bool is_fine = idx < num_fine;
+		const t_vec_real& Q = is_fine ? Qs_fine[idx] : Qs_coarse[idx - num_fine];
+		std::vector<t_real>& energies = is_fine
+			? meshes.fine.energies[idx] : meshes.coarse.energies[idx - num_fine];
+
+		// keep one mode per site, i.e. the magnon creation modes, including the
+		// zero modes, so that the modes at all mesh points can be matched by index
+		const SofQE result = calc_dispersion_point(dyn, cfg, Q);
+		energies = result.E;
+		std::sort(energies.begin(), energies.end(), std::greater<t_real>());
+		energies.resize(std::min<t_size>(energies.size(), dyn.GetAtomSites().size()));
+
+		for(t_real& E : energies)
+			E = std::max<t_real>(E, 0.);
+		std::reverse(energies.begin(), energies.end());
+	}, progress);
+}
+
+
+
+/**
+ * number of states below E in a tetrahedron with the sorted corner energies e,
+ * normalised to the tetrahedron's volume
+ */
+static t_real get_tetrahedron_states(const t_real* e, t_real E)
+{
+	if(E <= e[0])
+		return 0.;
+	if(E >= e[3])
+		return 1.;
+
+	if(E < e[1])
+		return std::pow(E - e[0], 3) / ((e[1] - e[0]) * (e[2] - e[0]) * (e[3] - e[0]));
+
+	if(E < e[2])
+	{
+		const t_real e21 = e[1] - e[0], e31 = e[2] - e[0], e41 = e[3] - e[0];
+		const t_real e32 = e[2] - e[1], e42 = e[3] - e[1];
+		const t_real dE = E - e[1];
+
+		return (e21*e21 + t_real(3)*e21*dE + t_real(3)*dE*dE
+			- (e31 + e42) / (e32 * e42) * dE*dE*dE) / (e31 * e41);
+	}
+
+	return t_real(1) - std::pow(e[3] - E, 3) / ((e[3] - e[0]) * (e[3] - e[1]) * (e[3] - e[2]));
+}
+
+
+
+/**
+ * density of states using histograms of the mesh energies
+ */
+static bool calc_dos_histogram(const DosMesh& mesh, const MagDynConfig& cfg,
+	DosResults& results, CalcThreadPool& pool)
+{
+	const t_real dE = (results.E_range[1] - results.E_range[0]) / t_real(results.num_E - 1);
+	const t_size num_points = mesh.weights.size();
+	const t_size num_blocks = (num_points + DOS_ITEMS_PER_BLOCK - 1) / DOS_ITEMS_PER_BLOCK;
+
+	DosHistograms hists{results.num_E};
+
+	if(!pool.ParallelFor(num_blocks, [&mesh, &cfg, &results, &hists, dE, num_points](t_size block)
+	{
+		std::vector<t_real>* hist = hists.Acquire();
+
+		const t_size end = std::min<t_size>((block + 1) * DOS_ITEMS_PER_BLOCK, num_points);
+		for(t_size pt=block * DOS_ITEMS_PER_BLOCK; pt<end; ++pt)
+		{
+			for(t_real E : mesh.energies[pt])
+			{
+				add_energy_kernel(hist->data(), results.num_E, results.E_range[0], dE,
+					E, mesh.weights[pt] / dE, KERNEL_GAUSSIAN, cfg.dos_E_width);
+			}
+		}
+
+		hists.Release(hist);
+	}))
+		return false;
+
+	results.dos = hists.Merge();
+	return true;
+}
+
+
+
+/**
+ * density of states using the linear tetrahedron method, every cube
+ * of the mesh is split into six tetrahedra along its main diagonal
+ */
+static bool calc_dos_tetrahedron(const DosMesh& mesh,
+	DosResults& results, CalcThreadPool& pool)
+{
+	const t_real dE = (results.E_range[1] - results.E_range[0]) / t_real(results.num_E - 1);
+	const t_size num_cubes = mesh.GetFullSize();
+	const t_size num_blocks = (num_cubes + DOS_ITEMS_PER_BLOCK - 1) / DOS_ITEMS_PER_BLOCK;
+
+	// corners of the tetrahedra, bits 0, 1, and 2 of the indices are the cube's x, y, and z offsets
+	static const t_size tetrahedra[6][4] =
+	{
+		{ 0, 1, 3, 7 }, { 0, 1, 5, 7 }, { 0, 2, 3, 7 },
+		{ 0, 2, 6, 7 }, { 0, 4, 5, 7 }, { 0, 4, 6, 7 },
+	};
+
+	// weight of a tetrahedron per meV
+	const t_real tetra_weight = t_real(1) / (t_real(6 * num_cubes) * dE);
+
+	DosHistograms hists{results.num_E};
+
+	if(!pool.ParallelFor(num_blocks, [&mesh, &results, &hists, dE, num_cubes, tetra_weight](t_size block)
+	{
+		std::vector<t_real>* hist = hists.Acquire();
+
+		const t_size end = std::min<t_size>((block + 1) * DOS_ITEMS_PER_BLOCK, num_cubes);
+		for(t_size cube=block * DOS_ITEMS_PER_BLOCK; cube<end; ++cube)
+		{
+			const t_size i = cube / (mesh.dims[1] * mesh.dims[2]);
+			const t_size j = (cube / mesh.dims[2]) % mesh.dims[1];
+			const t_size l = cube % mesh.dims[2];
+
+			// calculated points at the cube's corners, the mesh is periodic
+			const std::vector<t_real>* corners[8];
+			for(t_size corner=0; corner<8; ++corner)
+			{
+				const t_size ci = (i + (corner & 1)) % mesh.dims[0];
+				const t_size cj = (j + ((corner >> 1) & 1)) % mesh.dims[1];
+				const t_size cl = (l + ((corner >> 2) & 1)) % mesh.dims[2];
+
+				corners[corner] = &mesh.energies[mesh.full_to_reduced[
+					(ci*mesh.dims[1] + cj)*mesh.dims[2] + cl]];
+			}
+
+			for(const t_size* tetra : tetrahedra)
+			{
+				// modes are matched by their energy order
+				t_size num_modes = std::numeric_limits<t_size>::max();
+				for(int corner=0; corner<4; ++corner)
+					num_modes = std::min(num_modes, corners[tetra[corner]]->size());
+
+				for(t_size mode=0; mode<num_modes; ++mode)
+				{
+					t_real e[4];
+					for(int corner=0; corner<4; ++corner)
+						e[corner] = (*corners[tetra[corner]])[mode];
+					std::sort(e, e + 4);
+
+					// avoid degenerate corner energies
+					for(int corner=1; corner<4; ++corner)
+						e[corner] = std::max(e[corner], e[corner - 1] + g_eps*1e-3);
+
+					const t_real bin_lo = std::max<t_real>(
+						std::floor((e[0] - results.E_range[0]) / dE), 0.);
+					const t_real bin_hi = std::min<t_real>(
+						std::ceil((e[3] - results.E_range[0]) / dE), t_real(results.num_E - 1));
+
+					for(t_real bin=bin_lo; bin<=bin_hi; bin+=t_real(1))
+					{
+						const t_real bin_E = results.E_range[0] + bin * dE;
+						(*hist)[t_size(bin)] += tetra_weight * (
+							get_tetrahedron_states(e, bin_E + t_real(0.5)*dE) -
+							get_tetrahedron_states(e, bin_E - t_real(0.5)*dE));
+					}
+				}
+			}
+		}
+
+		hists.Release(hist);
+	}))
+		return false;
+
+	results.dos = hists.Merge();
+	return true;
+}
+
+
+
+/**
+ * thermodynamic quantities per unit cell at the temperature T
+ */
+struct DosThermodynamics
+{
+	t_real energy{}, heat{}, entropy{}, free_energy{}, magnons{};
+};
+
+static DosThermodynamics calc_dos_thermodynamics(const DosMesh& mesh, t_real T)
+{
+	DosThermodynamics thermo;
+	if(T <= t_real(0))
+		return thermo;
+
+	const t_real kT = DOS_KB * T;
+
+	for(t_size pt=0; pt<mesh.weights.size(); ++pt)
+	{
+		const t_real weight = mesh.weights[pt];
+
+		for(t_real E : mesh.energies[pt])
+		{
+			// the bose factor diverges for the zero modes
+			if(E <= g_eps)
+				continue;
+
+			const t_real x = E / kT;
+			const t_real exp_x = std::exp(x);
+			if(std::isinf(exp_x))
+				continue;
+
+			const t_real n = t_real(1) / (exp_x - t_real(1));
+
+			thermo.energy += weight * E * n;
+			thermo.heat += weight * x*x * exp_x * n*n;
+			thermo.entropy += weight * ((t_real(1) + n)*std::log1p(n) - n*std::log(n));
+			thermo.free_energy += weight * kT * std::log1p(-t_real(1)/exp_x);
+			thermo.magnons += weight * n;
+		}
+	}
+
+	if(mesh.num_sites)
+		thermo.magnons /= t_real(mesh.num_sites);
+
+	return thermo;
+}
+
+
+
+/**
+ * mean magnon energy on the mesh
+ */
+static t_real get_dos_mean_energy(const DosMesh& mesh)
+{
+	t_real E_sum = 0., num = 0.;
+	for(t_size pt=0; pt<mesh.weights.size(); ++pt)
+	{
+		for(t_real E : mesh.energies[pt])
+		{
+			E_sum += mesh.weights[pt] * E;
+			num += mesh.weights[pt];
+		}
+	}
+
+	return num > t_real(0) ? E_sum / num : t_real(0);
+}
+
+
+
+/**
+ * calculate the density of states and the thermodynamics from the meshes
+ */
+bool calc_dos(const DosMeshes& meshes, const MagDynConfig& cfg,
+	DosResults& results, CalcThreadPool& pool)
+{
+	const DosMesh& mesh = meshes.fine;
+	results = DosResults{};
+
+	// energy range
+	results.num_E = std::max<t_size>(cfg.dos_num_E, 2);
+	results.E_range[0] = cfg.dos_E_range[0];
+	results.E_range[1] = cfg.dos_E_range[1];
+	if(results.E_range[1] <= results.E_range[0])
+	{
+		t_real E_max = 0.;
+		for(const std::vector<t_real>& energies : mesh.energies)
+		{
+			if(energies.size())
+				E_max = std::max(E_max, *energies.rbegin());
+		}
+
+		results.E_range[0] = 0.;
+		results.E_range[1] = E_max > g_eps ? E_max * 1.05 : 1.;
+	}
+
+	// density of states
+	if(cfg.dos_method == DOS_TETRAHEDRON)
+	{
+		if(!calc_dos_tetrahedron(mesh, results, pool))
+			return false;
+	}
+	else
+	{
+		if(!calc_dos_histogram(mesh, cfg, results, pool))
+			return false;
+	}
+
+	// thermodynamics
+	const t_size num_T = std::max<t_size>(cfg.dos_num_T, 1);
+	results.temperatures.resize(num_T);
+	for(t_size T_idx=0; T_idx<num_T; ++T_idx)
+	{
+		results.temperatures[T_idx] = num_T > 1
+			? std::lerp(cfg.dos_T_range[0], cfg.dos_T_range[1], t_real(T_idx) / t_real(num_T - 1))
+			: cfg.dos_T_range[0];
+	}
+
+	for(std::vector<t_real>* vec : { &results.energy, &results.heat,
+		&results.entropy, &results.free_energy, &results.magnons })
+		vec->resize(num_T);
+	std::vector<t_real> coarse_heat(meshes.has_coarse ? num_T : 0);
+
+	if(!pool.ParallelFor(num_T, [&meshes, &results, &coarse_heat](t_size T_idx)
+	{
+		const t_real T = results.temperatures[T_idx];
+		const DosThermodynamics thermo = calc_dos_thermodynamics(meshes.fine, T);
+
+		results.energy[T_idx] = thermo.energy;
+		results.heat[T_idx] = thermo.heat;
+		results.entropy[T_idx] = thermo.entropy;
+		results.free_energy[T_idx] = thermo.free_energy;
+		results.magnons[T_idx] = thermo.magnons;
+
+		if(meshes.has_coarse)
+			coarse_heat[T_idx] = calc_dos_thermodynamics(meshes.coarse, T).heat;
+	}))
+		return false;
+
+	// convergence
+	results.has_convergence = meshes.has_coarse;
+	if(meshes.has_coarse)
+	{
+		for(int i=0; i<3; ++i)
+			results.coarse_dims[i] = meshes.coarse.dims[i];
+
+		const t_real mean_E = get_dos_mean_energy(meshes.fine);
+		const t_real mean_E_coarse = get_dos_mean_energy(meshes.coarse);
+		results.conv_mean_E = mean_E > g_eps
+			? std::abs(mean_E - mean_E_coarse) / mean_E : t_real(0);
+
+		t_real max_heat = 0., max_diff = 0.;
+		for(t_size T_idx=0; T_idx<num_T; ++T_idx)
+		{
+			max_heat = std::max(max_heat, std::abs(results.heat[T_idx]));
+			max_diff = std::max(max_diff, std::abs(results.heat[T_idx] - coarse_heat[T_idx]));
+		}
+		results.conv_heat = max_heat > g_eps ? max_diff / max_heat : t_real(0);
+	}
+
+	return true;
+}
+
+
+
+/**
+ * save the density of states and the thermodynamics
+ */
+bool save_dos(const std::string& filename, const DosResults& results)
+{
+	std::ofstream ofstr{filename};
+	if(!ofstr)
+		return false;
+
+	ofstr.precision(g_prec);
+	const int field_len = g_prec * 2.5;
+
+	if(results.has_convergence)
+	{
+		ofstr << "# relative change compared to the "
+			<< results.coarse_dims[0] << "x" << results.coarse_dims[1] << "x"
+			<< results.coarse_dims[2] << " mesh: "
+			<< "mean energy: " << results.conv_mean_E << ", "
+			<< "specific heat: " << results.conv_heat << "\n";
+	}
+
+	ofstr << "# density of states per unit cell\n";
+	ofstr << "# "
+		<< std::setw(field_len) << std::left << "E (meV)" << " "
+		<< std::setw(field_len) << std::left << "DOS (1/meV)" << "\n";
+	for(t_size E_idx=0; E_idx<results.num_E; ++E_idx)
+	{
+		ofstr
+			<< std::setw(field_len) << std::left << results.GetE(E_idx) << " "
+			<< std::setw(field_len) << std::left << results.dos[E_idx] << "\n";
+	}
+
+	ofstr << "\n\n# thermodynamics per unit cell\n";
+	ofstr << "# "
+		<< std::setw(field_len) << std::left << "T (K)" << " "
+		<< std::setw(field_len) << std::left << "U (meV)" << " "
+		<< std::setw(field_len) << std::left << "C (k_B)" << " "
+		<< std::setw(field_len) << std::left << "S (k_B)" << " "
+		<< std::setw(field_len) << std::left << "F (meV)" << " "
+		<< std::setw(field_len) << std::left << "n (1/site)" << "\n";
+	for(t_size T_idx=0; T_idx<results.temperatures.size(); ++T_idx)
+	{
+		ofstr
+			<< std::setw(field_len) << std::left << results.temperatures[T_idx] << " "
+			<< std::setw(field_len) << std::left << results.energy[T_idx] << " "
+			<< std::setw(field_len) << std::left << results.heat[T_idx] << " "
+			<< std::setw(field_len) << std::left << results.entropy[T_idx] << " "
+			<< std::setw(field_len) << std::left << results.free_energy[T_idx] << " "
+			<< std::setw(field_len) << std::left << results.magnons[T_idx] << "\n";
+	}
+
+	ofstr.flush();
+	return true;
+}
@@ -0,0 +1,117 @@
+/**
+ * magnetic dynamics -- magnon density of states and thermodynamics
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __MAGDYN_DOS_H__
+#define __MAGDYN_DOS_H__
+
+#include <string>
+#include <vector>
+
+#include "defs.h"
+#include "calc.h"
+
+
+
+/**
+ * magnon energies on a monkhorst-pack k mesh
+ */
+struct DosMesh
+{
+	t_size dims[3]{ 1, 1, 1 };
+	bool reduced{ false };            // k and -k are only calculated once
+
+	std::vector<t_size> full_to_reduced{};  // [full mesh index] -> calculated point
+	std::vector<t_real> weights{};          // [calculated point], sum is 1
+	std::vector<std::vector<t_real>> energies{};  // [calculated point][mode], sorted, zero modes clamped to 0
+
+	t_size num_sites{};               // magnetic sites per unit cell
+
+	t_size GetFullSize() const { return dims[0] * dims[1] * dims[2]; }
+};
+
+
+
+/**
+ * meshes for the density of states, the coarse one
+ * has half the density and is used for the convergence check
+ */
+struct DosMeshes
+{
+	DosMesh fine{}, coarse{};
+	bool has_coarse{ false };
+};
+
+
+
+/**
+ * density of states and thermodynamic quantities per magnetic unit cell
+ */
+struct DosResults
+{
+	// density of states in states per meV
+	t_real E_range[2]{};
+	t_size num_E{};
+	std::vector<t_real> dos{};
+
+	// thermodynamics
+	std::vector<t_real> temperatures{};    // K
+	std::vector<t_real> energy{};          // internal energy, meV
+	std::vector<t_real> heat{};            // specific heat, k_B
+	std::vector<t_real> entropy{};         // k_B
+	std::vector<t_real> free_energy{};     // meV
+	std::vector<t_real> magnons{};         // thermal magnons per site
+
+	// convergence: relative changes compared to the coarse mesh
+	bool has_convergence{ false };
+	t_size coarse_dims[3]{};
+	t_real conv_mean_E{};      // mean magnon energy
+	t_real conv_heat{};        // maximum change of the specific heat
+
+	t_real GetE(t_size E_idx) const;
+};
+
+
+
+/**
+ * the meshes are calculated once, the density of states and the thermodynamics
+ * can then be re-evaluated for other ranges without any diagonalisations
+ */
+extern void get_dos_mesh_points(const t_size* dims, bool reduce,
+	DosMesh& mesh, std::vector<t_vec_real>& Qs);
+
+extern bool calc_dos_meshes(const t_magdyn& dyn, const MagDynConfig& cfg,
+	DosMeshes& meshes, CalcThreadPool& pool,
+	const t_calc_progress& progress = nullptr);
+
+extern bool calc_dos(const DosMeshes& meshes, const MagDynConfig& cfg,
+	DosResults& results, CalcThreadPool& pool);
+
+extern bool save_dos(const std::string& filename, const DosResults& results);
+
+
+#endif
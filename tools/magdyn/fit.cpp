@@ -0,0 +1,566 @@
+/**
+ * magnetic dynamics -- fitting of variables to measured dispersion points
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "fit.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+
+extern int g_prec;
+
+
+
+/**
+ * correlation coefficient of two fitted variables
+ */
+t_real FitResults::GetCorrelation(t_size i, t_size j) const
+{
+	const t_real norm = errors[i] * errors[j];
+	if(norm <= t_real(0))
+		return t_real(0);
+	return GetCovariance(i, j) / norm;
+}
+
+
+
+/**
+ * chi^2 per degree of freedom
+ */
+t_real FitResults::GetReducedChi2() const
+{
+	if(ndf == 0)
+		return chi2;
+	return chi2 / t_real(ndf);
+}
+
+
+
+/**
+ * load measured dispersion points from a text file with the
+ * columns h, k, l, E and an optional energy uncertainty
+ */
+std::vector<FitDataPoint> load_fit_data(const std::string& filename)
+{
+	std::ifstream ifstr{filename};
+	if(!ifstr)
+		throw std::runtime_error("Cannot open file \"" + filename + "\".");
+
+	std::vector<FitDataPoint> data;
+	std::string line;
+	t_size line_nr = 0;
+
+	while(std::getline(ifstr, line))
+	{
+		++line_nr;
+
+		// strip comments
+		if(std::size_t comment = line.find('#'); comment != std::string::npos)
+			line.resize(comment);
+
+		std::istringstream istr{line};
+		std::vector<t_real> cols;
+		t_real val{};
+		while(istr >> val)
+			cols.push_back(val);
+
+		if(cols.size() == 0)
+			continue;
+		if(cols.size() < 4)
+		{
+			throw std::runtime_error("Line " + std::to_string(line_nr) +
+				" of \"" + filename + "\" needs at least the columns h, k, l, and E.");
+		}
+
+		FitDataPoint pt;
+		pt.h = cols[0];
+		pt.k = cols[1];
+		pt.l = cols[2];
+		pt.E = cols[3];
+		if(cols.size() >= 5)
+			pt.sigma = cols[4];
+
+		if(pt.sigma <= t_real(0))
+		{
+			throw std::runtime_error("Line " + std::to_string(line_nr) +
+				" of \"" + filename + "\" has a non-positive uncertainty.");
+		}
+
+		data.push_back(pt);
+	}
+
+	return data;
+}
+
+
+
+/**
+ * solve the symmetric positive-definite system A x = b in place using
+ * a cholesky decomposition, A is overwritten by its decomposition
+ * @returns false if A is not positive-definite
+ */
+static bool solve_cholesky(t_size N, std::vector<t_real>& A, std::vector<t_real>& b)
+{
+	// A = L L^T, L is stored in the lower triangle of A
+	for(t_size j=0; j<N; ++j)
+	{
+		t_real diag = A[j*N + j];
+		for(t_size k=0; k<j; ++k)
+			diag -= A[j*N + k] * A[j*N + k];
+		if(diag <= t_real(0) || std::isnan(diag))
+			return false;
+		diag = std::sqrt(diag);
+		A[j*N + j] = diag;
+
+		for(t_size i=j+1; i<N; ++i)
+		{
+			t_real val = A[i*N + j];
+			for(t_size k=0; k<j; ++k)
+				val -= A[i*N + k] * A[j*N + k];
+			A[i*N + j] = val / diag;
+		}
+	}
+
+	// forward substitution, L y = b
+	for(t_size i=0; i<N; ++i)
+	{
+		for(t_size k=0; k<i; ++k)
+			b[i] -= A[i*N + k] * b[k];
+		b[i] /= A[i*N + i];
+	}
+
+	// back substitution, L^T x = y
+	for(t_size i=N; i>0; --i)
+	{
+		for(t_size k=i; k<N; ++k)
+			b[i-1] -= A[k*N + i-1] * b[k];
+		b[i-1] /= A[(i-1)*N + i-1];
+	}
+
+	return true;
+}
+
+
+
+/**
+ * invert the symmetric positive-definite matrix A
+ */
+static bool invert_cholesky(t_size N, const std::vector<t_real>& A, std::vector<t_real>& A_inv)
+{
+	A_inv.assign(N*N, t_real(0));
+
+	for(t_size col=0; col<N; ++col)
+	{
+		std::vector<t_real> decomp = A;
+		std::vector<t_real> unit(N, t_real(0));
+		unit[col] = t_real(1);
+
+		if(!solve_cholesky(N, decomp, unit))
+			return false;
+
+		for(t_size row=0; row<N; ++row)
+			A_inv[row*N + col] = unit[row];
+	}
+
+	return true;
+}
+
+
+
+/**
+ * set the real parts of the fitted variables of a calculator
+ * and recalculate its sites and couplings
+ */
+static void set_fit_variables(t_magdyn& calc,
+	const std::vector<std::string>& names, const std::vector<t_real>& values)
+{
+	std::vector<t_magdyn::Variable> vars = calc.GetVariables();
+
+	for(t_magdyn::Variable& var : vars)
+	{
+		auto iter = std::find(names.begin(), names.end(), var.name);
+		if(iter == names.end())
+			continue;
+
+		var.value = t_cplx{values[iter - names.begin()], var.value.imag()};
+	}
+
+	calc.ClearVariables();
+	for(t_magdyn::Variable& var : vars)
+		calc.AddVariable(std::move(var));
+
+	calc.CalcAtomSites();
+	calc.CalcExchangeTerms();
+}
+
+
+
+/**
+ * normalised residual of a measured point: the deviation
+ * from the nearest calculated branch in units of sigma
+ */
+static t_real get_fit_residual(const t_magdyn& calc,
+	const MagDynConfig& cfg, const FitDataPoint& pt)
+{
+	const t_vec_real Q = tl2::create<t_vec_real>({ pt.h, pt.k, pt.l });
+	const SofQE result = calc_dispersion_point(calc, cfg, Q);
+
+	// without any branch the point is compared to zero energy
+	t_real nearest_E = 0.;
+	t_real min_dist = std::numeric_limits<t_real>::max();
+	for(t_real E : result.E)
+	{
+		if(t_real dist = std::abs(E - pt.E); dist < min_dist)
+		{
+			min_dist = dist;
+			nearest_E = E;
+		}
+	}
+
+	return (nearest_E - pt.E) / pt.sigma;
+}
+
+
+
+/**
+ * fit the real parts of the given variables to the measured dispersion points
+ *
+ * the fit keeps one calculator for the current parameters and two for each
+ * central-difference step of the jacobian, they are reused in every iteration,
+ * all (calculator, data point) pairs are evaluated in one thread pool job
+ *
+ * @returns false if the fit was stopped by the progress callback
+ */
+bool fit_variables(const t_magdyn& dyn, const MagDynConfig& _cfg,
+	const std::vector<FitDataPoint>& data, const std::vector<std::string>& var_names,
+	FitResults& results, CalcThreadPool& pool,
+	const t_calc_progress& progress, t_size max_iterations)
+{
+	const t_size num_params = var_names.size();
+	const t_size num_data = data.size();
+
+	if(num_params == 0)
+		throw std::runtime_error("No fit variables given.");
+	if(num_data < num_params)
+		throw std::runtime_error("The fit needs at least as many data points as variables.");
+
+	// only the energies are needed
+	MagDynConfig cfg = _cfg;
+	cfg.use_weights = false;
+
+	results = FitResults{};
+	results.names = var_names;
+	results.values.resize(num_params);
+	results.ndf = num_data - num_params;
+
+	// start values
+	for(t_size param_idx=0; param_idx<num_params; ++param_idx)
+	{
+		bool found = false;
+		for(const t_magdyn::Variable& var : dyn.GetVariables())
+		{
+			if(var.name == var_names[param_idx])
+			{
+				results.values[param_idx] = var.value.real();
+				found = true;
+				break;
+			}
+		}
+
+		if(!found)
+			throw std::runtime_error("Unknown fit variable \"" + var_names[param_idx] + "\".");
+	}
+
+	// calculator 0 is at the current parameters, calculators 2i+1 and 2i+2
+	// are at the forward and backward steps of parameter i
+	const t_size num_calcs = 2*num_params + 1;
+	std::vector<std::unique_ptr<t_magdyn>> calcs;
+	calcs.reserve(num_calcs);
+	for(t_size calc_idx=0; calc_idx<num_calcs; ++calc_idx)
+		calcs.emplace_back(std::make_unique<t_magdyn>(dyn));
+
+	std::vector<std::vector<t_real>> calc_params(num_calcs);
+	std::vector<t_real> steps(num_params);   // distance between the forward and backward steps
+	std::vector<t_real> residuals(num_calcs * num_data);
+
+	// the truncation error of central differences scales with the step squared,
+	// so the optimal step is ~cbrt(epsilon) instead of ~sqrt(epsilon) for forward differences
+	const t_real rel_step = cfg.fit_rel_step > t_real(0)
+		? cfg.fit_rel_step
+		: std::cbrt(std::numeric_limits<t_real>::epsilon());
+
+	t_size iteration = 0;
+	auto job_progress = [&progress, &iteration, max_iterations](t_size, t_size) -> bool
+	{
+		return !progress || progress(iteration, max_iterations);
+	};
+
+	// evaluate the residuals of the calculators [first_calc, first_calc + num_calcs)
+	auto evaluate = [&](t_size first_calc, t_size num_calcs) -> bool
+	{
+		if(!pool.ParallelFor(num_calcs, [&](t_size idx)
+		{
+			set_fit_variables(*calcs[first_calc + idx], var_names, calc_params[first_calc + idx]);
+		}, job_progress, 1))
+			return false;
+
+		return pool.ParallelFor(num_calcs * num_data, [&](t_size idx)
+		{
+			const t_size calc_idx = first_calc + idx / num_data;
+			const t_size data_idx = idx % num_data;
+
+			residuals[calc_idx*num_data + data_idx] =
+				get_fit_residual(*calcs[calc_idx], cfg, data[data_idx]);
+		}, job_progress);
+	};
+
+	// set up the parameters of all calculators and evaluate them
+	auto evaluate_jacobian = [&](bool with_centre) -> bool
+	{
+		for(t_size param_idx=0; param_idx<num_params; ++param_idx)
+		{
+			const t_real value = results.values[param_idx];
+			const t_real step = rel_step * std::max<t_real>(std::abs(value), 1.);
+
+			calc_params[2*param_idx + 1] = results.values;
+			calc_params[2*param_idx + 1][param_idx] = value + step;
+			calc_params[2*param_idx + 2] = results.values;
+			calc_params[2*param_idx + 2][param_idx] = value - step;
+
+			// use the representable step
+			steps[param_idx] = (value + step) - (value - step);
+		}
+
+		if(with_centre)
+		{
+			calc_params[0] = results.values;
+			return evaluate(0, num_calcs);
+		}
+
+		return evaluate(1, num_calcs - 1);
+	};
+
+	auto get_chi2 = [&residuals, num_data](t_size calc_idx) -> t_real
+	{
+		t_real chi2 = 0.;
+		for(t_size data_idx=0; data_idx<num_data; ++data_idx)
+		{
+			const t_real res = residuals[calc_idx*num_data + data_idx];
+			chi2 += res * res;
+		}
+		return chi2;
+	};
+
+	// J^T J and J^T r at the current parameters
+	std::vector<t_real> JtJ(num_params * num_params), Jtr(num_params);
+	std::vector<t_real> centre_residuals(num_data);
+	auto calc_normal_equations = [&]()
+	{
+		std::fill(JtJ.begin(), JtJ.end(), t_real(0));
+		std::fill(Jtr.begin(), Jtr.end(), t_real(0));
+
+		std::vector<t_real> J_row(num_params);
+		for(t_size data_idx=0; data_idx<num_data; ++data_idx)
+		{
+			for(t_size param_idx=0; param_idx<num_params; ++param_idx)
+			{
+				J_row[param_idx] = (residuals[(2*param_idx + 1)*num_data + data_idx]
+					- residuals[(2*param_idx + 2)*num_data + data_idx]) / steps[param_idx];
+			}
+
+			for(t_size i=0; i<num_params; ++i)
+			{
+				Jtr[i] += J_row[i] * centre_residuals[data_idx];
+				for(t_size j=0; j<num_params; ++j)
+					JtJ[i*num_params + j] += J_row[i] * J_row[j];
+			}
+		}
+	};
+
+	if(!evaluate_jacobian(true))
+		return false;
+	results.chi2 = get_chi2(0);
+	std::copy(residuals.begin(), residuals.begin() + num_data, centre_residuals.begin());
+	calc_normal_equations();
+
+	const t_real tolerance = 1e-8;
+	t_real lambda = 1e-3;
+
+	for(iteration=1; iteration<=max_iterations; ++iteration)
+	{
+		results.iterations = iteration;
+
+		// find a step that decreases chi^2, increasing the damping otherwise
+		bool accepted = false;
+		std::vector<t_real> delta(num_params);
+		for(int damping=0; damping<16; ++damping)
+		{
+			std::vector<t_real> A = JtJ;
+			for(t_size param_idx=0; param_idx<num_params; ++param_idx)
+			{
+				A[param_idx*num_params + param_idx] += lambda *
+					std::max<t_real>(JtJ[param_idx*num_params + param_idx], tolerance);
+				delta[param_idx] = -Jtr[param_idx];
+			}
+
+			if(!solve_cholesky(num_params, A, delta))
+			{
+				lambda *= 10.;
+				continue;
+			}
+
+			calc_params[0] = results.values;
+			for(t_size param_idx=0; param_idx<num_params; ++param_idx)
+				calc_params[0][param_idx] += delta[param_idx];
+
+			if(!evaluate(0, 1))
+				return false;
+
+			const t_real chi2 = get_chi2(0);
+			if(chi2 <= results.chi2)
+			{
+				// converged if neither chi^2 nor the parameters change significantly
+				bool params_converged = true;
+				for(t_size param_idx=0; param_idx<num_params; ++param_idx)
+				{
+					if(std::abs(delta[param_idx]) > tolerance *
+						(std::abs(results.values[param_idx]) + tolerance))
+					{
+						params_converged = false;
+						break;
+					}
+				}
+
+				results.converged = params_converged ||
+					results.chi2 - chi2 <= tolerance * results.chi2;
+
+				results.values = calc_params[0];
+				results.chi2 = chi2;
+				std::copy(residuals.begin(), residuals.begin() + num_data,
+					centre_residuals.begin());
+
+				lambda = std::max<t_real>(lambda * 0.1, 1e-12);
+				accepted = true;
+				break;
+			}
+
+			lambda *= 10.;
+		}
+
+		// no step decreases chi^2 even with the maximum damping
+		if(!accepted)
+		{
+			results.converged = false;
+			results.status = "No step decreasing chi^2 was found, the damping reached its limit.";
+			break;
+		}
+
+		// the jacobian at the new parameters is needed for the next step and the covariance
+		if(!evaluate_jacobian(false))
+			return false;
+		calc_normal_equations();
+
+		if(results.converged)
+		{
+			results.status = "Neither chi^2 nor the variables change significantly.";
+			break;
+		}
+	}
+
+	if(!results.converged && results.status == "")
+		results.status = "The maximum number of iterations was reached.";
+
+	// covariance matrix from the inverse of J^T J
+	results.errors.assign(num_params, std::numeric_limits<t_real>::quiet_NaN());
+	if(invert_cholesky(num_params, JtJ, results.covariance))
+	{
+		for(t_size param_idx=0; param_idx<num_params; ++param_idx)
+			results.errors[param_idx] = std::sqrt(results.GetCovariance(param_idx, param_idx));
+	}
+	else
+	{
+		results.covariance.assign(num_params * num_params,
+			std::numeric_limits<t_real>::quiet_NaN());
+	}
+
+	if(progress)
+		progress(max_iterations, max_iterations);
+	return true;
+}
+
+
+
+/**
+ * set the variables of the magnon calculator to the fitted values
+ */
+void apply_fit_results(t_magdyn& dyn, const FitResults& results)
+{
+	set_fit_variables(dyn, results.names, results.values);
+}
+
+
+
+/**
+ * write the fitted values, their errors and correlations
+ */
+void print_fit_results(std::ostream& ostr, const FitResults& results)
+{
+	const t_size num_params = results.names.size();
+	const int field_len = g_prec * 2.5;
+	const auto prec = ostr.precision(g_prec);
+
+	ostr << "Fit " << (results.converged ? "converged" : "did not converge")
+		<< " after " << results.iterations << " iteration(s).\n";
+	if(results.status != "")
+		ostr << results.status << "\n";
+	ostr << "chi^2 = " << results.chi2 << ", ndf = " << results.ndf
+		<< ", chi^2/ndf = " << results.GetReducedChi2() << "\n\n";
+
+	for(t_size param_idx=0; param_idx<num_params; ++param_idx)
+	{
+		ostr << std::setw(field_len) << std::left << results.names[param_idx] << " = "
+			<< std::setw(field_len) << std::left << results.values[param_idx] << " +- "
+			<< results.errors[param_idx] << "\n";
+	}
+
+	ostr << "\nCorrelations:\n";
+	for(t_size i=0; i<num_params; ++i)
+	{
+		ostr << std::setw(field_len) << std::left << results.names[i] << " ";
+		for(t_size j=0; j<num_params; ++j)
+			ostr << std::setw(field_len) << std::left << results.GetCorrelation(i, j) << " ";
+		ostr << "\n";
+	}
+
+	ostr.precision(prec);
+}
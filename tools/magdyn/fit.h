@@ -0,0 +1,93 @@
+/**
+ * magnetic dynamics -- fitting of variables to measured dispersion points
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __MAGDYN_FIT_H__
+#define __MAGDYN_FIT_H__
+
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+#include "defs.h"
+#include "calc.h"
+
+
+
+/**
+ * a measured dispersion point
+ */
+struct FitDataPoint
+{
+	t_real h{}, k{}, l{};
+	t_real E{};
+	t_real sigma{ 1. };   // energy uncertainty
+};
+
+
+
+/**
+ * fitted variables and their covariance
+ */
+struct FitResults
+{
+	std::vector<std::string> names{};
+	std::vector<t_real> values{};
+	std::vector<t_real> errors{};
+	std::vector<t_real> covariance{};   // [param][param]
+
+	t_real chi2{};
+	t_size ndf{};            // degrees of freedom
+	t_size iterations{};
+	bool converged{ false };
+	std::string status{};    // why the fit stopped iterating
+
+	t_real GetCovariance(t_size i, t_size j) const
+	{ return covariance[i*names.size() + j]; }
+
+	t_real GetCorrelation(t_size i, t_size j) const;
+	t_real GetReducedChi2() const;
+};
+
+
+
+/**
+ * fits the real parts of the given variables to the measured points using
+ * levenberg-marquardt, each point is assigned to its nearest calculated branch
+ */
+extern std::vector<FitDataPoint> load_fit_data(const std::string& filename);
+
+extern bool fit_variables(const t_magdyn& dyn, const MagDynConfig& cfg,
+	const std::vector<FitDataPoint>& data, const std::vector<std::string>& var_names,
+	FitResults& results, CalcThreadPool& pool,
+	const t_calc_progress& progress = nullptr, t_size max_iterations = 100);
+
+extern void apply_fit_results(t_magdyn& dyn, const FitResults& results);
+extern void print_fit_results(std::ostream& ostr, const FitResults& results);
+
+
+#endif
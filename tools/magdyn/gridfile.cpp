@@ -0,0 +1,325 @@
+/**
+ * magnetic dynamics -- memory-mapped reader for the takin grid file format
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "gridfile.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+
+namespace ipr = boost::interprocess;
+
+
+static_assert(sizeof(GridFile::Branch) == 2*sizeof(double),
+	"Unexpected padding in grid file branch data.");
+
+
+// file offsets
+static constexpr std::uint64_t HEADER_SIZE = sizeof(std::uint64_t) + 9*sizeof(double);
+static constexpr const char* SIGNATURE = "Takin/Magdyn Grid File Version 2";
+
+// tolerance for Q positions on the edges of the grid
+static constexpr double GRID_EPS = 1e-6;
+
+
+
+/**
+ * read a value from a possibly unaligned position in the mapped file
+ */
+template<class T>
+static T read_value(const unsigned char *data)
+{
+	T val;
+	std::memcpy(&val, data, sizeof(val));
+	return val;
+}
+
+
+
+/**
+ * open and validate a grid file
+ */
+GridFile::GridFile(const std::string& filename)
+{
+	try
+	{
+		m_file = ipr::file_mapping(filename.c_str(), ipr::read_only);
+		m_region = ipr::mapped_region(m_file, ipr::read_only);
+	}
+	catch(const std::exception& ex)
+	{
+		throw std::runtime_error("Cannot map grid file \"" + filename + "\": " + ex.what());
+	}
+
+	// the branches are looked up in random order
+	m_region.advise(ipr::mapped_region::advice_random);
+
+	m_data = static_cast<const unsigned char*>(m_region.get_address());
+	m_size = m_region.get_size();
+
+	// header
+	const std::size_t sig_len = std::strlen(SIGNATURE);
+	if(m_size < HEADER_SIZE + sig_len)
+		throw std::runtime_error("Grid file \"" + filename + "\" is too small.");
+	if(std::memcmp(m_data + HEADER_SIZE, SIGNATURE, sig_len) != 0)
+		throw std::runtime_error("Unrecognised grid file format in \"" + filename + "\".");
+
+	m_index = read_value<std::uint64_t>(m_data);
+	if(m_index < HEADER_SIZE + sig_len || m_index > m_size
+		|| (m_size - m_index) % sizeof(std::uint64_t) != 0)
+	{
+		throw std::runtime_error("Invalid index block in grid file \"" + filename + "\".");
+	}
+	const t_size num_indices = (m_size - m_index) / sizeof(std::uint64_t);
+
+	for(int i=0; i<3; ++i)
+	{
+		const unsigned char *axis = m_data + sizeof(std::uint64_t) + 3*i*sizeof(t_real);
+		m_start[i] = read_value<t_real>(axis);
+		m_end[i] = read_value<t_real>(axis + sizeof(t_real));
+		m_step[i] = read_value<t_real>(axis + 2*sizeof(t_real));
+	}
+
+	// the number of points is only known for axes with a non-zero step,
+	// the remaining one has to be deduced from the size of the index block
+	t_size known_points = 1;
+	int num_unknown = 0, unknown_axis = -1;
+	for(int i=0; i<3; ++i)
+	{
+		if(m_step[i] != 0.)
+		{
+			t_real num = std::round((m_end[i] - m_start[i]) / m_step[i]);
+			if(!std::isfinite(num) || num < 1.)
+				throw std::runtime_error("Invalid grid axes in grid file \"" + filename + "\".");
+
+			m_num_points[i] = t_size(num);
+			known_points *= m_num_points[i];
+		}
+		else
+		{
+			m_num_points[i] = 1;
+			++num_unknown;
+			unknown_axis = i;
+		}
+	}
+
+	if(num_unknown == 1 && known_points && num_indices % known_points == 0)
+		m_num_points[unknown_axis] = num_indices / known_points;
+	else if(num_unknown > 1 && num_indices != 1)
+		throw std::runtime_error("Ambiguous grid axes in grid file \"" + filename + "\".");
+
+	if(m_num_points[0] * m_num_points[1] * m_num_points[2] != num_indices)
+	{
+		throw std::runtime_error("Index block size does not match the grid axes in grid file \""
+			+ filename + "\".");
+	}
+
+	// all points have to lie between the header and the index block
+	for(t_size idx=0; idx<num_indices; ++idx)
+	{
+		std::uint64_t offs = read_value<std::uint64_t>(
+			m_data + m_index + idx*sizeof(std::uint64_t));
+
+		bool valid = offs >= HEADER_SIZE + sig_len
+			&& offs + sizeof(std::uint32_t) <= m_index;
+		if(valid)
+		{
+			std::uint64_t num_branches = read_value<std::uint32_t>(m_data + offs);
+			valid = num_branches*sizeof(Branch) <= m_index - offs - sizeof(std::uint32_t);
+		}
+
+		if(!valid)
+		{
+			throw std::runtime_error("Invalid point offset " + std::to_string(idx)
+				+ " in grid file \"" + filename + "\".");
+		}
+	}
+}
+
+
+
+/**
+ * file offset of the point with the given grid indices
+ */
+std::uint64_t GridFile::GetPointOffset(t_size h_idx, t_size k_idx, t_size l_idx) const
+{
+	t_size idx = (h_idx*m_num_points[1] + k_idx)*m_num_points[2] + l_idx;
+	return read_value<std::uint64_t>(m_data + m_index + idx*sizeof(std::uint64_t));
+}
+
+
+
+/**
+ * view of the branches stored at the given file offset
+ */
+GridFile::t_branches GridFile::GetBranchesAtOffset(std::uint64_t offs) const
+{
+	std::uint32_t num_branches = read_value<std::uint32_t>(m_data + offs);
+	return t_branches(m_data + offs + sizeof(std::uint32_t), num_branches);
+}
+
+
+
+/**
+ * fractional grid index of Q along the given axis
+ */
+bool GridFile::GetGridPosition(int axis, t_real Q, t_real& pos) const
+{
+	// all points of a flat axis are at the start position
+	if(m_step[axis] == 0. || m_num_points[axis] == 1)
+	{
+		pos = 0.;
+		return std::abs(Q - m_start[axis]) <= GRID_EPS;
+	}
+
+	pos = (Q - m_start[axis]) / m_step[axis];
+	return pos >= -GRID_EPS && pos <= t_real(m_num_points[axis] - 1) + GRID_EPS;
+}
+
+
+
+/**
+ * branches at the given grid indices
+ */
+GridFile::t_branches GridFile::GetBranches(t_size h_idx, t_size k_idx, t_size l_idx) const
+{
+	if(h_idx >= m_num_points[0] || k_idx >= m_num_points[1] || l_idx >= m_num_points[2])
+		return t_branches{};
+
+	return GetBranchesAtOffset(GetPointOffset(h_idx, k_idx, l_idx));
+}
+
+
+
+/**
+ * branches at the grid point nearest to Q
+ */
+GridFile::t_branches GridFile::GetBranches(t_real h, t_real k, t_real l) const
+{
+	const t_real Q[3] = { h, k, l };
+	t_size idx[3];
+
+	for(int i=0; i<3; ++i)
+	{
+		t_real pos;
+		if(!GetGridPosition(i, Q[i], pos))
+			return t_branches{};
+
+		idx[i] = std::min(t_size(std::round(std::max(pos, t_real(0)))), m_num_points[i] - 1);
+	}
+
+	return GetBranchesAtOffset(GetPointOffset(idx[0], idx[1], idx[2]));
+}
+
+
+
+/**
+ * batch lookup of the nearest grid points
+ */
+void GridFile::GetBranches(const t_real *Qs, t_size num_Q, t_branches *results) const
+{
+	for(t_size Q_idx=0; Q_idx<num_Q; ++Q_idx)
+	{
+		const t_real *Q = Qs + Q_idx*3;
+		results[Q_idx] = GetBranches(Q[0], Q[1], Q[2]);
+	}
+}
+
+
+
+/**
+ * trilinearly interpolate the branches of the eight surrounding grid points,
+ * if they don't all have the same number of branches, the nearest point is used
+ */
+bool GridFile::Interpolate(t_real h, t_real k, t_real l, std::vector<Branch>& branches) const
+{
+	const t_real Q[3] = { h, k, l };
+	t_size idx0[3];  // lower grid indices
+	t_real frac[3];  // position between the lower and upper grid points
+
+	for(int i=0; i<3; ++i)
+	{
+		t_real pos;
+		if(!GetGridPosition(i, Q[i], pos))
+			return false;
+
+		pos = std::clamp(pos, t_real(0), t_real(m_num_points[i] - 1));
+		idx0[i] = t_size(std::floor(pos));
+		if(idx0[i] + 1 >= m_num_points[i])
+			idx0[i] = m_num_points[i] > 1 ? m_num_points[i] - 2 : 0;
+		frac[i] = m_num_points[i] > 1 ? pos - t_real(idx0[i]) : 0.;
+	}
+
+	// corner points and their weights
+	t_branches corners[8];
+	t_real corner_weights[8];
+	bool same_num_branches = true;
+	int nearest_corner = 0;
+
+	for(int corner=0; corner<8; ++corner)
+	{
+		t_size idx[3];
+		t_real weight = 1.;
+		for(int i=0; i<3; ++i)
+		{
+			bool upper = (corner >> (2 - i)) & 1;
+			idx[i] = std::min(idx0[i] + (upper ? 1 : 0), m_num_points[i] - 1);
+			weight *= upper ? frac[i] : 1. - frac[i];
+		}
+
+		corners[corner] = GetBranchesAtOffset(GetPointOffset(idx[0], idx[1], idx[2]));
+		corner_weights[corner] = weight;
+
+		if(corners[corner].size() != corners[0].size())
+			same_num_branches = false;
+		if(weight > corner_weights[nearest_corner])
+			nearest_corner = corner;
+	}
+
+	if(!same_num_branches)
+	{
+		branches.assign(corners[nearest_corner].begin(), corners[nearest_corner].end());
+		return true;
+	}
+
+	branches.assign(corners[0].size(), Branch{ 0., 0. });
+	for(int corner=0; corner<8; ++corner)
+	{
+		if(corner_weights[corner] == 0.)
+			continue;
+
+		for(t_size branch=0; branch<branches.size(); ++branch)
+		{
+			branches[branch].E += corner_weights[corner] * corners[corner][branch].E;
+			branches[branch].S += corner_weights[corner] * corners[corner][branch].S;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,180 @@
+/**
+ * magnetic dynamics -- memory-mapped reader for the takin grid file format
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __MAGDYN_GRIDFILE_H__
+#define __MAGDYN_GRIDFILE_H__
+
+#include <string>
+#include <vector>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+
+
+/**
+ * random-access reader for the grid files written by export_sqe
+ * (Takin/Magdyn grid file version 2)
+ *
+ * file layout:
+ *   uint64 offset of the index block
+ *   (start, end, step) of h, k, and l as doubles
+ *   signature string
+ *   for each (h, k, l) point: uint32 number of branches, (E, S) double pairs
+ *   index block: uint64 file offset of each (h, k, l) point
+ *
+ * the grid points are at start + idx*step with idx < (end - start) / step,
+ * the file is mapped into memory, so the returned branches are views into it,
+ * the branches are not aligned in the file and are copied out element-wise
+ */
+class GridFile
+{
+public:
+	using t_real = double;
+	using t_size = std::size_t;
+
+#pragma pack(push, 1)
+	/**
+	 * energy and spectral weight of a branch as stored in the file
+	 */
+	struct Branch
+	{
+		t_real E;
+		t_real S;
+	};
+#pragma pack(pop)
+
+	/**
+	 * view of the branches at a grid point in the mapped file,
+	 * the elements are read with memcpy, as the file gives no alignment guarantee
+	 */
+	class BranchView
+	{
+	public:
+		class iterator
+		{
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = Branch;
+			using difference_type = std::ptrdiff_t;
+			using pointer = void;
+			using reference = Branch;
+
+			iterator() = default;
+			explicit iterator(const unsigned char *data) : m_data{data} {}
+
+			Branch operator*() const { return BranchView::Read(m_data); }
+			iterator& operator++() { m_data += sizeof(Branch); return *this; }
+			iterator operator++(int) { iterator iter = *this; ++*this; return iter; }
+			bool operator==(const iterator& iter) const { return m_data == iter.m_data; }
+
+		private:
+			const unsigned char *m_data{};
+		};
+
+		BranchView() = default;
+		BranchView(const unsigned char *data, t_size size) : m_data{data}, m_size{size} {}
+
+		t_size size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+
+		// raw bytes of the (E, S) pairs as stored in the file
+		const unsigned char* data() const { return m_data; }
+		t_size size_bytes() const { return m_size * sizeof(Branch); }
+
+		Branch operator[](t_size idx) const { return Read(m_data + idx*sizeof(Branch)); }
+
+		iterator begin() const { return iterator{m_data}; }
+		iterator end() const { return iterator{m_data + size_bytes()}; }
+
+	private:
+		static Branch Read(const unsigned char *data)
+		{
+			Branch branch;
+			std::memcpy(&branch, data, sizeof(branch));
+			return branch;
+		}
+
+		const unsigned char *m_data{};
+		t_size m_size{};
+	};
+
+	using t_branches = BranchView;
+
+
+public:
+	explicit GridFile(const std::string& filename);
+	~GridFile() = default;
+
+	GridFile(const GridFile&) = delete;
+	GridFile& operator=(const GridFile&) = delete;
+
+	t_size GetNumPoints(int axis) const { return m_num_points[axis]; }
+	t_real GetStart(int axis) const { return m_start[axis]; }
+	t_real GetEnd(int axis) const { return m_end[axis]; }
+	t_real GetStep(int axis) const { return m_step[axis]; }
+
+	// branches at the given grid indices
+	t_branches GetBranches(t_size h_idx, t_size k_idx, t_size l_idx) const;
+
+	// branches at the grid point nearest to Q, empty if Q is outside the grid
+	t_branches GetBranches(t_real h, t_real k, t_real l) const;
+
+	// batch lookup of the nearest grid points, Qs contains (h, k, l) triples
+	void GetBranches(const t_real *Qs, t_size num_Q, t_branches *results) const;
+
+	// trilinearly interpolated branches, false if Q is outside the grid
+	bool Interpolate(t_real h, t_real k, t_real l, std::vector<Branch>& branches) const;
+
+
+protected:
+	// fractional grid index of Q along the given axis
+	bool GetGridPosition(int axis, t_real Q, t_real& pos) const;
+
+	t_branches GetBranchesAtOffset(std::uint64_t offs) const;
+	std::uint64_t GetPointOffset(t_size h_idx, t_size k_idx, t_size l_idx) const;
+
+
+private:
+	boost::interprocess::file_mapping m_file{};
+	boost::interprocess::mapped_region m_region{};
+
+	const unsigned char *m_data{};  // start of the mapped file
+	t_size m_size{};                // file size
+	std::uint64_t m_index{};        // offset of the index block
+
+	t_real m_start[3]{}, m_end[3]{}, m_step[3]{};
+	t_size m_num_points[3]{};
+};
+
+
+#endif
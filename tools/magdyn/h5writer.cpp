@@ -0,0 +1,260 @@
+/**
+ * magnetic dynamics -- streaming hdf5 writer for S(Q, E) grids
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "h5writer.h"
+
+#ifdef USE_HDF5
+
+#include <algorithm>
+#include <type_traits>
+#include <stdexcept>
+
+
+
+/**
+ * hdf5 type corresponding to the real type
+ */
+static const H5::PredType& get_real_h5type()
+{
+	if constexpr(std::is_same_v<t_real, float>)
+		return H5::PredType::NATIVE_FLOAT;
+	else
+		return H5::PredType::NATIVE_DOUBLE;
+}
+
+
+
+/**
+ * create the (initially empty) datasets
+ */
+SQEH5Writer::SQEH5Writer(H5::H5File& file, const std::string& group,
+	t_size num_h, t_size num_k, t_size num_l,
+	int compression, t_size chunk_size)
+	: m_dims{num_h, num_k, num_l}, m_chunk_size{std::max<t_size>(chunk_size, 1)}
+{
+	if(compression > 0 && !H5Zfilter_avail(H5Z_FILTER_DEFLATE))
+		throw std::runtime_error("HDF5 deflate compression is not available.");
+
+	// per-point datasets with one (k, l) plane per chunk
+	hsize_t point_dims[] = { num_h, num_k, num_l };
+	hsize_t point_chunk[] = { 1, num_k, num_l };
+	H5::DataSpace point_space(3, point_dims);
+
+	H5::DSetCreatPropList point_props;
+	point_props.setChunk(3, point_chunk);
+	if(compression > 0)
+		point_props.setDeflate(compression);
+
+	m_indices = file.createDataSet(group + "/indices",
+		H5::PredType::NATIVE_UINT64, point_space, point_props);
+	m_branches = file.createDataSet(group + "/branches",
+		H5::PredType::NATIVE_UINT64, point_space, point_props);
+
+	// extensible per-branch datasets
+	hsize_t branch_dims[] = { 0 };
+	hsize_t branch_maxdims[] = { H5S_UNLIMITED };
+	hsize_t branch_chunk[] = { m_chunk_size };
+	H5::DataSpace branch_space(1, branch_dims, branch_maxdims);
+
+	H5::DSetCreatPropList branch_props;
+	branch_props.setChunk(1, branch_chunk);
+	if(compression > 0)
+		branch_props.setDeflate(compression);
+
+	m_energies = file.createDataSet(group + "/energies",
+		get_real_h5type(), branch_space, branch_props);
+	m_weights = file.createDataSet(group + "/weights",
+		get_real_h5type(), branch_space, branch_props);
+
+	m_plane_indices.reserve(num_k * num_l);
+	m_plane_branches.reserve(num_k * num_l);
+	m_buf_energies.reserve(m_chunk_size);
+	m_buf_weights.reserve(m_chunk_size);
+}
+
+
+
+/**
+ * continue writing into the datasets of an interrupted export,
+ * all data after the given number of complete (k, l) planes is discarded
+ */
+SQEH5Writer::SQEH5Writer(H5::H5File& file, const std::string& group,
+	t_size num_h, t_size num_k, t_size num_l,
+	t_size planes_written, t_size branches_written,
+	t_size chunk_size)
+	: m_dims{num_h, num_k, num_l}, m_chunk_size{std::max<t_size>(chunk_size, 1)}
+{
+	m_indices = file.openDataSet(group + "/indices");
+	m_branches = file.openDataSet(group + "/branches");
+	m_energies = file.openDataSet(group + "/energies");
+	m_weights = file.openDataSet(group + "/weights");
+
+	// check the grid dimensions
+	hsize_t point_dims[3]{};
+	if(m_indices.getSpace().getSimpleExtentNdims() != 3)
+		throw std::runtime_error("Invalid HDF5 grid datasets.");
+	m_indices.getSpace().getSimpleExtentDims(point_dims);
+	if(point_dims[0] != num_h || point_dims[1] != num_k || point_dims[2] != num_l)
+		throw std::runtime_error("HDF5 grid dimensions do not match.");
+
+	hsize_t branch_dims[1]{};
+	m_energies.getSpace().getSimpleExtentDims(branch_dims);
+	if(planes_written > num_h || branches_written > branch_dims[0])
+		throw std::runtime_error("HDF5 grid is smaller than expected.");
+
+	// discard the branches written after the last complete plane
+	hsize_t new_size[] = { branches_written };
+	m_energies.extend(new_size);
+	m_weights.extend(new_size);
+
+	m_plane = planes_written;
+	m_num_points = planes_written * num_k * num_l;
+	m_num_branches = m_branches_written = branches_written;
+
+	m_plane_indices.reserve(num_k * num_l);
+	m_plane_branches.reserve(num_k * num_l);
+	m_buf_energies.reserve(m_chunk_size);
+	m_buf_weights.reserve(m_chunk_size);
+}
+
+
+
+SQEH5Writer::~SQEH5Writer()
+{
+	try
+	{
+		Flush();
+	}
+	catch(const H5::Exception&)
+	{
+	}
+}
+
+
+
+/**
+ * add the energies and weights of the next point in (h, k, l) order
+ */
+void SQEH5Writer::WritePoint(const std::vector<t_real>& energies,
+	const std::vector<t_real>& weights)
+{
+	if(m_plane >= m_dims[0])
+		throw std::out_of_range("Too many points written to HDF5 grid.");
+
+	m_plane_indices.push_back(m_num_branches);
+	m_plane_branches.push_back(energies.size());
+
+	m_buf_energies.insert(m_buf_energies.end(), energies.begin(), energies.end());
+	m_buf_weights.insert(m_buf_weights.end(), weights.begin(), weights.end());
+	m_num_branches += energies.size();
+	++m_num_points;
+
+	if(m_buf_energies.size() >= m_chunk_size)
+		FlushBranches();
+	if(m_plane_indices.size() == m_dims[1] * m_dims[2])
+		FlushPlane();
+}
+
+
+
+/**
+ * append the buffered branches to the energy and weight datasets
+ */
+void SQEH5Writer::FlushBranches()
+{
+	if(m_buf_energies.size() == 0)
+		return;
+
+	hsize_t offs[] = { m_branches_written };
+	hsize_t count[] = { m_buf_energies.size() };
+	hsize_t new_size[] = { m_branches_written + m_buf_energies.size() };
+
+	H5::DataSpace mem_space(1, count);
+	for(auto [dset, buf] : { std::make_pair(&m_energies, &m_buf_energies),
+		std::make_pair(&m_weights, &m_buf_weights) })
+	{
+		dset->extend(new_size);
+
+		H5::DataSpace file_space = dset->getSpace();
+		file_space.selectHyperslab(H5S_SELECT_SET, count, offs);
+		dset->write(buf->data(), get_real_h5type(), mem_space, file_space);
+	}
+
+	m_branches_written += m_buf_energies.size();
+	m_buf_energies.clear();
+	m_buf_weights.clear();
+}
+
+
+
+/**
+ * write the indices and branch counts of the current (possibly partial) (k, l) plane
+ */
+void SQEH5Writer::FlushPlane()
+{
+	if(m_plane_indices.size() == 0)
+		return;
+
+	hsize_t offs[] = { m_plane, 0, 0 };
+	hsize_t count[] = { 1, m_dims[1], m_dims[2] };
+
+	// a partial plane is only written at the end of a stopped export
+	const bool partial = m_plane_indices.size() < m_dims[1] * m_dims[2];
+	if(partial)
+	{
+		m_plane_indices.resize(m_dims[1] * m_dims[2], 0);
+		m_plane_branches.resize(m_dims[1] * m_dims[2], 0);
+	}
+
+	H5::DataSpace mem_space(3, count);
+	for(auto [dset, buf] : { std::make_pair(&m_indices, &m_plane_indices),
+		std::make_pair(&m_branches, &m_plane_branches) })
+	{
+		H5::DataSpace file_space = dset->getSpace();
+		file_space.selectHyperslab(H5S_SELECT_SET, count, offs);
+		dset->write(buf->data(), H5::PredType::NATIVE_UINT64, mem_space, file_space);
+	}
+
+	m_plane_indices.clear();
+	m_plane_branches.clear();
+	++m_plane;
+}
+
+
+
+/**
+ * write all pending data
+ */
+void SQEH5Writer::Flush()
+{
+	FlushBranches();
+	FlushPlane();
+}
+
+
+#endif
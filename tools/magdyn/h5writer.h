@@ -0,0 +1,101 @@
+/**
+ * magnetic dynamics -- streaming hdf5 writer for S(Q, E) grids
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __MAGDYN_H5WRITER_H__
+#define __MAGDYN_H5WRITER_H__
+
+#ifdef USE_HDF5
+
+#include <H5Cpp.h>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "defs.h"
+
+
+
+/**
+ * writes S(Q, E) grid data incrementally into extensible, chunked hdf5 datasets
+ *
+ * the points have to be written in (h, k, l) order, the resulting file layout is:
+ *   data/indices:  [num_h, num_k, num_l] index of a point's first branch
+ *   data/branches: [num_h, num_k, num_l] number of branches of a point
+ *   data/energies: [total branches] branch energies
+ *   data/weights:  [total branches] branch weights
+ */
+class SQEH5Writer
+{
+public:
+	SQEH5Writer(H5::H5File& file, const std::string& group,
+		t_size num_h, t_size num_k, t_size num_l,
+		int compression = 0, t_size chunk_size = 1 << 16);
+	SQEH5Writer(H5::H5File& file, const std::string& group,
+		t_size num_h, t_size num_k, t_size num_l,
+		t_size planes_written, t_size branches_written,
+		t_size chunk_size = 1 << 16);
+	~SQEH5Writer();
+
+	SQEH5Writer(const SQEH5Writer&) = delete;
+	const SQEH5Writer& operator=(const SQEH5Writer&) = delete;
+
+	void WritePoint(const std::vector<t_real>& energies, const std::vector<t_real>& weights);
+	void Flush();
+
+	t_size GetNumPoints() const { return m_num_points; }
+	t_size GetNumBranches() const { return m_num_branches; }
+
+
+protected:
+	void FlushBranches();
+	void FlushPlane();
+
+
+private:
+	t_size m_dims[3]{};                        // grid dimensions
+	t_size m_chunk_size{};                     // branch buffer size
+
+	H5::DataSet m_indices{}, m_branches{};     // per-point datasets
+	H5::DataSet m_energies{}, m_weights{};     // per-branch datasets
+
+	// buffers for the current (k, l) plane
+	std::vector<std::uint64_t> m_plane_indices{}, m_plane_branches{};
+	t_size m_plane{};                          // current h index
+
+	// buffers for the branches not yet written
+	std::vector<t_real> m_buf_energies{}, m_buf_weights{};
+	t_size m_branches_written{};               // branches already in the file
+
+	t_size m_num_points{};                     // total points written
+	t_size m_num_branches{};                   // total branches written
+};
+
+
+#endif
+#endif
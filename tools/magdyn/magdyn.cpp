@@ -27,10 +27,14 @@
  */
 
 #include "magdyn.h"
+#include "profiler.h"
 
 #include <QtCore/QMimeData>
 #include <QtWidgets/QLabel>
 #include <QtWidgets/QMessageBox>
+#include <QtWidgets/QInputDialog>
+#include <QtWidgets/QFileDialog>
+#include <QtCore/QFileInfo>
 
 #include <iostream>
 #include <boost/scope_exit.hpp>
@@ -82,6 +86,10 @@ MagDynDlg::MagDynDlg(QWidget* pParent) : QDialog{pParent},
 	CreateHamiltonPanel();
 	CreateCoordinatesPanel();
 	CreateExportPanel();
+	CreateSweepPanel();
+	CreatePowderPanel();
+	CreateSlicePanel();
+	CreateDosPanel();
 
 	// restore settings
 	if(m_sett)
@@ -97,8 +105,16 @@ MagDynDlg::MagDynDlg(QWidget* pParent) : QDialog{pParent},
 
 		if(m_sett->contains("splitter"))
 			m_split_inout->restoreState(m_sett->value("splitter").toByteArray());
+
+		if(m_sett->contains("pin_threads"))
+			m_pin_threads->setChecked(m_sett->value("pin_threads").toBool());
 	}
 
+	// start calculation threads
+	RestartThreadPool(
+		m_sett ? m_sett->value("num_threads", 0).toUInt() : 0,
+		m_pin_threads->isChecked());
+
 	setAcceptDrops(true);
 	m_ignoreTableChanges = false;
 }
@@ -106,6 +122,16 @@ MagDynDlg::MagDynDlg(QWidget* pParent) : QDialog{pParent},
 
 MagDynDlg::~MagDynDlg()
 {
+	// stop and wait for the background calculations,
+	// each thread also waits for the stopped run it has replaced
+	StopCalculations();
+	for(CalcJob* job : { &m_disp_job, &m_export_job, &m_sweep_job,
+		&m_fit_job, &m_powder_job, &m_slice_job, &m_dos_job })
+	{
+		if(job->thread.joinable())
+			job->thread.join();
+	}
+
 	Clear();
 
 	if(m_structplot_dlg)
@@ -145,8 +171,7 @@ void MagDynDlg::AddSiteTabItem(int row,
 	BOOST_SCOPE_EXIT(this_)
 	{
 		this_->m_ignoreTableChanges = false;
-		if(this_->m_autocalc->isChecked())
-			this_->CalcAll();
+		this_->RequestCalc(CALC_ALL);
 	} BOOST_SCOPE_EXIT_END
 
 	if(row == -1)	// append to end of table
@@ -217,8 +242,7 @@ void MagDynDlg::AddTermTabItem(int row,
 	BOOST_SCOPE_EXIT(this_)
 	{
 		this_->m_ignoreTableChanges = false;
-		if(this_->m_autocalc->isChecked())
-			this_->CalcAll();
+		this_->RequestCalc(CALC_ALL);
 	} BOOST_SCOPE_EXIT_END
 
 	if(row == -1)	// append to end of table
@@ -288,8 +312,7 @@ void MagDynDlg::AddVariableTabItem(int row,
 	BOOST_SCOPE_EXIT(this_)
 	{
 		this_->m_ignoreTableChanges = false;
-		if(this_->m_autocalc->isChecked())
-			this_->CalcAll();
+		this_->RequestCalc(CALC_ALL);
 	} BOOST_SCOPE_EXIT_END
 
 	if(row == -1)	// append to end of table
@@ -441,13 +464,64 @@ void MagDynDlg::AddCoordinateTabItem(int row,
 }
 
 
+/**
+ * add a sweep parameter
+ */
+void MagDynDlg::AddSweepTabItem(int row,
+	const std::string& name, t_real start, t_real end, t_size num_points)
+{
+	bool bclone = 0;
+
+	if(row == -1)	// append to end of table
+		row = m_sweeptab->rowCount();
+	else if(row == -2 && m_sweep_cursor_row >= 0)	// use row from member variable
+		row = m_sweep_cursor_row;
+	else if(row == -3 && m_sweep_cursor_row >= 0)	// use row from member variable +1
+		row = m_sweep_cursor_row + 1;
+	else if(row == -4 && m_sweep_cursor_row >= 0)	// use row from member variable +1
+	{
+		row = m_sweep_cursor_row + 1;
+		bclone = 1;
+	}
+
+	m_sweeptab->setSortingEnabled(false);
+	m_sweeptab->insertRow(row);
+
+	if(bclone)
+	{
+		for(int thecol=0; thecol<NUM_SWEEP_COLS; ++thecol)
+		{
+			m_sweeptab->setItem(row, thecol,
+				m_sweeptab->item(m_sweep_cursor_row, thecol)->clone());
+		}
+	}
+	else
+	{
+		m_sweeptab->setItem(row, COL_SWEEP_NAME,
+			new QTableWidgetItem(name.c_str()));
+		m_sweeptab->setItem(row, COL_SWEEP_START,
+			new tl2::NumericTableWidgetItem<t_real>(start));
+		m_sweeptab->setItem(row, COL_SWEEP_END,
+			new tl2::NumericTableWidgetItem<t_real>(end));
+		m_sweeptab->setItem(row, COL_SWEEP_POINTS,
+			new tl2::NumericTableWidgetItem<t_size>(num_points));
+	}
+
+	m_sweeptab->scrollToItem(m_sweeptab->item(row, 0));
+	m_sweeptab->setCurrentCell(row, 0);
+	m_sweeptab->setSortingEnabled(true);
+
+	UpdateVerticalHeader(m_sweeptab);
+}
+
+
 /**
  * delete table widget items
  */
 void MagDynDlg::DelTabItem(QTableWidget *pTab, int begin, int end)
 {
 	bool needs_recalc = true;
-	if(pTab == m_fieldstab || pTab == m_coordinatestab)
+	if(pTab == m_fieldstab || pTab == m_coordinatestab || pTab == m_sweeptab)
 		needs_recalc = false;
 
 	if(needs_recalc)
@@ -457,8 +531,7 @@ void MagDynDlg::DelTabItem(QTableWidget *pTab, int begin, int end)
 		if(needs_recalc)
 		{
 			this_->m_ignoreTableChanges = false;
-			if(this_->m_autocalc->isChecked())
-				this_->CalcAll();
+			this_->RequestCalc(CALC_ALL);
 		}
 	} BOOST_SCOPE_EXIT_END
 
@@ -490,7 +563,7 @@ void MagDynDlg::DelTabItem(QTableWidget *pTab, int begin, int end)
 void MagDynDlg::MoveTabItemUp(QTableWidget *pTab)
 {
 	bool needs_recalc = true;
-	if(pTab == m_fieldstab || pTab == m_coordinatestab)
+	if(pTab == m_fieldstab || pTab == m_coordinatestab || pTab == m_sweeptab)
 		needs_recalc = false;
 
 	if(needs_recalc)
@@ -501,8 +574,7 @@ void MagDynDlg::MoveTabItemUp(QTableWidget *pTab)
 		if(needs_recalc)
 		{
 			this_->m_ignoreTableChanges = false;
-			if(this_->m_autocalc->isChecked())
-				this_->CalcAll();
+			this_->RequestCalc(CALC_ALL);
 		}
 	} BOOST_SCOPE_EXIT_END
 
@@ -539,7 +611,7 @@ void MagDynDlg::MoveTabItemUp(QTableWidget *pTab)
 void MagDynDlg::MoveTabItemDown(QTableWidget *pTab)
 {
 	bool needs_recalc = true;
-	if(pTab == m_fieldstab || pTab == m_coordinatestab)
+	if(pTab == m_fieldstab || pTab == m_coordinatestab || pTab == m_sweeptab)
 		needs_recalc = false;
 
 	if(needs_recalc)
@@ -550,8 +622,7 @@ void MagDynDlg::MoveTabItemDown(QTableWidget *pTab)
 		if(needs_recalc)
 		{
 			this_->m_ignoreTableChanges = false;
-			if(this_->m_autocalc->isChecked())
-				this_->CalcAll();
+			this_->RequestCalc(CALC_ALL);
 		}
 	} BOOST_SCOPE_EXIT_END
 
@@ -631,8 +702,7 @@ void MagDynDlg::SitesTableItemChanged(QTableWidgetItem * /*item*/)
 	if(m_ignoreTableChanges)
 		return;
 
-	if(m_autocalc->isChecked())
-		CalcAll();
+	RequestCalc(CALC_ALL);
 }
 
 
@@ -644,8 +714,7 @@ void MagDynDlg::TermsTableItemChanged(QTableWidgetItem * /*item*/)
 	if(m_ignoreTableChanges)
 		return;
 
-	if(m_autocalc->isChecked())
-		CalcAll();
+	RequestCalc(CALC_ALL);
 }
 
 
@@ -657,8 +726,7 @@ void MagDynDlg::VariablesTableItemChanged(QTableWidgetItem * /*item*/)
 	if(m_ignoreTableChanges)
 		return;
 
-	if(m_autocalc->isChecked())
-		CalcAll();
+	RequestCalc(CALC_ALL);
 }
 
 
@@ -743,12 +811,57 @@ void MagDynDlg::dropEvent(QDropEvent *evt)
  */
 void MagDynDlg::CalcAll()
 {
+	// supersedes any pending automatic calculation
+	m_calc_timer->stop();
+	m_calc_requested = 0;
+
 	SyncSitesAndTerms();
 	StructPlotSync();
 	CalcAllDynamics();
 }
 
 
+/**
+ * request an automatic calculation, which is delayed
+ * until no further input has arrived for a short time
+ */
+void MagDynDlg::RequestCalc(unsigned int what)
+{
+	if(m_ignoreCalc || !m_autocalc || !m_autocalc->isChecked())
+		return;
+
+	m_calc_requested |= what;
+
+	// a running dispersion calculation will be superseded by the new one
+	if(what & CALC_DISPERSION)
+		m_disp_job.thread.request_stop();
+
+	// (re-)start the debounce interval
+	m_calc_timer->start();
+}
+
+
+/**
+ * perform the requested automatic calculations
+ */
+void MagDynDlg::RunRequestedCalc()
+{
+	const unsigned int what = m_calc_requested;
+	m_calc_requested = 0;
+
+	if(what & CALC_SYNC)
+	{
+		SyncSitesAndTerms();
+		StructPlotSync();
+	}
+
+	if(what & CALC_DISPERSION)
+		CalcDispersion();
+	if(what & CALC_HAMILTONIAN)
+		CalcHamiltonian();
+}
+
+
 /**
  * enable GUI inputs after calculation threads have finished
  */
@@ -771,3 +884,146 @@ void MagDynDlg::DisableInput()
 	m_tabs_in->setEnabled(false);
 	m_btnStart->setEnabled(false);
 }
+
+
+/**
+ * run a calculation of the job in a background thread,
+ * calc is called in the thread with a progress callback reporting to the job's progress bar,
+ * done is called in the gui thread afterwards, unless the job has been restarted in the meantime
+ */
+void MagDynDlg::StartCalcJob(CalcJob& job, const t_job_calc& calc, const t_job_done& done)
+{
+	// a still running calculation is only stopped here, the new
+	// thread waits for it, so that the gui thread is not blocked
+	std::jthread prev_thread = std::move(job.thread);
+	prev_thread.request_stop();
+
+	const std::size_t generation = ++job.generation;
+	if(job.progress)
+	{
+		job.progress->setRange(0, 100);
+		job.progress->setValue(0);
+	}
+
+	job.thread = std::jthread([this, &job, generation, calc, done,
+		prev_thread = std::move(prev_thread)](std::stop_token stop) mutable
+	{
+		if(prev_thread.joinable())
+			prev_thread.join();
+
+		bool finished = false;
+		std::string error;
+
+		try
+		{
+			if(!stop.stop_requested())
+			{
+				finished = calc([this, &job, &stop, generation](t_size done, t_size total) -> bool
+				{
+					const int percent = total ? int(done * 100 / total) : 100;
+					QMetaObject::invokeMethod(this, [&job, generation, percent]()
+					{
+						if(generation == job.generation && job.progress)
+							job.progress->setValue(percent);
+					}, Qt::QueuedConnection);
+
+					return !stop.stop_requested();
+				}, stop);
+			}
+		}
+		catch(const std::exception& ex)
+		{
+			error = ex.what();
+		}
+
+		QMetaObject::invokeMethod(this, [&job, generation, done, finished, error]()
+		{
+			// a newer calculation has already been started
+			if(generation != job.generation)
+				return;
+
+			if(finished && job.progress)
+				job.progress->setValue(100);
+			done(finished, error);
+		}, Qt::QueuedConnection);
+	});
+}
+
+
+/**
+ * stop a running calculation of the job and discard its pending notifications
+ */
+void MagDynDlg::StopCalcJob(CalcJob& job)
+{
+	job.thread.request_stop();
+	++job.generation;
+}
+
+
+/**
+ * (re-)start the calculation threads
+ */
+void MagDynDlg::RestartThreadPool(unsigned int num_threads, bool pin_threads)
+{
+	if(!m_pool)
+		m_pool = std::make_unique<CalcThreadPool>(num_threads, pin_threads);
+	else
+		m_pool->Start(num_threads, pin_threads);
+}
+
+
+/**
+ * ask for the number of calculation threads
+ */
+void MagDynDlg::SetNumThreads()
+{
+	bool ok = false;
+	int num_threads = QInputDialog::getInt(this, "Calculation Threads",
+		"Number of calculation threads:", m_pool ? m_pool->GetNumThreads() : 1,
+		1, 1024, 1, &ok);
+	if(!ok)
+		return;
+
+	RestartThreadPool(num_threads, m_pin_threads->isChecked());
+	if(m_sett)
+		m_sett->setValue("num_threads", num_threads);
+}
+
+
+/**
+ * show the timings of the profiled calculation stages
+ */
+void MagDynDlg::ShowProfile()
+{
+	if(!is_profiling())
+	{
+		QMessageBox::information(this, "Magnetic Dynamics",
+			"Calculation profiling is not enabled.");
+		return;
+	}
+
+	QString summary = QString("<pre>") + get_profile_summary().c_str() + "</pre>";
+	QMessageBox::information(this, "Calculation Profile", summary);
+}
+
+
+/**
+ * save the recorded calculation stages as a chrome trace file
+ */
+void MagDynDlg::SaveProfileTrace()
+{
+	QString dirLast = m_sett->value("dir", "").toString();
+	QString filename = QFileDialog::getSaveFileName(
+		this, "Save Profile Trace", dirLast, "Trace Files (*.json)");
+	if(filename == "")
+		return;
+
+	if(!save_profile_trace(filename.toStdString()))
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics",
+			"Could not save profile trace to \"" + filename + "\".");
+		return;
+	}
+
+	m_sett->setValue("dir", QFileInfo(filename).path());
+}
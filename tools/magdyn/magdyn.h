@@ -30,6 +30,7 @@
 #define __MAG_DYN_GUI_H__
 
 #include <QtCore/QSettings>
+#include <QtCore/QTimer>
 #include <QtWidgets/QGridLayout>
 #include <QtWidgets/QSplitter>
 #include <QtWidgets/QDialog>
@@ -39,6 +40,7 @@
 #include <QtWidgets/QProgressBar>
 #include <QtWidgets/QPushButton>
 #include <QtWidgets/QSpinBox>
+#include <QtWidgets/QLineEdit>
 #include <QtWidgets/QCheckBox>
 #include <QtWidgets/QComboBox>
 #include <QtWidgets/QTextEdit>
@@ -54,6 +56,11 @@
 #include <qcustomplot.h>
 
 #include <vector>
+#include <memory>
+#include <functional>
+#include <string>
+#include <thread>
+#include <mutex>
 #include <unordered_map>
 #include <optional>
 
@@ -63,24 +70,40 @@
 #include "tlibs2/libs/qt/glplot.h"
 
 #include "defs.h"
+#include "calc.h"
+#include "sweep.h"
+#include "fit.h"
+#include "powder.h"
+#include "slice.h"
+#include "dos.h"
 #include "graph.h"
 #include "table_import.h"
 
 using namespace tl2_mag;
 
 
-using t_magdyn = MagDyn<t_mat, t_vec, t_mat_real, t_vec_real, t_cplx, t_real, t_size>;
-
+/**
+ * a calculation running in a background thread, see MagDynDlg::StartCalcJob
+ */
+struct CalcJob
+{
+	std::jthread thread{};
+	std::size_t generation{};    // id of the most recent run, older notifications are discarded
+	QProgressBar *progress{};    // shows the progress of this job
+};
 
 
 /**
- * export file types
+ * parts to (re-)calculate
  */
-enum : int
+enum : unsigned int
 {
-	EXPORT_HDF5 = 0,
-	EXPORT_GRID = 1,
-	EXPORT_TEXT = 2,
+	CALC_SYNC        = 1 << 0,   // sites, terms, and structure plot
+	CALC_DISPERSION  = 1 << 1,
+	CALC_HAMILTONIAN = 1 << 2,
+
+	CALC_DYNAMICS    = CALC_DISPERSION | CALC_HAMILTONIAN,
+	CALC_ALL         = CALC_SYNC | CALC_DYNAMICS,
 };
 
 
@@ -152,6 +175,19 @@ enum : int
 };
 
 
+/**
+ * columns of the table with the sweep parameters
+ */
+enum : int
+{
+	COL_SWEEP_NAME = 0,
+	COL_SWEEP_START, COL_SWEEP_END,
+	COL_SWEEP_POINTS,
+
+	NUM_SWEEP_COLS
+};
+
+
 /**
  * infos for atom sites
  */
@@ -185,11 +221,28 @@ public:
 
 protected:
 	QSettings *m_sett{};
+
+	// calculation threads
+	std::unique_ptr<CalcThreadPool> m_pool{};
+	QAction *m_pin_threads{};
+	QAction *m_profile{};
 	QMenuBar *m_menu{};
 	QSplitter *m_split_inout{};
 	QLabel *m_status{};
 	QProgressBar *m_progress{};
+	QProgressBar *m_fitProgress{};
+	QProgressBar *m_exportProgress{};
+	QProgressBar *m_sweepProgress{};
+	QProgressBar *m_powderProgress{};
+	QProgressBar *m_sliceProgress{};
+	QProgressBar *m_dosProgress{};
 	QPushButton* m_btnStart{};
+	QPushButton* m_btnExport{};
+	QPushButton* m_btnExportResume{};
+	QPushButton* m_btnSweep{};
+	QPushButton* m_btnPowder{};
+	QPushButton* m_btnSlice{};
+	QPushButton* m_btnDos{};
 
 	QAction *m_autocalc{};
 	QAction *m_use_dmi{};
@@ -200,7 +253,9 @@ protected:
 	QAction *m_unite_degeneracies{};
 	QAction *m_ignore_annihilation{};
 	QAction *m_force_incommensurate{};
+	QAction *m_cache_phases{};
 	QAction *m_plot_channels{};
+	QAction *m_disp_path_mode{};
 	QMenu *m_menuChannels{};
 	QAction *m_plot_channel[3]{};
 
@@ -231,6 +286,10 @@ protected:
 	QWidget *m_hamiltonianpanel{};
 	QWidget *m_coordinatespanel{};
 	QWidget *m_exportpanel{};
+	QWidget *m_sweeppanel{};
+	QWidget *m_powderpanel{};
+	QWidget *m_slicepanel{};
+	QWidget *m_dospanel{};
 
 	// sites
 	QTableWidget *m_sitestab{};
@@ -243,6 +302,12 @@ protected:
 	QDoubleSpinBox *m_ordering[3]{nullptr, nullptr, nullptr};
 	QDoubleSpinBox *m_normaxis[3]{nullptr, nullptr, nullptr};
 
+	// crystal lattice and neighbour shells for generating couplings
+	QDoubleSpinBox *m_xtallattice[3]{nullptr, nullptr, nullptr};
+	QDoubleSpinBox *m_xtalangles[3]{nullptr, nullptr, nullptr};
+	QLineEdit *m_couplingShells{};
+	QDoubleSpinBox *m_couplingShellTol{};
+
 	// variables
 	QTableWidget *m_varstab{};
 
@@ -253,6 +318,8 @@ protected:
 	QDoubleSpinBox *m_q_start[3]{nullptr, nullptr, nullptr};
 	QDoubleSpinBox *m_q_end[3]{nullptr, nullptr, nullptr};
 	QSpinBox *m_num_points{};
+	QCheckBox *m_adaptive_Q{};
+	QDoubleSpinBox *m_adaptive_E_tol{};
 	QDoubleSpinBox *m_weight_scale{}, *m_weight_min{}, *m_weight_max{};
 
 	// hamiltonian
@@ -281,6 +348,60 @@ protected:
 	QDoubleSpinBox *m_exportEndQ[3]{nullptr, nullptr, nullptr};
 	QSpinBox *m_exportNumPoints[3]{nullptr, nullptr, nullptr};
 	QComboBox *m_exportFormat{nullptr};
+	QSpinBox *m_exportCompression{nullptr};
+	QCheckBox *m_exportUseSymmetry{nullptr};
+	QCheckBox *m_exportTimeReversal{nullptr};
+	QCheckBox *m_exportCheckpoints{nullptr};
+	QDoubleSpinBox *m_exportCheckpointInterval{nullptr};
+
+	// parameter sweep
+	QTableWidget *m_sweeptab{};
+	QCustomPlot *m_sweepplot{};
+	QDoubleSpinBox *m_sweepStartQ[3]{nullptr, nullptr, nullptr};
+	QDoubleSpinBox *m_sweepEndQ[3]{nullptr, nullptr, nullptr};
+	QSpinBox *m_sweepNumQ{}, *m_sweepPlotQ{};
+	QComboBox *m_sweepFormat{};
+
+	// powder average
+	QCustomPlot *m_powderplot{};
+	QCPColorMap *m_powdermap{};
+	QDoubleSpinBox *m_powderQRange[2]{nullptr, nullptr};
+	QDoubleSpinBox *m_powderERange[2]{nullptr, nullptr};
+	QSpinBox *m_powderNumQ{}, *m_powderNumE{};
+	QSpinBox *m_powderNumDirs{};
+	QDoubleSpinBox *m_powderESigma{};
+	QComboBox *m_powderFormat{};
+
+	// S(Q, E) slice
+	QCustomPlot *m_sliceplot{};
+	QCPColorMap *m_slicemap{};
+	QComboBox *m_sliceMode{};
+	QDoubleSpinBox *m_sliceOrigin[3]{nullptr, nullptr, nullptr};
+	QDoubleSpinBox *m_sliceDir1[3]{nullptr, nullptr, nullptr};
+	QDoubleSpinBox *m_sliceDir2[3]{nullptr, nullptr, nullptr};
+	QDoubleSpinBox *m_sliceRange1[2]{nullptr, nullptr};
+	QDoubleSpinBox *m_sliceRange2[2]{nullptr, nullptr};
+	QSpinBox *m_sliceNumPoints[2]{nullptr, nullptr};
+	QDoubleSpinBox *m_sliceERange[2]{nullptr, nullptr};
+	QSpinBox *m_sliceNumE{};
+	QComboBox *m_sliceKernel{};
+	QDoubleSpinBox *m_sliceEWidth{};
+	QDoubleSpinBox *m_sliceQWidth[2]{nullptr, nullptr};
+	QDoubleSpinBox *m_slicePlotE{};
+	QComboBox *m_sliceFormat{};
+
+	// density of states and thermodynamics
+	QCustomPlot *m_dosplot{}, *m_thermoplot{};
+	QSpinBox *m_dosMesh[3]{nullptr, nullptr, nullptr};
+	QCheckBox *m_dosReduceInversion{};
+	QComboBox *m_dosMethod{};
+	QDoubleSpinBox *m_dosERange[2]{nullptr, nullptr};
+	QSpinBox *m_dosNumE{};
+	QDoubleSpinBox *m_dosEWidth{};
+	QDoubleSpinBox *m_dosTRange[2]{nullptr, nullptr};
+	QSpinBox *m_dosNumT{};
+	QComboBox *m_dosThermoQuantity{};
+	QLabel *m_dosConvergence{};
 
 	// magnon dynamics calculator
 	t_magdyn m_dyn{};
@@ -321,6 +442,10 @@ protected:
 	void CreateHamiltonPanel();
 	void CreateExportPanel();
 	void CreateCoordinatesPanel();
+	void CreateSweepPanel();
+	void CreatePowderPanel();
+	void CreateSlicePanel();
+	void CreateDosPanel();
 
 	// general table operations
 	void MoveTabItemUp(QTableWidget *pTab);
@@ -361,8 +486,15 @@ protected:
 		t_real Bh = 0., t_real Bk = 0., t_real Bl = 1.,
 		t_real Bmag = 1.);
 
+	void AddSweepTabItem(int row = -1,
+		const std::string& name = "field",
+		t_real start = 0., t_real end = 1.,
+		t_size num_points = 16);
+
 	void SetCurrentField();
 	void SetCurrentCoordinate(int which = 0);
+	void SetCoordinatePath(bool enable = true);
+	std::vector<DispersionSegment> GetCoordinatePath() const;
 
 	void DelTabItem(QTableWidget *pTab, int begin=-2, int end=-2);
 	void UpdateVerticalHeader(QTableWidget *pTab);
@@ -378,10 +510,11 @@ protected:
 	void Save();
 	void SaveAs();
 	void ExportSQE();
+	void ResumeExportSQE();
 
 	bool Load(const QString& filename);
 	bool Save(const QString& filename);
-	bool ExportSQE(const QString& filename);
+	bool ExportSQE(const QString& filename, bool resume = false);
 
 	void SavePlotFigure();
 	void SaveDispersion();
@@ -390,20 +523,60 @@ protected:
 	void RotateField(bool ccw = true);
 	void GenerateSitesFromSG();
 	void GenerateCouplingsFromSG();
+	void GenerateCouplingsByDistance();
 
 	std::optional<t_size> GetTermAtomIndex(int row, int num) const;
 	void SyncSitesAndTerms();
+	MagDynConfig GetCalcConfig() const;
 
 	void CalcAll();
 	void CalcAllDynamics();
+	void RequestCalc(unsigned int what);
+	void RunRequestedCalc();
 	void CalcDispersion();
 	void CalcHamiltonian();
 
 	void PlotDispersion();
+	void SetDispersionData(const std::vector<SofQE>& results);
+	void UpdatePartialDispersion();
+	void StopCalculations();
+
+	// background calculations
+	using t_job_calc = std::function<bool(const t_calc_progress& progress, const std::stop_token& stop)>;
+	using t_job_done = std::function<void(bool finished, const std::string& error)>;
+	void StartCalcJob(CalcJob& job, const t_job_calc& calc, const t_job_done& done);
+	void StopCalcJob(CalcJob& job);
 
 	void PlotMouseMove(QMouseEvent* evt);
 	void PlotMousePress(QMouseEvent* evt);
 
+	// parameter sweep
+	std::vector<SweepParameter> GetSweepParameters() const;
+	void CalcSweep();
+	void PlotSweep();
+	void SaveSweep();
+
+	// fitting of the variables
+	std::vector<std::string> GetFitVariables() const;
+	void FitVariables();
+	void SetFitResults(const FitResults& results);
+
+	// powder average
+	void CalcPowder();
+	void PlotPowder();
+	void SavePowder();
+
+	// S(Q, E) slice
+	void CalcSlice();
+	void PlotSlice();
+	void SaveSlice();
+
+	// density of states and thermodynamics
+	std::string GetDosMeshKey(const MagDynConfig& cfg) const;
+	void CalcDos();
+	void PlotDos();
+	void SaveDos();
+
 	virtual void mousePressEvent(QMouseEvent *evt) override;
 	virtual void closeEvent(QCloseEvent *evt) override;
 	virtual void dragEnterEvent(QDragEnterEvent *evt) override;
@@ -433,6 +606,14 @@ protected:
 	void EnableInput();
 	void DisableInput();
 
+	// thread pool settings
+	void SetNumThreads();
+	void RestartThreadPool(unsigned int num_threads, bool pin_threads);
+
+	// profiling of the calculation stages
+	void ShowProfile();
+	void SaveProfileTrace();
+
 
 private:
 	int m_sites_cursor_row = -1;
@@ -440,10 +621,36 @@ private:
 	int m_variables_cursor_row = -1;
 	int m_fields_cursor_row = -1;
 	int m_coordinates_cursor_row = -1;
+	int m_sweep_cursor_row = -1;
 
 	bool m_ignoreTableChanges = true;
 	bool m_ignoreCalc = false;
-	bool m_stopRequested = false;
+
+	// background calculations, stopped via their stop tokens
+	CalcJob m_disp_job{};
+	CalcJob m_export_job{};
+	CalcJob m_sweep_job{};
+	std::shared_ptr<const SweepResults> m_sweep_results{};
+	CalcJob m_fit_job{};
+	CalcJob m_powder_job{};
+	std::shared_ptr<const PowderResults> m_powder_results{};
+	CalcJob m_slice_job{};
+	std::shared_ptr<const SliceResults> m_slice_results{};
+	CalcJob m_dos_job{};
+	std::shared_ptr<const DosMeshes> m_dos_meshes{};
+	std::string m_dos_mesh_key{};      // structure and mesh the meshes belong to
+	std::shared_ptr<const DosResults> m_dos_results{};
+
+	// partial dispersion results, handed over by the calculation threads
+	std::mutex m_disp_mtx{};
+	std::vector<std::pair<t_size, SofQE>> m_disp_pending{};
+	std::vector<SofQE> m_disp_results{};
+	bool m_disp_use_weights{true};
+	QTimer *m_disp_timer{};
+
+	// debounced automatic calculation
+	QTimer *m_calc_timer{};
+	unsigned int m_calc_requested{};  // CALC_* flags
 
 	// data for dispersion plot
 	QVector<t_real> m_qs_data{}, m_Es_data{}, m_ws_data{};
@@ -451,6 +658,11 @@ private:
 	t_size m_Q_idx{};                 // plot x axis
 	t_real m_Q_start{}, m_Q_end{};    // plot x axis range
 
+	// multi-segment path along the saved coordinates
+	bool m_disp_path{false};
+	MagDynConfig m_disp_path_cfg{};
+	std::vector<t_path_tick> m_disp_path_ticks{};
+
 	// reference object handles
 	std::size_t m_structplot_sphere = 0;
 	std::size_t m_structplot_arrow = 0;
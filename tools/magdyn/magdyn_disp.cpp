@@ -28,17 +28,18 @@
 
 // these need to be included before all other things on mingw
 #include <boost/scope_exit.hpp>
-#include <boost/asio.hpp>
-namespace asio = boost::asio;
 
 #include "magdyn.h"
+#include "profiler.h"
 
 #include <QtWidgets/QApplication>
+#include <QtWidgets/QMessageBox>
 
 #include <sstream>
 #include <thread>
-#include <future>
-#include <mutex>
+#include <memory>
+#include <numeric>
+#include <algorithm>
 
 #include "tlibs2/libs/phys.h"
 #include "tlibs2/libs/algos.h"
@@ -76,6 +77,8 @@ void MagDynDlg::ClearDispersion(bool replot)
 	}
 
 	m_Q_idx = 0;
+	m_disp_path = false;
+	m_disp_path_ticks.clear();
 }
 
 
@@ -143,8 +146,22 @@ void MagDynDlg::PlotDispersion()
 	}
 
 	// set labels
-	const char* Q_label[]{ "h (rlu)", "k (rlu)", "l (rlu)" };
-	m_plot->xAxis->setLabel(Q_label[m_Q_idx]);
+	if(m_disp_path)
+	{
+		// label the path's vertices
+		auto ticker = QSharedPointer<QCPAxisTickerText>::create();
+		for(const auto& [pos, label] : m_disp_path_ticks)
+			ticker->addTick(pos, label.c_str());
+
+		m_plot->xAxis->setTicker(ticker);
+		m_plot->xAxis->setLabel("Q Path (1/A)");
+	}
+	else
+	{
+		const char* Q_label[]{ "h (rlu)", "k (rlu)", "l (rlu)" };
+		m_plot->xAxis->setTicker(QSharedPointer<QCPAxisTicker>::create());
+		m_plot->xAxis->setLabel(Q_label[m_Q_idx]);
+	}
 
 	// set ranges
 	auto [min_E_iter, max_E_iter] = std::minmax_element(m_Es_data.begin(), m_Es_data.end());
@@ -170,18 +187,125 @@ void MagDynDlg::PlotDispersion()
 
 
 /**
- * calculate the dispersion branches
+ * set the dispersion plot data from the results, which are ordered by Q
+ */
+void MagDynDlg::SetDispersionData(const std::vector<SofQE>& results)
+{
+	m_qs_data.clear();
+	m_Es_data.clear();
+	m_ws_data.clear();
+
+	for(int i=0; i<3; ++i)
+	{
+		m_qs_data_channel[i].clear();
+		m_Es_data_channel[i].clear();
+		m_ws_data_channel[i].clear();
+	}
+
+	auto get_q = [this](const SofQE& result) -> t_real
+	{
+		if(m_disp_path)
+			return result.path_pos;
+
+		const t_real Q[] { result.h, result.k, result.l };
+		return Q[m_Q_idx];
+	};
+
+	// the plot expects the data sorted by Q, but adaptively
+	// refined results arrive in the order of their calculation
+	std::vector<t_size> order(results.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(),
+		[&results, &get_q](t_size idx1, t_size idx2) -> bool
+	{
+		return get_q(results[idx1]) < get_q(results[idx2]);
+	});
+
+	// concatenate the results, slots not yet calculated are empty
+	for(t_size idx : order)
+	{
+		const SofQE& result = results[idx];
+		const t_real q = get_q(result);
+
+		for(std::size_t branch=0; branch<result.E.size(); ++branch)
+		{
+			const t_real E = result.E[branch];
+
+			m_qs_data.push_back(q);
+			m_Es_data.push_back(E);
+
+			// weights
+			if(!m_disp_use_weights)
+				continue;
+
+			m_ws_data.push_back(result.S[branch]);
+
+			for(int channel=0; channel<3; ++channel)
+			{
+				t_real weight_channel = result.S_channel[channel][branch];
+				if(!tl2::equals_0<t_real>(weight_channel, g_eps))
+				{
+					m_Es_data_channel[channel].push_back(E);
+					m_qs_data_channel[channel].push_back(q);
+					m_ws_data_channel[channel].push_back(weight_channel);
+				}
+			}
+		}
+	}
+}
+
+
+/**
+ * plot the dispersion results that have been calculated so far
+ */
+void MagDynDlg::UpdatePartialDispersion()
+{
+	{
+		std::lock_guard lock{m_disp_mtx};
+		if(m_disp_pending.size() == 0)
+			return;
+
+		for(auto& [idx, result] : m_disp_pending)
+		{
+			if(idx < m_disp_results.size())
+				m_disp_results[idx] = std::move(result);
+		}
+		m_disp_pending.clear();
+	}
+
+	SetDispersionData(m_disp_results);
+	PlotDispersion();
+}
+
+
+/**
+ * request all running background calculations to stop
+ */
+void MagDynDlg::StopCalculations()
+{
+	for(CalcJob* job : { &m_disp_job, &m_export_job, &m_sweep_job,
+		&m_fit_job, &m_powder_job, &m_slice_job, &m_dos_job })
+		job->thread.request_stop();
+}
+
+
+/**
+ * calculate the dispersion branches in a background thread
  */
 void MagDynDlg::CalcDispersion()
 {
 	if(m_ignoreCalc)
 		return;
 
-	BOOST_SCOPE_EXIT(this_)
+	// stop a still running calculation, its stop token keeps
+	// it from handing over further partial results
+	StopCalcJob(m_disp_job);
+	m_disp_timer->stop();
 	{
-		this_->EnableInput();
-	} BOOST_SCOPE_EXIT_END
-	DisableInput();
+		std::lock_guard lock{m_disp_mtx};
+		m_disp_pending.clear();
+	}
+	m_disp_results.clear();
 
 	// nothing to calculate?
 	if(m_dyn.GetAtomSites().size()==0 || m_dyn.GetExchangeTerms().size()==0)
@@ -224,44 +348,14 @@ void MagDynDlg::CalcDispersion()
 
 	t_size num_pts = m_num_points->value();
 
-	m_qs_data.reserve(num_pts*10);
-	m_Es_data.reserve(num_pts*10);
-	m_ws_data.reserve(num_pts*10);
-
-	for(int i=0; i<3; ++i)
-	{
-		m_qs_data_channel[i].reserve(num_pts*10);
-		m_Es_data_channel[i].reserve(num_pts*10);
-		m_ws_data_channel[i].reserve(num_pts*10);
-	}
-
 	m_Q_start = Q_start[m_Q_idx];
 	m_Q_end = Q_end[m_Q_idx];
 
 	// options
-	const bool use_goldstone = false;
-	const bool unite_degeneracies = m_unite_degeneracies->isChecked();
-	const bool ignore_annihilation = m_ignore_annihilation->isChecked();
-	const bool use_weights = m_use_weights->isChecked();
-	const bool use_projector = m_use_projector->isChecked();
-	const bool force_incommensurate = m_force_incommensurate->isChecked();
-
-	t_real E0 = use_goldstone ? m_dyn.GetGoldstoneEnergy() : 0.;
-	m_dyn.SetUniteDegenerateEnergies(unite_degeneracies);
-	m_dyn.SetForceIncommensurate(force_incommensurate);
-
-	// tread pool
-	unsigned int num_threads = std::max<unsigned int>(
-		1, std::thread::hardware_concurrency()/2);
-	asio::thread_pool pool{num_threads};
-
-	// mutex to protect m_qs_data, m_Es_data, and m_ws_data
-	std::mutex mtx;
-
-	using t_task = std::packaged_task<void()>;
-	using t_taskptr = std::shared_ptr<t_task>;
-	std::vector<t_taskptr> tasks;
-	tasks.reserve(num_pts);
+	MagDynConfig cfg = GetCalcConfig();
+	m_dyn.SetUniteDegenerateEnergies(cfg.unite_degeneracies);
+	m_dyn.SetForceIncommensurate(cfg.force_incommensurate);
+	m_disp_use_weights = cfg.use_weights;
 
 	// keep the scanned Q component in ascending order
 	if(Q_start[m_Q_idx] > Q_end[m_Q_idx])
@@ -271,120 +365,74 @@ void MagDynDlg::CalcDispersion()
 		std::swap(Q_start[2], Q_end[2]);
 	}
 
-	m_stopRequested = false;
-	m_progress->setMinimum(0);
-	m_progress->setMaximum(num_pts);
-	m_progress->setValue(0);
-	m_status->setText("Starting calculation.");
-
-	for(t_size i=0; i<num_pts; ++i)
+	for(int i=0; i<3; ++i)
 	{
-		auto task = [this, &mtx, i, num_pts, E0,
-			use_projector, use_weights, ignore_annihilation,
-			&Q_start, &Q_end]()
-		{
-			const t_vec_real Q = tl2::create<t_vec_real>(
-			{
-				std::lerp(Q_start[0], Q_end[0], t_real(i)/t_real(num_pts-1)),
-				std::lerp(Q_start[1], Q_end[1], t_real(i)/t_real(num_pts-1)),
-				std::lerp(Q_start[2], Q_end[2], t_real(i)/t_real(num_pts-1)),
-			});
-
-			auto energies_and_correlations = m_dyn.GetEnergies(Q, !use_weights);
-
-			for(const auto& E_and_S : energies_and_correlations)
-			{
-				if(m_stopRequested)
-					break;
-
-				t_real E = E_and_S.E - E0;
-				if(std::isnan(E) || std::isinf(E))
-					continue;
-				if(ignore_annihilation && E < t_real(0))
-					continue;
-
-				std::lock_guard<std::mutex> _lck{mtx};
-
-				// weights
-				if(use_weights)
-				{
-					t_real weight = use_projector ? E_and_S.weight : E_and_S.weight_full;
-					if(std::isnan(weight) || std::isinf(weight))
-						continue;
-
-					m_ws_data.push_back(weight);
-					//std::cout << Q[m_Q_idx] << " " << E << " " << weight << std::endl;
-
-					for(int channel=0; channel<3; ++channel)
-					{
-						t_real weight_channel = use_projector
-							? E_and_S.weight_channel[channel]
-							: E_and_S.weight_channel_full[channel];
-						if(!tl2::equals_0<t_real>(weight_channel, g_eps))
-						{
-							m_Es_data_channel[channel].push_back(E);
-							m_qs_data_channel[channel].push_back(Q[m_Q_idx]);
-							m_ws_data_channel[channel].push_back(weight_channel);
-						}
-					}
-				}
+		cfg.Q_start[i] = Q_start[i];
+		cfg.Q_end[i] = Q_end[i];
+	}
 
-				m_qs_data.push_back(Q[m_Q_idx]);
-				m_Es_data.push_back(E);
-			}
-		};
+	// calculate along all saved coordinates
+	m_disp_path = m_disp_path_mode->isChecked() && cfg.Q_path.size() > 0;
+	m_disp_path_ticks.clear();
+	if(m_disp_path)
+	{
+		m_disp_path_cfg = cfg;
+		m_disp_path_ticks = get_dispersion_path_ticks(cfg);
+		m_Q_start = m_disp_path_ticks.front().first;
+		m_Q_end = m_disp_path_ticks.back().first;
 
-		t_taskptr taskptr = std::make_shared<t_task>(task);
-		tasks.push_back(taskptr);
-		asio::post(pool, [taskptr]() { (*taskptr)(); });
+		num_pts = get_dispersion_path_num_points(cfg);
 	}
 
+	m_disp_results.resize(num_pts);
 	m_status->setText("Performing calculation.");
+	m_disp_timer->start();
 
-	for(std::size_t task_idx=0; task_idx<tasks.size(); ++task_idx)
-	{
-		t_taskptr task = tasks[task_idx];
+	// the calculation thread works on its own copy of the magnon calculator
+	auto dyn = std::make_shared<const t_magdyn>(m_dyn);
+	auto results = std::make_shared<std::vector<SofQE>>();
+	const bool path = m_disp_path;
 
-		qApp->processEvents();  // process events to see if the stop button was clicked
-		if(m_stopRequested)
+	StartCalcJob(m_disp_job, [this, dyn, cfg, results, path](
+		const t_calc_progress& progress, const std::stop_token& stop) -> bool
+	{
+		// every Q point is calculated into its own result slot,
+		// which are already ordered by Q and need no locking
+		auto on_result = [this, &stop](t_size idx, const SofQE& result)
 		{
-			pool.stop();
-			break;
-		}
-
-		task->get_future().get();
-		m_progress->setValue(task_idx+1);
-	}
-
-	pool.join();
-
-	if(m_stopRequested)
-		m_status->setText("Calculation stopped.");
-	else
-		m_status->setText("Calculation finished.");
+			// hand over the finished point for the progressive plot
+			std::lock_guard lock{m_disp_mtx};
+			if(!stop.stop_requested())
+				m_disp_pending.emplace_back(idx, result);
+		};
 
-	auto sort_data = [](QVector<t_real>& qvec, QVector<t_real>& Evec, QVector<t_real>& wvec)
+		if(path)
+			return calc_dispersion_path(*dyn, cfg, *results, *m_pool, progress, on_result);
+		return calc_dispersion(*dyn, cfg, *results, *m_pool, progress, on_result);
+	}, [this, results](bool finished, const std::string& error)
 	{
-		// sort vectors by q component
-		std::vector<std::size_t> perm = tl2::get_perm(qvec.size(),
-			[&qvec, &Evec](std::size_t idx1, std::size_t idx2) -> bool
+		m_disp_timer->stop();
 		{
-			// if q components are equal, sort by E
-			if(tl2::equals(qvec[idx1], qvec[idx2], g_eps))
-				return Evec[idx1] < Evec[idx2];
-			return qvec[idx1] < qvec[idx2];
-		});
+			std::lock_guard lock{m_disp_mtx};
+			m_disp_pending.clear();
+		}
 
-		qvec = tl2::reorder(qvec, perm);
-		Evec = tl2::reorder(Evec, perm);
-		wvec = tl2::reorder(wvec, perm);
-	};
+		if(error != "")
+		{
+			m_status->setText("Calculation failed.");
+			QMessageBox::critical(this, "Magnetic Dynamics", error.c_str());
+			return;
+		}
 
-	sort_data(m_qs_data, m_Es_data, m_ws_data);
-	for(int i=0; i<3; ++i)
-		sort_data(m_qs_data_channel[i], m_Es_data_channel[i], m_ws_data_channel[i]);
+		m_disp_results = std::move(*results);
+		SetDispersionData(m_disp_results);
+		PlotDispersion();
 
-	PlotDispersion();
+		QString status = finished ? "Calculation finished." : "Calculation stopped.";
+		if(is_profiling())
+			status += QString(" ") + get_profile_status().c_str() + ".";
+		m_status->setText(status);
+	});
 }
 
 
@@ -672,10 +720,10 @@ void MagDynDlg::SetCurrentCoordinate(int which)
 		BOOST_SCOPE_EXIT(this_)
 		{
 			this_->m_ignoreCalc = false;
-			if(this_->m_autocalc->isChecked())
-				this_->CalcDispersion();
+			this_->RequestCalc(CALC_DISPERSION);
 		} BOOST_SCOPE_EXIT_END
 
+		m_disp_path_mode->setChecked(false);
 		m_q_start[0]->setValue(hi->GetValue());
 		m_q_start[1]->setValue(ki->GetValue());
 		m_q_start[2]->setValue(li->GetValue());
@@ -695,8 +743,7 @@ void MagDynDlg::SetCurrentCoordinate(int which)
 		BOOST_SCOPE_EXIT(this_)
 		{
 			this_->m_ignoreCalc = false;
-			if(this_->m_autocalc->isChecked())
-				this_->CalcHamiltonian();
+			this_->RequestCalc(CALC_HAMILTONIAN);
 		} BOOST_SCOPE_EXIT_END
 
 		m_q[0]->setValue(hi->GetValue());
@@ -715,8 +762,7 @@ void MagDynDlg::SetCurrentCoordinate(int which)
 		BOOST_SCOPE_EXIT(this_)
 		{
 			this_->m_ignoreCalc = false;
-			if(this_->m_autocalc->isChecked())
-				this_->CalcHamiltonian();
+			this_->RequestCalc(CALC_HAMILTONIAN);
 		} BOOST_SCOPE_EXIT_END
 
 		m_q[0]->setValue(hf->GetValue());
@@ -726,6 +772,58 @@ void MagDynDlg::SetCurrentCoordinate(int which)
 }
 
 
+/**
+ * use all saved coordinates as consecutive segments of the dispersion path
+ */
+void MagDynDlg::SetCoordinatePath(bool enable)
+{
+	if(m_disp_path_mode->isChecked() == enable)
+		RequestCalc(CALC_DISPERSION);
+	else
+		m_disp_path_mode->setChecked(enable);  // requests the calculation
+}
+
+
+/**
+ * get the saved coordinates as segments of a dispersion path
+ */
+std::vector<DispersionSegment> MagDynDlg::GetCoordinatePath() const
+{
+	std::vector<DispersionSegment> path;
+	path.reserve(m_coordinatestab->rowCount());
+
+	for(int row = 0; row < m_coordinatestab->rowCount(); ++row)
+	{
+		const auto* hi = static_cast<tl2::NumericTableWidgetItem<t_real>*>(
+			m_coordinatestab->item(row, COL_COORD_HI));
+		const auto* ki = static_cast<tl2::NumericTableWidgetItem<t_real>*>(
+			m_coordinatestab->item(row, COL_COORD_KI));
+		const auto* li = static_cast<tl2::NumericTableWidgetItem<t_real>*>(
+			m_coordinatestab->item(row, COL_COORD_LI));
+		const auto* hf = static_cast<tl2::NumericTableWidgetItem<t_real>*>(
+			m_coordinatestab->item(row, COL_COORD_HF));
+		const auto* kf = static_cast<tl2::NumericTableWidgetItem<t_real>*>(
+			m_coordinatestab->item(row, COL_COORD_KF));
+		const auto* lf = static_cast<tl2::NumericTableWidgetItem<t_real>*>(
+			m_coordinatestab->item(row, COL_COORD_LF));
+
+		if(!hi || !ki || !li || !hf || !kf || !lf)
+			continue;
+
+		DispersionSegment segment;
+		segment.Q_start[0] = hi->GetValue();
+		segment.Q_start[1] = ki->GetValue();
+		segment.Q_start[2] = li->GetValue();
+		segment.Q_end[0] = hf->GetValue();
+		segment.Q_end[1] = kf->GetValue();
+		segment.Q_end[2] = lf->GetValue();
+		path.emplace_back(std::move(segment));
+	}
+
+	return path;
+}
+
+
 /**
  * mouse move event of the plot
  */
@@ -737,7 +835,7 @@ void MagDynDlg::PlotMouseMove(QMouseEvent* evt)
 	t_real Q = m_plot->xAxis->pixelToCoord(evt->pos().x());
 	t_real E = m_plot->yAxis->pixelToCoord(evt->pos().y());
 
-	QString status("Q = %1 rlu, E = %2 meV.");
+	QString status(m_disp_path ? "Q path = %1 / A, E = %2 meV." : "Q = %1 rlu, E = %2 meV.");
 	status = status.arg(Q, 0, 'g', g_prec_gui).arg(E, 0, 'g', g_prec_gui);
 	m_status->setText(status);
 }
@@ -0,0 +1,236 @@
+/**
+ * magnetic dynamics -- density of states and thermodynamics
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "magdyn.h"
+
+#include <QtCore/QFileInfo>
+#include <QtWidgets/QFileDialog>
+#include <QtWidgets/QMessageBox>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+
+#include <sstream>
+#include <memory>
+
+
+/**
+ * identifies the magnetic structure and the k mesh of the calculated energies
+ */
+std::string MagDynDlg::GetDosMeshKey(const MagDynConfig& cfg) const
+{
+	boost::property_tree::ptree node;
+	m_dyn.Save(node);
+
+	std::ostringstream ostr;
+	boost::property_tree::write_xml(ostr, node);
+	ostr << "\n" << cfg.dos_mesh[0] << " " << cfg.dos_mesh[1] << " " << cfg.dos_mesh[2]
+		<< " " << cfg.dos_reduce_inversion;
+
+	return ostr.str();
+}
+
+
+/**
+ * calculate the density of states in a background thread,
+ * the energies on the k mesh are re-used if the structure has not changed
+ */
+void MagDynDlg::CalcDos()
+{
+	SyncSitesAndTerms();
+
+	const MagDynConfig cfg = GetCalcConfig();
+	if(cfg.dos_T_range[1] < cfg.dos_T_range[0])
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics", "Invalid temperature range.");
+		return;
+	}
+
+	const std::string mesh_key = GetDosMeshKey(cfg);
+	std::shared_ptr<const DosMeshes> meshes{};
+	if(m_dos_meshes && mesh_key == m_dos_mesh_key)
+		meshes = m_dos_meshes;
+
+	m_status->setText(meshes ? "Calculating density of states." : "Calculating energies on the k mesh.");
+	m_btnDos->setEnabled(false);
+
+	// the dos thread works on its own copy of the magnon calculator
+	auto dyn = std::make_shared<const t_magdyn>(m_dyn);
+	auto new_meshes = std::make_shared<std::shared_ptr<const DosMeshes>>(meshes);
+	auto results = std::make_shared<DosResults>();
+
+	StartCalcJob(m_dos_job, [this, dyn, cfg, new_meshes, results](
+		const t_calc_progress& progress, const std::stop_token& stop) -> bool
+	{
+		if(!*new_meshes)
+		{
+			auto calc_meshes = std::make_shared<DosMeshes>();
+			if(!calc_dos_meshes(*dyn, cfg, *calc_meshes, *m_pool, progress))
+				return false;
+			*new_meshes = calc_meshes;
+		}
+
+		return !stop.stop_requested() && calc_dos(**new_meshes, cfg, *results, *m_pool);
+	}, [this, new_meshes, mesh_key, results](bool finished, const std::string& error)
+	{
+		m_btnDos->setEnabled(true);
+
+		if(error != "")
+		{
+			m_status->setText("Density of states failed.");
+			QMessageBox::critical(this, "Magnetic Dynamics", error.c_str());
+			return;
+		}
+
+		// keep the energies even if the rest was stopped
+		if(*new_meshes)
+		{
+			m_dos_meshes = *new_meshes;
+			m_dos_mesh_key = mesh_key;
+		}
+
+		if(!finished)
+		{
+			m_status->setText("Density of states stopped.");
+			return;
+		}
+
+		m_dos_results = results;
+		PlotDos();
+		m_status->setText("Density of states finished.");
+	});
+}
+
+
+/**
+ * show the density of states and the selected thermodynamic quantity
+ */
+void MagDynDlg::PlotDos()
+{
+	if(!m_dosplot || !m_thermoplot)
+		return;
+
+	m_dosplot->clearPlottables();
+	m_thermoplot->clearPlottables();
+
+	if(!m_dos_results)
+	{
+		m_dosConvergence->setText("");
+		m_dosplot->replot();
+		m_thermoplot->replot();
+		return;
+	}
+
+	const DosResults& results = *m_dos_results;
+
+	// density of states
+	QVector<t_real> Es, dos;
+	Es.reserve(results.num_E);
+	dos.reserve(results.num_E);
+	for(t_size E_idx=0; E_idx<results.num_E; ++E_idx)
+	{
+		Es.push_back(results.GetE(E_idx));
+		dos.push_back(results.dos[E_idx]);
+	}
+
+	QCPGraph *dosgraph = m_dosplot->addGraph();
+	QPen pen = dosgraph->pen();
+	pen.setColor(QColor(0xff, 0x00, 0x00));
+	pen.setWidthF(1.);
+	dosgraph->setPen(pen);
+	dosgraph->setLineStyle(QCPGraph::lsStepCenter);
+	dosgraph->setAntialiased(true);
+	dosgraph->setData(Es, dos, true /*already sorted*/);
+
+	// thermodynamics
+	const std::vector<t_real>* quantity = &results.heat;
+	QString label = "C (k_B)";
+	switch(m_dosThermoQuantity->currentData().toInt())
+	{
+		case 1: quantity = &results.energy; label = "U (meV)"; break;
+		case 2: quantity = &results.entropy; label = "S (k_B)"; break;
+		case 3: quantity = &results.free_energy; label = "F (meV)"; break;
+		case 4: quantity = &results.magnons; label = "Magnons per Site"; break;
+	}
+
+	QVector<t_real> Ts(results.temperatures.begin(), results.temperatures.end());
+	QVector<t_real> values(quantity->begin(), quantity->end());
+
+	QCPGraph *thermograph = m_thermoplot->addGraph();
+	thermograph->setPen(pen);
+	thermograph->setAntialiased(true);
+	thermograph->setData(Ts, values, true /*already sorted*/);
+	m_thermoplot->yAxis->setLabel(label);
+
+	// convergence
+	if(results.has_convergence)
+	{
+		m_dosConvergence->setText(QString("Change vs. %1x%2x%3 mesh: "
+			"mean E: %4 %, C: %5 %.")
+			.arg(results.coarse_dims[0])
+			.arg(results.coarse_dims[1])
+			.arg(results.coarse_dims[2])
+			.arg(results.conv_mean_E * 100., 0, 'g', g_prec_gui)
+			.arg(results.conv_heat * 100., 0, 'g', g_prec_gui));
+	}
+	else
+	{
+		m_dosConvergence->setText("");
+	}
+
+	m_dosplot->rescaleAxes();
+	m_dosplot->replot();
+	m_thermoplot->rescaleAxes();
+	m_thermoplot->replot();
+}
+
+
+/**
+ * save the density of states and the thermodynamics
+ */
+void MagDynDlg::SaveDos()
+{
+	if(!m_dos_results)
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics", "No density of states has been calculated.");
+		return;
+	}
+
+	QString dirLast = m_sett->value("dir", "").toString();
+	QString filename = QFileDialog::getSaveFileName(
+		this, "Save Density of States", dirLast, "Data Files (*.dat)");
+	if(filename == "")
+		return;
+	m_sett->setValue("dir", QFileInfo(filename).path());
+
+	if(!save_dos(filename.toStdString(), *m_dos_results))
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics",
+			"Cannot open file for writing.");
+	}
+}
@@ -28,8 +28,6 @@
 
 // these need to be included before all other things on mingw
 #include <boost/scope_exit.hpp>
-#include <boost/asio.hpp>
-namespace asio = boost::asio;
 
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
@@ -43,21 +41,13 @@ namespace pt = boost::property_tree;
 #include <iostream>
 #include <fstream>
 #include <sstream>
-#include <future>
-#include <mutex>
 #include <vector>
 #include <deque>
+#include <memory>
 #include <cstdlib>
 
 #include "tlibs2/libs/log.h"
 
-#ifdef USE_HDF5
-	#include "tlibs2/libs/h5file.h"
-#endif
-
-
-// for debugging: write individual data chunks in hdf5 file
-//#define WRITE_HDF5_CHUNKS
 
 // precision
 extern int g_prec;
@@ -76,14 +66,29 @@ void MagDynDlg::Clear()
 	} BOOST_SCOPE_EXIT_END
 	m_ignoreCalc = true;
 
+	// discard the results of a running dispersion calculation
+	StopCalcJob(m_disp_job);
+	m_disp_timer->stop();
+
 	// clear old tables
 	DelTabItem(m_sitestab, -1);
 	DelTabItem(m_termstab, -1);
 	DelTabItem(m_varstab, -1);
 	DelTabItem(m_fieldstab, -1);
 	DelTabItem(m_coordinatestab, -1);
+	DelTabItem(m_sweeptab, -1);
 
 	ClearDispersion(true);
+	m_sweep_results.reset();
+	PlotSweep();
+	m_powder_results.reset();
+	PlotPowder();
+	m_slice_results.reset();
+	PlotSlice();
+	m_dos_meshes.reset();
+	m_dos_mesh_key.clear();
+	m_dos_results.reset();
+	PlotDos();
 	m_hamiltonian->clear();
 	m_dyn.Clear();
 
@@ -104,6 +109,13 @@ void MagDynDlg::Clear()
 	m_weight_min->setValue(0.);
 	m_weight_max->setValue(9999.);
 
+	for(int i=0; i<3; ++i)
+	{
+		m_xtallattice[i]->setValue(5.);
+		m_xtalangles[i]->setValue(90.);
+	}
+	m_couplingShells->clear();
+
 	m_notes->clear();
 }
 
@@ -154,8 +166,7 @@ bool MagDynDlg::Load(const QString& filename)
 		BOOST_SCOPE_EXIT(this_)
 		{
 			this_->m_ignoreCalc = false;
-			if(this_->m_autocalc->isChecked())
-				this_->CalcAll();
+			this_->RequestCalc(CALC_ALL);
 		} BOOST_SCOPE_EXIT_END
 		m_ignoreCalc = true;
 
@@ -211,6 +222,10 @@ bool MagDynDlg::Load(const QString& filename)
 			m_q[2]->setValue(*optVal);
 		if(auto optVal = magdyn.get_optional<t_size>("config.num_Q_points"))
 			m_num_points->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<bool>("config.adaptive_Q"))
+			m_adaptive_Q->setChecked(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.adaptive_E_tol"))
+			m_adaptive_E_tol->setValue(*optVal);
 		if(auto optVal = magdyn.get_optional<t_real>("config.weight_scale"))
 			m_weight_scale->setValue(*optVal);
 		if(auto optVal = magdyn.get_optional<t_real>("config.weight_min"))
@@ -235,6 +250,8 @@ bool MagDynDlg::Load(const QString& filename)
 			m_ignore_annihilation->setChecked(*optVal);
 		if(auto optVal = magdyn.get_optional<bool>("config.force_incommensurate"))
 			m_force_incommensurate->setChecked(*optVal);
+		if(auto optVal = magdyn.get_optional<bool>("config.cache_phases"))
+			m_cache_phases->setChecked(*optVal);
 		if(auto optVal = magdyn.get_optional<bool>("config.use_projector"))
 			m_use_projector->setChecked(*optVal);
 		if(auto optVal = magdyn.get_optional<t_real>("config.field_axis_h"))
@@ -265,6 +282,117 @@ bool MagDynDlg::Load(const QString& filename)
 			m_exportNumPoints[1]->setValue(*optVal);
 		if(auto optVal = magdyn.get_optional<t_size>("config.export_num_points_3"))
 			m_exportNumPoints[2]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<int>("config.export_compression"))
+			m_exportCompression->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<bool>("config.export_use_symmetry"))
+			m_exportUseSymmetry->setChecked(*optVal);
+		if(auto optVal = magdyn.get_optional<bool>("config.export_time_reversal"))
+			m_exportTimeReversal->setChecked(*optVal);
+		if(auto optVal = magdyn.get_optional<bool>("config.export_checkpoints"))
+			m_exportCheckpoints->setChecked(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.export_checkpoint_interval"))
+			m_exportCheckpointInterval->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.powder_Q_min"))
+			m_powderQRange[0]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.powder_Q_max"))
+			m_powderQRange[1]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.powder_E_min"))
+			m_powderERange[0]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.powder_E_max"))
+			m_powderERange[1]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_size>("config.powder_num_Q"))
+			m_powderNumQ->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_size>("config.powder_num_E"))
+			m_powderNumE->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_size>("config.powder_num_dirs"))
+			m_powderNumDirs->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.powder_E_sigma"))
+			m_powderESigma->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<int>("config.slice_mode"))
+		{
+			if(int idx = m_sliceMode->findData(*optVal); idx >= 0)
+				m_sliceMode->setCurrentIndex(idx);
+		}
+		for(int i=0; i<3; ++i)
+		{
+			const std::string comp{"hkl"[i]};
+
+			if(auto optVal = magdyn.get_optional<t_real>("config.slice_origin_" + comp))
+				m_sliceOrigin[i]->setValue(*optVal);
+			if(auto optVal = magdyn.get_optional<t_real>("config.slice_dir1_" + comp))
+				m_sliceDir1[i]->setValue(*optVal);
+			if(auto optVal = magdyn.get_optional<t_real>("config.slice_dir2_" + comp))
+				m_sliceDir2[i]->setValue(*optVal);
+		}
+		for(int i=0; i<2; ++i)
+		{
+			const std::string idx = std::to_string(i+1);
+			QDoubleSpinBox **range = i == 0 ? m_sliceRange1 : m_sliceRange2;
+
+			if(auto optVal = magdyn.get_optional<t_real>("config.slice_min_" + idx))
+				range[0]->setValue(*optVal);
+			if(auto optVal = magdyn.get_optional<t_real>("config.slice_max_" + idx))
+				range[1]->setValue(*optVal);
+			if(auto optVal = magdyn.get_optional<t_size>("config.slice_num_points_" + idx))
+				m_sliceNumPoints[i]->setValue(*optVal);
+			if(auto optVal = magdyn.get_optional<t_real>("config.slice_Q_width_" + idx))
+				m_sliceQWidth[i]->setValue(*optVal);
+		}
+		if(auto optVal = magdyn.get_optional<t_real>("config.slice_E_min"))
+			m_sliceERange[0]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.slice_E_max"))
+			m_sliceERange[1]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_size>("config.slice_num_E"))
+			m_sliceNumE->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<int>("config.slice_kernel"))
+		{
+			if(int idx = m_sliceKernel->findData(*optVal); idx >= 0)
+				m_sliceKernel->setCurrentIndex(idx);
+		}
+		if(auto optVal = magdyn.get_optional<t_real>("config.slice_E_width"))
+			m_sliceEWidth->setValue(*optVal);
+		for(int i=0; i<3; ++i)
+		{
+			if(auto optVal = magdyn.get_optional<t_size>("config.dos_mesh_" + std::to_string(i+1)))
+				m_dosMesh[i]->setValue(*optVal);
+		}
+		if(auto optVal = magdyn.get_optional<bool>("config.dos_reduce_inversion"))
+			m_dosReduceInversion->setChecked(*optVal);
+		if(auto optVal = magdyn.get_optional<int>("config.dos_method"))
+		{
+			if(int idx = m_dosMethod->findData(*optVal); idx >= 0)
+				m_dosMethod->setCurrentIndex(idx);
+		}
+		if(auto optVal = magdyn.get_optional<t_real>("config.dos_E_min"))
+			m_dosERange[0]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.dos_E_max"))
+			m_dosERange[1]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_size>("config.dos_num_E"))
+			m_dosNumE->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.dos_E_width"))
+			m_dosEWidth->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.dos_T_min"))
+			m_dosTRange[0]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.dos_T_max"))
+			m_dosTRange[1]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_size>("config.dos_num_T"))
+			m_dosNumT->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.xtal_a"))
+			m_xtallattice[0]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.xtal_b"))
+			m_xtallattice[1]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.xtal_c"))
+			m_xtallattice[2]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.xtal_alpha"))
+			m_xtalangles[0]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.xtal_beta"))
+			m_xtalangles[1]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<t_real>("config.xtal_gamma"))
+			m_xtalangles[2]->setValue(*optVal);
+		if(auto optVal = magdyn.get_optional<std::string>("config.coupling_shells"))
+			m_couplingShells->setText(optVal->c_str());
+		if(auto optVal = magdyn.get_optional<t_real>("config.coupling_shell_tolerance"))
+			m_couplingShellTol->setValue(*optVal);
 
 		m_dyn.Load(magdyn);
 
@@ -308,6 +436,7 @@ bool MagDynDlg::Load(const QString& filename)
 		DelTabItem(m_varstab, -1);
 		DelTabItem(m_fieldstab, -1);
 		DelTabItem(m_coordinatestab, -1);
+		DelTabItem(m_sweeptab, -1);
 
 		// variables
 		for(const auto& var : m_dyn.GetVariables())
@@ -399,6 +528,20 @@ bool MagDynDlg::Load(const QString& filename)
 				AddCoordinateTabItem(-1, hi, ki, li, hf, kf, lf);
 			}
 		}
+
+		// sweep parameters
+		if(auto params = magdyn.get_child_optional("sweep_parameters"); params)
+		{
+			for(const auto &param : *params)
+			{
+				std::string name = param.second.get<std::string>("name", "");
+				t_real start = param.second.get<t_real>("start", 0.);
+				t_real end = param.second.get<t_real>("end", 1.);
+				t_size num_points = param.second.get<t_size>("points", 16);
+
+				AddSweepTabItem(-1, name, start, end, num_points);
+			}
+		}
 	}
 	catch(const std::exception& ex)
 	{
@@ -480,6 +623,8 @@ bool MagDynDlg::Save(const QString& filename)
 		magdyn.put<t_real>("config.k", m_q[1]->value());
 		magdyn.put<t_real>("config.l", m_q[2]->value());
 		magdyn.put<t_size>("config.num_Q_points", m_num_points->value());
+		magdyn.put<bool>("config.adaptive_Q", m_adaptive_Q->isChecked());
+		magdyn.put<t_real>("config.adaptive_E_tol", m_adaptive_E_tol->value());
 		magdyn.put<t_real>("config.weight_scale", m_weight_scale->value());
 		magdyn.put<t_real>("config.weight_min", m_weight_min->value());
 		magdyn.put<t_real>("config.weight_max", m_weight_max->value());
@@ -492,6 +637,7 @@ bool MagDynDlg::Save(const QString& filename)
 		magdyn.put<bool>("config.unite_degeneracies", m_unite_degeneracies->isChecked());
 		magdyn.put<bool>("config.ignore_annihilation", m_ignore_annihilation->isChecked());
 		magdyn.put<bool>("config.force_incommensurate", m_force_incommensurate->isChecked());
+		magdyn.put<bool>("config.cache_phases", m_cache_phases->isChecked());
 		magdyn.put<bool>("config.use_projector", m_use_projector->isChecked());
 		magdyn.put<t_real>("config.field_axis_h", m_rot_axis[0]->value());
 		magdyn.put<t_real>("config.field_axis_k", m_rot_axis[1]->value());
@@ -507,6 +653,62 @@ bool MagDynDlg::Save(const QString& filename)
 		magdyn.put<t_size>("config.export_num_points_1", m_exportNumPoints[0]->value());
 		magdyn.put<t_size>("config.export_num_points_2", m_exportNumPoints[1]->value());
 		magdyn.put<t_size>("config.export_num_points_3", m_exportNumPoints[2]->value());
+		magdyn.put<int>("config.export_compression", m_exportCompression->value());
+		magdyn.put<bool>("config.export_use_symmetry", m_exportUseSymmetry->isChecked());
+		magdyn.put<bool>("config.export_time_reversal", m_exportTimeReversal->isChecked());
+		magdyn.put<bool>("config.export_checkpoints", m_exportCheckpoints->isChecked());
+		magdyn.put<t_real>("config.export_checkpoint_interval", m_exportCheckpointInterval->value());
+		magdyn.put<t_real>("config.powder_Q_min", m_powderQRange[0]->value());
+		magdyn.put<t_real>("config.powder_Q_max", m_powderQRange[1]->value());
+		magdyn.put<t_real>("config.powder_E_min", m_powderERange[0]->value());
+		magdyn.put<t_real>("config.powder_E_max", m_powderERange[1]->value());
+		magdyn.put<t_size>("config.powder_num_Q", m_powderNumQ->value());
+		magdyn.put<t_size>("config.powder_num_E", m_powderNumE->value());
+		magdyn.put<t_size>("config.powder_num_dirs", m_powderNumDirs->value());
+		magdyn.put<t_real>("config.powder_E_sigma", m_powderESigma->value());
+		magdyn.put<int>("config.slice_mode", m_sliceMode->currentData().toInt());
+		for(int i=0; i<3; ++i)
+		{
+			const std::string comp{"hkl"[i]};
+
+			magdyn.put<t_real>("config.slice_origin_" + comp, m_sliceOrigin[i]->value());
+			magdyn.put<t_real>("config.slice_dir1_" + comp, m_sliceDir1[i]->value());
+			magdyn.put<t_real>("config.slice_dir2_" + comp, m_sliceDir2[i]->value());
+		}
+		for(int i=0; i<2; ++i)
+		{
+			const std::string idx = std::to_string(i+1);
+			QDoubleSpinBox **range = i == 0 ? m_sliceRange1 : m_sliceRange2;
+
+			magdyn.put<t_real>("config.slice_min_" + idx, range[0]->value());
+			magdyn.put<t_real>("config.slice_max_" + idx, range[1]->value());
+			magdyn.put<t_size>("config.slice_num_points_" + idx, m_sliceNumPoints[i]->value());
+			magdyn.put<t_real>("config.slice_Q_width_" + idx, m_sliceQWidth[i]->value());
+		}
+		magdyn.put<t_real>("config.slice_E_min", m_sliceERange[0]->value());
+		magdyn.put<t_real>("config.slice_E_max", m_sliceERange[1]->value());
+		magdyn.put<t_size>("config.slice_num_E", m_sliceNumE->value());
+		magdyn.put<int>("config.slice_kernel", m_sliceKernel->currentData().toInt());
+		magdyn.put<t_real>("config.slice_E_width", m_sliceEWidth->value());
+		for(int i=0; i<3; ++i)
+			magdyn.put<t_size>("config.dos_mesh_" + std::to_string(i+1), m_dosMesh[i]->value());
+		magdyn.put<bool>("config.dos_reduce_inversion", m_dosReduceInversion->isChecked());
+		magdyn.put<int>("config.dos_method", m_dosMethod->currentData().toInt());
+		magdyn.put<t_real>("config.dos_E_min", m_dosERange[0]->value());
+		magdyn.put<t_real>("config.dos_E_max", m_dosERange[1]->value());
+		magdyn.put<t_size>("config.dos_num_E", m_dosNumE->value());
+		magdyn.put<t_real>("config.dos_E_width", m_dosEWidth->value());
+		magdyn.put<t_real>("config.dos_T_min", m_dosTRange[0]->value());
+		magdyn.put<t_real>("config.dos_T_max", m_dosTRange[1]->value());
+		magdyn.put<t_size>("config.dos_num_T", m_dosNumT->value());
+		magdyn.put<t_real>("config.xtal_a", m_xtallattice[0]->value());
+		magdyn.put<t_real>("config.xtal_b", m_xtallattice[1]->value());
+		magdyn.put<t_real>("config.xtal_c", m_xtallattice[2]->value());
+		magdyn.put<t_real>("config.xtal_alpha", m_xtalangles[0]->value());
+		magdyn.put<t_real>("config.xtal_beta", m_xtalangles[1]->value());
+		magdyn.put<t_real>("config.xtal_gamma", m_xtalangles[2]->value());
+		magdyn.put<std::string>("config.coupling_shells", m_couplingShells->text().toStdString());
+		magdyn.put<t_real>("config.coupling_shell_tolerance", m_couplingShellTol->value());
 
 		// save magnon calculator configuration
 		m_dyn.Save(magdyn);
@@ -597,6 +799,26 @@ bool MagDynDlg::Save(const QString& filename)
 			magdyn.add_child("saved_coordinates.coordinate", itemNode);
 		}
 
+		// sweep parameters
+		for(int param_row = 0; param_row < m_sweeptab->rowCount(); ++param_row)
+		{
+			const auto* name = m_sweeptab->item(param_row, COL_SWEEP_NAME);
+			const auto* start = static_cast<tl2::NumericTableWidgetItem<t_real>*>(
+				m_sweeptab->item(param_row, COL_SWEEP_START));
+			const auto* end = static_cast<tl2::NumericTableWidgetItem<t_real>*>(
+				m_sweeptab->item(param_row, COL_SWEEP_END));
+			const auto* num_points = static_cast<tl2::NumericTableWidgetItem<t_size>*>(
+				m_sweeptab->item(param_row, COL_SWEEP_POINTS));
+
+			boost::property_tree::ptree itemNode;
+			itemNode.put<std::string>("name", name ? name->text().toStdString() : "");
+			itemNode.put<t_real>("start", start ? start->GetValue() : 0.);
+			itemNode.put<t_real>("end", end ? end->GetValue() : 1.);
+			itemNode.put<t_size>("points", num_points ? num_points->GetValue() : 16);
+
+			magdyn.add_child("sweep_parameters.parameter", itemNode);
+		}
+
 
 		pt::ptree node;
 		node.put_child("magdyn", magdyn);
@@ -655,6 +877,17 @@ void MagDynDlg::SaveDispersion()
 		return;
 	m_sett->setValue("dir", QFileInfo(filename).path());
 
+	// multi-segment path along the saved coordinates
+	if(m_disp_path)
+	{
+		if(!save_dispersion_path(filename.toStdString(), m_disp_path_cfg, m_disp_results))
+		{
+			QMessageBox::critical(this, "Magnetic Dynamics",
+				"Cannot open file for writing.");
+		}
+		return;
+	}
+
 	const t_real Q_start[]
 	{
 		m_q_start[0]->value(),
@@ -703,348 +936,69 @@ void MagDynDlg::ExportSQE()
 
 
 /**
- * export S(Q, E) into a grid
+ * show dialog and resume an interrupted export from its checkpoint
  */
-bool MagDynDlg::ExportSQE(const QString& filename)
+void MagDynDlg::ResumeExportSQE()
 {
-#ifdef USE_HDF5
-	std::unique_ptr<H5::H5File> h5file;
-#endif
-	std::unique_ptr<std::ofstream> ofstr;
-	bool file_opened = false;
-
-	const int format = m_exportFormat->currentData().toInt();
-	if(format == EXPORT_GRID || format == EXPORT_TEXT)
-	{
-		ofstr = std::make_unique<std::ofstream>(filename.toStdString());
-		ofstr->precision(g_prec);
-		file_opened = ofstr->operator bool();
-	}
-
-#ifdef USE_HDF5
-	else if(format == EXPORT_HDF5)
-	{
-		h5file = std::make_unique<H5::H5File>(filename.toStdString().c_str(), H5F_ACC_TRUNC);
-		h5file->createGroup("meta_infos");
-		h5file->createGroup("infos");
-		h5file->createGroup("data");
-#ifdef WRITE_HDF5_CHUNKS
-		h5file->createGroup("chunks");
-#endif
-
-		file_opened = true;
-	}
-#endif
-
-	if(!file_opened)
+	QString extension;
+	switch(m_exportFormat->currentData().toInt())
 	{
-		QMessageBox::critical(this, "Magnetic Dynamics", "File could not be opened.");
-		return false;
+		case EXPORT_HDF5: extension = "HDF5 Files (*.hdf)"; break;
+		case EXPORT_GRID: extension = "Takin Grid Files (*.bin)"; break;
+		case EXPORT_TEXT: extension = "Text Files (*.txt)"; break;
 	}
 
-	const t_vec_real Qstart = tl2::create<t_vec_real>({
-		m_exportStartQ[0]->value(),
-		m_exportStartQ[1]->value(),
-		m_exportStartQ[2]->value() });
-	const t_vec_real Qend = tl2::create<t_vec_real>({
-		m_exportEndQ[0]->value(),
-		m_exportEndQ[1]->value(),
-		m_exportEndQ[2]->value() });
-
-	const t_size num_pts_h = m_exportNumPoints[0]->value();
-	const t_size num_pts_k = m_exportNumPoints[1]->value();
-	const t_size num_pts_l = m_exportNumPoints[2]->value();
-
-	MagDyn dyn = m_dyn;
-	dyn.SetUniteDegenerateEnergies(m_unite_degeneracies->isChecked());
-	bool use_weights = m_use_weights->isChecked();
-	bool use_projector = m_use_projector->isChecked();
-
-	const t_vec_real dir = Qend - Qstart;
-	const t_real inc_h = dir[0] / t_real(num_pts_h);
-	const t_real inc_k = dir[1] / t_real(num_pts_k);
-	const t_real inc_l = dir[2] / t_real(num_pts_l);
-	const t_vec_real Qstep = tl2::create<t_vec_real>({inc_h, inc_k, inc_l});
-
-	// tread pool
-	unsigned int num_threads = std::max<unsigned int>(
-		1, std::thread::hardware_concurrency()/2);
-	asio::thread_pool pool{num_threads};
-
-
-	using t_taskret = std::deque<
-		std::tuple<t_real, t_real, t_real,          // h, k, l
-		std::vector<t_real>, std::vector<t_real>,   // E, S
-		std::size_t, std::size_t, std::size_t>>;    // h_idx, k_idx, l_idx
-
-	// calculation task
-	auto task = [this, use_weights, use_projector, &dyn, inc_l, num_pts_l]
-		(t_real h_pos, t_real k_pos, t_real l_pos, std::size_t h_idx, std::size_t k_idx) -> t_taskret
-	{
-		t_taskret ret;
-
-		// iterate last Q dimension
-		for(std::size_t l_idx=0; l_idx<num_pts_l; ++l_idx)
-		{
-			t_real l = l_pos + inc_l*t_real(l_idx);
-			auto energies_and_correlations = dyn.GetEnergies(
-				h_pos, k_pos, l, !use_weights);
-
-			std::vector<t_real> Es, weights;
-			Es.reserve(energies_and_correlations.size());
-			weights.reserve(energies_and_correlations.size());
-
-			for(const auto& E_and_S : energies_and_correlations)
-			{
-				if(m_stopRequested)
-					break;
-
-				t_real E = E_and_S.E;
-				if(std::isnan(E) || std::isinf(E))
-					continue;
-
-				const t_mat& S = E_and_S.S;
-				t_real weight = E_and_S.weight;
-
-				if(!use_projector)
-					weight = tl2::trace<t_mat>(S).real();
-
-				if(std::isnan(weight) || std::isinf(weight))
-					weight = 0.;
+	QString dirLast = m_sett->value("dir", "").toString();
+	QString filename = QFileDialog::getOpenFileName(
+		this, "Resume S(Q,E) Export", dirLast, extension);
+	if(filename == "")
+		return;
 
-				Es.push_back(E);
-				weights.push_back(weight);
-			}
+	if(ExportSQE(filename, true))
+		m_sett->setValue("dir", QFileInfo(filename).path());
+}
 
-			ret.emplace_back(std::make_tuple(h_pos, k_pos, l, Es, weights, h_idx, k_idx, l_idx));
-		}
-
-		return ret;
-	};
 
+/**
+ * export S(Q, E) into a grid in a background thread,
+ * optionally resuming an interrupted export
+ */
+bool MagDynDlg::ExportSQE(const QString& filename, bool resume)
+{
+	const MagDynConfig cfg = GetCalcConfig();
+	const int format = m_exportFormat->currentData().toInt();
 
-	// tasks
-	using t_task = std::packaged_task<t_taskret(t_real, t_real, t_real, std::size_t, std::size_t)>;
-	using t_taskptr = std::shared_ptr<t_task>;
-	std::deque<t_taskptr> tasks;
-	std::deque<std::future<t_taskret>> futures;
+	m_status->setText(resume ? "Resuming export." : "Performing export.");
+	m_btnExport->setEnabled(false);
+	m_btnExportResume->setEnabled(false);
 
-	m_stopRequested = false;
-	m_progress->setMinimum(0);
-	m_progress->setMaximum(num_pts_h * num_pts_k /** num_pts_l*/);
-	m_progress->setValue(0);
-	m_status->setText("Starting calculation.");
-	DisableInput();
+	// the export thread works on its own copy of the magnon calculator
+	auto dyn = std::make_shared<const t_magdyn>(m_dyn);
 
-	std::size_t task_idx = 0;
-	// iterate first two Q dimensions
-	for(std::size_t h_idx=0; h_idx<num_pts_h; ++h_idx)
+	StartCalcJob(m_export_job, [this, dyn, cfg, format, resume,
+		filename = filename.toStdString()](
+		const t_calc_progress& progress, const std::stop_token&) -> bool
 	{
-		if(m_stopRequested)
-			break;
-
-		for(std::size_t k_idx=0; k_idx<num_pts_k; ++k_idx)
-		{
-			if(m_stopRequested)
-				break;
-
-			qApp->processEvents();  // process events to see if the stop button was clicked
-			if(m_stopRequested)
-				break;
-
-			t_vec_real Q = Qstart;
-			Q[0] += inc_h*t_real(h_idx);
-			Q[1] += inc_k*t_real(k_idx);
-			//Q[2] += inc_l*t_real(l_idx);
-
-			// create tasks
-			t_taskptr taskptr = std::make_shared<t_task>(task);
-			tasks.push_back(taskptr);
-			futures.emplace_back(taskptr->get_future());
-			asio::post(pool, [taskptr, Q, h_idx, k_idx]()
-			{
-				(*taskptr)(Q[0], Q[1], Q[2], h_idx, k_idx);
-			});
-
-			++task_idx;
-			m_progress->setValue(task_idx);
-		}
-	}
-
-	m_progress->setValue(0);
-	m_status->setText("Performing calculation.");
-
-	std::deque<std::uint64_t> hklindices;
-	if(format == EXPORT_GRID)  // Takin grid format
+		return export_sqe(*dyn, cfg, filename, format, *m_pool, progress, resume);
+	}, [this](bool finished, const std::string& error)
 	{
-		std::uint64_t dummy = 0;  // to be filled by index block index
-		ofstr->write(reinterpret_cast<const char*>(&dummy), sizeof(dummy));
+		m_btnExport->setEnabled(true);
+		m_btnExportResume->setEnabled(true);
 
-		for(int i = 0; i<3; ++i)
+		if(error != "")
 		{
-			ofstr->write(reinterpret_cast<const char*>(&Qstart[i]), sizeof(Qstart[i]));
-			ofstr->write(reinterpret_cast<const char*>(&Qend[i]), sizeof(Qend[i]));
-			ofstr->write(reinterpret_cast<const char*>(&Qstep[i]), sizeof(Qstep[i]));
+			m_status->setText("Export failed.");
+			QMessageBox::critical(this, "Magnetic Dynamics", error.c_str());
 		}
-
-		(*ofstr) << "Takin/Magdyn Grid File Version 2 (doi: https://doi.org/10.5281/zenodo.4117437).";
-	}
-
-#ifdef USE_HDF5
-	std::vector<t_real> data_energies, data_weights;
-	std::vector<std::size_t> data_indices, data_num_branches;
-	data_energies.reserve(num_pts_h * num_pts_k * num_pts_l * 32);
-	data_weights.reserve(num_pts_h * num_pts_k * num_pts_l * 32);
-	data_indices.reserve(num_pts_h * num_pts_k * num_pts_l);
-	data_num_branches.reserve(num_pts_h * num_pts_k * num_pts_l);
-#endif
-
-	for(std::size_t future_idx=0; future_idx<futures.size(); ++future_idx)
-	{
-		qApp->processEvents();  // process events to see if the stop button was clicked
-		if(m_stopRequested)
+		else if(finished)
 		{
-			pool.stop();
-			break;
+			m_status->setText("Export finished.");
 		}
-
-		auto results = futures[future_idx].get();
-
-		for(std::size_t result_idx=0; result_idx<results.size(); ++result_idx)
+		else
 		{
-			const auto& result = results[result_idx];
-			std::size_t num_branches = std::get<3>(result).size();
-
-			const t_real qh = std::get<0>(result);
-			const t_real qk = std::get<1>(result);
-			const t_real ql = std::get<2>(result);
-			const auto& energies = std::get<3>(result);
-			const auto& weights = std::get<4>(result);
-
-			if(format == EXPORT_GRID)           // Takin grid format
-			{
-				hklindices.push_back(ofstr->tellp());
-
-				// write number of branches
-				std::uint32_t _num_branches = std::uint32_t(num_branches);
-				ofstr->write(reinterpret_cast<const char*>(&_num_branches), sizeof(_num_branches));
-			}
-			else if(format == EXPORT_TEXT)      // text format
-			{
-				(*ofstr) << "Q = " << qh << " " << qk << " " << ql << ":\n";
-			}
-#ifdef USE_HDF5
-			else if(format == EXPORT_HDF5)  // hdf5 format
-			{
-#ifdef WRITE_HDF5_CHUNKS
-				const std::size_t h_idx = std::get<5>(result);
-				const std::size_t k_idx = std::get<6>(result);
-				const std::size_t l_idx = std::get<7>(result);
-
-				std::ostringstream chunk_name;
-				chunk_name << std::hex << h_idx << "_" << k_idx << "_" << l_idx;
-				H5::Group data_group = h5file->openGroup("chunks");
-				data_group.createGroup(chunk_name.str());
-
-				tl2::set_h5_scalar(*h5file, "chunks/" + chunk_name.str() + "/h", qh);
-				tl2::set_h5_scalar(*h5file, "chunks/" + chunk_name.str() + "/k", qk);
-				tl2::set_h5_scalar(*h5file, "chunks/" + chunk_name.str() + "/l", ql);
-
-				tl2::set_h5_vector(*h5file, "chunks/" + chunk_name.str() + "/E", energies);
-				tl2::set_h5_vector(*h5file, "chunks/" + chunk_name.str() + "/S", weights);
-#endif
-
-				// TODO: write this incrementally to the hdf5 file, without these large temporary vectors
-				data_num_branches.push_back(energies.size());
-				data_indices.push_back(data_energies.size());
-				data_energies.insert(data_energies.end(), energies.begin(), energies.end());
-				data_weights.insert(data_weights.end(), weights.begin(), weights.end());
-			}
-#endif
-
-			// iterate energies and weights
-			for(std::size_t j=0; j<num_branches; ++j)
-			{
-				t_real energy = energies[j];
-				t_real weight = weights[j];
-
-				if(format == EXPORT_GRID)       // Takin grid format
-				{
-					// write energies and weights
-					ofstr->write(reinterpret_cast<const char*>(&energy), sizeof(energy));
-					ofstr->write(reinterpret_cast<const char*>(&weight), sizeof(weight));
-				}
-				else if(format == EXPORT_TEXT)  // text format
-				{
-					(*ofstr)
-						<< "\tE = " << energy
-						<< ", S = " << weight
-						<< std::endl;
-				}
-			}
+			m_status->setText("Export stopped.");
 		}
-
-		m_progress->setValue(future_idx+1);
-	}
-
-	pool.join();
-	EnableInput();
-
-	if(format == EXPORT_GRID)  // Takin grid format
-	{
-		std::uint64_t idxblock = ofstr->tellp();
-
-		// write hkl indices
-		for(std::uint64_t idx : hklindices)
-			ofstr->write(reinterpret_cast<const char*>(&idx), sizeof(idx));
-
-		// write index into index block
-		ofstr->seekp(0, std::ios_base::beg);
-		ofstr->write(reinterpret_cast<const char*>(&idxblock), sizeof(idxblock));
-		ofstr->flush();
-	}
-#ifdef USE_HDF5
-	else if(format == EXPORT_HDF5)
-	{
-		const char* user = std::getenv("USER");
-		if(!user) user = "";
-		tl2::set_h5_string<std::string>(*h5file, "meta_infos/type", "takin_grid");
-		tl2::set_h5_string<std::string>(*h5file, "meta_infos/description", "Takin/Magdyn grid format");
-		tl2::set_h5_string<std::string>(*h5file, "meta_infos/user", user);
-		tl2::set_h5_string<std::string>(*h5file, "meta_infos/date", tl2::epoch_to_str<t_real>(tl2::epoch<t_real>()));
-		tl2::set_h5_string<std::string>(*h5file, "meta_infos/url", "https://code.ill.fr/scientific-software/takin");
-		tl2::set_h5_string<std::string>(*h5file, "meta_infos/doi", "https://doi.org/10.5281/zenodo.4117437");
-		tl2::set_h5_string<std::string>(*h5file, "meta_infos/doi_tlibs", "https://doi.org/10.5281/zenodo.5717779");
-
-		tl2::set_h5_string<std::string>(*h5file, "infos/shape", "cuboid");
-		tl2::set_h5_vector(*h5file, "infos/Q_start", static_cast<const std::vector<t_real>&>(Qstart));
-		tl2::set_h5_vector(*h5file, "infos/Q_end", static_cast<const std::vector<t_real>&>(Qend));
-		tl2::set_h5_vector(*h5file, "infos/Q_steps", static_cast<const std::vector<t_real>&>(Qstep));
-		tl2::set_h5_vector(*h5file, "infos/Q_dimensions", std::vector<std::size_t>{{ num_pts_h, num_pts_k, num_pts_l }});
-
-		std::vector<std::string> labels{{"h", "k", "l", "E", "S_perp"}};
-		tl2::set_h5_string_vector(*h5file, "infos/labels", labels);
-
-		std::vector<std::string> units{{"rlu", "rlu", "rlu", "meV", "a.u."}};
-		tl2::set_h5_string_vector(*h5file, "infos/units", units);
-
-		hsize_t index_dims[] = { num_pts_h, num_pts_k, num_pts_l };
-		tl2::set_h5_multidim(*h5file, "data/indices", 3, index_dims, data_indices.data());
-		tl2::set_h5_multidim(*h5file, "data/branches", 3, index_dims, data_num_branches.data());
-		//tl2::set_h5_vector(*h5file, "data/indices", data_indices);
-		//tl2::set_h5_vector(*h5file, "data/branches", data_num_branches);
-
-		tl2::set_h5_vector(*h5file, "data/energies", data_energies);
-		tl2::set_h5_vector(*h5file, "data/weights", data_weights);
-
-		h5file->close();
-	}
-#endif
-
-	if(m_stopRequested)
-		m_status->setText("Calculation stopped.");
-	else
-		m_status->setText("Calculation finished.");
+	});
 
 	return true;
 }
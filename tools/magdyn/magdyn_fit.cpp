@@ -0,0 +1,174 @@
+/**
+ * magnetic dynamics -- fitting of variables to measured dispersion points
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+// these need to be included before all other things on mingw
+#include <boost/scope_exit.hpp>
+
+#include "magdyn.h"
+
+#include <QtCore/QFileInfo>
+#include <QtWidgets/QFileDialog>
+#include <QtWidgets/QMessageBox>
+
+#include <algorithm>
+#include <sstream>
+#include <memory>
+
+
+/**
+ * names of the variables to fit: the selected rows of the variables table or all variables
+ */
+std::vector<std::string> MagDynDlg::GetFitVariables() const
+{
+	std::vector<int> rows;
+	for(const QTableWidgetItem* item : m_varstab->selectedItems())
+	{
+		if(std::find(rows.begin(), rows.end(), item->row()) == rows.end())
+			rows.push_back(item->row());
+	}
+
+	if(rows.size() == 0)
+	{
+		for(int row = 0; row < m_varstab->rowCount(); ++row)
+			rows.push_back(row);
+	}
+
+	std::sort(rows.begin(), rows.end());
+
+	std::vector<std::string> names;
+	names.reserve(rows.size());
+	for(int row : rows)
+	{
+		const auto* name = m_varstab->item(row, COL_VARS_NAME);
+		if(!name)
+			continue;
+		names.push_back(name->text().trimmed().toStdString());
+	}
+
+	return names;
+}
+
+
+/**
+ * fit the variables to measured dispersion points in a background thread
+ */
+void MagDynDlg::FitVariables()
+{
+	SyncSitesAndTerms();
+
+	const std::vector<std::string> var_names = GetFitVariables();
+	if(var_names.size() == 0)
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics", "No variables to fit defined.");
+		return;
+	}
+
+	QString dirLast = m_sett->value("dir", "").toString();
+	QString filename = QFileDialog::getOpenFileName(
+		this, "Load Dispersion Data", dirLast, "Data Files (*.dat *.txt)");
+	if(filename == "")
+		return;
+	m_sett->setValue("dir", QFileInfo(filename).path());
+
+	std::vector<FitDataPoint> data;
+	try
+	{
+		data = load_fit_data(filename.toStdString());
+	}
+	catch(const std::exception& ex)
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics", ex.what());
+		return;
+	}
+
+	const t_size max_iterations = 100;
+	m_status->setText("Fitting variables.");
+
+	// the fit thread works on its own copy of the magnon calculator
+	auto dyn = std::make_shared<const t_magdyn>(m_dyn);
+	const MagDynConfig cfg = GetCalcConfig();
+	auto results = std::make_shared<FitResults>();
+
+	StartCalcJob(m_fit_job, [this, dyn, cfg, data, var_names, max_iterations, results](
+		const t_calc_progress& progress, const std::stop_token&) -> bool
+	{
+		return fit_variables(*dyn, cfg, data, var_names, *results, *m_pool,
+			progress, max_iterations);
+	}, [this, results](bool finished, const std::string& error)
+	{
+		if(error != "")
+		{
+			m_status->setText("Fit failed.");
+			QMessageBox::critical(this, "Magnetic Dynamics", error.c_str());
+			return;
+		}
+
+		if(!finished)
+		{
+			m_status->setText("Fit stopped.");
+			return;
+		}
+
+		SetFitResults(*results);
+		m_status->setText(results->converged ? "Fit converged." : "Fit did not converge.");
+
+		std::ostringstream ostr;
+		print_fit_results(ostr, *results);
+		QMessageBox::information(this, "Magnetic Dynamics", ostr.str().c_str());
+	});
+}
+
+
+/**
+ * write the fitted values into the variables table
+ */
+void MagDynDlg::SetFitResults(const FitResults& results)
+{
+	m_ignoreTableChanges = true;
+	BOOST_SCOPE_EXIT(this_)
+	{
+		this_->m_ignoreTableChanges = false;
+		this_->RequestCalc(CALC_ALL);
+	} BOOST_SCOPE_EXIT_END
+
+	for(int row = 0; row < m_varstab->rowCount(); ++row)
+	{
+		const auto* name = m_varstab->item(row, COL_VARS_NAME);
+		auto* value = static_cast<tl2::NumericTableWidgetItem<t_real>*>(
+			m_varstab->item(row, COL_VARS_VALUE_REAL));
+		if(!name || !value)
+			continue;
+
+		auto iter = std::find(results.names.begin(), results.names.end(),
+			name->text().trimmed().toStdString());
+		if(iter == results.names.end())
+			continue;
+
+		value->SetValue(results.values[iter - results.names.begin()]);
+	}
+}
@@ -27,6 +27,7 @@
  */
 
 #include "magdyn.h"
+#include "profiler.h"
 
 #include <QtWidgets/QGridLayout>
 #include <QtWidgets/QPushButton>
@@ -59,6 +60,7 @@ void MagDynDlg::CreateMainWindow()
 	// progress bar
 	m_progress = new QProgressBar(this);
 	m_progress->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+	m_disp_job.progress = m_progress;
 
 	// start button
 	m_btnStart = new QPushButton(QIcon::fromTheme("media-playback-start"), "Calculate", this);
@@ -91,7 +93,18 @@ void MagDynDlg::CreateMainWindow()
 
 	// signals
 	connect(m_btnStart, &QAbstractButton::clicked, [this]() { this->CalcAll(); });
-	connect(btnStop, &QAbstractButton::clicked, [this]() { m_stopRequested = true; });
+	connect(btnStop, &QAbstractButton::clicked, this, &MagDynDlg::StopCalculations);
+
+	// timer for progressive plot updates during the calculation
+	m_disp_timer = new QTimer(this);
+	m_disp_timer->setInterval(250);
+	connect(m_disp_timer, &QTimer::timeout, this, &MagDynDlg::UpdatePartialDispersion);
+
+	// timer to coalesce the automatic calculations triggered by quick edits
+	m_calc_timer = new QTimer(this);
+	m_calc_timer->setSingleShot(true);
+	m_calc_timer->setInterval(200);
+	connect(m_calc_timer, &QTimer::timeout, this, &MagDynDlg::RunRequestedCalc);
 }
 
 
@@ -445,6 +458,55 @@ void MagDynDlg::CreateExchangeTermsPanel()
 			QSizePolicy::Expanding, QSizePolicy::Fixed});
 	}
 
+	// crystal lattice and neighbour shells
+	const char* lattice_prefixes[] = { "a = ", "b = ", "c = " };
+	const char* angle_prefixes[] = { "α = ", "β = ", "γ = " };
+	for(int i=0; i<3; ++i)
+	{
+		m_xtallattice[i] = new QDoubleSpinBox(m_termspanel);
+		m_xtallattice[i]->setDecimals(4);
+		m_xtallattice[i]->setMinimum(0.001);
+		m_xtallattice[i]->setMaximum(999.999);
+		m_xtallattice[i]->setSingleStep(0.1);
+		m_xtallattice[i]->setValue(5.);
+		m_xtallattice[i]->setPrefix(lattice_prefixes[i]);
+		m_xtallattice[i]->setSizePolicy(QSizePolicy{
+			QSizePolicy::Expanding, QSizePolicy::Fixed});
+
+		m_xtalangles[i] = new QDoubleSpinBox(m_termspanel);
+		m_xtalangles[i]->setDecimals(2);
+		m_xtalangles[i]->setMinimum(0.01);
+		m_xtalangles[i]->setMaximum(179.99);
+		m_xtalangles[i]->setSingleStep(0.1);
+		m_xtalangles[i]->setValue(90.);
+		m_xtalangles[i]->setPrefix(angle_prefixes[i]);
+		m_xtalangles[i]->setSizePolicy(QSizePolicy{
+			QSizePolicy::Expanding, QSizePolicy::Fixed});
+	}
+
+	m_couplingShells = new QLineEdit(m_termspanel);
+	m_couplingShells->setPlaceholderText("e.g. 3.5, 4.2");
+	m_couplingShells->setToolTip("Distances of the neighbour shells, separated by commas.");
+
+	m_couplingShellTol = new QDoubleSpinBox(m_termspanel);
+	m_couplingShellTol->setDecimals(4);
+	m_couplingShellTol->setMinimum(0.);
+	m_couplingShellTol->setMaximum(9.9999);
+	m_couplingShellTol->setSingleStep(0.01);
+	m_couplingShellTol->setValue(0.01);
+	m_couplingShellTol->setPrefix("Δ = ");
+	m_couplingShellTol->setToolTip("Tolerance of the shell distances.");
+	m_couplingShellTol->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Fixed});
+
+	QPushButton *btnShells = new QPushButton(
+		QIcon::fromTheme("insert-object"),
+		"Generate", m_termspanel);
+	btnShells->setToolTip("Create couplings between all atoms in the given distance shells.");
+	btnShells->setFocusPolicy(Qt::StrongFocus);
+	btnShells->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Fixed});
+
 	m_ordering[0]->setPrefix("Oh = ");
 	m_ordering[1]->setPrefix("Ok = ");
 	m_ordering[2]->setPrefix("Ol = ");
@@ -455,6 +517,7 @@ void MagDynDlg::CreateExchangeTermsPanel()
 
 	auto sep1 = new QFrame(m_samplepanel); sep1->setFrameStyle(QFrame::HLine);
 	auto sep2 = new QFrame(m_samplepanel); sep2->setFrameStyle(QFrame::HLine);
+	auto sep3 = new QFrame(m_samplepanel); sep3->setFrameStyle(QFrame::HLine);
 
 	// grid
 	auto grid = new QGridLayout(m_termspanel);
@@ -489,6 +552,31 @@ void MagDynDlg::CreateExchangeTermsPanel()
 		QSizePolicy::Minimum, QSizePolicy::Fixed),
 		y++,0, 1,1);
 
+	grid->addWidget(new QLabel("Generate Coupling Terms By Distance:"), y++,0,1,4);
+	grid->addWidget(new QLabel(QString("Lattice (A):"),
+		m_termspanel), y,0,1,1);
+	grid->addWidget(m_xtallattice[0], y,1,1,1);
+	grid->addWidget(m_xtallattice[1], y,2,1,1);
+	grid->addWidget(m_xtallattice[2], y++,3,1,1);
+	grid->addWidget(new QLabel(QString("Angles (deg):"),
+		m_termspanel), y,0,1,1);
+	grid->addWidget(m_xtalangles[0], y,1,1,1);
+	grid->addWidget(m_xtalangles[1], y,2,1,1);
+	grid->addWidget(m_xtalangles[2], y++,3,1,1);
+	grid->addWidget(new QLabel(QString("Shells (A):"),
+		m_termspanel), y,0,1,1);
+	grid->addWidget(m_couplingShells, y,1,1,2);
+	grid->addWidget(m_couplingShellTol, y++,3,1,1);
+	grid->addWidget(btnShells, y++,3,1,1);
+
+	grid->addItem(new QSpacerItem(8, 8,
+		QSizePolicy::Minimum, QSizePolicy::Fixed),
+		y++,0, 1,1);
+	grid->addWidget(sep3, y++,0, 1,4);
+	grid->addItem(new QSpacerItem(8, 8,
+		QSizePolicy::Minimum, QSizePolicy::Fixed),
+		y++,0, 1,1);
+
 	grid->addWidget(new QLabel(QString("Ordering Vector:"),
 		m_termspanel), y,0,1,1);
 	grid->addWidget(m_ordering[0], y,1,1,1);
@@ -543,6 +631,8 @@ void MagDynDlg::CreateExchangeTermsPanel()
 		[this]() { this->MoveTabItemDown(m_termstab); });
 	connect(btnSG, &QAbstractButton::clicked,
 		this, &MagDynDlg::GenerateCouplingsFromSG);
+	connect(btnShells, &QAbstractButton::clicked,
+		this, &MagDynDlg::GenerateCouplingsByDistance);
 
 	connect(btnShowStruct, &QAbstractButton::clicked, this, &MagDynDlg::ShowStructurePlot);
 
@@ -575,8 +665,7 @@ void MagDynDlg::CreateExchangeTermsPanel()
 
 	auto calc_all = [this]()
 	{
-		if(this->m_autocalc->isChecked())
-			this->CalcAll();
+		this->RequestCalc(CALC_ALL);
 	};
 
 	for(int i=0; i<3; ++i)
@@ -659,6 +748,12 @@ void MagDynDlg::CreateVariablesPanel()
 		QSizePolicy::Expanding, QSizePolicy::Fixed});
 
 
+	// progress of the fit
+	m_fitProgress = new QProgressBar(m_varspanel);
+	m_fitProgress->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+	m_fit_job.progress = m_fitProgress;
+
+
 	// grid
 	auto grid = new QGridLayout(m_varspanel);
 	grid->setSpacing(4);
@@ -670,6 +765,7 @@ void MagDynDlg::CreateVariablesPanel()
 	grid->addWidget(btnDel, y,1,1,1);
 	grid->addWidget(btnUp, y,2,1,1);
 	grid->addWidget(btnDown, y++,3,1,1);
+	grid->addWidget(m_fitProgress, y++,0,1,4);
 
 
 	// table CustomContextMenu
@@ -1007,8 +1103,7 @@ void MagDynDlg::CreateSampleEnvPanel()
 
 	auto calc_all = [this]()
 	{
-		if(this->m_autocalc->isChecked())
-			this->CalcAll();
+		this->RequestCalc(CALC_ALL);
 	};
 
 	// signals
@@ -1133,6 +1228,23 @@ void MagDynDlg::CreateDispersionPanel()
 	m_num_points->setSizePolicy(QSizePolicy{
 		QSizePolicy::Expanding, QSizePolicy::Fixed});
 
+	// adaptive refinement of the Q points
+	m_adaptive_Q = new QCheckBox("Adaptive Q", m_disppanel);
+	m_adaptive_Q->setToolTip("Refine the Q points where the energies change quickly, "
+		"the Q count then gives the maximum number of points.");
+	m_adaptive_Q->setChecked(false);
+
+	m_adaptive_E_tol = new QDoubleSpinBox(m_disppanel);
+	m_adaptive_E_tol->setToolTip("Maximum energy change between neighbouring Q points.");
+	m_adaptive_E_tol->setDecimals(4);
+	m_adaptive_E_tol->setMinimum(0.0001);
+	m_adaptive_E_tol->setMaximum(99.9999);
+	m_adaptive_E_tol->setSingleStep(0.01);
+	m_adaptive_E_tol->setValue(0.01);
+	m_adaptive_E_tol->setSuffix(" meV");
+	m_adaptive_E_tol->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Fixed});
+
 	// scaling factor for weights
 	for(auto** comp : {&m_weight_scale, &m_weight_min, &m_weight_max})
 	{
@@ -1205,6 +1317,10 @@ void MagDynDlg::CreateDispersionPanel()
 	grid->addWidget(
 		new QLabel(QString("Max. Weight:"), m_disppanel), y,2,1,1);
 	grid->addWidget(m_weight_max, y++,3,1,1);
+	grid->addWidget(m_adaptive_Q, y,0,1,2);
+	grid->addWidget(
+		new QLabel(QString("E Tolerance:"), m_disppanel), y,2,1,1);
+	grid->addWidget(m_adaptive_E_tol, y++,3,1,1);
 
 	// signals
 	for(int i=0; i<3; ++i)
@@ -1213,15 +1329,13 @@ void MagDynDlg::CreateDispersionPanel()
 			static_cast<void (QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
 			[this]()
 		{
-			if(this->m_autocalc->isChecked())
-				this->CalcDispersion();
+			this->RequestCalc(CALC_DISPERSION);
 		});
 		connect(m_q_end[i],
 			static_cast<void (QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
 			[this]()
 		{
-			if(this->m_autocalc->isChecked())
-				this->CalcDispersion();
+			this->RequestCalc(CALC_DISPERSION);
 		});
 	}
 
@@ -1229,8 +1343,19 @@ void MagDynDlg::CreateDispersionPanel()
 		static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged),
 		[this]()
 	{
-		if(this->m_autocalc->isChecked())
-			this->CalcDispersion();
+		this->RequestCalc(CALC_DISPERSION);
+	});
+
+	connect(m_adaptive_Q, &QCheckBox::toggled, [this]()
+	{
+		this->RequestCalc(CALC_DISPERSION);
+	});
+
+	connect(m_adaptive_E_tol,
+		static_cast<void (QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
+		[this]()
+	{
+		this->RequestCalc(CALC_DISPERSION);
 	});
 
 	for(auto* comp : {m_weight_scale, m_weight_min, m_weight_max})
@@ -1308,8 +1433,7 @@ void MagDynDlg::CreateHamiltonPanel()
 			static_cast<void (QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
 			[this]()
 		{
-			if(this->m_autocalc->isChecked())
-				this->CalcHamiltonian();
+			this->RequestCalc(CALC_HAMILTONIAN);
 		});
 	}
 
@@ -1380,6 +1504,8 @@ void MagDynDlg::CreateCoordinatesPanel()
 
 	QPushButton *btnSetDispersion = new QPushButton("To Dispersion", m_coordinatespanel);
 	btnSetDispersion->setToolTip("Calculate the dispersion relation for the currently selected Q path.");
+	QPushButton *btnSetPath = new QPushButton("Path To Dispersion", m_coordinatespanel);
+	btnSetPath->setToolTip("Calculate the dispersion relation along all Q paths as consecutive segments.");
 	QPushButton *btnSetHamilton = new QPushButton("To Hamiltonian", m_coordinatespanel);
 	btnSetHamilton->setToolTip("Calculate the Hamiltonian for the currently selected initial Q coordinate.");
 
@@ -1421,6 +1547,10 @@ void MagDynDlg::CreateCoordinatesPanel()
 		QIcon::fromTheme("go-home"),
 		"Calculate Dispersion", this,
 		[this]() { this->SetCurrentCoordinate(0); });
+	menuTableContext->addAction(
+		QIcon::fromTheme("go-home"),
+		"Calculate Dispersion Along All Paths", this,
+		[this]() { this->SetCoordinatePath(true); });
 	menuTableContext->addAction(
 		QIcon::fromTheme("go-home"),
 		"Calculate Hamiltonian From Initial Q", this,
@@ -1455,6 +1585,7 @@ void MagDynDlg::CreateCoordinatesPanel()
 	grid->addWidget(btnDelCoord, y,1,1,1);
 	grid->addWidget(btnCoordUp, y,2,1,1);
 	grid->addWidget(btnCoordDown, y++,3,1,1);
+	grid->addWidget(btnSetPath, y,1,1,1);
 	grid->addWidget(btnSetDispersion, y,2,1,1);
 	grid->addWidget(btnSetHamilton, y++,3,1,1);
 
@@ -1471,9 +1602,21 @@ void MagDynDlg::CreateCoordinatesPanel()
 
 	connect(btnSetDispersion, &QAbstractButton::clicked,
 		[this]() { this->SetCurrentCoordinate(0); });
+	connect(btnSetPath, &QAbstractButton::clicked,
+		[this]() { this->SetCoordinatePath(true); });
 	connect(btnSetHamilton, &QAbstractButton::clicked,
 		[this]() { this->SetCurrentCoordinate(1); });
 
+	// the path changes with the saved coordinates
+	auto coords_changed = [this]()
+	{
+		if(m_disp_path_mode && m_disp_path_mode->isChecked())
+			this->RequestCalc(CALC_DISPERSION);
+	};
+	connect(m_coordinatestab, &QTableWidget::itemChanged, coords_changed);
+	connect(m_coordinatestab->model(), &QAbstractItemModel::rowsRemoved, coords_changed);
+	connect(m_coordinatestab->model(), &QAbstractItemModel::layoutChanged, coords_changed);
+
 	connect(m_coordinatestab, &QTableWidget::itemSelectionChanged, [this]()
 	{
 		QList<QTableWidgetItem*> selected = m_coordinatestab->selectedItems();
@@ -1530,10 +1673,59 @@ void MagDynDlg::CreateExportPanel()
 #endif
 	m_exportFormat->addItem("Text File", EXPORT_TEXT);
 
-	QPushButton *btn_export = new QPushButton(
+	// hdf5 compression level
+	m_exportCompression = new QSpinBox(m_exportpanel);
+	m_exportCompression->setMinimum(0);
+	m_exportCompression->setMaximum(9);
+	m_exportCompression->setValue(0);
+	m_exportCompression->setPrefix("Compression: ");
+	m_exportCompression->setSpecialValueText("No Compression");
+	m_exportCompression->setToolTip("Deflate compression level for HDF5 files.");
+	m_exportCompression->setEnabled(m_exportFormat->currentData().toInt() == EXPORT_HDF5);
+	m_exportCompression->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Fixed});
+
+	// symmetry reduction
+	m_exportUseSymmetry = new QCheckBox("Use Space Group Symmetry", m_exportpanel);
+	m_exportUseSymmetry->setChecked(false);
+	m_exportUseSymmetry->setToolTip("Only calculate the symmetry-inequivalent grid points.\n"
+		"Operations of the space group that do not leave S(Q, E) invariant are ignored;\n"
+		"they are only checked numerically at some generic Q points.");
+
+	m_exportTimeReversal = new QCheckBox("Use Q -> -Q", m_exportpanel);
+	m_exportTimeReversal->setChecked(true);
+	m_exportTimeReversal->setToolTip("Also use time reversal for the symmetry reduction.");
+	m_exportTimeReversal->setEnabled(m_exportUseSymmetry->isChecked());
+
+	// checkpoints
+	m_exportCheckpoints = new QCheckBox("Write Checkpoints", m_exportpanel);
+	m_exportCheckpoints->setChecked(false);
+	m_exportCheckpoints->setToolTip("Regularly record the export progress,\n"
+		"so that an interrupted export can be resumed.");
+
+	m_exportCheckpointInterval = new QDoubleSpinBox(m_exportpanel);
+	m_exportCheckpointInterval->setDecimals(0);
+	m_exportCheckpointInterval->setMinimum(1.);
+	m_exportCheckpointInterval->setMaximum(86400.);
+	m_exportCheckpointInterval->setSingleStep(60.);
+	m_exportCheckpointInterval->setValue(300.);
+	m_exportCheckpointInterval->setPrefix("Every ");
+	m_exportCheckpointInterval->setSuffix(" s");
+	m_exportCheckpointInterval->setToolTip("Time between checkpoints.");
+	m_exportCheckpointInterval->setEnabled(m_exportCheckpoints->isChecked());
+	m_exportCheckpointInterval->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Fixed});
+
+	m_btnExport = new QPushButton(
 		QIcon::fromTheme("document-save-as"),
 		"Export...", m_exportpanel);
-	btn_export->setFocusPolicy(Qt::StrongFocus);
+	m_btnExport->setFocusPolicy(Qt::StrongFocus);
+
+	m_btnExportResume = new QPushButton(
+		QIcon::fromTheme("media-playback-start"),
+		"Resume...", m_exportpanel);
+	m_btnExportResume->setToolTip("Resume an interrupted export from its checkpoint.");
+	m_btnExportResume->setFocusPolicy(Qt::StrongFocus);
 
 	for(int i=0; i<3; ++i)
 	{
@@ -1559,6 +1751,12 @@ void MagDynDlg::CreateExportPanel()
 	}
 
 
+	// progress of the export
+	m_exportProgress = new QProgressBar(m_exportpanel);
+	m_exportProgress->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+	m_export_job.progress = m_exportProgress;
+
+
 	auto grid = new QGridLayout(m_exportpanel);
 	grid->setSpacing(4);
 	grid->setContentsMargins(6, 6, 6, 6);
@@ -1593,6 +1791,15 @@ void MagDynDlg::CreateExportPanel()
 	grid->addWidget(m_exportNumPoints[0], y,1,1,1);
 	grid->addWidget(m_exportNumPoints[1], y,2,1,1);
 	grid->addWidget(m_exportNumPoints[2], y++,3,1,1);
+	grid->addWidget(new QLabel(QString("Symmetry:"),
+		m_exportpanel), y,0,1,1);
+	grid->addWidget(m_exportUseSymmetry, y,1,1,2);
+	grid->addWidget(m_exportTimeReversal, y++,3,1,1);
+	grid->addWidget(new QLabel(QString("Checkpoints:"),
+		m_exportpanel), y,0,1,1);
+	grid->addWidget(m_exportCheckpoints, y,1,1,1);
+	grid->addWidget(m_exportCheckpointInterval, y,2,1,1);
+	grid->addWidget(m_btnExportResume, y++,3,1,1);
 
 	grid->addItem(new QSpacerItem(8, 8,
 		QSizePolicy::Minimum, QSizePolicy::Fixed),
@@ -1607,20 +1814,885 @@ void MagDynDlg::CreateExportPanel()
 		QSizePolicy::Minimum, QSizePolicy::Expanding),
 		y++,0,1,4);
 
+	grid->addWidget(m_exportProgress, y++,0,1,4);
 	grid->addWidget(new QLabel(QString("Export Format:"),
 		m_exportpanel), y,0,1,1);
 	grid->addWidget(m_exportFormat, y,1,1,1);
-	grid->addWidget(btn_export, y++,3,1,1);
+	grid->addWidget(m_exportCompression, y,2,1,1);
+	grid->addWidget(m_btnExport, y++,3,1,1);
 
 	// signals
-	connect(btn_export, &QAbstractButton::clicked, this,
+	connect(m_exportFormat,
+		static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+		[this]()
+	{
+		m_exportCompression->setEnabled(
+			m_exportFormat->currentData().toInt() == EXPORT_HDF5);
+	});
+	connect(m_exportUseSymmetry, &QCheckBox::toggled,
+		m_exportTimeReversal, &QWidget::setEnabled);
+	connect(m_exportCheckpoints, &QCheckBox::toggled,
+		m_exportCheckpointInterval, &QWidget::setEnabled);
+	connect(m_btnExport, &QAbstractButton::clicked, this,
 		static_cast<void (MagDynDlg::*)()>(&MagDynDlg::ExportSQE));
+	connect(m_btnExportResume, &QAbstractButton::clicked,
+		this, &MagDynDlg::ResumeExportSQE);
 
 	m_tabs_out->addTab(m_exportpanel, "Export");
 }
 
 
 
+/**
+ * panel for parameter sweeps
+ */
+void MagDynDlg::CreateSweepPanel()
+{
+	const char* hklPrefix[] = { "h = ", "k = ","l = ", };
+	m_sweeppanel = new QWidget(this);
+
+	// plot of the energies versus the first parameter
+	m_sweepplot = new QCustomPlot(m_sweeppanel);
+	m_sweepplot->xAxis->setLabel("Parameter");
+	m_sweepplot->yAxis->setLabel("E (meV)");
+	m_sweepplot->setInteraction(QCP::iRangeDrag, true);
+	m_sweepplot->setInteraction(QCP::iRangeZoom, true);
+	m_sweepplot->setSelectionRectMode(QCP::srmZoom);
+	m_sweepplot->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Expanding});
+
+	// parameter table
+	m_sweeptab = new QTableWidget(m_sweeppanel);
+	m_sweeptab->setShowGrid(true);
+	m_sweeptab->setSortingEnabled(true);
+	m_sweeptab->setMouseTracking(true);
+	m_sweeptab->setSelectionBehavior(QTableWidget::SelectRows);
+	m_sweeptab->setSelectionMode(QTableWidget::ContiguousSelection);
+	m_sweeptab->setContextMenuPolicy(Qt::CustomContextMenu);
+	m_sweeptab->setToolTip("Parameters to sweep: names of variables, \"field\" for the "
+		"field magnitude, or \"temperature\".");
+
+	m_sweeptab->verticalHeader()->setDefaultSectionSize(fontMetrics().lineSpacing() + 4);
+	m_sweeptab->verticalHeader()->setVisible(true);
+
+	m_sweeptab->setColumnCount(NUM_SWEEP_COLS);
+	m_sweeptab->setHorizontalHeaderItem(COL_SWEEP_NAME,
+		new QTableWidgetItem{"Parameter"});
+	m_sweeptab->setHorizontalHeaderItem(COL_SWEEP_START,
+		new QTableWidgetItem{"Start"});
+	m_sweeptab->setHorizontalHeaderItem(COL_SWEEP_END,
+		new QTableWidgetItem{"End"});
+	m_sweeptab->setHorizontalHeaderItem(COL_SWEEP_POINTS,
+		new QTableWidgetItem{"Points"});
+
+	m_sweeptab->setColumnWidth(COL_SWEEP_NAME, 150);
+	m_sweeptab->setColumnWidth(COL_SWEEP_START, 90);
+	m_sweeptab->setColumnWidth(COL_SWEEP_END, 90);
+	m_sweeptab->setColumnWidth(COL_SWEEP_POINTS, 90);
+	m_sweeptab->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Expanding});
+
+	QPushButton *btnAdd = new QPushButton(
+		QIcon::fromTheme("list-add"),
+		"Add", m_sweeppanel);
+	QPushButton *btnDel = new QPushButton(
+		QIcon::fromTheme("list-remove"),
+		"Delete", m_sweeppanel);
+	QPushButton *btnUp = new QPushButton(
+		QIcon::fromTheme("go-up"),
+		"Up", m_sweeppanel);
+	QPushButton *btnDown = new QPushButton(
+		QIcon::fromTheme("go-down"),
+		"Down", m_sweeppanel);
+
+	btnAdd->setToolTip("Add a sweep parameter.");
+	btnDel->setToolTip("Delete selected sweep parameter.");
+	btnUp->setToolTip("Move selected parameter(s) up.");
+	btnDown->setToolTip("Move selected parameter(s) down.");
+
+	for(QPushButton* btn : { btnAdd, btnDel, btnUp, btnDown })
+	{
+		btn->setFocusPolicy(Qt::StrongFocus);
+		btn->setSizePolicy(QSizePolicy{
+			QSizePolicy::Expanding, QSizePolicy::Fixed});
+	}
+
+	// Q range
+	for(int i=0; i<3; ++i)
+	{
+		m_sweepStartQ[i] = new QDoubleSpinBox(m_sweeppanel);
+		m_sweepEndQ[i] = new QDoubleSpinBox(m_sweeppanel);
+
+		for(QDoubleSpinBox* spin : { m_sweepStartQ[i], m_sweepEndQ[i] })
+		{
+			spin->setDecimals(4);
+			spin->setMinimum(-99.9999);
+			spin->setMaximum(+99.9999);
+			spin->setSingleStep(0.01);
+			spin->setValue(0.);
+			spin->setSuffix(" rlu");
+			spin->setSizePolicy(QSizePolicy{
+				QSizePolicy::Expanding, QSizePolicy::Fixed});
+			spin->setPrefix(hklPrefix[i]);
+		}
+	}
+
+	m_sweepStartQ[0]->setValue(-1.);
+	m_sweepEndQ[0]->setValue(+1.);
+
+	m_sweepNumQ = new QSpinBox(m_sweeppanel);
+	m_sweepNumQ->setMinimum(1);
+	m_sweepNumQ->setMaximum(9999);
+	m_sweepNumQ->setValue(1);
+	m_sweepNumQ->setToolTip("Number of Q points, a single point is calculated at the start Q.");
+	m_sweepNumQ->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Fixed});
+
+	m_sweepPlotQ = new QSpinBox(m_sweeppanel);
+	m_sweepPlotQ->setMinimum(0);
+	m_sweepPlotQ->setMaximum(0);
+	m_sweepPlotQ->setValue(0);
+	m_sweepPlotQ->setToolTip("Index of the Q point to plot.");
+	m_sweepPlotQ->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Fixed});
+
+	// output
+	m_sweepFormat = new QComboBox(m_sweeppanel);
+	m_sweepFormat->addItem("Binary Cube", EXPORT_GRID);
+#ifdef USE_HDF5
+	m_sweepFormat->addItem("HDF5 File", EXPORT_HDF5);
+#endif
+	m_sweepFormat->addItem("Text File", EXPORT_TEXT);
+
+	QPushButton *btnSave = new QPushButton(
+		QIcon::fromTheme("document-save-as"),
+		"Save...", m_sweeppanel);
+	btnSave->setFocusPolicy(Qt::StrongFocus);
+
+	m_btnSweep = new QPushButton(
+		QIcon::fromTheme("media-playback-start"),
+		"Calculate", m_sweeppanel);
+	m_btnSweep->setToolTip("Calculate the dispersion for all combinations of the parameter values.");
+	m_btnSweep->setFocusPolicy(Qt::StrongFocus);
+
+
+	// table CustomContextMenu
+	QMenu *menuTableContext = new QMenu(m_sweeptab);
+	menuTableContext->addAction(
+		QIcon::fromTheme("list-add"),
+		"Add Parameter Before", this,
+		[this]() { this->AddSweepTabItem(-2); });
+	menuTableContext->addAction(
+		QIcon::fromTheme("list-add"),
+		"Add Parameter After", this,
+		[this]() { this->AddSweepTabItem(-3); });
+	menuTableContext->addAction(
+		QIcon::fromTheme("edit-copy"),
+		"Clone Parameter", this,
+		[this]() { this->AddSweepTabItem(-4); });
+	menuTableContext->addAction(
+		QIcon::fromTheme("list-remove"),
+		"Delete Parameter", this,
+		[this]() { this->DelTabItem(m_sweeptab); });
+
+
+	// table CustomContextMenu in case nothing is selected
+	QMenu *menuTableContextNoItem = new QMenu(m_sweeptab);
+	menuTableContextNoItem->addAction(
+		QIcon::fromTheme("list-add"),
+		"Add Parameter", this,
+		[this]() { this->AddSweepTabItem(); });
+	menuTableContextNoItem->addAction(
+		QIcon::fromTheme("list-remove"),
+		"Delete Parameter", this,
+		[this]() { this->DelTabItem(m_sweeptab); });
+
+
+	// progress of the calculation
+	m_sweepProgress = new QProgressBar(m_sweeppanel);
+	m_sweepProgress->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+	m_sweep_job.progress = m_sweepProgress;
+
+
+	auto grid = new QGridLayout(m_sweeppanel);
+	grid->setSpacing(4);
+	grid->setContentsMargins(6, 6, 6, 6);
+
+	int y = 0;
+	grid->addWidget(m_sweepplot, y++,0,1,4);
+	grid->addWidget(new QLabel(QString("Sweep Parameters:"),
+		m_sweeppanel), y++,0,1,4);
+	grid->addWidget(m_sweeptab, y++,0,1,4);
+	grid->addWidget(btnAdd, y,0,1,1);
+	grid->addWidget(btnDel, y,1,1,1);
+	grid->addWidget(btnUp, y,2,1,1);
+	grid->addWidget(btnDown, y++,3,1,1);
+	grid->addWidget(new QLabel(QString("Start Q:"),
+		m_sweeppanel), y,0,1,1);
+	grid->addWidget(m_sweepStartQ[0], y,1,1,1);
+	grid->addWidget(m_sweepStartQ[1], y,2,1,1);
+	grid->addWidget(m_sweepStartQ[2], y++,3,1,1);
+	grid->addWidget(new QLabel(QString("End Q:"),
+		m_sweeppanel), y,0,1,1);
+	grid->addWidget(m_sweepEndQ[0], y,1,1,1);
+	grid->addWidget(m_sweepEndQ[1], y,2,1,1);
+	grid->addWidget(m_sweepEndQ[2], y++,3,1,1);
+	grid->addWidget(new QLabel(QString("Q Count:"),
+		m_sweeppanel), y,0,1,1);
+	grid->addWidget(m_sweepNumQ, y,1,1,1);
+	grid->addWidget(new QLabel(QString("Plotted Q Index:"),
+		m_sweeppanel), y,2,1,1);
+	grid->addWidget(m_sweepPlotQ, y++,3,1,1);
+	grid->addWidget(m_sweepProgress, y++,0,1,4);
+	grid->addWidget(new QLabel(QString("Output Format:"),
+		m_sweeppanel), y,0,1,1);
+	grid->addWidget(m_sweepFormat, y,1,1,1);
+	grid->addWidget(btnSave, y,2,1,1);
+	grid->addWidget(m_btnSweep, y++,3,1,1);
+
+
+	// signals
+	connect(btnAdd, &QAbstractButton::clicked,
+		[this]() { this->AddSweepTabItem(-1); });
+	connect(btnDel, &QAbstractButton::clicked,
+		[this]() { this->DelTabItem(m_sweeptab); });
+	connect(btnUp, &QAbstractButton::clicked,
+		[this]() { this->MoveTabItemUp(m_sweeptab); });
+	connect(btnDown, &QAbstractButton::clicked,
+		[this]() { this->MoveTabItemDown(m_sweeptab); });
+
+	connect(m_sweeptab, &QTableWidget::itemSelectionChanged, [this]()
+	{
+		QList<QTableWidgetItem*> selected = m_sweeptab->selectedItems();
+		if(selected.size())
+		{
+			const QTableWidgetItem* item = *selected.begin();
+			m_sweep_cursor_row = item->row();
+		}
+	});
+	connect(m_sweeptab, &QTableWidget::customContextMenuRequested,
+		[this, menuTableContext, menuTableContextNoItem](const QPoint& pt)
+	{
+		this->ShowTableContextMenu(
+			m_sweeptab, menuTableContext, menuTableContextNoItem, pt);
+	});
+
+	connect(m_sweepPlotQ,
+		static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+		[this]()
+	{
+		this->PlotSweep();
+	});
+	connect(m_btnSweep, &QAbstractButton::clicked, this, &MagDynDlg::CalcSweep);
+	connect(btnSave, &QAbstractButton::clicked, this, &MagDynDlg::SaveSweep);
+
+	m_tabs_out->addTab(m_sweeppanel, "Sweep");
+}
+
+
+
+/**
+ * panel for the powder average
+ */
+void MagDynDlg::CreatePowderPanel()
+{
+	m_powderpanel = new QWidget(this);
+
+	// S(|Q|, E) map
+	m_powderplot = new QCustomPlot(m_powderpanel);
+	m_powderplot->xAxis->setLabel("|Q| (1/A)");
+	m_powderplot->yAxis->setLabel("E (meV)");
+	m_powderplot->setInteraction(QCP::iRangeDrag, true);
+	m_powderplot->setInteraction(QCP::iRangeZoom, true);
+	m_powderplot->setSelectionRectMode(QCP::srmZoom);
+	m_powderplot->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Expanding});
+
+	m_powdermap = new QCPColorMap(m_powderplot->xAxis, m_powderplot->yAxis);
+	m_powdermap->setGradient(QCPColorGradient::gpThermal);
+	m_powdermap->setInterpolate(false);
+	m_powdermap->setTightBoundary(false);
+
+	// ranges
+	const char* rangePrefix[] = { "min = ", "max = " };
+	for(int i=0; i<2; ++i)
+	{
+		m_powderQRange[i] = new QDoubleSpinBox(m_powderpanel);
+		m_powderQRange[i]->setDecimals(4);
+		m_powderQRange[i]->setMinimum(0.);
+		m_powderQRange[i]->setMaximum(99.9999);
+		m_powderQRange[i]->setSingleStep(0.1);
+		m_powderQRange[i]->setSuffix(" 1/A");
+		m_powderQRange[i]->setPrefix(rangePrefix[i]);
+
+		m_powderERange[i] = new QDoubleSpinBox(m_powderpanel);
+		m_powderERange[i]->setDecimals(4);
+		m_powderERange[i]->setMinimum(-9999.9999);
+		m_powderERange[i]->setMaximum(+9999.9999);
+		m_powderERange[i]->setSingleStep(0.1);
+		m_powderERange[i]->setSuffix(" meV");
+		m_powderERange[i]->setPrefix(rangePrefix[i]);
+
+		for(QDoubleSpinBox* spin : { m_powderQRange[i], m_powderERange[i] })
+		{
+			spin->setSizePolicy(QSizePolicy{
+				QSizePolicy::Expanding, QSizePolicy::Fixed});
+		}
+	}
+
+	m_powderQRange[0]->setValue(0.1);
+	m_powderQRange[1]->setValue(3.);
+	m_powderERange[0]->setValue(0.);
+	m_powderERange[1]->setValue(10.);
+
+	m_powderNumQ = new QSpinBox(m_powderpanel);
+	m_powderNumQ->setMinimum(1);
+	m_powderNumQ->setMaximum(99999);
+	m_powderNumQ->setValue(200);
+	m_powderNumQ->setPrefix("bins = ");
+	m_powderNumQ->setToolTip("Number of |Q| bins.");
+
+	m_powderNumE = new QSpinBox(m_powderpanel);
+	m_powderNumE->setMinimum(1);
+	m_powderNumE->setMaximum(99999);
+	m_powderNumE->setValue(400);
+	m_powderNumE->setPrefix("bins = ");
+	m_powderNumE->setToolTip("Number of energy bins.");
+
+	m_powderNumDirs = new QSpinBox(m_powderpanel);
+	m_powderNumDirs->setMinimum(1);
+	m_powderNumDirs->setMaximum(999999);
+	m_powderNumDirs->setValue(512);
+	m_powderNumDirs->setToolTip("Number of directions on the sphere to average for each |Q|.");
+
+	m_powderESigma = new QDoubleSpinBox(m_powderpanel);
+	m_powderESigma->setDecimals(4);
+	m_powderESigma->setMinimum(0.);
+	m_powderESigma->setMaximum(999.9999);
+	m_powderESigma->setSingleStep(0.01);
+	m_powderESigma->setValue(0.);
+	m_powderESigma->setSuffix(" meV");
+	m_powderESigma->setSpecialValueText("No Resolution");
+	m_powderESigma->setToolTip("Standard deviation of the gaussian energy resolution.");
+
+	for(QSpinBox* spin : { m_powderNumQ, m_powderNumE, m_powderNumDirs })
+	{
+		spin->setSizePolicy(QSizePolicy{
+			QSizePolicy::Expanding, QSizePolicy::Fixed});
+	}
+	m_powderESigma->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Fixed});
+
+	// output
+	m_powderFormat = new QComboBox(m_powderpanel);
+	m_powderFormat->addItem("Binary Grid", EXPORT_GRID);
+#ifdef USE_HDF5
+	m_powderFormat->addItem("HDF5 File", EXPORT_HDF5);
+#endif
+	m_powderFormat->addItem("Text File", EXPORT_TEXT);
+
+	QPushButton *btnSave = new QPushButton(
+		QIcon::fromTheme("document-save-as"),
+		"Save...", m_powderpanel);
+	btnSave->setFocusPolicy(Qt::StrongFocus);
+
+	m_btnPowder = new QPushButton(
+		QIcon::fromTheme("media-playback-start"),
+		"Calculate", m_powderpanel);
+	m_btnPowder->setToolTip("Calculate the powder-averaged S(|Q|, E).");
+	m_btnPowder->setFocusPolicy(Qt::StrongFocus);
+
+
+	// progress of the calculation
+	m_powderProgress = new QProgressBar(m_powderpanel);
+	m_powderProgress->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+	m_powder_job.progress = m_powderProgress;
+
+
+	auto grid = new QGridLayout(m_powderpanel);
+	grid->setSpacing(4);
+	grid->setContentsMargins(6, 6, 6, 6);
+
+	int y = 0;
+	grid->addWidget(m_powderplot, y++,0,1,4);
+	grid->addWidget(new QLabel(QString("|Q| Range:"),
+		m_powderpanel), y,0,1,1);
+	grid->addWidget(m_powderQRange[0], y,1,1,1);
+	grid->addWidget(m_powderQRange[1], y,2,1,1);
+	grid->addWidget(m_powderNumQ, y++,3,1,1);
+	grid->addWidget(new QLabel(QString("E Range:"),
+		m_powderpanel), y,0,1,1);
+	grid->addWidget(m_powderERange[0], y,1,1,1);
+	grid->addWidget(m_powderERange[1], y,2,1,1);
+	grid->addWidget(m_powderNumE, y++,3,1,1);
+	grid->addWidget(new QLabel(QString("Directions:"),
+		m_powderpanel), y,0,1,1);
+	grid->addWidget(m_powderNumDirs, y,1,1,1);
+	grid->addWidget(new QLabel(QString("E Resolution:"),
+		m_powderpanel), y,2,1,1);
+	grid->addWidget(m_powderESigma, y++,3,1,1);
+	grid->addWidget(m_powderProgress, y++,0,1,4);
+	grid->addWidget(new QLabel(QString("Output Format:"),
+		m_powderpanel), y,0,1,1);
+	grid->addWidget(m_powderFormat, y,1,1,1);
+	grid->addWidget(btnSave, y,2,1,1);
+	grid->addWidget(m_btnPowder, y++,3,1,1);
+
+
+	// signals
+	connect(m_btnPowder, &QAbstractButton::clicked, this, &MagDynDlg::CalcPowder);
+	connect(btnSave, &QAbstractButton::clicked, this, &MagDynDlg::SavePowder);
+
+	m_tabs_out->addTab(m_powderpanel, "Powder");
+}
+
+
+
+/**
+ * panel for S(Q, E) slices
+ */
+void MagDynDlg::CreateSlicePanel()
+{
+	const char* hklPrefix[] = { "h = ", "k = ","l = ", };
+	const char* rangePrefix[] = { "min = ", "max = " };
+	m_slicepanel = new QWidget(this);
+
+	// S(Q, E) map
+	m_sliceplot = new QCustomPlot(m_slicepanel);
+	m_sliceplot->setInteraction(QCP::iRangeDrag, true);
+	m_sliceplot->setInteraction(QCP::iRangeZoom, true);
+	m_sliceplot->setSelectionRectMode(QCP::srmZoom);
+	m_sliceplot->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Expanding});
+
+	m_slicemap = new QCPColorMap(m_sliceplot->xAxis, m_sliceplot->yAxis);
+	m_slicemap->setGradient(QCPColorGradient::gpThermal);
+	m_slicemap->setInterpolate(false);
+	m_slicemap->setTightBoundary(false);
+
+	// geometry
+	m_sliceMode = new QComboBox(m_slicepanel);
+	m_sliceMode->addItem("Q Plane", SLICE_PLANE);
+	m_sliceMode->addItem("Dispersion Path", SLICE_PATH);
+	m_sliceMode->setToolTip("Calculate S(Q, E) on a Q plane or along the dispersion path.");
+
+	for(int i=0; i<3; ++i)
+	{
+		m_sliceOrigin[i] = new QDoubleSpinBox(m_slicepanel);
+		m_sliceDir1[i] = new QDoubleSpinBox(m_slicepanel);
+		m_sliceDir2[i] = new QDoubleSpinBox(m_slicepanel);
+
+		for(QDoubleSpinBox* spin : { m_sliceOrigin[i], m_sliceDir1[i], m_sliceDir2[i] })
+		{
+			spin->setDecimals(4);
+			spin->setMinimum(-99.9999);
+			spin->setMaximum(+99.9999);
+			spin->setSingleStep(0.01);
+			spin->setValue(0.);
+			spin->setSuffix(" rlu");
+			spin->setSizePolicy(QSizePolicy{
+				QSizePolicy::Expanding, QSizePolicy::Fixed});
+			spin->setPrefix(hklPrefix[i]);
+		}
+	}
+
+	m_sliceDir1[0]->setValue(1.);
+	m_sliceDir2[1]->setValue(1.);
+
+	for(int i=0; i<2; ++i)
+	{
+		m_sliceRange1[i] = new QDoubleSpinBox(m_slicepanel);
+		m_sliceRange2[i] = new QDoubleSpinBox(m_slicepanel);
+		m_sliceERange[i] = new QDoubleSpinBox(m_slicepanel);
+
+		for(QDoubleSpinBox* spin : { m_sliceRange1[i], m_sliceRange2[i], m_sliceERange[i] })
+		{
+			spin->setDecimals(4);
+			spin->setMinimum(-9999.9999);
+			spin->setMaximum(+9999.9999);
+			spin->setSingleStep(0.1);
+			spin->setSizePolicy(QSizePolicy{
+				QSizePolicy::Expanding, QSizePolicy::Fixed});
+			spin->setPrefix(rangePrefix[i]);
+		}
+		m_sliceERange[i]->setSuffix(" meV");
+
+		m_sliceNumPoints[i] = new QSpinBox(m_slicepanel);
+		m_sliceNumPoints[i]->setMinimum(1);
+		m_sliceNumPoints[i]->setMaximum(99999);
+		m_sliceNumPoints[i]->setValue(128);
+		m_sliceNumPoints[i]->setPrefix("points = ");
+		m_sliceNumPoints[i]->setSizePolicy(QSizePolicy{
+			QSizePolicy::Expanding, QSizePolicy::Fixed});
+
+		m_sliceQWidth[i] = new QDoubleSpinBox(m_slicepanel);
+		m_sliceQWidth[i]->setDecimals(4);
+		m_sliceQWidth[i]->setMinimum(0.);
+		m_sliceQWidth[i]->setMaximum(99.9999);
+		m_sliceQWidth[i]->setSingleStep(0.01);
+		m_sliceQWidth[i]->setValue(0.);
+		m_sliceQWidth[i]->setSpecialValueText("No Q Resolution");
+		m_sliceQWidth[i]->setToolTip("Standard deviation of the gaussian Q resolution along the axis.");
+		m_sliceQWidth[i]->setSizePolicy(QSizePolicy{
+			QSizePolicy::Expanding, QSizePolicy::Fixed});
+	}
+
+	m_sliceRange1[0]->setValue(-1.);
+	m_sliceRange1[1]->setValue(1.);
+	m_sliceRange2[0]->setValue(-1.);
+	m_sliceRange2[1]->setValue(1.);
+	m_sliceERange[0]->setValue(0.);
+	m_sliceERange[1]->setValue(10.);
+
+	// energy axis and resolution
+	m_sliceNumE = new QSpinBox(m_slicepanel);
+	m_sliceNumE->setMinimum(1);
+	m_sliceNumE->setMaximum(99999);
+	m_sliceNumE->setValue(256);
+	m_sliceNumE->setPrefix("bins = ");
+	m_sliceNumE->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Fixed});
+
+	m_sliceKernel = new QComboBox(m_slicepanel);
+	m_sliceKernel->addItem("Gaussian", KERNEL_GAUSSIAN);
+	m_sliceKernel->addItem("Lorentzian", KERNEL_LORENTZIAN);
+	m_sliceKernel->setToolTip("Energy resolution kernel.");
+
+	m_sliceEWidth = new QDoubleSpinBox(m_slicepanel);
+	m_sliceEWidth->setDecimals(4);
+	m_sliceEWidth->setMinimum(0.);
+	m_sliceEWidth->setMaximum(999.9999);
+	m_sliceEWidth->setSingleStep(0.01);
+	m_sliceEWidth->setValue(0.1);
+	m_sliceEWidth->setSuffix(" meV");
+	m_sliceEWidth->setSpecialValueText("No E Resolution");
+	m_sliceEWidth->setToolTip("Width of the energy resolution: "
+		"standard deviation (gaussian) or half width (lorentzian).");
+	m_sliceEWidth->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Fixed});
+
+	m_slicePlotE = new QDoubleSpinBox(m_slicepanel);
+	m_slicePlotE->setDecimals(4);
+	m_slicePlotE->setMinimum(-9999.9999);
+	m_slicePlotE->setMaximum(+9999.9999);
+	m_slicePlotE->setSingleStep(0.1);
+	m_slicePlotE->setValue(1.);
+	m_slicePlotE->setSuffix(" meV");
+	m_slicePlotE->setToolTip("Energy of the constant-E cut shown for a Q plane.");
+	m_slicePlotE->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Fixed});
+
+	// output
+	m_sliceFormat = new QComboBox(m_slicepanel);
+#ifdef USE_HDF5
+	m_sliceFormat->addItem("HDF5 File", EXPORT_HDF5);
+#endif
+	m_sliceFormat->addItem("Text File", EXPORT_TEXT);
+
+	QPushButton *btnSave = new QPushButton(
+		QIcon::fromTheme("document-save-as"),
+		"Save...", m_slicepanel);
+	btnSave->setFocusPolicy(Qt::StrongFocus);
+
+	m_btnSlice = new QPushButton(
+		QIcon::fromTheme("media-playback-start"),
+		"Calculate", m_slicepanel);
+	m_btnSlice->setToolTip("Calculate the resolution-convolved S(Q, E).");
+	m_btnSlice->setFocusPolicy(Qt::StrongFocus);
+
+
+	// progress of the calculation
+	m_sliceProgress = new QProgressBar(m_slicepanel);
+	m_sliceProgress->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+	m_slice_job.progress = m_sliceProgress;
+
+
+	auto grid = new QGridLayout(m_slicepanel);
+	grid->setSpacing(4);
+	grid->setContentsMargins(6, 6, 6, 6);
+
+	int y = 0;
+	grid->addWidget(m_sliceplot, y++,0,1,4);
+	grid->addWidget(new QLabel(QString("Slice:"),
+		m_slicepanel), y,0,1,1);
+	grid->addWidget(m_sliceMode, y++,1,1,1);
+	grid->addWidget(new QLabel(QString("Plane Origin:"),
+		m_slicepanel), y,0,1,1);
+	grid->addWidget(m_sliceOrigin[0], y,1,1,1);
+	grid->addWidget(m_sliceOrigin[1], y,2,1,1);
+	grid->addWidget(m_sliceOrigin[2], y++,3,1,1);
+	grid->addWidget(new QLabel(QString("Direction 1:"),
+		m_slicepanel), y,0,1,1);
+	grid->addWidget(m_sliceDir1[0], y,1,1,1);
+	grid->addWidget(m_sliceDir1[1], y,2,1,1);
+	grid->addWidget(m_sliceDir1[2], y++,3,1,1);
+	grid->addWidget(new QLabel(QString("Direction 2:"),
+		m_slicepanel), y,0,1,1);
+	grid->addWidget(m_sliceDir2[0], y,1,1,1);
+	grid->addWidget(m_sliceDir2[1], y,2,1,1);
+	grid->addWidget(m_sliceDir2[2], y++,3,1,1);
+	grid->addWidget(new QLabel(QString("Range 1:"),
+		m_slicepanel), y,0,1,1);
+	grid->addWidget(m_sliceRange1[0], y,1,1,1);
+	grid->addWidget(m_sliceRange1[1], y,2,1,1);
+	grid->addWidget(m_sliceNumPoints[0], y++,3,1,1);
+	grid->addWidget(new QLabel(QString("Range 2:"),
+		m_slicepanel), y,0,1,1);
+	grid->addWidget(m_sliceRange2[0], y,1,1,1);
+	grid->addWidget(m_sliceRange2[1], y,2,1,1);
+	grid->addWidget(m_sliceNumPoints[1], y++,3,1,1);
+	grid->addWidget(new QLabel(QString("E Range:"),
+		m_slicepanel), y,0,1,1);
+	grid->addWidget(m_sliceERange[0], y,1,1,1);
+	grid->addWidget(m_sliceERange[1], y,2,1,1);
+	grid->addWidget(m_sliceNumE, y++,3,1,1);
+	grid->addWidget(new QLabel(QString("Resolution:"),
+		m_slicepanel), y,0,1,1);
+	grid->addWidget(m_sliceKernel, y,1,1,1);
+	grid->addWidget(m_sliceEWidth, y,2,1,1);
+	grid->addWidget(m_slicePlotE, y++,3,1,1);
+	grid->addWidget(new QLabel(QString("Q Resolution:"),
+		m_slicepanel), y,0,1,1);
+	grid->addWidget(m_sliceQWidth[0], y,1,1,1);
+	grid->addWidget(m_sliceQWidth[1], y++,2,1,1);
+	grid->addWidget(m_sliceProgress, y++,0,1,4);
+	grid->addWidget(new QLabel(QString("Output Format:"),
+		m_slicepanel), y,0,1,1);
+	grid->addWidget(m_sliceFormat, y,1,1,1);
+	grid->addWidget(btnSave, y,2,1,1);
+	grid->addWidget(m_btnSlice, y++,3,1,1);
+
+
+	// the plane settings are not used for a path
+	auto update_mode = [this]()
+	{
+		const bool is_plane = m_sliceMode->currentData().toInt() == SLICE_PLANE;
+
+		for(int i=0; i<3; ++i)
+		{
+			m_sliceOrigin[i]->setEnabled(is_plane);
+			m_sliceDir1[i]->setEnabled(is_plane);
+			m_sliceDir2[i]->setEnabled(is_plane);
+		}
+		for(int i=0; i<2; ++i)
+		{
+			m_sliceRange1[i]->setEnabled(is_plane);
+			m_sliceRange2[i]->setEnabled(is_plane);
+		}
+		m_sliceNumPoints[1]->setEnabled(is_plane);
+		m_sliceQWidth[1]->setEnabled(is_plane);
+		m_slicePlotE->setEnabled(is_plane);
+	};
+	update_mode();
+
+	// signals
+	connect(m_sliceMode,
+		static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+		update_mode);
+	connect(m_slicePlotE,
+		static_cast<void (QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
+		[this]()
+	{
+		this->PlotSlice();
+	});
+	connect(m_btnSlice, &QAbstractButton::clicked, this, &MagDynDlg::CalcSlice);
+	connect(btnSave, &QAbstractButton::clicked, this, &MagDynDlg::SaveSlice);
+
+	m_tabs_out->addTab(m_slicepanel, "Slice");
+}
+
+
+
+/**
+ * panel for the density of states and the thermodynamics
+ */
+void MagDynDlg::CreateDosPanel()
+{
+	const char* rangePrefix[] = { "min = ", "max = " };
+	m_dospanel = new QWidget(this);
+
+	// plots
+	m_dosplot = new QCustomPlot(m_dospanel);
+	m_dosplot->xAxis->setLabel("E (meV)");
+	m_dosplot->yAxis->setLabel("DOS (1/meV)");
+
+	m_thermoplot = new QCustomPlot(m_dospanel);
+	m_thermoplot->xAxis->setLabel("T (K)");
+
+	for(QCustomPlot* plot : { m_dosplot, m_thermoplot })
+	{
+		plot->setInteraction(QCP::iRangeDrag, true);
+		plot->setInteraction(QCP::iRangeZoom, true);
+		plot->setSelectionRectMode(QCP::srmZoom);
+		plot->setSizePolicy(QSizePolicy{
+			QSizePolicy::Expanding, QSizePolicy::Expanding});
+	}
+
+	// k mesh
+	for(int i=0; i<3; ++i)
+	{
+		m_dosMesh[i] = new QSpinBox(m_dospanel);
+		m_dosMesh[i]->setMinimum(1);
+		m_dosMesh[i]->setMaximum(9999);
+		m_dosMesh[i]->setValue(16);
+		m_dosMesh[i]->setPrefix(QString("%1 = ").arg(QChar("hkl"[i])));
+		m_dosMesh[i]->setSizePolicy(QSizePolicy{
+			QSizePolicy::Expanding, QSizePolicy::Fixed});
+	}
+
+	m_dosReduceInversion = new QCheckBox("Use E(k) = E(-k)", m_dospanel);
+	m_dosReduceInversion->setChecked(false);
+	m_dosReduceInversion->setToolTip("Only calculate one of each pair of k and -k points.\n"
+		"This is not valid if the dispersion is non-reciprocal, e.g. due to a DMI.");
+
+	m_dosMethod = new QComboBox(m_dospanel);
+	m_dosMethod->addItem("Histogram", DOS_HISTOGRAM);
+	m_dosMethod->addItem("Tetrahedra", DOS_TETRAHEDRON);
+	m_dosMethod->setToolTip("Integration method for the density of states.");
+
+	// energy and temperature axes
+	for(int i=0; i<2; ++i)
+	{
+		m_dosERange[i] = new QDoubleSpinBox(m_dospanel);
+		m_dosERange[i]->setDecimals(4);
+		m_dosERange[i]->setMinimum(0.);
+		m_dosERange[i]->setMaximum(+9999.9999);
+		m_dosERange[i]->setSingleStep(0.1);
+		m_dosERange[i]->setSuffix(" meV");
+		m_dosERange[i]->setToolTip("Energy range, it is determined automatically if max <= min.");
+
+		m_dosTRange[i] = new QDoubleSpinBox(m_dospanel);
+		m_dosTRange[i]->setDecimals(2);
+		m_dosTRange[i]->setMinimum(0.);
+		m_dosTRange[i]->setMaximum(+99999.99);
+		m_dosTRange[i]->setSingleStep(1.);
+		m_dosTRange[i]->setSuffix(" K");
+
+		for(QDoubleSpinBox* spin : { m_dosERange[i], m_dosTRange[i] })
+		{
+			spin->setPrefix(rangePrefix[i]);
+			spin->setSizePolicy(QSizePolicy{
+				QSizePolicy::Expanding, QSizePolicy::Fixed});
+		}
+	}
+
+	m_dosERange[0]->setValue(0.);
+	m_dosERange[1]->setValue(0.);
+	m_dosTRange[0]->setValue(1.);
+	m_dosTRange[1]->setValue(300.);
+
+	m_dosNumE = new QSpinBox(m_dospanel);
+	m_dosNumE->setMinimum(2);
+	m_dosNumE->setMaximum(99999);
+	m_dosNumE->setValue(256);
+	m_dosNumE->setPrefix("bins = ");
+	m_dosNumE->setToolTip("Number of energy bins.");
+
+	m_dosNumT = new QSpinBox(m_dospanel);
+	m_dosNumT->setMinimum(1);
+	m_dosNumT->setMaximum(99999);
+	m_dosNumT->setValue(300);
+	m_dosNumT->setPrefix("points = ");
+	m_dosNumT->setToolTip("Number of temperatures.");
+
+	for(QSpinBox* spin : { m_dosNumE, m_dosNumT })
+	{
+		spin->setSizePolicy(QSizePolicy{
+			QSizePolicy::Expanding, QSizePolicy::Fixed});
+	}
+
+	m_dosEWidth = new QDoubleSpinBox(m_dospanel);
+	m_dosEWidth->setDecimals(4);
+	m_dosEWidth->setMinimum(0.);
+	m_dosEWidth->setMaximum(999.9999);
+	m_dosEWidth->setSingleStep(0.01);
+	m_dosEWidth->setValue(0.);
+	m_dosEWidth->setSuffix(" meV");
+	m_dosEWidth->setSpecialValueText("No Broadening");
+	m_dosEWidth->setToolTip("Standard deviation of the gaussian broadening of the histogram.");
+	m_dosEWidth->setSizePolicy(QSizePolicy{
+		QSizePolicy::Expanding, QSizePolicy::Fixed});
+
+	m_dosThermoQuantity = new QComboBox(m_dospanel);
+	m_dosThermoQuantity->addItem("Specific Heat", 0);
+	m_dosThermoQuantity->addItem("Internal Energy", 1);
+	m_dosThermoQuantity->addItem("Entropy", 2);
+	m_dosThermoQuantity->addItem("Free Energy", 3);
+	m_dosThermoQuantity->addItem("Thermal Magnons", 4);
+	m_dosThermoQuantity->setToolTip("Thermodynamic quantity to plot.");
+
+	m_dosConvergence = new QLabel(m_dospanel);
+	m_dosConvergence->setToolTip("Relative changes compared to a mesh with half the density.");
+
+	QPushButton *btnSave = new QPushButton(
+		QIcon::fromTheme("document-save-as"),
+		"Save...", m_dospanel);
+	btnSave->setFocusPolicy(Qt::StrongFocus);
+
+	m_btnDos = new QPushButton(
+		QIcon::fromTheme("media-playback-start"),
+		"Calculate", m_dospanel);
+	m_btnDos->setToolTip("Calculate the magnon density of states and the thermodynamics.");
+	m_btnDos->setFocusPolicy(Qt::StrongFocus);
+
+
+	// progress of the calculation
+	m_dosProgress = new QProgressBar(m_dospanel);
+	m_dosProgress->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+	m_dos_job.progress = m_dosProgress;
+
+
+	auto grid = new QGridLayout(m_dospanel);
+	grid->setSpacing(4);
+	grid->setContentsMargins(6, 6, 6, 6);
+
+	int y = 0;
+	grid->addWidget(m_dosplot, y,0,1,2);
+	grid->addWidget(m_thermoplot, y++,2,1,2);
+	grid->addWidget(new QLabel(QString("k Mesh:"),
+		m_dospanel), y,0,1,1);
+	grid->addWidget(m_dosMesh[0], y,1,1,1);
+	grid->addWidget(m_dosMesh[1], y,2,1,1);
+	grid->addWidget(m_dosMesh[2], y++,3,1,1);
+	grid->addWidget(new QLabel(QString("Method:"),
+		m_dospanel), y,0,1,1);
+	grid->addWidget(m_dosMethod, y,1,1,1);
+	grid->addWidget(m_dosReduceInversion, y,2,1,1);
+	grid->addWidget(m_dosEWidth, y++,3,1,1);
+	grid->addWidget(new QLabel(QString("E Range:"),
+		m_dospanel), y,0,1,1);
+	grid->addWidget(m_dosERange[0], y,1,1,1);
+	grid->addWidget(m_dosERange[1], y,2,1,1);
+	grid->addWidget(m_dosNumE, y++,3,1,1);
+	grid->addWidget(new QLabel(QString("T Range:"),
+		m_dospanel), y,0,1,1);
+	grid->addWidget(m_dosTRange[0], y,1,1,1);
+	grid->addWidget(m_dosTRange[1], y,2,1,1);
+	grid->addWidget(m_dosNumT, y++,3,1,1);
+	grid->addWidget(new QLabel(QString("Plot:"),
+		m_dospanel), y,0,1,1);
+	grid->addWidget(m_dosThermoQuantity, y,1,1,1);
+	grid->addWidget(m_dosConvergence, y++,2,1,2);
+	grid->addWidget(m_dosProgress, y++,0,1,4);
+	grid->addWidget(btnSave, y,2,1,1);
+	grid->addWidget(m_btnDos, y++,3,1,1);
+
+
+	// signals
+	connect(m_dosThermoQuantity,
+		static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+		[this]()
+	{
+		this->PlotDos();
+	});
+	connect(m_btnDos, &QAbstractButton::clicked, this, &MagDynDlg::CalcDos);
+	connect(btnSave, &QAbstractButton::clicked, this, &MagDynDlg::SaveDos);
+
+	m_tabs_out->addTab(m_dospanel, "DOS");
+}
+
+
+
 /**
  * about dialog
  */
@@ -1761,6 +2833,10 @@ void MagDynDlg::CreateMenuBar()
 	m_plot_channels->setToolTip("Plot individual polarisation channels.");
 	m_plot_channels->setCheckable(true);
 	m_plot_channels->setChecked(false);
+	m_disp_path_mode = new QAction("Path Along Saved Coordinates", m_menuDisp);
+	m_disp_path_mode->setToolTip("Calculate the dispersion along all saved coordinates as consecutive path segments.");
+	m_disp_path_mode->setCheckable(true);
+	m_disp_path_mode->setChecked(false);
 	auto acRescalePlot = new QAction("Rescale Axes", m_menuDisp);
 	auto acSaveFigure = new QAction("Save Figure...", m_menuDisp);
 	auto acSaveDisp = new QAction("Save Data...", m_menuDisp);
@@ -1846,6 +2922,26 @@ void MagDynDlg::CreateMenuBar()
 	m_force_incommensurate->setToolTip("Enforce incommensurate calculation even for commensurate magnetic structures..");
 	m_force_incommensurate->setCheckable(true);
 	m_force_incommensurate->setChecked(false);
+	m_cache_phases = new QAction("Cache Phase Factors", menuCalc);
+	m_cache_phases->setToolTip("Assembles the Hamiltonian from cached phase factors along the Q paths and export grid lines (experimental).");
+	m_cache_phases->setCheckable(true);
+	m_cache_phases->setChecked(false);
+	QAction *acFit = new QAction("Fit Variables to Data...", menuCalc);
+	acFit->setToolTip("Fits the selected (or all) variables to measured dispersion points.");
+	QAction *acThreads = new QAction("Calculation Threads...", menuCalc);
+	acThreads->setToolTip("Sets the number of calculation threads.");
+	m_pin_threads = new QAction("Pin Threads to Cores", menuCalc);
+	m_pin_threads->setToolTip("Binds each calculation thread to its own processor core.");
+	m_pin_threads->setCheckable(true);
+	m_pin_threads->setChecked(false);
+	m_profile = new QAction("Profile Calculations", menuCalc);
+	m_profile->setToolTip("Records the time spent in the stages of the calculation.");
+	m_profile->setCheckable(true);
+	m_profile->setChecked(false);
+	QAction *acShowProfile = new QAction("Show Profile...", menuCalc);
+	QAction *acSaveTrace = new QAction("Save Profile Trace...", menuCalc);
+	acSaveTrace->setToolTip("Saves the recorded calculation stages in the Chrome trace format.");
+	QAction *acResetProfile = new QAction("Reset Profile", menuCalc);
 
 	// help menu
 	auto menuHelp = new QMenu("Help", m_menu);
@@ -1877,6 +2973,8 @@ void MagDynDlg::CreateMenuBar()
 	m_menuDisp->addAction(m_plot_channels);
 	m_menuDisp->addMenu(m_menuChannels);
 	m_menuDisp->addSeparator();
+	m_menuDisp->addAction(m_disp_path_mode);
+	m_menuDisp->addSeparator();
 	m_menuDisp->addAction(acRescalePlot);
 	m_menuDisp->addSeparator();
 	m_menuDisp->addAction(acSaveFigure);
@@ -1895,6 +2993,17 @@ void MagDynDlg::CreateMenuBar()
 	menuCalc->addAction(m_unite_degeneracies);
 	menuCalc->addAction(m_ignore_annihilation);
 	menuCalc->addAction(m_force_incommensurate);
+	menuCalc->addAction(m_cache_phases);
+	menuCalc->addSeparator();
+	menuCalc->addAction(acFit);
+	menuCalc->addSeparator();
+	menuCalc->addAction(acThreads);
+	menuCalc->addAction(m_pin_threads);
+	menuCalc->addSeparator();
+	menuCalc->addAction(m_profile);
+	menuCalc->addAction(acShowProfile);
+	menuCalc->addAction(acSaveTrace);
+	menuCalc->addAction(acResetProfile);
 
 	menuHelp->addAction(acAboutQt);
 	menuHelp->addAction(acAbout);
@@ -1925,14 +3034,12 @@ void MagDynDlg::CreateMenuBar()
 
 	auto calc_all = [this]()
 	{
-		if(this->m_autocalc->isChecked())
-			this->CalcAll();
+		this->RequestCalc(CALC_ALL);
 	};
 
 	auto calc_all_dyn = [this]()
 	{
-		if(this->m_autocalc->isChecked())
-			this->CalcAllDynamics();
+		this->RequestCalc(CALC_DYNAMICS);
 	};
 
 	connect(acStructView, &QAction::triggered, this, &MagDynDlg::ShowStructurePlot);
@@ -1945,6 +3052,25 @@ void MagDynDlg::CreateMenuBar()
 	connect(m_unite_degeneracies, &QAction::toggled, calc_all_dyn);
 	connect(m_ignore_annihilation, &QAction::toggled, calc_all_dyn);
 	connect(m_force_incommensurate, &QAction::toggled, calc_all_dyn);
+	connect(acFit, &QAction::triggered, this, &MagDynDlg::FitVariables);
+	connect(acThreads, &QAction::triggered, this, &MagDynDlg::SetNumThreads);
+	connect(m_pin_threads, &QAction::toggled, [this](bool checked)
+	{
+		if(m_pool)
+			RestartThreadPool(m_pool->GetNumThreads(), checked);
+		if(m_sett)
+			m_sett->setValue("pin_threads", checked);
+	});
+	connect(m_profile, &QAction::toggled, [](bool checked)
+	{
+		set_profiling(checked, true);
+	});
+	connect(acShowProfile, &QAction::triggered, this, &MagDynDlg::ShowProfile);
+	connect(acSaveTrace, &QAction::triggered, this, &MagDynDlg::SaveProfileTrace);
+	connect(acResetProfile, &QAction::triggered, []()
+	{
+		reset_profile();
+	});
 	connect(m_autocalc, &QAction::toggled, [this](bool checked)
 	{
 		if(checked)
@@ -1957,6 +3083,11 @@ void MagDynDlg::CreateMenuBar()
 		this->PlotDispersion();
 	});
 
+	connect(m_disp_path_mode, &QAction::toggled, [this]()
+	{
+		this->RequestCalc(CALC_DISPERSION);
+	});
+
 	for(int i=0; i<3; ++i)
 	{
 		connect(m_plot_channel[i], &QAction::toggled, [this](bool)
@@ -0,0 +1,163 @@
+/**
+ * magnetic dynamics -- powder average
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "magdyn.h"
+
+#include <QtCore/QFileInfo>
+#include <QtWidgets/QFileDialog>
+#include <QtWidgets/QMessageBox>
+
+#include <memory>
+
+
+/**
+ * calculate the powder average in a background thread
+ */
+void MagDynDlg::CalcPowder()
+{
+	SyncSitesAndTerms();
+
+	const MagDynConfig cfg = GetCalcConfig();
+	if(cfg.powder_Q_range[1] <= cfg.powder_Q_range[0] ||
+		cfg.powder_E_range[1] <= cfg.powder_E_range[0])
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics", "Invalid |Q| or E range.");
+		return;
+	}
+
+	m_status->setText("Calculating powder average.");
+	m_btnPowder->setEnabled(false);
+
+	// the powder thread works on its own copy of the magnon calculator
+	auto dyn = std::make_shared<const t_magdyn>(m_dyn);
+	auto results = std::make_shared<PowderResults>();
+
+	StartCalcJob(m_powder_job, [this, dyn, cfg, results](
+		const t_calc_progress& progress, const std::stop_token&) -> bool
+	{
+		return calc_powder(*dyn, cfg, *results, *m_pool, progress);
+	}, [this, results](bool finished, const std::string& error)
+	{
+		m_btnPowder->setEnabled(true);
+
+		if(error != "")
+		{
+			m_status->setText("Powder average failed.");
+			QMessageBox::critical(this, "Magnetic Dynamics", error.c_str());
+			return;
+		}
+
+		if(!finished)
+		{
+			m_status->setText("Powder average stopped.");
+			return;
+		}
+
+		m_powder_results = results;
+		PlotPowder();
+		m_status->setText("Powder average finished.");
+	});
+}
+
+
+/**
+ * show the S(|Q|, E) map
+ */
+void MagDynDlg::PlotPowder()
+{
+	if(!m_powderplot || !m_powdermap)
+		return;
+
+	if(!m_powder_results)
+	{
+		m_powdermap->data()->clear();
+		m_powderplot->replot();
+		return;
+	}
+
+	const PowderResults& results = *m_powder_results;
+
+	QCPColorMapData *data = m_powdermap->data();
+	data->setSize(results.num_Q, results.num_E);
+	data->setRange(
+		QCPRange(results.Q_range[0], results.Q_range[1]),
+		QCPRange(results.E_range[0], results.E_range[1]));
+
+	for(t_size Q_idx=0; Q_idx<results.num_Q; ++Q_idx)
+	{
+		for(t_size E_idx=0; E_idx<results.num_E; ++E_idx)
+			data->setCell(Q_idx, E_idx, results.GetIntensity(Q_idx, E_idx));
+	}
+
+	m_powdermap->rescaleDataRange(true);
+	m_powderplot->rescaleAxes();
+	m_powderplot->replot();
+}
+
+
+/**
+ * save the powder average
+ */
+void MagDynDlg::SavePowder()
+{
+	if(!m_powder_results)
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics", "No powder average has been calculated.");
+		return;
+	}
+
+	const int format = m_powderFormat->currentData().toInt();
+
+	QString extension;
+	switch(format)
+	{
+		case EXPORT_HDF5: extension = "HDF5 Files (*.hdf)"; break;
+		case EXPORT_GRID: extension = "Binary Files (*.bin)"; break;
+		case EXPORT_TEXT: extension = "Text Files (*.txt)"; break;
+	}
+
+	QString dirLast = m_sett->value("dir", "").toString();
+	QString filename = QFileDialog::getSaveFileName(
+		this, "Save Powder Average", dirLast, extension);
+	if(filename == "")
+		return;
+	m_sett->setValue("dir", QFileInfo(filename).path());
+
+	try
+	{
+		if(!save_powder(filename.toStdString(), *m_powder_results, format))
+		{
+			QMessageBox::critical(this, "Magnetic Dynamics",
+				"Cannot open file for writing.");
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics", ex.what());
+	}
+}
@@ -0,0 +1,200 @@
+/**
+ * magnetic dynamics -- S(Q, E) slices
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "magdyn.h"
+
+#include <QtCore/QFileInfo>
+#include <QtWidgets/QFileDialog>
+#include <QtWidgets/QMessageBox>
+
+#include <cmath>
+#include <algorithm>
+#include <memory>
+
+
+/**
+ * calculate the S(Q, E) slice in a background thread
+ */
+void MagDynDlg::CalcSlice()
+{
+	SyncSitesAndTerms();
+
+	const MagDynConfig cfg = GetCalcConfig();
+	if(cfg.slice_E_range[1] <= cfg.slice_E_range[0])
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics", "Invalid energy range.");
+		return;
+	}
+
+	m_status->setText("Calculating slice.");
+	m_btnSlice->setEnabled(false);
+
+	// the slice thread works on its own copy of the magnon calculator
+	auto dyn = std::make_shared<const t_magdyn>(m_dyn);
+	auto results = std::make_shared<SliceResults>();
+
+	StartCalcJob(m_slice_job, [this, dyn, cfg, results](
+		const t_calc_progress& progress, const std::stop_token&) -> bool
+	{
+		return calc_slice(*dyn, cfg, *results, *m_pool, progress);
+	}, [this, results](bool finished, const std::string& error)
+	{
+		m_btnSlice->setEnabled(true);
+
+		if(error != "")
+		{
+			m_status->setText("Slice calculation failed.");
+			QMessageBox::critical(this, "Magnetic Dynamics", error.c_str());
+			return;
+		}
+
+		if(!finished)
+		{
+			m_status->setText("Slice calculation stopped.");
+			return;
+		}
+
+		m_slice_results = results;
+		PlotSlice();
+		m_status->setText("Slice calculation finished.");
+	});
+}
+
+
+/**
+ * show the path-E map or the constant-E cut of the plane
+ */
+void MagDynDlg::PlotSlice()
+{
+	if(!m_sliceplot || !m_slicemap)
+		return;
+
+	if(!m_slice_results)
+	{
+		m_slicemap->data()->clear();
+		m_sliceplot->replot();
+		return;
+	}
+
+	const SliceResults& results = *m_slice_results;
+	QCPColorMapData *data = m_slicemap->data();
+
+	if(results.mode == SLICE_PATH)
+	{
+		data->setSize(results.num_points[0], results.num_E);
+		data->setRange(
+			QCPRange(results.range1[0], results.range1[1]),
+			QCPRange(results.E_range[0], results.E_range[1]));
+
+		for(t_size pt=0; pt<results.num_points[0]; ++pt)
+		{
+			for(t_size E_idx=0; E_idx<results.num_E; ++E_idx)
+				data->setCell(pt, E_idx, results.GetIntensity(pt, 0, E_idx));
+		}
+
+		// label the path's vertices
+		auto ticker = QSharedPointer<QCPAxisTickerText>::create();
+		for(const auto& [pos, label] : results.ticks)
+			ticker->addTick(pos, label.c_str());
+
+		m_sliceplot->xAxis->setTicker(ticker);
+		m_sliceplot->xAxis->setLabel("Q Path (1/A)");
+		m_sliceplot->yAxis->setLabel("E (meV)");
+	}
+	else
+	{
+		// nearest energy bin
+		const t_real dE = results.num_E > 1
+			? (results.E_range[1] - results.E_range[0]) / t_real(results.num_E - 1)
+			: t_real(1);
+		const t_real E_bin = std::round((m_slicePlotE->value() - results.E_range[0]) / dE);
+		const t_size E_idx = t_size(std::clamp<t_real>(E_bin, 0., t_real(results.num_E - 1)));
+
+		data->setSize(results.num_points[0], results.num_points[1]);
+		data->setRange(
+			QCPRange(results.range1[0], results.range1[1]),
+			QCPRange(results.range2[0], results.range2[1]));
+
+		for(t_size pt1=0; pt1<results.num_points[0]; ++pt1)
+		{
+			for(t_size pt2=0; pt2<results.num_points[1]; ++pt2)
+				data->setCell(pt1, pt2, results.GetIntensity(pt1, pt2, E_idx));
+		}
+
+		m_sliceplot->xAxis->setTicker(QSharedPointer<QCPAxisTicker>::create());
+		m_sliceplot->xAxis->setLabel("Direction 1 (rlu)");
+		m_sliceplot->yAxis->setLabel(QString("Direction 2 (rlu) at E = %1 meV")
+			.arg(results.GetE(E_idx), 0, 'g', g_prec_gui));
+	}
+
+	m_slicemap->rescaleDataRange(true);
+	m_sliceplot->rescaleAxes();
+	m_sliceplot->replot();
+}
+
+
+/**
+ * save the S(Q, E) slice
+ */
+void MagDynDlg::SaveSlice()
+{
+	if(!m_slice_results)
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics", "No slice has been calculated.");
+		return;
+	}
+
+	const int format = m_sliceFormat->currentData().toInt();
+
+	QString extension;
+	switch(format)
+	{
+		case EXPORT_HDF5: extension = "HDF5 Files (*.hdf)"; break;
+		case EXPORT_TEXT: extension = "Text Files (*.txt)"; break;
+	}
+
+	QString dirLast = m_sett->value("dir", "").toString();
+	QString filename = QFileDialog::getSaveFileName(
+		this, "Save Slice", dirLast, extension);
+	if(filename == "")
+		return;
+	m_sett->setValue("dir", QFileInfo(filename).path());
+
+	try
+	{
+		if(!save_slice(filename.toStdString(), *m_slice_results, format))
+		{
+			QMessageBox::critical(this, "Magnetic Dynamics",
+				"Cannot open file for writing.");
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics", ex.what());
+	}
+}
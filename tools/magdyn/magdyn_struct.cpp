@@ -27,10 +27,18 @@
  */
 
 #include "magdyn.h"
+#include "neighbours.h"
 #include <QtWidgets/QMessageBox>
 
 #include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <unordered_set>
+#include <tuple>
+#include <cmath>
+
 #include <boost/scope_exit.hpp>
+#include <boost/functional/hash.hpp>
 
 
 /**
@@ -42,8 +50,7 @@ void MagDynDlg::MirrorAtoms()
 	BOOST_SCOPE_EXIT(this_)
 	{
 		this_->m_ignoreCalc = false;
-		if(this_->m_autocalc->isChecked())
-			this_->CalcAll();
+		this_->RequestCalc(CALC_ALL);
 	} BOOST_SCOPE_EXIT_END
 	m_ignoreCalc = true;
 
@@ -106,8 +113,7 @@ void MagDynDlg::RotateField(bool ccw)
 		m_field_dir[i]->blockSignals(false);
 	}
 
-	if(m_autocalc->isChecked())
-		CalcAll();
+	RequestCalc(CALC_ALL);
 };
 
 
@@ -135,8 +141,7 @@ void MagDynDlg::SetCurrentField()
 	BOOST_SCOPE_EXIT(this_)
 	{
 		this_->m_ignoreCalc = false;
-		if(this_->m_autocalc->isChecked())
-			this_->CalcAll();
+		this_->RequestCalc(CALC_ALL);
 	} BOOST_SCOPE_EXIT_END
 
 	m_field_dir[0]->setValue(Bh->GetValue());
@@ -154,8 +159,7 @@ void MagDynDlg::GenerateSitesFromSG()
 	BOOST_SCOPE_EXIT(this_)
 	{
 		this_->m_ignoreCalc = false;
-		if(this_->m_autocalc->isChecked())
-			this_->CalcAll();
+		this_->RequestCalc(CALC_ALL);
 	} BOOST_SCOPE_EXIT_END
 	m_ignoreCalc = true;
 
@@ -271,8 +275,7 @@ void MagDynDlg::GenerateCouplingsFromSG()
 	BOOST_SCOPE_EXIT(this_)
 	{
 		this_->m_ignoreCalc = false;
-		if(this_->m_autocalc->isChecked())
-			this_->CalcAll();
+		this_->RequestCalc(CALC_ALL);
 	} BOOST_SCOPE_EXIT_END
 	m_ignoreCalc = true;
 
@@ -296,28 +299,23 @@ void MagDynDlg::GenerateCouplingsFromSG()
 			std::string                            // colour
 			>> generatedcouplings;
 
-		// avoids duplicate coupling terms
-		auto remove_duplicate_terms = [&generatedcouplings]()
+		// canonical key of a coupling: atom indices and rounded supercell vector
+		using t_coupling_key = std::tuple<t_size, t_size, int, int, int>;
+		auto get_coupling_hash = [](const t_coupling_key& key) -> std::size_t
 		{
-			for(auto iter1 = generatedcouplings.begin(); iter1 != generatedcouplings.end(); ++iter1)
-			{
-				for(auto iter2 = std::next(iter1, 1); iter2 != generatedcouplings.end();)
-				{
-					bool same_uc_idx1 = (std::get<1>(*iter1) == std::get<1>(*iter2));
-					bool same_uc_idx2 = (std::get<2>(*iter1) == std::get<2>(*iter2));
-
-					bool same_sc_x = tl2::equals<t_real>(std::get<3>(*iter1), std::get<3>(*iter2), g_eps);
-					bool same_sc_y = tl2::equals<t_real>(std::get<4>(*iter1), std::get<4>(*iter2), g_eps);
-					bool same_sc_z = tl2::equals<t_real>(std::get<5>(*iter1), std::get<5>(*iter2), g_eps);
-
-					if(same_uc_idx1 && same_uc_idx2 && same_sc_x && same_sc_y && same_sc_z)
-						iter2 = generatedcouplings.erase(iter2);
-					else
-						++iter2;
-				}
-			}
+			std::size_t hash = 0;
+			boost::hash_combine(hash, std::hash<t_size>{}(std::get<0>(key)));
+			boost::hash_combine(hash, std::hash<t_size>{}(std::get<1>(key)));
+			boost::hash_combine(hash, std::hash<int>{}(std::get<2>(key)));
+			boost::hash_combine(hash, std::hash<int>{}(std::get<3>(key)));
+			boost::hash_combine(hash, std::hash<int>{}(std::get<4>(key)));
+			return hash;
 		};
 
+		// keys of the already generated couplings, avoids duplicate coupling terms
+		std::unordered_set<t_coupling_key, decltype(get_coupling_hash)>
+			seen_couplings(64, get_coupling_hash);
+
 		const auto& sites = m_dyn.GetAtomSites();
 		const auto& ops = m_SGops[sgidx];
 
@@ -419,14 +417,19 @@ void MagDynDlg::GenerateCouplingsFromSG()
 						<< op_idx << "." << std::endl;
 				}
 
+				// only keep the first occurrence of a coupling
+				t_coupling_key key = std::make_tuple(newsite1_idx, newsite2_idx,
+					int(std::round(sc_dist[0])), int(std::round(sc_dist[1])),
+					int(std::round(sc_dist[2])));
+				if(!seen_couplings.insert(key).second)
+					continue;
+
 				generatedcouplings.emplace_back(std::make_tuple(
 					ident + "_" + tl2::var_to_str(op_idx), newsite1_idx, newsite2_idx,
 					sc_dist[0], sc_dist[1], sc_dist[2], oldJ,
 					tl2::var_to_str(newdmi[0]), tl2::var_to_str(newdmi[1]), tl2::var_to_str(newdmi[2]),
 					rgb));
 			}
-
-			remove_duplicate_terms();
 		}
 
 		if(!generatedcouplings.size())
@@ -453,6 +456,104 @@ void MagDynDlg::GenerateCouplingsFromSG()
 
 
 
+/**
+ * generate exchange terms between all atoms in the given distance shells
+ */
+void MagDynDlg::GenerateCouplingsByDistance()
+{
+	BOOST_SCOPE_EXIT(this_)
+	{
+		this_->m_ignoreCalc = false;
+		this_->RequestCalc(CALC_ALL);
+	} BOOST_SCOPE_EXIT_END
+	m_ignoreCalc = true;
+
+	try
+	{
+		// get the shell distances
+		std::string shells_str = m_couplingShells->text().toStdString();
+		std::replace_if(shells_str.begin(), shells_str.end(),
+			[](char c) -> bool { return c == ',' || c == ';'; }, ' ');
+
+		std::vector<t_real> shells;
+		std::istringstream istr{shells_str};
+		for(t_real shell{}; istr >> shell;)
+			shells.push_back(shell);
+
+		if(!istr.eof() || !shells.size())
+		{
+			QMessageBox::critical(this, "Magnetic Dynamics",
+				"Invalid shell distances given.");
+			return;
+		}
+
+		// get the crystal lattice
+		t_real lattice[3], angles[3];
+		for(int i=0; i<3; ++i)
+		{
+			lattice[i] = m_xtallattice[i]->value();
+			angles[i] = m_xtalangles[i]->value();
+		}
+
+		// get all site positions
+		const auto& sites = m_dyn.GetAtomSites();
+		std::vector<t_vec_real> allsites;
+		allsites.reserve(sites.size());
+		for(const auto& site: sites)
+			allsites.push_back(site.pos);
+
+		auto couplings = find_couplings_by_distance(allsites, lattice, angles,
+			shells, m_couplingShellTol->value());
+
+		if(!couplings.size())
+		{
+			QMessageBox::critical(this, "Magnetic Dynamics", "No couplings could be generated.");
+			return;
+		}
+
+		// add a coupling constant variable per shell, if it doesn't exist yet
+		for(std::size_t shell_idx=0; shell_idx<shells.size(); ++shell_idx)
+		{
+			std::string varname = "J" + tl2::var_to_str(shell_idx + 1);
+
+			bool var_exists = false;
+			for(int row=0; row<m_varstab->rowCount(); ++row)
+			{
+				if(auto *name = m_varstab->item(row, COL_VARS_NAME);
+					name && name->text().toStdString() == varname)
+				{
+					var_exists = true;
+					break;
+				}
+			}
+
+			if(!var_exists)
+				AddVariableTabItem(-1, varname, t_cplx{-1., 0.});
+		}
+
+		// remove original couplings
+		DelTabItem(m_termstab, -1);
+
+		// add new couplings
+		std::vector<t_size> shell_counts(shells.size(), 0);
+		for(const NeighbourCoupling& coupling : couplings)
+		{
+			std::string J = "J" + tl2::var_to_str(coupling.shell + 1);
+			std::string ident = J + "_" + tl2::var_to_str(shell_counts[coupling.shell]++);
+
+			AddTermTabItem(-1, ident, coupling.atom1, coupling.atom2,
+				t_real(coupling.sc[0]), t_real(coupling.sc[1]), t_real(coupling.sc[2]),
+				J);
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics", ex.what());
+	}
+}
+
+
+
 std::optional<t_size> MagDynDlg::GetTermAtomIndex(int row, int num) const
 {
 	int col = num==0 ? COL_XCH_ATOM1_IDX : COL_XCH_ATOM2_IDX;
@@ -499,7 +600,9 @@ std::optional<t_size> MagDynDlg::GetTermAtomIndex(int row, int num) const
 
 /**
  * get the sites, exchange terms, and variables from the table
- * and transfer them to the dynamics calculator
+ * and transfer them to the dynamics calculator,
+ * this is a full resync: the calculator is cleared, all rows are re-read,
+ * and all sites and terms are recalculated
  */
 void MagDynDlg::SyncSitesAndTerms()
 {
@@ -696,6 +799,94 @@ void MagDynDlg::SyncSitesAndTerms()
 
 
 
+/**
+ * get the calculation settings from the gui
+ */
+MagDynConfig MagDynDlg::GetCalcConfig() const
+{
+	MagDynConfig cfg;
+
+	for(int i=0; i<3; ++i)
+	{
+		cfg.Q_start[i] = m_q_start[i]->value();
+		cfg.Q_end[i] = m_q_end[i]->value();
+		cfg.export_start[i] = m_exportStartQ[i]->value();
+		cfg.export_end[i] = m_exportEndQ[i]->value();
+		cfg.export_num_points[i] = m_exportNumPoints[i]->value();
+		cfg.xtal_lattice[i] = m_xtallattice[i]->value();
+		cfg.xtal_angles[i] = m_xtalangles[i]->value();
+	}
+	cfg.num_Q_points = m_num_points->value();
+	cfg.adaptive_Q = m_adaptive_Q->isChecked();
+	cfg.adaptive_E_tol = m_adaptive_E_tol->value();
+	cfg.Q_path = GetCoordinatePath();
+	cfg.export_compression = m_exportCompression->value();
+	cfg.export_use_symmetry = m_exportUseSymmetry->isChecked();
+	cfg.export_time_reversal = m_exportTimeReversal->isChecked();
+	cfg.export_checkpoints = m_exportCheckpoints->isChecked();
+	cfg.export_checkpoint_interval = m_exportCheckpointInterval->value();
+
+	if(auto sgidx = m_comboSG->itemData(m_comboSG->currentIndex()).toInt();
+		sgidx >= 0 && std::size_t(sgidx) < m_SGops.size())
+		cfg.sg_ops = m_SGops[sgidx];
+
+	for(int i=0; i<2; ++i)
+	{
+		cfg.powder_Q_range[i] = m_powderQRange[i]->value();
+		cfg.powder_E_range[i] = m_powderERange[i]->value();
+	}
+	cfg.powder_num_Q = m_powderNumQ->value();
+	cfg.powder_num_E = m_powderNumE->value();
+	cfg.powder_num_dirs = m_powderNumDirs->value();
+	cfg.powder_E_sigma = m_powderESigma->value();
+
+	cfg.slice_mode = m_sliceMode->currentData().toInt();
+	for(int i=0; i<3; ++i)
+	{
+		cfg.slice_origin[i] = m_sliceOrigin[i]->value();
+		cfg.slice_dir1[i] = m_sliceDir1[i]->value();
+		cfg.slice_dir2[i] = m_sliceDir2[i]->value();
+	}
+	for(int i=0; i<2; ++i)
+	{
+		cfg.slice_range1[i] = m_sliceRange1[i]->value();
+		cfg.slice_range2[i] = m_sliceRange2[i]->value();
+		cfg.slice_num_points[i] = m_sliceNumPoints[i]->value();
+		cfg.slice_E_range[i] = m_sliceERange[i]->value();
+		cfg.slice_Q_width[i] = m_sliceQWidth[i]->value();
+	}
+	cfg.slice_num_E = m_sliceNumE->value();
+	cfg.slice_kernel = m_sliceKernel->currentData().toInt();
+	cfg.slice_E_width = m_sliceEWidth->value();
+
+	for(int i=0; i<3; ++i)
+		cfg.dos_mesh[i] = m_dosMesh[i]->value();
+	cfg.dos_reduce_inversion = m_dosReduceInversion->isChecked();
+	cfg.dos_method = m_dosMethod->currentData().toInt();
+	for(int i=0; i<2; ++i)
+	{
+		cfg.dos_E_range[i] = m_dosERange[i]->value();
+		cfg.dos_T_range[i] = m_dosTRange[i]->value();
+	}
+	cfg.dos_num_E = m_dosNumE->value();
+	cfg.dos_E_width = m_dosEWidth->value();
+	cfg.dos_num_T = m_dosNumT->value();
+
+	cfg.use_dmi = m_use_dmi->isChecked();
+	cfg.use_field = m_use_field->isChecked();
+	cfg.use_temperature = m_use_temperature->isChecked();
+	cfg.use_weights = m_use_weights->isChecked();
+	cfg.use_projector = m_use_projector->isChecked();
+	cfg.unite_degeneracies = m_unite_degeneracies->isChecked();
+	cfg.ignore_annihilation = m_ignore_annihilation->isChecked();
+	cfg.force_incommensurate = m_force_incommensurate->isChecked();
+	cfg.cache_phases = m_cache_phases->isChecked();
+
+	return cfg;
+}
+
+
+
 /**
  * open the table import dialog
  */
@@ -726,8 +917,7 @@ void MagDynDlg::ImportAtoms(const std::vector<TableImportAtom>& atompos_vec)
 	BOOST_SCOPE_EXIT(this_)
 	{
 		this_->m_ignoreCalc = false;
-		if(this_->m_autocalc->isChecked())
-			this_->CalcAll();
+		this_->RequestCalc(CALC_ALL);
 	} BOOST_SCOPE_EXIT_END
 	m_ignoreCalc = true;
 
@@ -764,8 +954,7 @@ void MagDynDlg::ImportCouplings(const std::vector<TableImportCoupling>& coupling
 	BOOST_SCOPE_EXIT(this_)
 	{
 		this_->m_ignoreCalc = false;
-		if(this_->m_autocalc->isChecked())
-			this_->CalcAll();
+		this_->RequestCalc(CALC_ALL);
 	} BOOST_SCOPE_EXIT_END
 	m_ignoreCalc = true;
 
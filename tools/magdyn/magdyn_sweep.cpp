@@ -0,0 +1,270 @@
+/**
+ * magnetic dynamics -- parameter sweeps
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "magdyn.h"
+
+#include <QtCore/QFileInfo>
+#include <QtWidgets/QFileDialog>
+#include <QtWidgets/QMessageBox>
+
+#include <algorithm>
+#include <tuple>
+#include <memory>
+
+extern int g_prec_gui;
+
+
+/**
+ * get the sweep parameters from the table
+ */
+std::vector<SweepParameter> MagDynDlg::GetSweepParameters() const
+{
+	std::vector<SweepParameter> params;
+	params.reserve(m_sweeptab->rowCount());
+
+	for(int row = 0; row < m_sweeptab->rowCount(); ++row)
+	{
+		const auto* name = m_sweeptab->item(row, COL_SWEEP_NAME);
+		const auto* start = static_cast<tl2::NumericTableWidgetItem<t_real>*>(
+			m_sweeptab->item(row, COL_SWEEP_START));
+		const auto* end = static_cast<tl2::NumericTableWidgetItem<t_real>*>(
+			m_sweeptab->item(row, COL_SWEEP_END));
+		const auto* num_points = static_cast<tl2::NumericTableWidgetItem<t_size>*>(
+			m_sweeptab->item(row, COL_SWEEP_POINTS));
+
+		if(!name || !start || !end || !num_points)
+			continue;
+
+		SweepParameter param;
+		param.name = name->text().trimmed().toStdString();
+		param.start = start->GetValue();
+		param.end = end->GetValue();
+		param.num_points = num_points->GetValue();
+
+		param.type = get_sweep_parameter_type(m_dyn, param.name);
+
+		params.emplace_back(std::move(param));
+	}
+
+	return params;
+}
+
+
+/**
+ * calculate the parameter sweep in a background thread
+ */
+void MagDynDlg::CalcSweep()
+{
+	SyncSitesAndTerms();
+
+	const std::vector<SweepParameter> params = GetSweepParameters();
+	if(params.size() == 0)
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics", "No sweep parameters defined.");
+		return;
+	}
+
+	MagDynConfig cfg = GetCalcConfig();
+	for(int i=0; i<3; ++i)
+	{
+		cfg.Q_start[i] = m_sweepStartQ[i]->value();
+		cfg.Q_end[i] = m_sweepEndQ[i]->value();
+	}
+	cfg.num_Q_points = m_sweepNumQ->value();
+
+	t_size num_items = cfg.num_Q_points;
+	for(const SweepParameter& param : params)
+		num_items *= std::max<t_size>(param.num_points, 1);
+
+	m_status->setText("Performing sweep.");
+	m_btnSweep->setEnabled(false);
+
+	// the sweep thread works on its own copy of the magnon calculator
+	auto dyn = std::make_shared<const t_magdyn>(m_dyn);
+	auto results = std::make_shared<SweepResults>();
+
+	StartCalcJob(m_sweep_job, [this, dyn, cfg, params, results](
+		const t_calc_progress& progress, const std::stop_token&) -> bool
+	{
+		return calc_sweep(*dyn, cfg, params, *results, *m_pool, progress);
+	}, [this, results](bool finished, const std::string& error)
+	{
+		m_btnSweep->setEnabled(true);
+
+		if(error != "")
+		{
+			m_status->setText("Sweep failed.");
+			QMessageBox::critical(this, "Magnetic Dynamics", error.c_str());
+			return;
+		}
+
+		if(!finished)
+		{
+			m_status->setText("Sweep stopped.");
+			return;
+		}
+
+		m_sweep_results = results;
+		m_sweepPlotQ->setMaximum(results->num_Q - 1);
+		PlotSweep();
+		m_status->setText("Sweep finished.");
+	});
+}
+
+
+/**
+ * plot the energies versus the first sweep parameter at the selected Q point
+ */
+void MagDynDlg::PlotSweep()
+{
+	if(!m_sweepplot)
+		return;
+
+	m_sweepplot->clearPlottables();
+
+	if(!m_sweep_results || m_sweep_results->params.size() == 0)
+	{
+		m_sweepplot->replot();
+		return;
+	}
+
+	const SweepResults& results = *m_sweep_results;
+	const t_size Q_idx = std::min<t_size>(m_sweepPlotQ->value(), results.num_Q - 1);
+
+	// (parameter, energy, weight), sorted by parameter
+	std::vector<std::tuple<t_real, t_real, t_real>> data;
+	for(t_size param_pt=0; param_pt<results.num_param_points; ++param_pt)
+	{
+		const t_real param = results.GetParamValues(param_pt)[0];
+		const SofQE& result = results.GetResult(param_pt, Q_idx);
+
+		for(std::size_t branch=0; branch<result.E.size(); ++branch)
+			data.emplace_back(param, result.E[branch], result.S[branch]);
+	}
+
+	std::stable_sort(data.begin(), data.end(), [](const auto& dat1, const auto& dat2) -> bool
+	{
+		return std::get<0>(dat1) < std::get<0>(dat2);
+	});
+
+	QVector<t_real> params, Es, ws;
+	params.reserve(data.size());
+	Es.reserve(data.size());
+	ws.reserve(data.size());
+	for(const auto& [param, E, w] : data)
+	{
+		params.push_back(param);
+		Es.push_back(E);
+		if(results.use_weights)
+			ws.push_back(w);
+	}
+
+	GraphWithWeights *graph = new GraphWithWeights(m_sweepplot->xAxis, m_sweepplot->yAxis);
+	QPen pen = graph->pen();
+	pen.setColor(QColor(0xff, 0x00, 0x00));
+	pen.setWidthF(1.);
+	graph->setPen(pen);
+	graph->setBrush(QBrush(pen.color(), Qt::SolidPattern));
+	graph->setLineStyle(QCPGraph::lsNone);
+	graph->setScatterStyle(QCPScatterStyle(
+		QCPScatterStyle::ssDisc, m_weight_scale->value()));
+	graph->setAntialiased(true);
+	graph->setData(params, Es, true /*already sorted*/);
+	graph->SetWeights(ws);
+	graph->SetWeightScale(m_weight_scale->value(), m_weight_min->value(), m_weight_max->value());
+
+	// labels
+	const SofQE& result = results.GetResult(0, Q_idx);
+	QString label = QString("%1 at Q = (%2, %3, %4) rlu")
+		.arg(results.params[0].GetName().c_str())
+		.arg(result.h, 0, 'g', g_prec_gui)
+		.arg(result.k, 0, 'g', g_prec_gui)
+		.arg(result.l, 0, 'g', g_prec_gui);
+	m_sweepplot->xAxis->setLabel(label);
+
+	// ranges
+	m_sweepplot->xAxis->setRange(
+		std::min(results.params[0].start, results.params[0].end),
+		std::max(results.params[0].start, results.params[0].end));
+
+	auto [min_E_iter, max_E_iter] = std::minmax_element(Es.begin(), Es.end());
+	if(min_E_iter != Es.end() && max_E_iter != Es.end())
+	{
+		t_real E_range = *max_E_iter - *min_E_iter;
+		m_sweepplot->yAxis->setRange(*min_E_iter - E_range*0.05, *max_E_iter + E_range*0.05);
+	}
+	else
+	{
+		m_sweepplot->yAxis->setRange(0., 1.);
+	}
+
+	m_sweepplot->replot();
+}
+
+
+/**
+ * save the sweep results
+ */
+void MagDynDlg::SaveSweep()
+{
+	if(!m_sweep_results)
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics", "No sweep has been calculated.");
+		return;
+	}
+
+	const int format = m_sweepFormat->currentData().toInt();
+
+	QString extension;
+	switch(format)
+	{
+		case EXPORT_HDF5: extension = "HDF5 Files (*.hdf)"; break;
+		case EXPORT_GRID: extension = "Binary Files (*.bin)"; break;
+		case EXPORT_TEXT: extension = "Text Files (*.txt)"; break;
+	}
+
+	QString dirLast = m_sett->value("dir", "").toString();
+	QString filename = QFileDialog::getSaveFileName(
+		this, "Save Sweep", dirLast, extension);
+	if(filename == "")
+		return;
+	m_sett->setValue("dir", QFileInfo(filename).path());
+
+	try
+	{
+		if(!save_sweep(filename.toStdString(), *m_sweep_results, format))
+		{
+			QMessageBox::critical(this, "Magnetic Dynamics",
+				"Cannot open file for writing.");
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		QMessageBox::critical(this, "Magnetic Dynamics", ex.what());
+	}
+}
@@ -7,7 +7,7 @@
  *
  * ----------------------------------------------------------------------------
  * mag-core (part of the Takin software suite)
- * Copyright (C) 2018-2022  Tobias WEBER (Institut Laue-Langevin (ILL),
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
  *                          Grenoble, France).
  * "misc" project
  * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
@@ -27,6 +27,13 @@
  */
 
 #include "magdyn.h"
+#include "calc.h"
+#include "sweep.h"
+#include "fit.h"
+#include "powder.h"
+#include "slice.h"
+#include "dos.h"
+#include "profiler.h"
 #include "tlibs2/libs/qt/gl.h"
 #include "tlibs2/libs/qt/helper.h"
 
@@ -34,21 +41,428 @@
 
 #include <iostream>
 #include <memory>
+#include <algorithm>
 
+#include <boost/program_options.hpp>
+namespace args = boost::program_options;
 
+
+/**
+ * command-line settings overriding the ones from the input file
+ */
+struct CliArgs
+{
+	std::string dispersion_file{}, export_file{}, sweep_file{};
+	std::string fit_file{}, powder_file{}, slice_file{}, dos_file{};
+	std::vector<std::string> fit_vars{};
+	t_real fit_rel_step{-1.};
+	std::string export_format{"hdf5"};
+	unsigned int num_threads{0};
+	bool pin_threads{false};
+
+	std::vector<t_real> Q_start{}, Q_end{};
+	t_size num_Q_points{0};
+	bool adaptive_Q{false};
+	bool Q_path{false};
+	t_real adaptive_E_tol{-1.};
+
+	std::vector<t_real> export_start{}, export_end{};
+	std::vector<t_size> export_num_points{};
+	int export_compression{-1};
+	t_real export_checkpoint_interval{-1.};
+	bool export_resume{false};
+	t_size export_shard{0}, export_num_shards{1};
+	std::vector<std::string> merge_files{};
+	std::string profile_file{};
+};
+
+
+/**
+ * copy a command-line vector to a settings array
+ */
+template<class t_val>
+static void set_cfg_vec(const std::vector<t_val>& vec, t_val* cfg_vec, const char* name)
+{
+	if(vec.size() == 0)
+		return;
+	if(vec.size() != 3)
+		throw std::runtime_error(std::string("Argument \"") + name + "\" needs three components.");
+
+	for(int i=0; i<3; ++i)
+		cfg_vec[i] = vec[i];
+}
+
+
+/**
+ * get the export format from its name
+ */
+static int get_export_format(const std::string& name)
+{
+	if(name == "hdf5")
+		return EXPORT_HDF5;
+	else if(name == "grid")
+		return EXPORT_GRID;
+	else if(name == "text")
+		return EXPORT_TEXT;
+
+	std::cerr << "Error: Unknown export format \"" << name << "\"." << std::endl;
+	return -1;
+}
+
+
+/**
+ * starts the cli program
+ */
+static int cli_main(const std::string& cfg_file, const CliArgs& cli_args)
+{
+	try
+	{
+		// merge the shards of a grid export, this does not need a magnetic structure
+		if(cli_args.merge_files.size())
+		{
+			if(cli_args.export_file == "")
+			{
+				std::cerr << "Error: No output file given for the merged grid." << std::endl;
+				return -1;
+			}
+
+			int format = get_export_format(cli_args.export_format);
+			if(format < 0)
+				return -1;
+
+			if(!merge_export_shards(cli_args.merge_files, cli_args.export_file, format,
+				std::max(cli_args.export_compression, 0)))
+			{
+				std::cerr << "Error: Could not merge the shards into \""
+					<< cli_args.export_file << "\"." << std::endl;
+				return -1;
+			}
+			return 0;
+		}
+
+		if(cfg_file == "")
+		{
+			std::cerr << "Error: No input file given." << std::endl;
+			return -1;
+		}
+
+		if(cli_args.dispersion_file == "" && cli_args.export_file == ""
+			&& cli_args.sweep_file == "" && cli_args.fit_file == ""
+			&& cli_args.powder_file == "" && cli_args.slice_file == ""
+			&& cli_args.dos_file == "")
+		{
+			std::cerr << "Error: No output file given." << std::endl;
+			return -1;
+		}
+
+		t_magdyn dyn;
+		MagDynConfig cfg;
+		load_magdyn(cfg_file, dyn, cfg);
+
+		// override file settings
+		set_cfg_vec(cli_args.Q_start, cfg.Q_start, "Q_start");
+		set_cfg_vec(cli_args.Q_end, cfg.Q_end, "Q_end");
+		if(cli_args.num_Q_points)
+			cfg.num_Q_points = cli_args.num_Q_points;
+		if(cli_args.adaptive_Q)
+			cfg.adaptive_Q = true;
+		if(cli_args.adaptive_E_tol > 0.)
+			cfg.adaptive_E_tol = cli_args.adaptive_E_tol;
+		if(cli_args.fit_rel_step > 0.)
+			cfg.fit_rel_step = cli_args.fit_rel_step;
+		set_cfg_vec(cli_args.export_start, cfg.export_start, "export_start");
+		set_cfg_vec(cli_args.export_end, cfg.export_end, "export_end");
+		set_cfg_vec(cli_args.export_num_points, cfg.export_num_points, "export_points");
+		if(cli_args.export_compression >= 0)
+			cfg.export_compression = cli_args.export_compression;
+		cfg.export_shard = cli_args.export_shard;
+		cfg.export_num_shards = cli_args.export_num_shards;
+		if(cli_args.export_checkpoint_interval >= 0.)
+		{
+			cfg.export_checkpoints = true;
+			cfg.export_checkpoint_interval = cli_args.export_checkpoint_interval;
+		}
+
+		CalcThreadPool pool{cli_args.num_threads, cli_args.pin_threads};
+		if(cli_args.profile_file != "")
+			set_profiling(true, true);
+
+		// fit the variables to measured dispersion points,
+		// the other calculations then use the fitted values
+		if(cli_args.fit_file != "")
+		{
+			std::vector<std::string> var_names = cli_args.fit_vars;
+			if(var_names.size() == 0)
+			{
+				for(const t_magdyn::Variable& var : dyn.GetVariables())
+					var_names.push_back(var.name);
+			}
+
+			std::vector<FitDataPoint> data = load_fit_data(cli_args.fit_file);
+
+			FitResults results;
+			if(!fit_variables(dyn, cfg, data, var_names, results, pool))
+			{
+				std::cerr << "Error: Fit failed." << std::endl;
+				return -1;
+			}
+			print_fit_results(std::cout, results);
+
+			apply_fit_results(dyn, results);
+		}
+
+		// dispersion along the saved coordinates
+		if(cli_args.dispersion_file != "" && cli_args.Q_path)
+		{
+			if(cfg.Q_path.size() == 0)
+			{
+				std::cerr << "Error: No saved coordinates for the path." << std::endl;
+				return -1;
+			}
+
+			std::vector<SofQE> results;
+			if(!calc_dispersion_path(dyn, cfg, results, pool))
+			{
+				std::cerr << "Error: Dispersion calculation failed." << std::endl;
+				return -1;
+			}
+
+			if(!save_dispersion_path(cli_args.dispersion_file, cfg, results))
+			{
+				std::cerr << "Error: Could not write dispersion to \""
+					<< cli_args.dispersion_file << "\"." << std::endl;
+				return -1;
+			}
+		}
+
+		// dispersion
+		else if(cli_args.dispersion_file != "")
+		{
+			std::vector<SofQE> results;
+			if(!calc_dispersion(dyn, cfg, results, pool))
+			{
+				std::cerr << "Error: Dispersion calculation failed." << std::endl;
+				return -1;
+			}
+
+			if(!save_dispersion(cli_args.dispersion_file, results))
+			{
+				std::cerr << "Error: Could not write dispersion to \""
+					<< cli_args.dispersion_file << "\"." << std::endl;
+				return -1;
+			}
+		}
+
+		int format = get_export_format(cli_args.export_format);
+		if(format < 0)
+			return -1;
+
+		// S(Q, E) grid
+		if(cli_args.export_file != "")
+		{
+			if(!export_sqe(dyn, cfg, cli_args.export_file, format, pool,
+				nullptr, cli_args.export_resume))
+			{
+				std::cerr << "Error: Could not export S(Q, E) to \""
+					<< cli_args.export_file << "\"." << std::endl;
+				return -1;
+			}
+		}
+
+		// parameter sweep along the dispersion path
+		if(cli_args.sweep_file != "")
+		{
+			std::vector<SweepParameter> params = load_sweep_parameters(cfg_file, dyn);
+
+			SweepResults results;
+			if(!calc_sweep(dyn, cfg, params, results, pool))
+			{
+				std::cerr << "Error: Parameter sweep failed." << std::endl;
+				return -1;
+			}
+
+			if(!save_sweep(cli_args.sweep_file, results, format))
+			{
+				std::cerr << "Error: Could not write sweep to \""
+					<< cli_args.sweep_file << "\"." << std::endl;
+				return -1;
+			}
+		}
+
+		// powder average
+		if(cli_args.powder_file != "")
+		{
+			PowderResults results;
+			if(!calc_powder(dyn, cfg, results, pool))
+			{
+				std::cerr << "Error: Powder average calculation failed." << std::endl;
+				return -1;
+			}
+
+			if(!save_powder(cli_args.powder_file, results, format))
+			{
+				std::cerr << "Error: Could not write powder average to \""
+					<< cli_args.powder_file << "\"." << std::endl;
+				return -1;
+			}
+		}
+
+		// S(Q, E) slice
+		if(cli_args.slice_file != "")
+		{
+			SliceResults results;
+			if(!calc_slice(dyn, cfg, results, pool))
+			{
+				std::cerr << "Error: Slice calculation failed." << std::endl;
+				return -1;
+			}
+
+			if(!save_slice(cli_args.slice_file, results, format))
+			{
+				std::cerr << "Error: Could not write slice to \""
+					<< cli_args.slice_file << "\"." << std::endl;
+				return -1;
+			}
+		}
+
+		// density of states and thermodynamics
+		if(cli_args.dos_file != "")
+		{
+			DosMeshes meshes;
+			DosResults results;
+			if(!calc_dos_meshes(dyn, cfg, meshes, pool) ||
+				!calc_dos(meshes, cfg, results, pool))
+			{
+				std::cerr << "Error: Density of states calculation failed." << std::endl;
+				return -1;
+			}
+
+			if(results.has_convergence)
+			{
+				std::cout << "Relative change compared to the "
+					<< results.coarse_dims[0] << "x" << results.coarse_dims[1] << "x"
+					<< results.coarse_dims[2] << " mesh: mean energy: " << results.conv_mean_E
+					<< ", specific heat: " << results.conv_heat << "." << std::endl;
+			}
+
+			if(!save_dos(cli_args.dos_file, results))
+			{
+				std::cerr << "Error: Could not write density of states to \""
+					<< cli_args.dos_file << "\"." << std::endl;
+				return -1;
+			}
+		}
+
+		// timings of the calculation stages
+		if(cli_args.profile_file != "")
+		{
+			std::cout << get_profile_summary() << std::flush;
+
+			if(!save_profile_trace(cli_args.profile_file))
+			{
+				std::cerr << "Error: Could not write profile trace to \""
+					<< cli_args.profile_file << "\"." << std::endl;
+				return -1;
+			}
+		}
+
+		return 0;
+	}
+	catch(const std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+		return -1;
+	}
+}
+
+
+/**
+ * starts the gui program
+ */
+static int gui_main(int argc, char** argv)
+{
+	tl2::set_gl_format(1, _GL_MAJ_VER, _GL_MIN_VER, 8);
+
+	QApplication::addLibraryPath(QString(".") + QDir::separator() + "qtplugins");
+	auto app = std::make_unique<QApplication>(argc, argv);
+	auto dlg = std::make_unique<MagDynDlg>(nullptr);
+	dlg->show();
+
+	return app->exec();
+}
+
+
+/**
+ * starts the cli or the gui program
+ */
 int main(int argc, char** argv)
 {
 	try
 	{
-		tl2::set_gl_format(1, _GL_MAJ_VER, _GL_MIN_VER, 8);
 		tl2::set_locales();
 
-		QApplication::addLibraryPath(QString(".") + QDir::separator() + "qtplugins");
-		auto app = std::make_unique<QApplication>(argc, argv);
-		auto dlg = std::make_unique<MagDynDlg>(nullptr);
-		dlg->show();
+		bool show_help = false;
+		bool use_cli = false;
+		std::string cfg_file;
+		CliArgs cli_args;
+
+		args::options_description arg_descr("Takin/Magdyn arguments");
+		arg_descr.add_options()
+			("help,h", args::bool_switch(&show_help), "show help")
+			("cli,c", args::bool_switch(&use_cli), "use command-line interface")
+			("input,i", args::value(&cfg_file), "input magnetic structure file")
+			("dispersion,d", args::value(&cli_args.dispersion_file), "output file for the dispersion")
+			("export,e", args::value(&cli_args.export_file), "output file for the S(Q, E) grid")
+			("sweep,s", args::value(&cli_args.sweep_file), "output file for the sweep over the file's sweep parameters")
+			("powder,p", args::value(&cli_args.powder_file), "output file for the powder-averaged S(|Q|, E)")
+			("slice", args::value(&cli_args.slice_file), "output file for the resolution-convolved S(Q, E) slice")
+			("dos", args::value(&cli_args.dos_file), "output file for the magnon density of states and thermodynamics")
+			("fit", args::value(&cli_args.fit_file), "measured dispersion points (h k l E [sigma]) to fit the variables to")
+			("fit_vars", args::value(&cli_args.fit_vars)->multitoken(), "names of the variables to fit (default: all)")
+			("fit_step", args::value(&cli_args.fit_rel_step), "relative step of the numerical derivatives in the fit")
+			("format,f", args::value(&cli_args.export_format), "export format: hdf5, grid, or text (slices: hdf5 or text)")
+			("compression", args::value(&cli_args.export_compression), "hdf5 deflate compression level (0-9)")
+			("threads,t", args::value(&cli_args.num_threads), "number of calculation threads (default: all cores)")
+			("pin", args::bool_switch(&cli_args.pin_threads), "pin calculation threads to cores")
+			("Q_start", args::value(&cli_args.Q_start)->multitoken(), "dispersion start Q: h k l")
+			("Q_end", args::value(&cli_args.Q_end)->multitoken(), "dispersion end Q: h k l")
+			("Q_points", args::value(&cli_args.num_Q_points), "number of dispersion Q points")
+			("path", args::bool_switch(&cli_args.Q_path), "calculate the dispersion along all saved coordinates")
+			("adaptive", args::bool_switch(&cli_args.adaptive_Q), "adaptively refine the dispersion Q points, Q_points is then the maximum")
+			("E_tol", args::value(&cli_args.adaptive_E_tol), "energy tolerance for the adaptive refinement")
+			("export_start", args::value(&cli_args.export_start)->multitoken(), "grid start Q: h k l")
+			("export_end", args::value(&cli_args.export_end)->multitoken(), "grid end Q: h k l")
+			("export_points", args::value(&cli_args.export_num_points)->multitoken(), "number of grid points: n_h n_k n_l")
+			("checkpoint", args::value(&cli_args.export_checkpoint_interval), "write a checkpoint of the grid export every given number of seconds")
+			("resume", args::bool_switch(&cli_args.export_resume), "resume an interrupted grid export from its checkpoint")
+			("shard", args::value(&cli_args.export_shard), "index of the h range to export, from 0 to shards-1")
+			("shards", args::value(&cli_args.export_num_shards), "number of h ranges to split the grid export into")
+			("merge", args::value(&cli_args.merge_files)->multitoken(), "shard files to merge into the export file")
+			("profile", args::value(&cli_args.profile_file), "output file for the chrome trace of the calculation stages");
+
+		args::positional_options_description posarg_descr;
+		posarg_descr.add("input", 1);
+
+		auto argparser = args::command_line_parser{argc, argv};
+		argparser.options(arg_descr);
+		argparser.positional(posarg_descr);
+		argparser.allow_unregistered();
+		auto parsedArgs = argparser.run();
+
+		args::variables_map mapArgs;
+		args::store(parsedArgs, mapArgs);
+		args::notify(mapArgs);
+
+		if(show_help)
+		{
+			std::cout << arg_descr << std::endl;
+			return 0;
+		}
 
-		return app->exec();
+		// either start the cli or the gui program
+		if(use_cli)
+			return cli_main(cfg_file, cli_args);
+		return gui_main(argc, argv);
 	}
 	catch(const std::exception& ex)
 	{
@@ -0,0 +1,217 @@
+/**
+ * magnetic dynamics -- neighbour shell search for coupling terms
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "neighbours.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+
+
+std::vector<NeighbourCoupling> find_couplings_by_distance(
+	const std::vector<t_vec_real>& sites,
+	const t_real lattice[3], const t_real angles[3],
+	const std::vector<t_real>& shells, t_real tolerance)
+{
+	std::vector<NeighbourCoupling> couplings;
+	if(!sites.size() || !shells.size())
+		return couplings;
+
+	for(t_real shell : shells)
+	{
+		if(shell <= 0.)
+			throw std::runtime_error("Invalid shell distance.");
+	}
+
+	for(int i=0; i<3; ++i)
+	{
+		if(lattice[i] <= 0.)
+			throw std::runtime_error("Invalid lattice constants.");
+	}
+
+	// lattice angles
+	const t_real deg2rad = tl2::pi<t_real> / t_real(180);
+	t_real cos_angles[3], sin_angles[3];
+	for(int i=0; i<3; ++i)
+	{
+		cos_angles[i] = std::cos(angles[i] * deg2rad);
+		sin_angles[i] = std::sin(angles[i] * deg2rad);
+	}
+
+	t_real vol_fac = t_real(1)
+		- cos_angles[0]*cos_angles[0]
+		- cos_angles[1]*cos_angles[1]
+		- cos_angles[2]*cos_angles[2]
+		+ t_real(2)*cos_angles[0]*cos_angles[1]*cos_angles[2];
+	if(vol_fac <= g_eps || sin_angles[2] <= g_eps)
+		throw std::runtime_error("Invalid lattice angles.");
+	vol_fac = std::sqrt(vol_fac);
+
+	// fractional to cartesian coordinates, lattice vectors as columns
+	const t_real A[3][3] =
+	{
+		{ lattice[0], lattice[1]*cos_angles[2], lattice[2]*cos_angles[1] },
+		{ 0., lattice[1]*sin_angles[2],
+			lattice[2]*(cos_angles[0] - cos_angles[1]*cos_angles[2]) / sin_angles[2] },
+		{ 0., 0., lattice[2]*vol_fac / sin_angles[2] },
+	};
+
+	// distances between opposite faces of the unit cell
+	t_real thickness[3];
+	for(int i=0; i<3; ++i)
+		thickness[i] = lattice[i] * vol_fac / sin_angles[i];
+
+	const t_real r_cut = *std::max_element(shells.begin(), shells.end()) + tolerance;
+
+	// number of bins per axis, each bin should be at least r_cut thick,
+	// but don't use many more bins than there are sites
+	const int max_bins = 2 * int(std::ceil(std::cbrt(t_real(sites.size()))));
+	int num_bins[3], reach[3];
+	for(int i=0; i<3; ++i)
+	{
+		num_bins[i] = std::clamp(int(thickness[i] / r_cut), 1, max_bins);
+
+		// number of neighbouring bins to search
+		reach[i] = int(std::ceil(r_cut * t_real(num_bins[i]) / thickness[i]));
+	}
+
+	// sort the sites into the cell list
+	const t_size num_sites = sites.size();
+	std::vector<t_real> frac(num_sites * 3);  // wrapped fractional positions
+	std::vector<int> cell(num_sites * 3);     // unit cell of the original positions
+	std::vector<std::vector<t_size>> bins(t_size(num_bins[0]) * num_bins[1] * num_bins[2]);
+
+	auto bin_index = [&num_bins](const int *bin) -> t_size
+	{
+		return (t_size(bin[0])*num_bins[1] + bin[1])*num_bins[2] + bin[2];
+	};
+
+	std::vector<int> site_bins(num_sites * 3);
+	for(t_size site_idx=0; site_idx<num_sites; ++site_idx)
+	{
+		for(int i=0; i<3; ++i)
+		{
+			t_real pos = sites[site_idx][i];
+			t_real cell_pos = std::floor(pos);
+
+			frac[site_idx*3 + i] = pos - cell_pos;
+			cell[site_idx*3 + i] = int(cell_pos);
+			site_bins[site_idx*3 + i] = std::min(
+				int(frac[site_idx*3 + i] * t_real(num_bins[i])), num_bins[i] - 1);
+		}
+
+		bins[bin_index(&site_bins[site_idx*3])].push_back(site_idx);
+	}
+
+	// search the neighbouring bins of each site
+	const int sc_zero[3] = { 0, 0, 0 };
+	for(t_size site1=0; site1<num_sites; ++site1)
+	{
+		const int *bin1 = &site_bins[site1*3];
+
+		for(int d0=-reach[0]; d0<=reach[0]; ++d0)
+		for(int d1=-reach[1]; d1<=reach[1]; ++d1)
+		for(int d2=-reach[2]; d2<=reach[2]; ++d2)
+		{
+			// neighbouring bin and its unit cell
+			const int d[3] = { d0, d1, d2 };
+			int bin2[3], sc[3];
+			for(int i=0; i<3; ++i)
+			{
+				int bin = bin1[i] + d[i];
+				sc[i] = bin >= 0 ? bin / num_bins[i] : -((-bin - 1) / num_bins[i]) - 1;
+				bin2[i] = bin - sc[i]*num_bins[i];
+			}
+
+			for(t_size site2 : bins[bin_index(bin2)])
+			{
+				// supercell vector between the original positions
+				int sc_orig[3];
+				for(int i=0; i<3; ++i)
+					sc_orig[i] = sc[i] - cell[site2*3 + i] + cell[site1*3 + i];
+
+				// only keep one direction of each bond
+				if(site1 > site2)
+					continue;
+				if(site1 == site2 && std::lexicographical_compare(
+					sc_orig, sc_orig + 3, sc_zero, sc_zero + 3))
+					continue;
+
+				// cartesian distance
+				t_real diff_frac[3];
+				for(int i=0; i<3; ++i)
+					diff_frac[i] = frac[site2*3 + i] + t_real(sc[i]) - frac[site1*3 + i];
+
+				t_real dist_sq = 0.;
+				for(int i=0; i<3; ++i)
+				{
+					t_real diff = A[i][0]*diff_frac[0] + A[i][1]*diff_frac[1] + A[i][2]*diff_frac[2];
+					dist_sq += diff*diff;
+				}
+
+				if(dist_sq > r_cut*r_cut)
+					continue;
+				t_real dist = std::sqrt(dist_sq);
+				if(dist <= g_eps)
+					continue;
+
+				// find the matching shell
+				for(t_size shell_idx=0; shell_idx<shells.size(); ++shell_idx)
+				{
+					if(std::abs(dist - shells[shell_idx]) > tolerance)
+						continue;
+
+					NeighbourCoupling coupling;
+					coupling.atom1 = site1;
+					coupling.atom2 = site2;
+					coupling.dist = dist;
+					coupling.shell = shell_idx;
+					for(int i=0; i<3; ++i)
+						coupling.sc[i] = sc_orig[i];
+
+					couplings.emplace_back(std::move(coupling));
+					break;
+				}
+			}
+		}
+	}
+
+	// order by shell, then by atoms
+	std::stable_sort(couplings.begin(), couplings.end(),
+		[](const NeighbourCoupling& coupling1, const NeighbourCoupling& coupling2)
+	{
+		if(coupling1.shell != coupling2.shell)
+			return coupling1.shell < coupling2.shell;
+		if(coupling1.atom1 != coupling2.atom1)
+			return coupling1.atom1 < coupling2.atom1;
+		return coupling1.atom2 < coupling2.atom2;
+	});
+
+	return couplings;
+}
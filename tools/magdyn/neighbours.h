@@ -0,0 +1,69 @@
+/**
+ * magnetic dynamics -- neighbour shell search for coupling terms
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __MAGDYN_NEIGHBOURS_H__
+#define __MAGDYN_NEIGHBOURS_H__
+
+#include <vector>
+
+#include "defs.h"
+
+
+
+/**
+ * a coupling between two atom sites found by the neighbour search
+ */
+struct NeighbourCoupling
+{
+	t_size atom1{}, atom2{};  // unit cell atom indices
+	int sc[3]{ 0, 0, 0 };     // supercell vector of the second atom
+	t_real dist{};            // distance between the atoms
+	t_size shell{};           // index of the distance shell
+};
+
+
+
+/**
+ * find all pairs of atom sites whose distances match one of the given shells
+ *
+ * sites:     fractional atom positions in the unit cell
+ * lattice:   lattice constants a, b, c
+ * angles:    lattice angles alpha, beta, gamma in degrees
+ * shells:    distances of the neighbour shells
+ * tolerance: maximum deviation of a pair's distance from its shell
+ *
+ * each bond is only returned once, the atoms are sorted into a cell list,
+ * so that the run time scales linearly with the number of sites
+ */
+extern std::vector<NeighbourCoupling> find_couplings_by_distance(
+	const std::vector<t_vec_real>& sites,
+	const t_real lattice[3], const t_real angles[3],
+	const std::vector<t_real>& shells, t_real tolerance);
+
+
+#endif
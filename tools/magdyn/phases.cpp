@@ -0,0 +1,454 @@
+/**
+ * magnetic dynamics -- hamiltonian assembly from cached phase factors
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "phases.h"
+
+#include <set>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <random>
+#include <atomic>
+
+using namespace tl2_ops;
+
+
+// minimum number of random Q points at which the sampled hamiltonian is verified
+#define PHASES_MIN_CHECKS 32
+
+
+
+/**
+ * collect the distinct cell distances of the exchange terms,
+ * the q-independent part is the component with zero distance
+ */
+bool HamiltonianPhases::Init(const t_magdyn& dyn, t_size max_samples)
+{
+	m_dists.clear();
+	m_components.clear();
+	m_num_samples = { 1, 1, 1 };
+	m_dim = 0;
+	m_incommensurate = false;
+
+	if(dyn.GetAtomSites().size() == 0 || dyn.GetExchangeTerms().size() == 0)
+		return false;
+
+	// the hamiltonian is hermitian, so it also contains the inverse distances
+	std::set<std::array<long, 3>> dists{ { 0, 0, 0 } };
+	std::array<long, 3> max_dist{ 0, 0, 0 };
+
+	for(const t_magdyn::ExchangeTerm& term : dyn.GetExchangeTerms())
+	{
+		std::array<long, 3> dist{};
+		for(int i=0; i<3; ++i)
+		{
+			dist[i] = std::lround(term.dist[i]);
+
+			// phases of fractional distances are not periodic on the sampling grid
+			if(std::abs(term.dist[i] - t_real(dist[i])) > g_eps)
+				return false;
+
+			max_dist[i] = std::max(max_dist[i], std::abs(dist[i]));
+		}
+
+		dists.insert(dist);
+		dists.insert({ -dist[0], -dist[1], -dist[2] });
+	}
+
+	// 2*max + 1 grid points per direction separate all distances
+	t_size num_samples = 1;
+	for(int i=0; i<3; ++i)
+	{
+		m_num_samples[i] = t_size(2*max_dist[i] + 1);
+		num_samples *= m_num_samples[i];
+	}
+
+	if(num_samples > max_samples)
+		return false;
+
+	m_dists.reserve(dists.size());
+	for(const std::array<long, 3>& dist : dists)
+		m_dists.emplace_back(tl2::create<t_vec_real>({ t_real(dist[0]), t_real(dist[1]), t_real(dist[2]) }));
+
+	return true;
+}
+
+
+
+/**
+ * number of Q points needed to sample the fourier components
+ */
+t_size HamiltonianPhases::GetNumSamples() const
+{
+	return m_num_samples[0] * m_num_samples[1] * m_num_samples[2];
+}
+
+
+
+/**
+ * sample the hamiltonian on the Q grid and get its fourier components,
+ * H_d = 1/N sum_Q H(Q) exp(-i 2pi Q*d)
+ */
+bool HamiltonianPhases::Calculate(const t_magdyn& dyn, CalcThreadPool& pool,
+	const CalcThreadPool::t_progress& progress)
+{
+	const t_size num_samples = GetNumSamples();
+	const t_size num_dists = m_dists.size();
+	if(num_dists == 0)
+		return false;
+
+	// Q position of a sampling point, the last index runs fastest
+	auto get_Q = [this](t_size idx) -> t_vec_real
+	{
+		const t_size idx_l = idx % m_num_samples[2];
+		const t_size idx_k = (idx / m_num_samples[2]) % m_num_samples[1];
+		const t_size idx_h = idx / (m_num_samples[2] * m_num_samples[1]);
+
+		return tl2::create<t_vec_real>(
+		{
+			t_real(idx_h) / t_real(m_num_samples[0]),
+			t_real(idx_k) / t_real(m_num_samples[1]),
+			t_real(idx_l) / t_real(m_num_samples[2]),
+		});
+	};
+
+	// the hamiltonians are calculated in parallel batches and summed up in
+	// a fixed order, so that the components are reproducible
+	std::vector<t_mat> sums(num_dists);
+	std::vector<t_mat> batch(std::max(pool.GetNumThreads(), 1u) * 4);
+
+	for(t_size batch_start=0; batch_start<num_samples; batch_start+=batch.size())
+	{
+		const t_size batch_size = std::min<t_size>(batch.size(), num_samples - batch_start);
+
+		if(!pool.ParallelFor(batch_size, [&dyn, &batch, &get_Q, batch_start](t_size idx)
+		{
+			batch[idx] = dyn.GetHamiltonian(get_Q(batch_start + idx));
+		}, [&progress, batch_start, num_samples](t_size done, t_size) -> bool
+		{
+			return !progress || progress(batch_start + done, num_samples);
+		}))
+			return false;
+
+		if(m_dim == 0)
+		{
+			m_dim = batch[0].size1();
+			if(m_dim == 0)
+				return false;
+
+			for(t_mat& sum : sums)
+				sum = tl2::zero<t_mat>(m_dim, m_dim);
+		}
+
+		for(t_size idx=0; idx<batch_size; ++idx)
+		{
+			if(batch[idx].size1() != m_dim || batch[idx].size2() != m_dim)
+				return false;
+		}
+
+		pool.ParallelFor(num_dists, [this, &sums, &batch, &get_Q, batch_start, batch_size](t_size dist_idx)
+		{
+			t_mat& sum = sums[dist_idx];
+
+			for(t_size idx=0; idx<batch_size; ++idx)
+			{
+				const t_mat& H = batch[idx];
+				const t_cplx phase = std::polar(t_real(1), -t_real(2)*tl2::pi<t_real>
+					* tl2::inner<t_vec_real>(get_Q(batch_start + idx), m_dists[dist_idx]));
+
+				for(t_size row=0; row<m_dim; ++row)
+					for(t_size col=0; col<m_dim; ++col)
+						sum(row, col) += H(row, col) * phase;
+			}
+		});
+	}
+
+	// normalisation
+	t_real max_elem = 0.;
+	for(t_mat& sum : sums)
+	{
+		for(t_size row=0; row<m_dim; ++row)
+		{
+			for(t_size col=0; col<m_dim; ++col)
+			{
+				sum(row, col) /= t_real(num_samples);
+				max_elem = std::max(max_elem, std::abs(sum(row, col)));
+			}
+		}
+	}
+
+	// only keep the non-zero elements and components
+	const t_real eps_elem = max_elem * t_real(num_samples) * std::numeric_limits<t_real>::epsilon();
+	std::vector<t_vec_real> dists;
+
+	for(t_size dist_idx=0; dist_idx<num_dists; ++dist_idx)
+	{
+		std::vector<Element> elems;
+		for(t_size row=0; row<m_dim; ++row)
+		{
+			for(t_size col=0; col<m_dim; ++col)
+			{
+				const t_cplx& val = sums[dist_idx](row, col);
+				if(std::abs(val) > eps_elem)
+					elems.emplace_back(Element{ row, col, val });
+			}
+		}
+
+		if(elems.size() == 0)
+			continue;
+
+		dists.emplace_back(std::move(m_dists[dist_idx]));
+		m_components.emplace_back(std::move(elems));
+	}
+
+	m_dists = std::move(dists);
+
+	// the sampling is only exact if the hamiltonian has no other Q dependence,
+	// compare with the full hamiltonian at reproducible random points between the grid points
+	const t_size num_checks = std::max<t_size>(PHASES_MIN_CHECKS, 2*m_dists.size());
+	std::vector<t_vec_real> Qs_check;
+	Qs_check.reserve(num_checks);
+
+	std::mt19937 rng{ 0x6d616764u };
+	std::uniform_real_distribution<t_real> dist_Q{ -2., 2. };
+	for(t_size idx=0; idx<num_checks; ++idx)
+		Qs_check.emplace_back(tl2::create<t_vec_real>({ dist_Q(rng), dist_Q(rng), dist_Q(rng) }));
+
+	const t_real eps_check = g_eps * std::max(max_elem, t_real(1));
+	std::atomic<bool> matches_all{ true };
+
+	bool checked = pool.ParallelFor(num_checks, [this, &dyn, &Qs_check, &matches_all, eps_check](t_size idx)
+	{
+		if(!matches_all)
+			return;
+
+		const t_mat H_full = dyn.GetHamiltonian(Qs_check[idx]);
+		const t_mat H = GetHamiltonian(Qs_check[idx]);
+
+		bool matches = H_full.size1() == m_dim && H_full.size2() == m_dim;
+		for(t_size row=0; row<m_dim && matches; ++row)
+			for(t_size col=0; col<m_dim && matches; ++col)
+				matches = std::abs(H(row, col) - H_full(row, col)) <= eps_check;
+
+		if(!matches)
+			matches_all = false;
+	}, [&progress, num_samples](t_size, t_size) -> bool
+	{
+		return !progress || progress(num_samples, num_samples);
+	});
+
+	if(!checked || !matches_all)
+	{
+		m_dists.clear();
+		m_components.clear();
+		return false;
+	}
+
+	return true;
+}
+
+
+
+/**
+ * phase factors exp(i 2pi Q*d) of all components
+ */
+void HamiltonianPhases::GetPhases(const t_vec_real& Q, t_cplx *phases) const
+{
+	for(t_size dist_idx=0; dist_idx<m_dists.size(); ++dist_idx)
+	{
+		phases[dist_idx] = std::polar(t_real(1), t_real(2)*tl2::pi<t_real>
+			* tl2::inner<t_vec_real>(Q, m_dists[dist_idx]));
+	}
+}
+
+
+
+void HamiltonianPhases::GetPhases(const t_vec_real& Q, std::vector<t_cplx>& phases) const
+{
+	phases.resize(m_dists.size());
+	GetPhases(Q, phases.data());
+}
+
+
+
+/**
+ * sum up the fourier components with the given phase factors
+ */
+t_mat HamiltonianPhases::GetHamiltonian(const std::vector<t_cplx>& phases) const
+{
+	t_mat H = tl2::zero<t_mat>(m_dim, m_dim);
+
+	for(t_size dist_idx=0; dist_idx<m_components.size(); ++dist_idx)
+	{
+		const t_cplx phase = phases[dist_idx];
+		for(const Element& elem : m_components[dist_idx])
+			H(elem.row, elem.col) += elem.val * phase;
+	}
+
+	return H;
+}
+
+
+
+t_mat HamiltonianPhases::GetHamiltonian(const t_vec_real& Q) const
+{
+	std::vector<t_cplx> phases;
+	GetPhases(Q, phases);
+	return GetHamiltonian(phases);
+}
+
+
+
+/**
+ * set the ordering wave vector and the rotations of the correlation functions,
+ * see equations (39) and (40) in (Toth 2015),
+ * phase_sign is the calculator's sign convention, see MagDyn::GetPhaseSign
+ */
+void HamiltonianPhases::SetIncommensurate(const t_vec_real& ordering,
+	const t_vec_real& rot_axis, t_real phase_sign)
+{
+	m_incommensurate = true;
+	m_ordering = ordering;
+	GetPhases(m_ordering, m_phases_ordering);
+
+	const t_real len = tl2::norm<t_vec_real>(rot_axis);
+	t_real n[3] = { 0., 0., 1. };
+	if(len > g_eps)
+	{
+		for(int i=0; i<3; ++i)
+			n[i] = rot_axis[i] / len;
+	}
+
+	const t_real skew[3][3] =
+	{
+		{    0., -n[2],  n[1] },
+		{  n[2],    0., -n[0] },
+		{ -n[1],  n[0],    0. },
+	};
+
+	for(t_mat& rot : m_rot_incomm)
+		rot = tl2::zero<t_mat>(3, 3);
+
+	for(int i=0; i<3; ++i)
+	{
+		for(int j=0; j<3; ++j)
+		{
+			// projector onto the rotation axis
+			const t_real proj = n[i] * n[j];
+			m_rot_incomm[0](i, j) = proj;
+
+			// (1 - i*sign*[n]_x - n n^T) / 2 and its complex conjugate
+			const t_cplx rot = t_real(0.5) * t_cplx((i == j ? 1. : 0.) - proj, -phase_sign*skew[i][j]);
+			m_rot_incomm[1](i, j) = rot;
+			m_rot_incomm[2](i, j) = std::conj(rot);
+		}
+	}
+}
+
+
+
+/**
+ * sum up the fourier components for Q, Q + O, and Q - O,
+ * the shifted phase factors are exp(i 2pi Q*d) * exp(+-i 2pi O*d)
+ */
+void HamiltonianPhases::GetHamiltonians(const std::vector<t_cplx>& phases, t_mat *H) const
+{
+	for(int i=0; i<3; ++i)
+		H[i] = tl2::zero<t_mat>(m_dim, m_dim);
+
+	for(t_size dist_idx=0; dist_idx<m_components.size(); ++dist_idx)
+	{
+		const t_cplx phase = phases[dist_idx];
+		const t_cplx phase_p = phase * m_phases_ordering[dist_idx];
+		const t_cplx phase_m = phase * std::conj(m_phases_ordering[dist_idx]);
+
+		for(const Element& elem : m_components[dist_idx])
+		{
+			H[0](elem.row, elem.col) += elem.val * phase;
+			H[1](elem.row, elem.col) += elem.val * phase_p;
+			H[2](elem.row, elem.col) += elem.val * phase_m;
+		}
+	}
+}
+
+
+
+HamiltonianLine::HamiltonianLine(const HamiltonianPhases& phases,
+	const t_vec_real& Q_start, const t_vec_real& Q_step, t_size refresh)
+	: m_phases{phases}, m_Q_start{Q_start}, m_Q_step{Q_step}, m_refresh{refresh}
+{
+	m_phases.GetPhases(m_Q_step, m_phase_inc);
+	m_phase.resize(m_phase_inc.size());
+}
+
+
+
+/**
+ * phase factors at Q_0 + idx*dQ
+ */
+void HamiltonianLine::UpdatePhases(t_size idx)
+{
+	if(m_valid && idx == m_idx + 1 && m_steps < m_refresh)
+	{
+		// next point on the line
+		for(t_size dist_idx=0; dist_idx<m_phase.size(); ++dist_idx)
+			m_phase[dist_idx] *= m_phase_inc[dist_idx];
+		++m_steps;
+	}
+	else
+	{
+		// direct calculation of the phases
+		m_phases.GetPhases(m_Q_start + m_Q_step*t_real(idx), m_phase);
+		m_steps = 0;
+		m_valid = true;
+	}
+
+	m_idx = idx;
+}
+
+
+
+/**
+ * hamiltonian at Q_0 + idx*dQ
+ */
+t_mat HamiltonianLine::GetHamiltonian(t_size idx)
+{
+	UpdatePhases(idx);
+	return m_phases.GetHamiltonian(m_phase);
+}
+
+
+
+/**
+ * hamiltonians at Q_0 + idx*dQ and Q_0 + idx*dQ +- O
+ */
+void HamiltonianLine::GetHamiltonians(t_size idx, t_mat *H)
+{
+	UpdatePhases(idx);
+	m_phases.GetHamiltonians(m_phase, H);
+}
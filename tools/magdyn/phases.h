@@ -0,0 +1,155 @@
+/**
+ * magnetic dynamics -- hamiltonian assembly from cached phase factors
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __MAGDYN_PHASES_H__
+#define __MAGDYN_PHASES_H__
+
+#include <vector>
+#include <array>
+
+#include "defs.h"
+#include "pool.h"
+
+
+
+/**
+ * fourier components of the hamiltonian with respect to the cell distances d
+ * of the exchange terms: H(Q) = sum_d H_d exp(i 2pi Q*d)
+ *
+ * the components are sampled once from the full hamiltonian on a grid of
+ * Q points, afterwards the hamiltonian only needs the phase factors of the
+ * distinct distances instead of a loop over all exchange terms
+ *
+ * for incommensurate structures, the hamiltonians at Q, Q + O, and Q - O
+ * are assembled together, their phase factors only differ by exp(+-i 2pi O*d)
+ */
+class HamiltonianPhases
+{
+public:
+	HamiltonianPhases() = default;
+	~HamiltonianPhases() = default;
+
+	// collect the distances, false if the model's phases are not supported
+	bool Init(const t_magdyn& dyn, t_size max_samples = 4096);
+
+	// sample and verify the fourier components, false if they are invalid or the progress callback stopped the sampling
+	bool Calculate(const t_magdyn& dyn, CalcThreadPool& pool,
+		const CalcThreadPool::t_progress& progress = nullptr);
+
+	// number of hamiltonians needed for the sampling
+	t_size GetNumSamples() const;
+	t_size GetNumComponents() const { return m_dists.size(); }
+
+	// phase factors of the components at Q
+	void GetPhases(const t_vec_real& Q, std::vector<t_cplx>& phases) const;
+	void GetPhases(const t_vec_real& Q, t_cplx *phases) const;
+
+	// hamiltonian from the phase factors of the components
+	t_mat GetHamiltonian(const std::vector<t_cplx>& phases) const;
+	t_mat GetHamiltonian(const t_vec_real& Q) const;
+
+	// ordering wave vector O and rotation axis of an incommensurate structure,
+	// has to be called after the components have been calculated
+	void SetIncommensurate(const t_vec_real& ordering, const t_vec_real& rot_axis, t_real phase_sign);
+	bool IsIncommensurate() const { return m_incommensurate; }
+	const t_vec_real& GetOrdering() const { return m_ordering; }
+
+	// rotations of the correlation functions at Q, Q + O, and Q - O
+	const t_mat& GetIncommensurateRotation(int idx) const { return m_rot_incomm[idx]; }
+
+	// hamiltonians at Q, Q + O, and Q - O in one pass over the components
+	void GetHamiltonians(const std::vector<t_cplx>& phases, t_mat *H) const;
+
+
+protected:
+	/**
+	 * non-zero element of a fourier component
+	 */
+	struct Element
+	{
+		t_size row{}, col{};
+		t_cplx val{};
+	};
+
+
+private:
+	std::vector<t_vec_real> m_dists{};                // distinct cell distances
+	std::vector<std::vector<Element>> m_components{}; // non-zero elements per distance
+	std::array<t_size, 3> m_num_samples{};            // sampling grid
+	t_size m_dim{};                                   // hamiltonian size
+
+	// incommensurate structures
+	bool m_incommensurate{ false };
+	t_vec_real m_ordering{};                          // ordering wave vector O
+	std::vector<t_cplx> m_phases_ordering{};          // exp(i 2pi O*d)
+	t_mat m_rot_incomm[3]{};                          // rotations at Q, Q + O, and Q - O
+};
+
+
+
+/**
+ * evaluation of the hamiltonian along a line Q_0 + idx*dQ,
+ * for consecutive indices the phase factors follow the recurrence
+ * exp(i 2pi Q_{idx+1}*d) = exp(i 2pi Q_idx*d) * exp(i 2pi dQ*d),
+ * they are recalculated directly after a number of steps to bound the rounding drift
+ */
+class HamiltonianLine
+{
+public:
+	HamiltonianLine(const HamiltonianPhases& phases,
+		const t_vec_real& Q_start, const t_vec_real& Q_step,
+		t_size refresh = 32);
+	~HamiltonianLine() = default;
+
+	// hamiltonian at the given index, fastest if the indices are consecutive
+	t_mat GetHamiltonian(t_size idx);
+
+	// hamiltonians at the given index and shifted by +- O
+	void GetHamiltonians(t_size idx, t_mat *H);
+
+	const HamiltonianPhases& GetPhases() const { return m_phases; }
+
+
+protected:
+	void UpdatePhases(t_size idx);
+
+
+private:
+	const HamiltonianPhases& m_phases;
+	t_vec_real m_Q_start{}, m_Q_step{};
+	t_size m_refresh{};
+
+	std::vector<t_cplx> m_phase{};      // phase factors at the current index
+	std::vector<t_cplx> m_phase_inc{};  // phase factors of one step
+	t_size m_idx{};                     // current index
+	t_size m_steps{};                   // recurrence steps since the last refresh
+	bool m_valid{ false };              // phase factors have been calculated
+};
+
+
+#endif
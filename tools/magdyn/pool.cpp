@@ -0,0 +1,368 @@
+/**
+ * magnetic dynamics -- persistent thread pool for the calculations
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "pool.h"
+
+#include <algorithm>
+#include <chrono>
+
+#if defined(__linux__)
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+
+
+CalcThreadPool::CalcThreadPool(unsigned int num_threads, bool pin_threads)
+{
+	Start(num_threads, pin_threads);
+}
+
+
+
+CalcThreadPool::~CalcThreadPool()
+{
+	Stop();
+}
+
+
+
+/**
+ * default number of threads: all available cores
+ */
+unsigned int CalcThreadPool::GetDefaultNumThreads()
+{
+	return std::max<unsigned int>(1, std::thread::hardware_concurrency());
+}
+
+
+
+/**
+ * number of running threads
+ */
+unsigned int CalcThreadPool::GetNumThreads() const
+{
+	std::lock_guard lock{m_mtx_threads};
+	return m_threads.size();
+}
+
+
+
+/**
+ * (re-)start the pool's threads,
+ * the previous threads are retired without waiting for the queued jobs:
+ * they finish their current chunks and exit, while the new threads
+ * take over the remaining items
+ */
+void CalcThreadPool::Start(unsigned int num_threads, bool pin_threads)
+{
+	std::lock_guard lock_threads{m_mtx_threads};
+
+	if(num_threads == 0)
+		num_threads = GetDefaultNumThreads();
+
+	std::size_t generation = 0;
+	{
+		std::lock_guard lock{m_mtx_jobs};
+		m_quit = false;
+		generation = ++m_generation;
+	}
+	m_cond_jobs.notify_all();
+
+	JoinRetiredThreads(false);
+	for(Worker& worker : m_threads)
+		m_retired.emplace_back(std::move(worker));
+	m_threads.clear();
+
+	m_pin_threads = pin_threads;
+	m_threads.reserve(num_threads);
+
+	for(unsigned int thread_idx=0; thread_idx<num_threads; ++thread_idx)
+	{
+		Worker worker;
+		worker.exited = std::make_shared<std::atomic<bool>>(false);
+		worker.thread = std::thread(&CalcThreadPool::ThreadFunc, this,
+			thread_idx, generation, worker.exited);
+		m_threads.emplace_back(std::move(worker));
+	}
+}
+
+
+
+/**
+ * stop the pool's threads after the running jobs are finished
+ */
+void CalcThreadPool::Stop()
+{
+	std::lock_guard lock_threads{m_mtx_threads};
+	StopThreads();
+}
+
+
+
+/**
+ * stop the threads, m_mtx_threads has to be locked
+ */
+void CalcThreadPool::StopThreads()
+{
+	{
+		std::lock_guard lock{m_mtx_jobs};
+		m_quit = true;
+	}
+	m_cond_jobs.notify_all();
+
+	for(Worker& worker : m_threads)
+	{
+		if(worker.thread.joinable())
+			worker.thread.join();
+	}
+
+	m_threads.clear();
+	JoinRetiredThreads(true);
+}
+
+
+
+/**
+ * join the retired threads, either all of them or only those that have already exited,
+ * m_mtx_threads has to be locked
+ */
+void CalcThreadPool::JoinRetiredThreads(bool all)
+{
+	std::erase_if(m_retired, [all](Worker& worker) -> bool
+	{
+		if(!all && !*worker.exited)
+			return false;
+
+		if(worker.thread.joinable())
+			worker.thread.join();
+		return true;
+	});
+}
+
+
+
+/**
+ * mark items of a job as done and wake up the waiting caller when all are
+ */
+void CalcThreadPool::FinishItems(const std::shared_ptr<Job>& job, t_size num_items)
+{
+	if(num_items == 0)
+		return;
+
+	if(job->done_items.fetch_add(num_items) + num_items == job->num_items)
+	{
+		std::lock_guard lock{job->mtx_done};
+		job->cond_done.notify_all();
+	}
+}
+
+
+
+/**
+ * skip all items of a job that have not yet been fetched,
+ * so that the job finishes as soon as its running chunks are done
+ */
+void CalcThreadPool::CancelJob(const std::shared_ptr<Job>& job)
+{
+	job->stop = true;
+
+	const t_size begin = job->next_item.exchange(job->num_items);
+	if(begin < job->num_items)
+		FinishItems(job, job->num_items - begin);
+
+	RemoveJob(job);
+}
+
+
+
+/**
+ * remove a job from the queue
+ */
+void CalcThreadPool::RemoveJob(const std::shared_ptr<Job>& job)
+{
+	std::lock_guard lock{m_mtx_jobs};
+
+	auto iter = std::find(m_jobs.begin(), m_jobs.end(), job);
+	if(iter != m_jobs.end())
+		m_jobs.erase(iter);
+}
+
+
+
+/**
+ * processes the next chunk of a job
+ * @returns false if the job has no more items
+ */
+bool CalcThreadPool::RunChunk(const std::shared_ptr<Job>& job)
+{
+	const t_size begin = job->next_item.fetch_add(job->chunk_size);
+	if(begin >= job->num_items)
+		return false;
+	const t_size end = std::min(begin + job->chunk_size, job->num_items);
+
+	bool failed = false;
+	for(t_size idx=begin; idx<end; ++idx)
+	{
+		if(job->stop)
+			continue;
+
+		try
+		{
+			job->func(idx);
+		}
+		catch(...)
+		{
+			std::lock_guard lock{job->mtx_done};
+			if(!job->error)
+				job->error = std::current_exception();
+			failed = true;
+		}
+	}
+
+	FinishItems(job, end - begin);
+
+	// skip the remaining items after an error
+	if(failed)
+		CancelJob(job);
+
+	return true;
+}
+
+
+
+/**
+ * thread main function, fetches chunks from the queued jobs in turn
+ */
+void CalcThreadPool::ThreadFunc([[maybe_unused]] unsigned int thread_idx,
+	std::size_t generation, std::shared_ptr<std::atomic<bool>> exited)
+{
+#if defined(__linux__)
+	if(m_pin_threads)
+	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(thread_idx % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	}
+#endif
+
+	while(true)
+	{
+		std::shared_ptr<Job> job;
+
+		{
+			std::unique_lock lock{m_mtx_jobs};
+			m_cond_jobs.wait(lock, [this, generation]()
+			{
+				return m_quit || generation != m_generation || m_jobs.size();
+			});
+
+			// a retired thread leaves the queued jobs to its successors
+			if(m_jobs.size() == 0 || generation != m_generation)
+				break;
+
+			// round-robin over the queued jobs
+			m_next_job %= m_jobs.size();
+			job = m_jobs[m_next_job++];
+		}
+
+		if(!RunChunk(job))
+		{
+			// all items of the job have been fetched
+			RemoveJob(job);
+		}
+	}
+
+	*exited = true;
+}
+
+
+
+/**
+ * call func for all indices in [0, num_items) using the pool's threads
+ * @returns false if the job was stopped by the progress callback
+ */
+bool CalcThreadPool::ParallelFor(t_size num_items, const t_func& func,
+	const t_progress& progress, t_size chunk_size)
+{
+	if(num_items == 0)
+		return true;
+
+	auto job = std::make_shared<Job>();
+	job->func = func;
+	job->num_items = num_items;
+
+	// default chunk size: several chunks per thread to balance the load
+	const unsigned int num_threads = GetNumThreads();
+	if(chunk_size == 0)
+		chunk_size = num_items / (std::max(num_threads, 1u) * 8);
+	job->chunk_size = std::max<t_size>(chunk_size, 1);
+
+	if(num_threads == 0)
+	{
+		// no threads running: process the items in the calling thread
+		while(RunChunk(job))
+		{
+			if(progress && !job->stop && !progress(job->done_items, num_items))
+				CancelJob(job);
+		}
+	}
+	else
+	{
+		{
+			std::lock_guard lock{m_mtx_jobs};
+			m_jobs.push_back(job);
+		}
+		m_cond_jobs.notify_all();
+	}
+
+	// wait for the job to finish, while reporting the progress
+	std::unique_lock lock{job->mtx_done};
+	while(job->done_items < num_items)
+	{
+		lock.unlock();
+		if(progress && !job->stop && !progress(job->done_items, num_items))
+			CancelJob(job);
+		lock.lock();
+
+		job->cond_done.wait_for(lock, std::chrono::milliseconds(100), [&job, num_items]()
+		{
+			return job->done_items >= num_items;
+		});
+	}
+
+	if(job->error)
+		std::rethrow_exception(job->error);
+	if(job->stop)
+		return false;
+
+	if(progress)
+		progress(num_items, num_items);
+	return true;
+}
@@ -0,0 +1,140 @@
+/**
+ * magnetic dynamics -- persistent thread pool for the calculations
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __MAGDYN_POOL_H__
+#define __MAGDYN_POOL_H__
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+#include "defs.h"
+
+
+
+/**
+ * long-lived pool of calculation threads
+ *
+ * jobs are index ranges whose items are fetched in chunks by the
+ * idle threads, so that items with very different computational
+ * costs are balanced dynamically between the threads,
+ * the threads serve all queued jobs in turn, so that a short job
+ * does not have to wait for a long-running one
+ */
+class CalcThreadPool
+{
+public:
+	// function to call for every item index
+	using t_func = std::function<void(t_size idx)>;
+
+	// progress callback, returns false to stop the job
+	using t_progress = std::function<bool(t_size done, t_size total)>;
+
+
+public:
+	CalcThreadPool(unsigned int num_threads = 0, bool pin_threads = false);
+	~CalcThreadPool();
+
+	CalcThreadPool(const CalcThreadPool&) = delete;
+	const CalcThreadPool& operator=(const CalcThreadPool&) = delete;
+
+	void Start(unsigned int num_threads = 0, bool pin_threads = false);
+	void Stop();
+
+	unsigned int GetNumThreads() const;
+	bool GetPinThreads() const { return m_pin_threads; }
+
+	static unsigned int GetDefaultNumThreads();
+
+	// call func for all indices in [0, num_items) and wait for the results,
+	// must not be called from within one of the pool's threads
+	bool ParallelFor(t_size num_items, const t_func& func,
+		const t_progress& progress = nullptr, t_size chunk_size = 0);
+
+
+protected:
+	/**
+	 * an index range to be processed
+	 */
+	struct Job
+	{
+		t_func func{};
+		t_size num_items{}, chunk_size{1};
+
+		std::atomic<t_size> next_item{0};     // next item to be fetched
+		std::atomic<t_size> done_items{0};    // finished (or skipped) items
+		std::atomic<bool> stop{false};        // skip the remaining items
+
+		std::mutex mtx_done{};
+		std::condition_variable cond_done{};
+		std::exception_ptr error{};
+	};
+
+	void ThreadFunc(unsigned int thread_idx, std::size_t generation,
+		std::shared_ptr<std::atomic<bool>> exited);
+	bool RunChunk(const std::shared_ptr<Job>& job);
+
+	void FinishItems(const std::shared_ptr<Job>& job, t_size num_items);
+	void CancelJob(const std::shared_ptr<Job>& job);
+	void RemoveJob(const std::shared_ptr<Job>& job);
+
+	void StopThreads();
+	void JoinRetiredThreads(bool all);
+
+
+private:
+	/**
+	 * a running thread and its exit flag
+	 */
+	struct Worker
+	{
+		std::thread thread{};
+		std::shared_ptr<std::atomic<bool>> exited{};
+	};
+
+	std::vector<Worker> m_threads{};
+	std::vector<Worker> m_retired{};     // threads of a previous start, finishing their chunks
+	bool m_pin_threads{false};
+	mutable std::mutex m_mtx_threads{};  // guards starting and stopping the threads
+
+	std::deque<std::shared_ptr<Job>> m_jobs{};
+	std::size_t m_next_job{0};           // round-robin index into m_jobs
+	std::size_t m_generation{0};         // threads of other generations are retired
+	std::mutex m_mtx_jobs{};
+	std::condition_variable m_cond_jobs{};
+	bool m_quit{false};
+};
+
+
+#endif
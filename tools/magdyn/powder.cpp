@@ -0,0 +1,288 @@
+/**
+ * magnetic dynamics -- powder-averaged S(|Q|, E)
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "powder.h"
+
+#include <fstream>
+#include <iomanip>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#ifdef USE_HDF5
+	#include <H5Cpp.h>
+	#include "tlibs2/libs/h5file.h"
+#endif
+
+using namespace tl2_ops;
+
+extern int g_prec;
+
+
+// number of directions that are histogrammed in one work item
+#define POWDER_DIRS_PER_ITEM 64
+
+
+
+/**
+ * |Q| at the centre of the given bin
+ */
+t_real PowderResults::GetQ(t_size Q_idx) const
+{
+	if(num_Q <= 1)
+		return Q_range[0];
+	return std::lerp(Q_range[0], Q_range[1], t_real(Q_idx) / t_real(num_Q - 1));
+}
+
+
+
+/**
+ * E at the centre of the given bin
+ */
+t_real PowderResults::GetE(t_size E_idx) const
+{
+	if(num_E <= 1)
+		return E_range[0];
+	return std::lerp(E_range[0], E_range[1], t_real(E_idx) / t_real(num_E - 1));
+}
+
+
+
+/**
+ * nearly uniformly distributed unit vectors on a fibonacci lattice
+ */
+std::vector<t_vec_real> get_fibonacci_directions(t_size num_dirs)
+{
+	std::vector<t_vec_real> dirs;
+	dirs.reserve(num_dirs);
+
+	const t_real golden_angle = tl2::pi<t_real> * (t_real(3) - std::sqrt(t_real(5)));
+
+	for(t_size idx=0; idx<num_dirs; ++idx)
+	{
+		const t_real z = t_real(1) - t_real(2*idx + 1) / t_real(num_dirs);
+		const t_real r = std::sqrt(std::max<t_real>(t_real(1) - z*z, 0.));
+		const t_real phi = golden_angle * t_real(idx);
+
+		dirs.emplace_back(tl2::create<t_vec_real>({ r*std::cos(phi), r*std::sin(phi), z }));
+	}
+
+	return dirs;
+}
+
+
+
+/**
+ * calculate the powder-averaged S(|Q|, E) map,
+ * the work items are blocks of directions of one |Q| bin
+ */
+bool calc_powder(const t_magdyn& dyn, const MagDynConfig& cfg,
+	PowderResults& results, CalcThreadPool& pool,
+	const t_calc_progress& progress)
+{
+	results.Q_range[0] = cfg.powder_Q_range[0];
+	results.Q_range[1] = cfg.powder_Q_range[1];
+	results.E_range[0] = cfg.powder_E_range[0];
+	results.E_range[1] = cfg.powder_E_range[1];
+	results.num_Q = std::max<t_size>(cfg.powder_num_Q, 1);
+	results.num_E = std::max<t_size>(cfg.powder_num_E, 1);
+	results.num_dirs = std::max<t_size>(cfg.powder_num_dirs, 1);
+	results.intensities.assign(results.num_Q * results.num_E, t_real(0));
+
+	// transformation from lab 1/A to rlu
+	const t_mat_real B = tl2::B_matrix<t_mat_real>(
+		cfg.xtal_lattice[0], cfg.xtal_lattice[1], cfg.xtal_lattice[2],
+		cfg.xtal_angles[0]/180.*tl2::pi<t_real>,
+		cfg.xtal_angles[1]/180.*tl2::pi<t_real>,
+		cfg.xtal_angles[2]/180.*tl2::pi<t_real>);
+	const auto [B_inv, B_ok] = tl2::inv<t_mat_real>(B);
+	if(!B_ok)
+		throw std::runtime_error("Invalid crystal lattice.");
+
+	const std::vector<t_vec_real> dirs = get_fibonacci_directions(results.num_dirs);
+	const t_size num_blocks = (results.num_dirs + POWDER_DIRS_PER_ITEM - 1) / POWDER_DIRS_PER_ITEM;
+
+	// energy bins
+	const t_real E_min = results.E_range[0];
+	const t_real dE = results.num_E > 1
+		? (results.E_range[1] - results.E_range[0]) / t_real(results.num_E - 1)
+		: t_real(1);
+	const t_real sigma = cfg.powder_E_sigma;
+
+	// weights are averaged over the directions
+	const t_real norm = t_real(1) / t_real(results.num_dirs);
+
+	// blocks of the same |Q| bin add to the same row
+	auto row_mutexes = std::make_unique<std::mutex[]>(results.num_Q);
+
+	return pool.ParallelFor(results.num_Q * num_blocks,
+		[&](t_size idx)
+	{
+		const t_size Q_idx = idx / num_blocks;
+		const t_size block = idx % num_blocks;
+		const t_size dir_begin = block * POWDER_DIRS_PER_ITEM;
+		const t_size dir_end = std::min<t_size>(dir_begin + POWDER_DIRS_PER_ITEM, results.num_dirs);
+		const t_real Q_len = results.GetQ(Q_idx);
+
+		std::vector<t_real> row(results.num_E, t_real(0));
+
+		for(t_size dir_idx=dir_begin; dir_idx<dir_end; ++dir_idx)
+		{
+			const t_vec_real Q_lab = dirs[dir_idx] * Q_len;
+			const t_vec_real Q = B_inv * Q_lab;
+
+			const SofQE result = calc_dispersion_point(dyn, cfg, Q);
+			for(std::size_t branch=0; branch<result.E.size(); ++branch)
+			{
+				// without weights, every branch counts equally
+				const t_real weight = cfg.use_weights ? result.S[branch] : t_real(1);
+				add_energy_kernel(row.data(), results.num_E, E_min, dE,
+					result.E[branch], weight * norm, KERNEL_GAUSSIAN, sigma);
+			}
+		}
+
+		std::lock_guard<std::mutex> _lck{row_mutexes[Q_idx]};
+		for(t_size E_idx=0; E_idx<results.num_E; ++E_idx)
+			results.intensities[Q_idx*results.num_E + E_idx] += row[E_idx];
+	}, progress);
+}
+
+
+
+/**
+ * save the powder map as text, as a binary grid or in hdf5 format
+ */
+bool save_powder(const std::string& filename, const PowderResults& results, int format)
+{
+	if(format == EXPORT_TEXT)
+	{
+		std::ofstream ofstr{filename};
+		if(!ofstr)
+			return false;
+
+		ofstr.precision(g_prec);
+		const int field_len = g_prec * 2.5;
+
+		ofstr << "# directions per |Q|: " << results.num_dirs << "\n";
+		ofstr << "# "
+			<< std::setw(field_len) << std::left << "|Q| (1/A)" << " "
+			<< std::setw(field_len) << std::left << "E (meV)" << " "
+			<< std::setw(field_len) << std::left << "S" << "\n";
+
+		for(t_size Q_idx=0; Q_idx<results.num_Q; ++Q_idx)
+		{
+			for(t_size E_idx=0; E_idx<results.num_E; ++E_idx)
+			{
+				ofstr
+					<< std::setw(field_len) << std::left << results.GetQ(Q_idx) << " "
+					<< std::setw(field_len) << std::left << results.GetE(E_idx) << " "
+					<< std::setw(field_len) << std::left << results.GetIntensity(Q_idx, E_idx) << "\n";
+			}
+		}
+
+		ofstr.flush();
+		return true;
+	}
+
+	else if(format == EXPORT_GRID)
+	{
+		// binary grid:
+		//   signature, uint64 num_Q, num_E, num_dirs,
+		//   double Q_min, Q_max, E_min, E_max,
+		//   double intensities[num_Q][num_E]
+		std::ofstream ofstr{filename, std::ios_base::binary};
+		if(!ofstr)
+			return false;
+
+		const std::string signature = "Takin/Magdyn Powder File Version 1.";
+		ofstr.write(signature.c_str(), signature.length() + 1);
+
+		const std::uint64_t dims[] = { results.num_Q, results.num_E, results.num_dirs };
+		ofstr.write(reinterpret_cast<const char*>(dims), sizeof(dims));
+
+		const double ranges[] = { results.Q_range[0], results.Q_range[1],
+			results.E_range[0], results.E_range[1] };
+		ofstr.write(reinterpret_cast<const char*>(ranges), sizeof(ranges));
+
+		for(t_real val : results.intensities)
+		{
+			const double dval = val;
+			ofstr.write(reinterpret_cast<const char*>(&dval), sizeof(dval));
+		}
+
+		ofstr.flush();
+		return ofstr.good();
+	}
+
+#ifdef USE_HDF5
+	else if(format == EXPORT_HDF5)
+	{
+		try
+		{
+			H5::H5File h5file(filename.c_str(), H5F_ACC_TRUNC);
+			h5file.createGroup("meta_infos");
+			h5file.createGroup("infos");
+			h5file.createGroup("data");
+
+			tl2::set_h5_string<std::string>(h5file, "meta_infos/type", "takin_powder");
+			tl2::set_h5_string<std::string>(h5file, "meta_infos/description", "Takin/Magdyn powder average");
+
+			tl2::set_h5_vector(h5file, "infos/Q_range", std::vector<t_real>{
+				results.Q_range[0], results.Q_range[1] });
+			tl2::set_h5_vector(h5file, "infos/E_range", std::vector<t_real>{
+				results.E_range[0], results.E_range[1] });
+			tl2::set_h5_vector(h5file, "infos/dimensions", std::vector<std::size_t>{
+				results.num_Q, results.num_E });
+			tl2::set_h5_vector(h5file, "infos/directions", std::vector<std::size_t>{
+				results.num_dirs });
+
+			const H5::PredType& h5type = std::is_same_v<t_real, float>
+				? H5::PredType::NATIVE_FLOAT : H5::PredType::NATIVE_DOUBLE;
+
+			const hsize_t dims[] = { results.num_Q, results.num_E };
+			H5::DataSpace space(2, dims);
+			H5::DataSet dataset = h5file.createDataSet("data/intensities", h5type, space);
+			if(results.intensities.size())
+				dataset.write(results.intensities.data(), h5type);
+
+			h5file.close();
+			return true;
+		}
+		catch(const H5::Exception& ex)
+		{
+			throw std::runtime_error(ex.getDetailMsg());
+		}
+	}
+#endif
+
+	return false;
+}
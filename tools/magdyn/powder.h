@@ -0,0 +1,74 @@
+/**
+ * magnetic dynamics -- powder-averaged S(|Q|, E)
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __MAGDYN_POWDER_H__
+#define __MAGDYN_POWDER_H__
+
+#include <string>
+#include <vector>
+
+#include "defs.h"
+#include "calc.h"
+
+
+
+/**
+ * powder-averaged S(|Q|, E) map
+ */
+struct PowderResults
+{
+	t_real Q_range[2]{};    // bin centres of the first and last |Q| bin in 1/A
+	t_real E_range[2]{};    // bin centres of the first and last E bin in meV
+	t_size num_Q{}, num_E{};
+	t_size num_dirs{};      // averaged directions per |Q|
+
+	std::vector<t_real> intensities{};  // [Q][E]
+
+	t_real GetQ(t_size Q_idx) const;
+	t_real GetE(t_size E_idx) const;
+	t_real GetIntensity(t_size Q_idx, t_size E_idx) const
+	{ return intensities[Q_idx*num_E + E_idx]; }
+};
+
+
+
+/**
+ * averages the spectral weights over directions on the sphere, which are
+ * sampled by a fibonacci lattice, and histograms them into |Q|-E bins
+ */
+extern std::vector<t_vec_real> get_fibonacci_directions(t_size num_dirs);
+
+extern bool calc_powder(const t_magdyn& dyn, const MagDynConfig& cfg,
+	PowderResults& results, CalcThreadPool& pool,
+	const t_calc_progress& progress = nullptr);
+
+extern bool save_powder(const std::string& filename,
+	const PowderResults& results, int format);
+
+
+#endif
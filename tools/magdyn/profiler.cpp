@@ -0,0 +1,443 @@
+/**
+ * magnetic dynamics -- profiling of the calculation stages
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "profiler.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+
+
+/**
+ * a timed stage for the trace file
+ */
+struct ProfileEvent
+{
+	int stage{};
+	std::int64_t start{};      // ns since the start of the profile
+	std::int64_t duration{};   // ns
+};
+
+
+
+/**
+ * timings of one thread slot, only written by the thread using the slot
+ */
+struct ProfileThreadData
+{
+	t_size thread_idx{};
+	bool in_use{};             // a running thread is using the slot
+
+	std::atomic<std::uint64_t> calls[PROFILE_NUM_STAGES]{};
+	std::atomic<std::uint64_t> nanoseconds[PROFILE_NUM_STAGES]{};
+
+	// events for the trace file
+	std::mutex mtx_events{};
+	std::vector<ProfileEvent> events{};
+	t_size dropped_events{};
+};
+
+
+
+static std::atomic<bool> g_profiling{false};
+static std::atomic<bool> g_tracing{false};
+
+// start of the profile in ns of the steady clock
+static std::atomic<std::int64_t> g_profile_start{0};
+
+// data of the thread slots, the entries are never removed, so that the
+// threads' cached pointers stay valid, but a slot is handed to a new thread
+// after its previous one has exited, which keeps accumulating its counters
+static std::mutex g_mtx_threads{};
+static std::vector<std::unique_ptr<ProfileThreadData>> g_threads{};
+
+// maximum number of trace events per thread
+static constexpr t_size g_max_events = 1 << 18;
+
+
+
+static std::int64_t get_profile_ns(ProfileTimer::t_clock::time_point time)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		time.time_since_epoch()).count();
+}
+
+
+
+/**
+ * a thread's slot, which is released when the thread exits
+ */
+struct ProfileThreadSlot
+{
+	ProfileThreadData* data{};
+
+	~ProfileThreadSlot()
+	{
+		if(!data)
+			return;
+
+		std::lock_guard lock{g_mtx_threads};
+		data->in_use = false;
+	}
+};
+
+
+
+/**
+ * get the current thread's data, assigning a free slot at its first use
+ */
+static ProfileThreadData* get_profile_thread_data()
+{
+	thread_local ProfileThreadSlot slot;
+
+	if(!slot.data)
+	{
+		std::lock_guard lock{g_mtx_threads};
+
+		for(auto& data : g_threads)
+		{
+			if(!data->in_use)
+			{
+				slot.data = data.get();
+				break;
+			}
+		}
+
+		if(!slot.data)
+		{
+			g_threads.emplace_back(std::make_unique<ProfileThreadData>());
+			slot.data = g_threads.back().get();
+			slot.data->thread_idx = g_threads.size() - 1;
+		}
+
+		slot.data->in_use = true;
+	}
+
+	return slot.data;
+}
+
+
+
+ProfileTimer::ProfileTimer(int stage)
+{
+	if(!g_profiling.load(std::memory_order_relaxed))
+		return;
+
+	m_stage = stage;
+	m_start = t_clock::now();
+}
+
+
+
+ProfileTimer::~ProfileTimer()
+{
+	if(m_stage < 0)
+		return;
+
+	const std::int64_t start = get_profile_ns(m_start);
+	const std::int64_t duration = get_profile_ns(t_clock::now()) - start;
+
+	ProfileThreadData* data = get_profile_thread_data();
+	data->calls[m_stage].fetch_add(1, std::memory_order_relaxed);
+	data->nanoseconds[m_stage].fetch_add(duration, std::memory_order_relaxed);
+
+	if(g_tracing.load(std::memory_order_relaxed))
+	{
+		std::lock_guard lock{data->mtx_events};
+
+		if(data->events.size() < g_max_events)
+		{
+			data->events.emplace_back(ProfileEvent{ m_stage,
+				start - g_profile_start.load(std::memory_order_relaxed),
+				duration });
+		}
+		else
+		{
+			++data->dropped_events;
+		}
+	}
+}
+
+
+
+/**
+ * switch profiling on or off, a new profile is started when switching it on
+ */
+void set_profiling(bool enabled, bool trace)
+{
+	if(enabled && !g_profiling)
+		reset_profile();
+
+	g_tracing = enabled && trace;
+	g_profiling = enabled;
+}
+
+
+
+bool is_profiling()
+{
+	return g_profiling;
+}
+
+
+
+/**
+ * clear the timings and events of all threads
+ */
+void reset_profile()
+{
+	std::lock_guard lock{g_mtx_threads};
+
+	for(auto& data : g_threads)
+	{
+		for(int stage=0; stage<PROFILE_NUM_STAGES; ++stage)
+		{
+			data->calls[stage] = 0;
+			data->nanoseconds[stage] = 0;
+		}
+
+		std::lock_guard lock_events{data->mtx_events};
+		data->events.clear();
+		data->dropped_events = 0;
+	}
+
+	g_profile_start = get_profile_ns(ProfileTimer::t_clock::now());
+}
+
+
+
+const char* get_profile_stage_name(int stage)
+{
+	switch(stage)
+	{
+		case PROFILE_Q_POINT: return "Q point";
+		case PROFILE_HAMILTONIAN: return "Hamiltonian";
+		case PROFILE_EIGENSYSTEM: return "Eigensystem";
+		case PROFILE_CORRELATIONS: return "Correlations";
+		case PROFILE_UNITE: return "Unite energies";
+		case PROFILE_INCOMMENSURATE: return "Incommensurate energies";
+		case PROFILE_EXPORT_WRITE: return "Export writing";
+	}
+
+	return "Unknown";
+}
+
+
+
+/**
+ * get the timings of all threads that have been active in the profile
+ */
+std::vector<ProfileThread> get_profile_threads()
+{
+	std::vector<ProfileThread> threads;
+	std::lock_guard lock{g_mtx_threads};
+
+	for(const auto& data : g_threads)
+	{
+		ProfileThread thread;
+		thread.thread_idx = data->thread_idx;
+		bool active = false;
+
+		for(int stage=0; stage<PROFILE_NUM_STAGES; ++stage)
+		{
+			thread.stages[stage].name = get_profile_stage_name(stage);
+			thread.stages[stage].calls = data->calls[stage].load(std::memory_order_relaxed);
+			thread.stages[stage].seconds = t_real(
+				data->nanoseconds[stage].load(std::memory_order_relaxed)) * 1e-9;
+
+			if(thread.stages[stage].calls)
+				active = true;
+		}
+
+		if(active)
+			threads.emplace_back(std::move(thread));
+	}
+
+	return threads;
+}
+
+
+
+/**
+ * get the timings of all stages summed over the threads
+ */
+std::vector<ProfileStage> get_profile_stages()
+{
+	std::vector<ProfileStage> stages(PROFILE_NUM_STAGES);
+	for(int stage=0; stage<PROFILE_NUM_STAGES; ++stage)
+		stages[stage].name = get_profile_stage_name(stage);
+
+	for(const ProfileThread& thread : get_profile_threads())
+	{
+		for(int stage=0; stage<PROFILE_NUM_STAGES; ++stage)
+		{
+			stages[stage].calls += thread.stages[stage].calls;
+			stages[stage].seconds += thread.stages[stage].seconds;
+		}
+	}
+
+	return stages;
+}
+
+
+
+/**
+ * get a table of the timings per stage and per thread
+ */
+std::string get_profile_summary()
+{
+	std::ostringstream ostr;
+	ostr << std::fixed;
+
+	ostr << std::left << std::setw(26) << "Stage"
+		<< std::right << std::setw(12) << "Calls"
+		<< std::setw(14) << "Total [ms]"
+		<< std::setw(14) << "Mean [us]" << "\n";
+
+	for(const ProfileStage& stage : get_profile_stages())
+	{
+		if(stage.calls == 0)
+			continue;
+
+		ostr << std::left << std::setw(26) << stage.name
+			<< std::right << std::setw(12) << stage.calls
+			<< std::setw(14) << std::setprecision(3) << stage.seconds * 1e3
+			<< std::setw(14) << std::setprecision(3) << stage.seconds * 1e6 / t_real(stage.calls)
+			<< "\n";
+	}
+
+	// the q point stage includes the other calculation stages
+	ostr << "\n" << std::left << std::setw(26) << "Thread"
+		<< std::right << std::setw(12) << "Q points"
+		<< std::setw(14) << "Busy [ms]" << "\n";
+
+	for(const ProfileThread& thread : get_profile_threads())
+	{
+		const ProfileStage& Q_point = thread.stages[PROFILE_Q_POINT];
+		const ProfileStage& writing = thread.stages[PROFILE_EXPORT_WRITE];
+
+		ostr << std::left << std::setw(26) << ("#" + std::to_string(thread.thread_idx))
+			<< std::right << std::setw(12) << Q_point.calls
+			<< std::setw(14) << std::setprecision(3)
+			<< (Q_point.seconds + writing.seconds) * 1e3 << "\n";
+	}
+
+	return ostr.str();
+}
+
+
+
+/**
+ * get a one-line overview of the calculation stages
+ */
+std::string get_profile_status()
+{
+	std::ostringstream ostr;
+	ostr << std::fixed << std::setprecision(1);
+
+	bool first = true;
+	for(const ProfileStage& stage : get_profile_stages())
+	{
+		// the q point stage includes the other stages
+		if(stage.calls == 0 || stage.name == get_profile_stage_name(PROFILE_Q_POINT))
+			continue;
+
+		if(!first)
+			ostr << ", ";
+		ostr << stage.name << ": " << stage.seconds * 1e3 << " ms";
+		first = false;
+	}
+
+	return ostr.str();
+}
+
+
+
+/**
+ * write the recorded events in the chrome trace format,
+ * which can be viewed in chrome://tracing or https://ui.perfetto.dev
+ */
+bool save_profile_trace(const std::string& filename)
+{
+	std::ofstream ofstr(filename);
+	if(!ofstr)
+		return false;
+
+	ofstr << std::fixed << std::setprecision(3);
+	ofstr << "{\n\"displayTimeUnit\": \"ms\",\n\"traceEvents\": [";
+
+	bool first = true;
+	auto separator = [&ofstr, &first]()
+	{
+		ofstr << (first ? "\n" : ",\n");
+		first = false;
+	};
+
+	std::lock_guard lock{g_mtx_threads};
+	for(const auto& data : g_threads)
+	{
+		std::lock_guard lock_events{data->mtx_events};
+		if(data->events.size() == 0)
+			continue;
+
+		separator();
+		ofstr << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+			<< data->thread_idx << ", \"args\": {\"name\": \"Thread #"
+			<< data->thread_idx << "\"}}";
+
+		for(const ProfileEvent& event : data->events)
+		{
+			// skip stages that started before the profile
+			if(event.start < 0)
+				continue;
+
+			separator();
+			ofstr << "{\"name\": \"" << get_profile_stage_name(event.stage)
+				<< "\", \"cat\": \"magdyn\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+				<< data->thread_idx
+				<< ", \"ts\": " << t_real(event.start) * 1e-3
+				<< ", \"dur\": " << t_real(event.duration) * 1e-3 << "}";
+		}
+
+		if(data->dropped_events)
+		{
+			separator();
+			ofstr << "{\"name\": \"dropped events\", \"ph\": \"C\", \"pid\": 1, \"tid\": "
+				<< data->thread_idx << ", \"ts\": 0, \"args\": {\"dropped\": "
+				<< data->dropped_events << "}}";
+		}
+	}
+
+	ofstr << "\n]\n}\n";
+	ofstr.flush();
+	return ofstr.good();
+}
@@ -0,0 +1,121 @@
+/**
+ * magnetic dynamics -- profiling of the calculation stages
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __MAGDYN_PROFILER_H__
+#define __MAGDYN_PROFILER_H__
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+#include "defs.h"
+
+
+
+/**
+ * profiled calculation stages
+ */
+enum : int
+{
+	PROFILE_Q_POINT = 0,       // complete calculation of one Q point
+	PROFILE_HAMILTONIAN,       // hamiltonian assembly
+	PROFILE_EIGENSYSTEM,       // eigen-decomposition of the hamiltonian
+	PROFILE_CORRELATIONS,      // correlation functions and spectral weights
+	PROFILE_UNITE,             // uniting of degenerate energies
+	PROFILE_INCOMMENSURATE,    // combined stages for incommensurate structures
+	PROFILE_EXPORT_WRITE,      // writing of a grid export column
+
+	PROFILE_NUM_STAGES
+};
+
+
+
+/**
+ * accumulated timings of one stage
+ */
+struct ProfileStage
+{
+	std::string name{};
+	t_size calls{};
+	t_real seconds{};
+};
+
+
+
+/**
+ * accumulated timings of one thread slot,
+ * a slot is reused by a new thread after its previous thread has exited
+ */
+struct ProfileThread
+{
+	t_size thread_idx{};
+	ProfileStage stages[PROFILE_NUM_STAGES]{};
+};
+
+
+
+/**
+ * times a stage during its lifetime if profiling is enabled,
+ * the timings are aggregated per thread
+ */
+class ProfileTimer
+{
+public:
+	using t_clock = std::chrono::steady_clock;
+
+
+public:
+	explicit ProfileTimer(int stage);
+	~ProfileTimer();
+
+	ProfileTimer(const ProfileTimer&) = delete;
+	const ProfileTimer& operator=(const ProfileTimer&) = delete;
+
+
+private:
+	int m_stage{ -1 };         // -1: not profiling
+	t_clock::time_point m_start{};
+};
+
+
+
+extern void set_profiling(bool enabled, bool trace = false);
+extern bool is_profiling();
+extern void reset_profile();
+
+extern const char* get_profile_stage_name(int stage);
+extern std::vector<ProfileThread> get_profile_threads();
+extern std::vector<ProfileStage> get_profile_stages();
+extern std::string get_profile_summary();
+extern std::string get_profile_status();
+
+extern bool save_profile_trace(const std::string& filename);
+
+
+#endif
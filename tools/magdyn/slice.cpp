@@ -0,0 +1,412 @@
+/**
+ * magnetic dynamics -- resolution-convolved S(Q, E) slices
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include "slice.h"
+
+#include <fstream>
+#include <iomanip>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#ifdef USE_HDF5
+	#include <H5Cpp.h>
+	#include "tlibs2/libs/h5file.h"
+#endif
+
+extern int g_prec;
+extern t_real g_eps;
+
+
+
+/**
+ * coordinate of the given point along an axis
+ */
+t_real SliceResults::GetCoord(int axis, t_size idx) const
+{
+	const t_real* range = axis == 0 ? range1 : range2;
+	const t_size num = num_points[axis];
+
+	if(num <= 1)
+		return range[0];
+	return std::lerp(range[0], range[1], t_real(idx) / t_real(num - 1));
+}
+
+
+
+/**
+ * E at the centre of the given bin
+ */
+t_real SliceResults::GetE(t_size E_idx) const
+{
+	if(num_E <= 1)
+		return E_range[0];
+	return std::lerp(E_range[0], E_range[1], t_real(E_idx) / t_real(num_E - 1));
+}
+
+
+
+/**
+ * set up the Q points of a plane
+ */
+static void get_slice_plane(const MagDynConfig& cfg, SliceResults& results)
+{
+	results.num_points[0] = std::max<t_size>(cfg.slice_num_points[0], 1);
+	results.num_points[1] = std::max<t_size>(cfg.slice_num_points[1], 1);
+
+	for(int i=0; i<2; ++i)
+	{
+		results.range1[i] = cfg.slice_range1[i];
+		results.range2[i] = cfg.slice_range2[i];
+	}
+
+	results.Qs.resize(results.GetNumPoints() * 3);
+	for(t_size pt1=0; pt1<results.num_points[0]; ++pt1)
+	{
+		const t_real coord1 = results.GetCoord(0, pt1);
+
+		for(t_size pt2=0; pt2<results.num_points[1]; ++pt2)
+		{
+			const t_real coord2 = results.GetCoord(1, pt2);
+			t_real* Q = results.Qs.data() + (pt1*results.num_points[1] + pt2)*3;
+
+			for(int i=0; i<3; ++i)
+				Q[i] = cfg.slice_origin[i] + coord1*cfg.slice_dir1[i] + coord2*cfg.slice_dir2[i];
+		}
+	}
+}
+
+
+
+/**
+ * set up equidistant Q points along the dispersion path, or along
+ * the straight path from Q_start to Q_end if no path is defined
+ */
+static void get_slice_path(const MagDynConfig& _cfg, SliceResults& results)
+{
+	MagDynConfig cfg = _cfg;
+	if(cfg.Q_path.size() == 0)
+	{
+		DispersionSegment segment;
+		for(int i=0; i<3; ++i)
+		{
+			segment.Q_start[i] = cfg.Q_start[i];
+			segment.Q_end[i] = cfg.Q_end[i];
+		}
+		cfg.Q_path.push_back(segment);
+	}
+
+	const std::vector<t_real> lengths = get_dispersion_path_lengths(cfg);
+	const t_real total_len = std::accumulate(lengths.begin(), lengths.end(), t_real(0));
+	if(total_len <= g_eps)
+		throw std::runtime_error("The slice path has zero length.");
+
+	results.num_points[0] = std::max<t_size>(cfg.slice_num_points[0], 1);
+	results.num_points[1] = 1;
+	results.range1[0] = 0.;
+	results.range1[1] = total_len;
+	results.range2[0] = results.range2[1] = 0.;
+	results.ticks = get_dispersion_path_ticks(cfg);
+
+	results.Qs.resize(results.GetNumPoints() * 3);
+	for(t_size pt=0; pt<results.num_points[0]; ++pt)
+	{
+		// find the segment containing the path position
+		t_real pos = results.GetCoord(0, pt);
+		t_size seg_idx = 0;
+		while(seg_idx + 1 < lengths.size() && pos > lengths[seg_idx])
+		{
+			pos -= lengths[seg_idx];
+			++seg_idx;
+		}
+
+		const DispersionSegment& segment = cfg.Q_path[seg_idx];
+		const t_real frac = lengths[seg_idx] > g_eps
+			? std::clamp<t_real>(pos / lengths[seg_idx], 0., 1.) : 0.;
+
+		for(int i=0; i<3; ++i)
+			results.Qs[pt*3 + i] = std::lerp(segment.Q_start[i], segment.Q_end[i], frac);
+	}
+}
+
+
+
+/**
+ * convolve the histogram with a gaussian of the given width along one of the Q axes,
+ * every line along the axis is independent and convolved in place
+ */
+static bool convolve_slice_axis(SliceResults& results, int axis,
+	t_real width, CalcThreadPool& pool, const t_calc_progress& progress)
+{
+	const t_size num = results.num_points[axis];
+	if(num <= 1 || width <= t_real(0))
+		return true;
+
+	const t_real* range = axis == 0 ? results.range1 : results.range2;
+	const t_real step = std::abs(range[1] - range[0]) / t_real(num - 1);
+	if(step <= g_eps)
+		return true;
+
+	// discrete and normalised kernel
+	const t_real sigma = width / step;
+	const t_size radius = t_size(std::ceil(t_real(4) * sigma));
+	std::vector<t_real> kernel(2*radius + 1);
+	for(t_size idx=0; idx<kernel.size(); ++idx)
+	{
+		const t_real dist = (t_real(idx) - t_real(radius)) / sigma;
+		kernel[idx] = std::exp(-t_real(0.5) * dist*dist);
+	}
+	const t_real norm = std::accumulate(kernel.begin(), kernel.end(), t_real(0));
+	for(t_real& val : kernel)
+		val /= norm;
+
+	// element distance along the axis
+	const t_size inner = axis == 0 ? results.num_points[1] * results.num_E : results.num_E;
+	const t_size num_lines = results.intensities.size() / num;
+
+	return pool.ParallelFor(num_lines, [&results, &kernel, num, inner, radius](t_size line)
+	{
+		const t_size base = (line / inner)*num*inner + line % inner;
+
+		std::vector<t_real> values(num);
+		for(t_size idx=0; idx<num; ++idx)
+			values[idx] = results.intensities[base + idx*inner];
+
+		for(t_size idx=0; idx<num; ++idx)
+		{
+			const t_size begin = idx >= radius ? idx - radius : 0;
+			const t_size end = std::min(idx + radius + 1, num);
+
+			t_real val = 0.;
+			for(t_size src=begin; src<end; ++src)
+				val += values[src] * kernel[src + radius - idx];
+			results.intensities[base + idx*inner] = val;
+		}
+	}, progress);
+}
+
+
+
+/**
+ * calculate the S(Q, E) slice, every Q point only writes to its
+ * own histogram row, so no locking or merging is needed
+ */
+bool calc_slice(const t_magdyn& dyn, const MagDynConfig& cfg,
+	SliceResults& results, CalcThreadPool& pool,
+	const t_calc_progress& progress)
+{
+	results = SliceResults{};
+	results.mode = cfg.slice_mode;
+	results.num_E = std::max<t_size>(cfg.slice_num_E, 1);
+	results.E_range[0] = cfg.slice_E_range[0];
+	results.E_range[1] = cfg.slice_E_range[1];
+
+	if(results.mode == SLICE_PATH)
+		get_slice_path(cfg, results);
+	else
+		get_slice_plane(cfg, results);
+
+	const t_size num_points = results.GetNumPoints();
+	results.intensities.assign(num_points * results.num_E, t_real(0));
+
+	const t_real dE = results.num_E > 1
+		? (results.E_range[1] - results.E_range[0]) / t_real(results.num_E - 1)
+		: t_real(1);
+
+	if(!pool.ParallelFor(num_points, [&dyn, &cfg, &results, dE](t_size pt)
+	{
+		const t_real* Qs = results.Qs.data() + pt*3;
+		const t_vec_real Q = tl2::create<t_vec_real>({ Qs[0], Qs[1], Qs[2] });
+		const SofQE result = calc_dispersion_point(dyn, cfg, Q);
+
+		t_real* row = results.intensities.data() + pt*results.num_E;
+		for(std::size_t branch=0; branch<result.E.size(); ++branch)
+		{
+			// without weights, every branch counts equally
+			const t_real weight = cfg.use_weights ? result.S[branch] : t_real(1);
+			add_energy_kernel(row, results.num_E, results.E_range[0], dE,
+				result.E[branch], weight, cfg.slice_kernel, cfg.slice_E_width);
+		}
+	}, progress))
+		return false;
+
+	// Q resolution
+	if(!convolve_slice_axis(results, 0, cfg.slice_Q_width[0], pool, progress))
+		return false;
+	if(results.mode != SLICE_PATH &&
+		!convolve_slice_axis(results, 1, cfg.slice_Q_width[1], pool, progress))
+		return false;
+
+	return true;
+}
+
+
+
+/**
+ * save the slice as text or in hdf5 format
+ */
+bool save_slice(const std::string& filename, const SliceResults& results, int format)
+{
+	const bool is_path = results.mode == SLICE_PATH;
+
+	if(format == EXPORT_TEXT)
+	{
+		std::ofstream ofstr{filename};
+		if(!ofstr)
+			return false;
+
+		ofstr.precision(g_prec);
+		const int field_len = g_prec * 2.5;
+
+		for(const auto& [pos, label] : results.ticks)
+			ofstr << "# path vertex at " << pos << " 1/A: " << label << "\n";
+
+		ofstr << "# ";
+		if(is_path)
+		{
+			ofstr << std::setw(field_len) << std::left << "pos (1/A)" << " ";
+		}
+		else
+		{
+			ofstr
+				<< std::setw(field_len) << std::left << "x1" << " "
+				<< std::setw(field_len) << std::left << "x2" << " ";
+		}
+		ofstr
+			<< std::setw(field_len) << std::left << "h" << " "
+			<< std::setw(field_len) << std::left << "k" << " "
+			<< std::setw(field_len) << std::left << "l" << " "
+			<< std::setw(field_len) << std::left << "E" << " "
+			<< std::setw(field_len) << std::left << "S" << "\n";
+
+		for(t_size pt1=0; pt1<results.num_points[0]; ++pt1)
+		{
+			for(t_size pt2=0; pt2<results.num_points[1]; ++pt2)
+			{
+				const t_real* Q = results.Qs.data() + (pt1*results.num_points[1] + pt2)*3;
+
+				for(t_size E_idx=0; E_idx<results.num_E; ++E_idx)
+				{
+					ofstr << std::setw(field_len) << std::left << results.GetCoord(0, pt1) << " ";
+					if(!is_path)
+						ofstr << std::setw(field_len) << std::left << results.GetCoord(1, pt2) << " ";
+					ofstr
+						<< std::setw(field_len) << std::left << Q[0] << " "
+						<< std::setw(field_len) << std::left << Q[1] << " "
+						<< std::setw(field_len) << std::left << Q[2] << " "
+						<< std::setw(field_len) << std::left << results.GetE(E_idx) << " "
+						<< std::setw(field_len) << std::left
+						<< results.GetIntensity(pt1, pt2, E_idx) << "\n";
+				}
+			}
+		}
+
+		ofstr.flush();
+		return true;
+	}
+
+#ifdef USE_HDF5
+	else if(format == EXPORT_HDF5)
+	{
+		try
+		{
+			H5::H5File h5file(filename.c_str(), H5F_ACC_TRUNC);
+			h5file.createGroup("meta_infos");
+			h5file.createGroup("infos");
+			h5file.createGroup("data");
+
+			tl2::set_h5_string<std::string>(h5file, "meta_infos/type", "takin_slice");
+			tl2::set_h5_string<std::string>(h5file, "meta_infos/description", "Takin/Magdyn S(Q, E) slice");
+
+			tl2::set_h5_string<std::string>(h5file, "infos/mode", is_path ? "path" : "plane");
+			tl2::set_h5_vector(h5file, "infos/range_1", std::vector<t_real>{
+				results.range1[0], results.range1[1] });
+			tl2::set_h5_vector(h5file, "infos/E_range", std::vector<t_real>{
+				results.E_range[0], results.E_range[1] });
+
+			if(is_path)
+			{
+				std::vector<t_real> tick_pos;
+				std::vector<std::string> tick_labels;
+				for(const auto& [pos, label] : results.ticks)
+				{
+					tick_pos.push_back(pos);
+					tick_labels.push_back(label);
+				}
+
+				tl2::set_h5_vector(h5file, "infos/dimensions", std::vector<std::size_t>{
+					results.num_points[0], results.num_E });
+				tl2::set_h5_vector(h5file, "infos/path_vertices", tick_pos);
+				tl2::set_h5_string_vector(h5file, "infos/path_labels", tick_labels);
+			}
+			else
+			{
+				tl2::set_h5_vector(h5file, "infos/range_2", std::vector<t_real>{
+					results.range2[0], results.range2[1] });
+				tl2::set_h5_vector(h5file, "infos/dimensions", std::vector<std::size_t>{
+					results.num_points[0], results.num_points[1], results.num_E });
+			}
+
+			const H5::PredType& h5type = std::is_same_v<t_real, float>
+				? H5::PredType::NATIVE_FLOAT : H5::PredType::NATIVE_DOUBLE;
+
+			auto write_cube = [&h5file, &h5type](const std::string& name,
+				const std::vector<t_real>& data, std::vector<hsize_t> dims)
+			{
+				H5::DataSpace space(dims.size(), dims.data());
+				H5::DataSet dataset = h5file.createDataSet(name, h5type, space);
+				if(data.size())
+					dataset.write(data.data(), h5type);
+			};
+
+			write_cube("data/Q", results.Qs, { results.GetNumPoints(), 3 });
+			if(is_path)
+			{
+				write_cube("data/intensities", results.intensities,
+					{ results.num_points[0], results.num_E });
+			}
+			else
+			{
+				write_cube("data/intensities", results.intensities,
+					{ results.num_points[0], results.num_points[1], results.num_E });
+			}
+
+			h5file.close();
+			return true;
+		}
+		catch(const H5::Exception& ex)
+		{
+			throw std::runtime_error(ex.getDetailMsg());
+		}
+	}
+#endif
+
+	return false;
+}
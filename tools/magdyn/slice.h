@@ -0,0 +1,81 @@
+/**
+ * magnetic dynamics -- resolution-convolved S(Q, E) slices
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __MAGDYN_SLICE_H__
+#define __MAGDYN_SLICE_H__
+
+#include <string>
+#include <vector>
+
+#include "defs.h"
+#include "calc.h"
+
+
+
+/**
+ * S(Q, E) histogram on a Q plane or along a path
+ */
+struct SliceResults
+{
+	int mode{ SLICE_PLANE };
+
+	// Q points along the two axes, the second axis has one point for a path
+	t_size num_points[2]{ 1, 1 };
+	t_real range1[2]{}, range2[2]{};  // for a path: position in 1/A
+	std::vector<t_path_tick> ticks{}; // path vertices
+
+	t_size num_E{};
+	t_real E_range[2]{};              // bin centres of the first and last E bin
+
+	std::vector<t_real> Qs{};           // [point][3] in rlu
+	std::vector<t_real> intensities{};  // [point1][point2][E]
+
+	t_size GetNumPoints() const { return num_points[0] * num_points[1]; }
+	t_real GetCoord(int axis, t_size idx) const;
+	t_real GetE(t_size E_idx) const;
+
+	t_real GetIntensity(t_size pt1, t_size pt2, t_size E_idx) const
+	{ return intensities[(pt1*num_points[1] + pt2)*num_E + E_idx]; }
+};
+
+
+
+/**
+ * calculates the energy-resolution-convolved S(Q, E) on a Q plane or along the
+ * dispersion path, an optional Q resolution is applied afterwards as a
+ * separable convolution along the slice axes
+ */
+extern bool calc_slice(const t_magdyn& dyn, const MagDynConfig& cfg,
+	SliceResults& results, CalcThreadPool& pool,
+	const t_calc_progress& progress = nullptr);
+
+extern bool save_slice(const std::string& filename,
+	const SliceResults& results, int format);
+
+
+#endif
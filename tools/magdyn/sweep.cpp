@@ -0,0 +1,518 @@
+/**
+ * magnetic dynamics -- parameter sweeps
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+namespace pt = boost::property_tree;
+
+#include "sweep.h"
+
+#include <fstream>
+#include <iomanip>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <stdexcept>
+#include <type_traits>
+
+#ifdef USE_HDF5
+	#include <H5Cpp.h>
+	#include "tlibs2/libs/h5file.h"
+#endif
+
+extern int g_prec;
+
+
+
+/**
+ * value of the parameter at the given sweep index
+ */
+t_real SweepParameter::GetValue(t_size idx) const
+{
+	if(num_points <= 1)
+		return start;
+	return std::lerp(start, end, t_real(idx) / t_real(num_points - 1));
+}
+
+
+
+/**
+ * name of the parameter for labels and file headers
+ */
+std::string SweepParameter::GetName() const
+{
+	switch(type)
+	{
+		case SWEEP_FIELD: return "field";
+		case SWEEP_TEMPERATURE: return "temperature";
+		default: return name;
+	}
+}
+
+
+
+/**
+ * a name refers to a variable or, if there's no such variable,
+ * to the field magnitude or the temperature
+ */
+int get_sweep_parameter_type(const t_magdyn& dyn, const std::string& name)
+{
+	for(const t_magdyn::Variable& var : dyn.GetVariables())
+	{
+		if(var.name == name)
+			return SWEEP_VARIABLE;
+	}
+
+	if(name == "field")
+		return SWEEP_FIELD;
+	else if(name == "temperature")
+		return SWEEP_TEMPERATURE;
+
+	return SWEEP_VARIABLE;
+}
+
+
+
+/**
+ * load the sweep parameters from a magdyn file
+ */
+std::vector<SweepParameter> load_sweep_parameters(
+	const std::string& filename, const t_magdyn& dyn)
+{
+	pt::ptree node;
+
+	std::ifstream ifstr{filename};
+	if(!ifstr)
+		throw std::runtime_error("Cannot open file \"" + filename + "\".");
+	pt::read_xml(ifstr, node);
+
+	std::vector<SweepParameter> params;
+	if(auto nodeParams = node.get_child_optional("magdyn.sweep_parameters"); nodeParams)
+	{
+		for(const auto &nodeParam : *nodeParams)
+		{
+			SweepParameter param;
+			param.name = nodeParam.second.get<std::string>("name", "");
+			param.start = nodeParam.second.get<t_real>("start", 0.);
+			param.end = nodeParam.second.get<t_real>("end", 1.);
+			param.num_points = nodeParam.second.get<t_size>("points", 16);
+			param.type = get_sweep_parameter_type(dyn, param.name);
+
+			params.emplace_back(std::move(param));
+		}
+	}
+
+	return params;
+}
+
+
+
+/**
+ * create a copy of the magnon calculator with the parameters set to the given values
+ */
+static std::shared_ptr<t_magdyn> create_sweep_calculator(const t_magdyn& dyn,
+	const std::vector<SweepParameter>& params, const t_real* values)
+{
+	auto calc = std::make_shared<t_magdyn>(dyn);
+
+	std::vector<t_magdyn::Variable> vars = calc->GetVariables();
+	bool vars_changed = false;
+	bool field_changed = false;
+
+	for(std::size_t param_idx=0; param_idx<params.size(); ++param_idx)
+	{
+		const SweepParameter& param = params[param_idx];
+		const t_real value = values[param_idx];
+
+		switch(param.type)
+		{
+			case SWEEP_VARIABLE:
+			{
+				for(t_magdyn::Variable& var : vars)
+				{
+					if(var.name != param.name)
+						continue;
+
+					// only the real part is swept
+					var.value = t_cplx{value, var.value.imag()};
+					vars_changed = true;
+				}
+				break;
+			}
+
+			case SWEEP_FIELD:
+			{
+				t_magdyn::ExternalField field = calc->GetExternalField();
+				field.mag = value;
+				calc->SetExternalField(field);
+				field_changed = true;
+				break;
+			}
+
+			case SWEEP_TEMPERATURE:
+			{
+				// only enters the weights, no need to recalculate the sites and terms
+				calc->SetTemperature(value);
+				break;
+			}
+		}
+	}
+
+	if(vars_changed)
+	{
+		calc->ClearVariables();
+		for(t_magdyn::Variable& var : vars)
+			calc->AddVariable(std::move(var));
+	}
+
+	if(vars_changed || field_changed)
+	{
+		calc->CalcAtomSites();
+		calc->CalcExchangeTerms();
+	}
+
+	return calc;
+}
+
+
+
+/**
+ * calculate the dispersion for all combinations of the parameter values,
+ * all (parameter, Q) pairs are distributed over the thread pool in one job
+ */
+bool calc_sweep(const t_magdyn& dyn, const MagDynConfig& cfg,
+	const std::vector<SweepParameter>& params, SweepResults& results,
+	CalcThreadPool& pool, const t_calc_progress& progress)
+{
+	if(params.size() == 0)
+		throw std::runtime_error("No sweep parameters given.");
+
+	for(const SweepParameter& param : params)
+	{
+		if(param.type == SWEEP_VARIABLE)
+		{
+			bool found = false;
+			for(const t_magdyn::Variable& var : dyn.GetVariables())
+			{
+				if(var.name == param.name)
+				{
+					found = true;
+					break;
+				}
+			}
+
+			if(!found)
+				throw std::runtime_error("Unknown sweep variable \"" + param.name + "\".");
+		}
+		else if(param.type == SWEEP_FIELD)
+		{
+			if(dyn.GetExternalField().dir.size() != 3)
+				throw std::runtime_error("Sweeping the field needs a field direction.");
+		}
+	}
+
+	results.params = params;
+	results.num_Q = std::max<t_size>(cfg.num_Q_points, 1);
+	results.use_weights = cfg.use_weights;
+	results.num_param_points = 1;
+	for(SweepParameter& param : results.params)
+	{
+		param.num_points = std::max<t_size>(param.num_points, 1);
+		results.num_param_points *= param.num_points;
+	}
+
+	// parameter values of all combinations, the last parameter runs fastest
+	results.param_values.resize(results.num_param_points * params.size());
+	for(t_size param_pt=0; param_pt<results.num_param_points; ++param_pt)
+	{
+		t_size idx = param_pt;
+		for(std::size_t param_idx=params.size(); param_idx>0; --param_idx)
+		{
+			const SweepParameter& param = results.params[param_idx - 1];
+			results.param_values[param_pt*params.size() + param_idx - 1] =
+				param.GetValue(idx % param.num_points);
+			idx /= param.num_points;
+		}
+	}
+
+	results.results.clear();
+	results.results.resize(results.num_param_points * results.num_Q);
+
+	// calculators for the parameter combinations, each is created by the first
+	// task that needs it and released after its last Q point, the tasks are
+	// fetched in order, so only a few calculators exist at the same time
+	struct SweepCalculator
+	{
+		std::once_flag created{};
+		std::shared_ptr<const t_magdyn> dyn{};
+		std::atomic<t_size> remaining{};
+	};
+
+	auto calcs = std::make_unique<SweepCalculator[]>(results.num_param_points);
+
+	return pool.ParallelFor(results.num_param_points * results.num_Q,
+		[&dyn, &cfg, &results, &calcs](t_size idx)
+	{
+		const t_size param_pt = idx / results.num_Q;
+		const t_size Q_idx = idx % results.num_Q;
+
+		SweepCalculator& calc = calcs[param_pt];
+		std::call_once(calc.created, [&dyn, &results, &calc, param_pt]()
+		{
+			calc.dyn = create_sweep_calculator(dyn,
+				results.params, results.GetParamValues(param_pt));
+			calc.remaining = results.num_Q;
+		});
+
+		const t_real frac = results.num_Q > 1 ? t_real(Q_idx)/t_real(results.num_Q-1) : 0.;
+		const t_vec_real Q = tl2::create<t_vec_real>(
+		{
+			std::lerp(cfg.Q_start[0], cfg.Q_end[0], frac),
+			std::lerp(cfg.Q_start[1], cfg.Q_end[1], frac),
+			std::lerp(cfg.Q_start[2], cfg.Q_end[2], frac),
+		});
+
+		// each task only writes into its own result slot
+		results.results[idx] = calc_dispersion_point(*calc.dyn, cfg, Q);
+
+		if(--calc.remaining == 0)
+			calc.dyn.reset();
+	}, progress);
+}
+
+
+
+/**
+ * maximum number of branches of all results
+ */
+static t_size get_max_branches(const SweepResults& results)
+{
+	t_size max_branches = 0;
+	for(const SofQE& result : results.results)
+		max_branches = std::max<t_size>(max_branches, result.E.size());
+	return max_branches;
+}
+
+
+
+/**
+ * copy the energies and weights into cubes of [param point][Q][branch],
+ * missing branches are filled with nan
+ */
+static void get_sweep_cubes(const SweepResults& results, t_size max_branches,
+	std::vector<t_real>& energies, std::vector<t_real>& weights)
+{
+	const t_real nan = std::numeric_limits<t_real>::quiet_NaN();
+	energies.assign(results.results.size() * max_branches, nan);
+	weights.assign(results.results.size() * max_branches, nan);
+
+	for(std::size_t idx=0; idx<results.results.size(); ++idx)
+	{
+		const SofQE& result = results.results[idx];
+		for(std::size_t branch=0; branch<result.E.size(); ++branch)
+		{
+			energies[idx*max_branches + branch] = result.E[branch];
+			weights[idx*max_branches + branch] = result.S[branch];
+		}
+	}
+}
+
+
+
+/**
+ * save the sweep results as text, as a binary cube or in hdf5 format
+ */
+bool save_sweep(const std::string& filename, const SweepResults& results, int format)
+{
+	const t_size num_params = results.params.size();
+	const t_size max_branches = get_max_branches(results);
+
+	if(format == EXPORT_TEXT)
+	{
+		std::ofstream ofstr{filename};
+		if(!ofstr)
+			return false;
+
+		ofstr.precision(g_prec);
+		const int field_len = g_prec * 2.5;
+
+		ofstr << "# ";
+		for(const SweepParameter& param : results.params)
+			ofstr << std::setw(field_len) << std::left << param.GetName() << " ";
+		ofstr
+			<< std::setw(field_len) << std::left << "h" << " "
+			<< std::setw(field_len) << std::left << "k" << " "
+			<< std::setw(field_len) << std::left << "l" << " "
+			<< std::setw(field_len) << std::left << "E" << " "
+			<< std::setw(field_len) << std::left << "w" << "\n";
+
+		for(t_size param_pt=0; param_pt<results.num_param_points; ++param_pt)
+		{
+			const t_real* values = results.GetParamValues(param_pt);
+
+			for(t_size Q_idx=0; Q_idx<results.num_Q; ++Q_idx)
+			{
+				const SofQE& result = results.GetResult(param_pt, Q_idx);
+
+				for(std::size_t branch=0; branch<result.E.size(); ++branch)
+				{
+					for(t_size param_idx=0; param_idx<num_params; ++param_idx)
+						ofstr << std::setw(field_len) << std::left << values[param_idx] << " ";
+					ofstr
+						<< std::setw(field_len) << std::left << result.h << " "
+						<< std::setw(field_len) << std::left << result.k << " "
+						<< std::setw(field_len) << std::left << result.l << " "
+						<< std::setw(field_len) << std::left << result.E[branch] << " "
+						<< std::setw(field_len) << std::left << result.S[branch] << "\n";
+				}
+			}
+		}
+
+		ofstr.flush();
+		return true;
+	}
+
+	std::vector<t_real> energies, weights;
+	get_sweep_cubes(results, max_branches, energies, weights);
+
+	std::vector<t_real> Qs;
+	Qs.reserve(results.num_Q * 3);
+	for(t_size Q_idx=0; Q_idx<results.num_Q; ++Q_idx)
+	{
+		const SofQE& result = results.GetResult(0, Q_idx);
+		Qs.insert(Qs.end(), { result.h, result.k, result.l });
+	}
+
+	if(format == EXPORT_GRID)
+	{
+		// binary cube:
+		//   signature, uint64 num_params, num_param_points, num_Q, max_branches,
+		//   per parameter: uint64 num_points, double start, end,
+		//   double param_values[num_param_points][num_params], Q[num_Q][3],
+		//   energies[num_param_points][num_Q][max_branches], weights[...]
+		std::ofstream ofstr{filename, std::ios_base::binary};
+		if(!ofstr)
+			return false;
+
+		const std::string signature = "Takin/Magdyn Sweep File Version 1.";
+		ofstr.write(signature.c_str(), signature.length() + 1);
+
+		const std::uint64_t dims[] = { num_params,
+			results.num_param_points, results.num_Q, max_branches };
+		ofstr.write(reinterpret_cast<const char*>(dims), sizeof(dims));
+
+		for(const SweepParameter& param : results.params)
+		{
+			const std::uint64_t num_points = param.num_points;
+			const double range[] = { param.start, param.end };
+			ofstr.write(reinterpret_cast<const char*>(&num_points), sizeof(num_points));
+			ofstr.write(reinterpret_cast<const char*>(range), sizeof(range));
+		}
+
+		auto write_doubles = [&ofstr](const std::vector<t_real>& vec)
+		{
+			for(t_real val : vec)
+			{
+				const double dval = val;
+				ofstr.write(reinterpret_cast<const char*>(&dval), sizeof(dval));
+			}
+		};
+
+		write_doubles(results.param_values);
+		write_doubles(Qs);
+		write_doubles(energies);
+		write_doubles(weights);
+
+		ofstr.flush();
+		return ofstr.good();
+	}
+
+#ifdef USE_HDF5
+	else if(format == EXPORT_HDF5)
+	{
+		try
+		{
+			H5::H5File h5file(filename.c_str(), H5F_ACC_TRUNC);
+			h5file.createGroup("meta_infos");
+			h5file.createGroup("infos");
+			h5file.createGroup("data");
+
+			tl2::set_h5_string<std::string>(h5file, "meta_infos/type", "takin_sweep");
+			tl2::set_h5_string<std::string>(h5file, "meta_infos/description", "Takin/Magdyn parameter sweep");
+
+			std::vector<std::string> names;
+			std::vector<t_real> starts, ends;
+			std::vector<std::size_t> num_points;
+			for(const SweepParameter& param : results.params)
+			{
+				names.push_back(param.GetName());
+				starts.push_back(param.start);
+				ends.push_back(param.end);
+				num_points.push_back(param.num_points);
+			}
+
+			tl2::set_h5_string_vector(h5file, "infos/parameters", names);
+			tl2::set_h5_vector(h5file, "infos/parameters_start", starts);
+			tl2::set_h5_vector(h5file, "infos/parameters_end", ends);
+			tl2::set_h5_vector(h5file, "infos/parameters_dimensions", num_points);
+
+			const H5::PredType& h5type = std::is_same_v<t_real, float>
+				? H5::PredType::NATIVE_FLOAT : H5::PredType::NATIVE_DOUBLE;
+
+			auto write_cube = [&h5file, &h5type](const std::string& name,
+				const std::vector<t_real>& data, std::vector<hsize_t> dims)
+			{
+				H5::DataSpace space(dims.size(), dims.data());
+				H5::DataSet dataset = h5file.createDataSet(name, h5type, space);
+				if(data.size())
+					dataset.write(data.data(), h5type);
+			};
+
+			write_cube("data/parameters", results.param_values,
+				{ results.num_param_points, num_params });
+			write_cube("data/Q", Qs, { results.num_Q, 3 });
+			write_cube("data/energies", energies,
+				{ results.num_param_points, results.num_Q, max_branches });
+			write_cube("data/weights", weights,
+				{ results.num_param_points, results.num_Q, max_branches });
+
+			h5file.close();
+			return true;
+		}
+		catch(const H5::Exception& ex)
+		{
+			throw std::runtime_error(ex.getDetailMsg());
+		}
+	}
+#endif
+
+	return false;
+}
@@ -0,0 +1,108 @@
+/**
+ * magnetic dynamics -- parameter sweeps
+ * @author Tobias Weber <tweber@ill.fr>
+ * @date Oct-2026
+ * @license GPLv3, see 'LICENSE' file
+ * @desc The present version was forked on 28-Dec-2018 from my privately developed "misc" project (https://github.com/t-weber/misc).
+ *
+ * ----------------------------------------------------------------------------
+ * mag-core (part of the Takin software suite)
+ * Copyright (C) 2018-2026  Tobias WEBER (Institut Laue-Langevin (ILL),
+ *                          Grenoble, France).
+ * "misc" project
+ * Copyright (C) 2017-2022  Tobias WEBER (privately developed).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef __MAGDYN_SWEEP_H__
+#define __MAGDYN_SWEEP_H__
+
+#include <string>
+#include <vector>
+
+#include "defs.h"
+#include "calc.h"
+
+
+
+/**
+ * kinds of sweepable parameters
+ */
+enum : int
+{
+	SWEEP_VARIABLE = 0,     // a variable of the magnetic structure
+	SWEEP_FIELD = 1,        // magnitude of the external field
+	SWEEP_TEMPERATURE = 2,  // temperature for the bose factor
+};
+
+
+
+/**
+ * a parameter to sweep and its range
+ */
+struct SweepParameter
+{
+	int type{ SWEEP_VARIABLE };
+	std::string name{};          // variable name for SWEEP_VARIABLE
+
+	t_real start{ 0. }, end{ 1. };
+	t_size num_points{ 16 };
+
+	t_real GetValue(t_size idx) const;
+	std::string GetName() const;
+};
+
+
+
+/**
+ * results of a sweep over all combinations of the parameter values,
+ * the last parameter runs fastest
+ */
+struct SweepResults
+{
+	std::vector<SweepParameter> params{};
+	t_size num_param_points{};   // number of parameter combinations
+	t_size num_Q{};              // number of Q points per combination
+	bool use_weights{ true };
+
+	std::vector<t_real> param_values{};  // [param point][param]
+	std::vector<SofQE> results{};        // [param point][Q]
+
+	const SofQE& GetResult(t_size param_pt, t_size Q_idx) const
+	{ return results[param_pt*num_Q + Q_idx]; }
+
+	const t_real* GetParamValues(t_size param_pt) const
+	{ return param_values.data() + param_pt*params.size(); }
+};
+
+
+
+/**
+ * calculates the dispersion along the configured Q path (or at Q_start
+ * for a single Q point) for all combinations of the parameter values
+ */
+extern int get_sweep_parameter_type(const t_magdyn& dyn, const std::string& name);
+extern std::vector<SweepParameter> load_sweep_parameters(
+	const std::string& filename, const t_magdyn& dyn);
+
+extern bool calc_sweep(const t_magdyn& dyn, const MagDynConfig& cfg,
+	const std::vector<SweepParameter>& params, SweepResults& results,
+	CalcThreadPool& pool, const t_calc_progress& progress = nullptr);
+
+extern bool save_sweep(const std::string& filename,
+	const SweepResults& results, int format);
+
+
+#endif